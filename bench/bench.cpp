@@ -0,0 +1,224 @@
+/* GStreamer
+ * Copyright (C) 2015 Raimo Järvi <raimo.jarvi@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include <unistd.h>
+#include <sys/resource.h>
+#include <glib/gstdio.h>
+#include "bench.h"
+
+static GQuark
+bench_probe_quark (void)
+{
+  static GQuark quark = 0;
+
+  if (!quark) {
+    quark = g_quark_from_static_string ("bench-probe");
+  }
+  return quark;
+}
+
+void
+bench_register (void)
+{
+  gst_plugin_register_static (GST_VERSION_MAJOR, GST_VERSION_MINOR,
+      "bdasrc", "BDA Source", gst_bdasrc_plugin_init, VERSION, GST_LICENSE,
+      PACKAGE, GST_PACKAGE_NAME, GST_PACKAGE_ORIGIN);
+}
+
+/* Records the arrival time of a sample before it is queued. */
+static void
+bench_sample_received (GstBdaSrc * src, gpointer data, gsize size)
+{
+  BenchProbe *probe =
+      (BenchProbe *) g_object_get_qdata (G_OBJECT (src), bench_probe_quark ());
+
+  probe->arrivals[probe->calls++ % BENCH_ARRIVALS] = g_get_monotonic_time ();
+  probe->sample_received (src, data, size);
+}
+
+static void
+bench_handoff (GstElement * sink, GstBuffer * buffer, GstPad * pad,
+    gpointer user_data)
+{
+  BenchProbe *probe = (BenchProbe *) user_data;
+  guint64 offset = GST_BUFFER_OFFSET (buffer);
+  gint64 latency =
+      g_get_monotonic_time () - probe->arrivals[offset % BENCH_ARRIVALS];
+
+  if (offset > probe->next_offset) {
+    probe->dropped += offset - probe->next_offset;
+  }
+  probe->next_offset = offset + 1;
+  probe->buffers++;
+  probe->bytes += gst_buffer_get_size (buffer);
+  g_array_append_val (probe->latencies, latency);
+
+  if (probe->consumer_delay) {
+    g_usleep (probe->consumer_delay);
+  }
+}
+
+GstElement *
+bench_pipeline_new (BenchProbe * probe, GstElement ** src)
+{
+  GstElement *pipeline = gst_pipeline_new (NULL);
+  GstElement *source = gst_element_factory_make ("bdasrc", NULL);
+  GstElement *sink = gst_element_factory_make ("fakesink", NULL);
+
+  if (!source || !sink) {
+    g_printerr ("Unable to create elements\n");
+    if (source) {
+      gst_object_unref (source);
+    }
+    if (sink) {
+      gst_object_unref (sink);
+    }
+    gst_object_unref (pipeline);
+    return NULL;
+  }
+
+  g_object_set (sink, "sync", FALSE, "enable-last-sample", FALSE,
+      "signal-handoffs", TRUE, NULL);
+  g_signal_connect (sink, "handoff", G_CALLBACK (bench_handoff), probe);
+
+  g_object_set_qdata (G_OBJECT (source), bench_probe_quark (), probe);
+  probe->sample_received = GST_BDASRC (source)->sample_received;
+  GST_BDASRC (source)->sample_received = bench_sample_received;
+
+  gst_bin_add_many (GST_BIN (pipeline), source, sink, NULL);
+  gst_element_link (source, sink);
+
+  *src = source;
+  return pipeline;
+}
+
+BenchProbe *
+bench_probe_new (guint consumer_delay)
+{
+  BenchProbe *probe = g_new0 (BenchProbe, 1);
+  probe->consumer_delay = consumer_delay;
+  probe->latencies = g_array_new (FALSE, FALSE, sizeof (gint64));
+
+  return probe;
+}
+
+void
+bench_probe_free (BenchProbe * probe)
+{
+  g_array_free (probe->latencies, TRUE);
+  g_free (probe);
+}
+
+static gint
+compare_latency (gconstpointer a, gconstpointer b)
+{
+  gint64 x = *(const gint64 *) a;
+  gint64 y = *(const gint64 *) b;
+
+  return x < y ? -1 : x > y;
+}
+
+static gint64
+percentile (GArray * sorted, gdouble p)
+{
+  if (sorted->len == 0) {
+    return 0;
+  }
+  return g_array_index (sorted, gint64, (guint) ((sorted->len - 1) * p + 0.5));
+}
+
+void
+bench_print_latency (BenchProbe * probe)
+{
+  GArray *sorted = probe->latencies;
+
+  g_array_sort (sorted, compare_latency);
+  g_print ("{\"p50\": %" G_GINT64_FORMAT ", \"p90\": %" G_GINT64_FORMAT
+      ", \"p99\": %" G_GINT64_FORMAT ", \"p999\": %" G_GINT64_FORMAT
+      ", \"max\": %" G_GINT64_FORMAT "}", percentile (sorted, 0.5),
+      percentile (sorted, 0.9), percentile (sorted, 0.99),
+      percentile (sorted, 0.999), percentile (sorted, 1.0));
+}
+
+void
+bench_get_usage (BenchUsage * usage)
+{
+  struct rusage ru;
+  getrusage (RUSAGE_SELF, &ru);
+
+  usage->cpu = ru.ru_utime.tv_sec + ru.ru_stime.tv_sec +
+      (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+  usage->voluntary_switches = ru.ru_nvcsw;
+  usage->involuntary_switches = ru.ru_nivcsw;
+}
+
+gchar *
+bench_write_stream (const GstBdaTsGenParams * params, gsize size)
+{
+  GError *err = NULL;
+  gchar *location;
+  gint fd = g_file_open_tmp ("bdabench-XXXXXX.ts", &location, &err);
+  if (fd < 0) {
+    g_printerr ("%s\n", err->message);
+    g_error_free (err);
+    return NULL;
+  }
+  close (fd);
+
+  guint8 *stream = (guint8 *) g_malloc (size);
+  GstBdaTsGen *gen = gst_bda_ts_gen_new (params);
+  gst_bda_ts_gen_fill (gen, stream, size);
+  gst_bda_ts_gen_free (gen);
+  gboolean ok = g_file_set_contents (location, (const gchar *) stream, size,
+      &err);
+  g_free (stream);
+  if (!ok) {
+    g_printerr ("%s\n", err->message);
+    g_error_free (err);
+    g_unlink (location);
+    g_free (location);
+    return NULL;
+  }
+
+  return location;
+}
+
+GArray *
+bench_parse_list (const gchar * name, const gchar * str, guint min,
+    guint max)
+{
+  GArray *values = g_array_new (FALSE, FALSE, sizeof (guint));
+  gchar **items = g_strsplit (str, ",", -1);
+
+  for (gchar ** item = items; *item; item++) {
+    gchar *end;
+    guint64 value = g_ascii_strtoull (*item, &end, 10);
+    if (end == *item || *end || value < min || value > max) {
+      g_printerr ("Invalid %s '%s'\n", name, *item);
+      g_array_free (values, TRUE);
+      values = NULL;
+      break;
+    }
+    guint v = (guint) value;
+    g_array_append_val (values, v);
+  }
+  g_strfreev (items);
+
+  return values;
+}
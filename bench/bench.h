@@ -0,0 +1,99 @@
+/* GStreamer
+ * Copyright (C) 2015 Raimo Järvi <raimo.jarvi@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+#include <gst/gst.h>
+#include "gstbdasrc.h"
+#include "gstbdatsgen.h"
+
+/* Helpers shared by the benchmarks. */
+
+/* Arrival times of recent samples, indexed by sequence number. Must be
+   larger than any queue limit. */
+#define BENCH_ARRIVALS 65536
+
+typedef struct _BenchProbe BenchProbe;
+
+/* Measures sample latency from GstBdaSrc::sample_received to the sink, and
+   samples dropped by the queue, of one bdasrc ! fakesink pipeline. */
+struct _BenchProbe {
+  void (*sample_received) (GstBdaSrc * src, gpointer data, gsize size);
+  guint64 calls;
+  gint64 arrivals[BENCH_ARRIVALS];
+
+  /* Time spent downstream per sample in us. */
+  guint consumer_delay;
+
+  /* Consumer side, updated from the streaming thread. */
+  guint64 buffers;
+  guint64 bytes;
+  guint64 next_offset;
+  guint64 dropped;
+  GArray *latencies;
+};
+
+/**
+ * Registers bdasrc as a static plugin. The benchmarks link the element
+ * sources directly.
+ */
+void bench_register (void);
+
+/**
+ * Creates a bdasrc ! fakesink pipeline measured by probe. The source is
+ * returned in src for configuration.
+ */
+GstElement *bench_pipeline_new (BenchProbe * probe, GstElement ** src);
+
+BenchProbe *bench_probe_new (guint consumer_delay);
+void bench_probe_free (BenchProbe * probe);
+
+/**
+ * Prints latency percentiles of probe as a JSON object.
+ */
+void bench_print_latency (BenchProbe * probe);
+
+typedef struct _BenchUsage BenchUsage;
+
+struct _BenchUsage {
+  gdouble cpu;
+  gint64 voluntary_switches;
+  gint64 involuntary_switches;
+};
+
+/**
+ * Returns process CPU time in seconds and context switch counts.
+ */
+void bench_get_usage (BenchUsage * usage);
+
+/**
+ * Writes size bytes of generated stream to a temporary file.
+ * @return the file name, or NULL on error
+ */
+gchar *bench_write_stream (const GstBdaTsGenParams * params, gsize size);
+
+/**
+ * Parses a comma separated list of unsigned integers.
+ * @return NULL if a value is invalid or out of range
+ */
+GArray *bench_parse_list (const gchar * name, const gchar * str, guint min,
+    guint max);
+
+#endif
@@ -0,0 +1,242 @@
+/* GStreamer
+ * Copyright (C) 2015 Raimo Järvi <raimo.jarvi@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+/* Ingest benchmark. Replays a generated transport stream through
+ * GstBdaSrc::sample_received, the sample queue and gst_bdasrc_create () into
+ * a fakesink, for every combination of chunk size, producer rate and queue
+ * limit, and prints throughput, dropped samples, CPU time per Gbit and
+ * sample latency percentiles as JSON:
+ *
+ *   bench-ingest --chunk-sizes=1316,65424 --rates=0,100000000 \
+ *       --buffer-sizes=4,64 > ingest.json
+ *
+ * A rate of 0 replays as fast as possible. With --trace a sample trace
+ * recorded with the trace-location property is replayed with its original
+ * sample sizes and timing instead, and only queue limits are swept:
+ *
+ *   bench-ingest --trace=tuner.trace --buffer-sizes=4,16,64,256
+ */
+
+#include <glib/gstdio.h>
+#include "bench.h"
+
+#define DEFAULT_CHUNK_SIZES "1316,65424,262448"
+#define DEFAULT_RATES "0,100000000,1000000000"
+#define DEFAULT_BUFFER_SIZES "4,16,64"
+
+typedef struct _BenchRun BenchRun;
+
+struct _BenchRun {
+  /* Chunk size and rate are 0 when replaying a trace. */
+  gboolean trace;
+  guint chunk_size;
+  guint rate;
+  guint buffer_size;
+};
+
+/* Runs one configuration for duration seconds. */
+static gboolean
+bench_run (BenchRun * run, const gchar * location, const gchar * params,
+    guint consumer_delay, gdouble duration)
+{
+  BenchProbe *probe = bench_probe_new (consumer_delay);
+  GstElement *src;
+  GstElement *pipeline = bench_pipeline_new (probe, &src);
+  if (!pipeline) {
+    bench_probe_free (probe);
+    return FALSE;
+  }
+
+  if (run->trace) {
+    g_object_set (src, "backend", GST_BDA_BACKEND_TRACE,
+        "pacing", GST_BDA_PACING_PCR, "synthetic-params", params, NULL);
+  } else {
+    g_object_set (src, "backend", GST_BDA_BACKEND_REPLAY,
+        "pacing", run->rate ? GST_BDA_PACING_BITRATE : GST_BDA_PACING_NONE,
+        "bitrate", run->rate ? run->rate : 1,
+        "chunk-size", run->chunk_size, NULL);
+  }
+  g_object_set (src, "replay-location", location,
+      "buffer-size", run->buffer_size, "loop", TRUE, NULL);
+
+  BenchUsage before, after;
+  bench_get_usage (&before);
+  gint64 start = g_get_monotonic_time ();
+  if (gst_element_set_state (pipeline,
+          GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE) {
+    g_printerr ("Unable to start the pipeline\n");
+    gst_element_set_state (pipeline, GST_STATE_NULL);
+    gst_object_unref (pipeline);
+    bench_probe_free (probe);
+    return FALSE;
+  }
+
+  g_usleep ((gulong) (duration * G_USEC_PER_SEC));
+  gdouble elapsed = (g_get_monotonic_time () - start) / 1e6;
+  bench_get_usage (&after);
+  gdouble cpu = after.cpu - before.cpu;
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (pipeline);
+
+  gdouble gbits = probe->bytes * 8 / 1e9;
+  guint64 offered = probe->buffers + probe->dropped;
+
+  g_print ("    {\"trace\": %s, \"chunk_size\": %u, \"rate\": %u, "
+      "\"buffer_size\": %u, \"consumer_delay_us\": %u,\n",
+      run->trace ? "true" : "false", run->chunk_size, run->rate,
+      run->buffer_size, consumer_delay);
+  g_print ("     \"samples\": %" G_GUINT64_FORMAT ", \"bytes\": %"
+      G_GUINT64_FORMAT ", \"dropped\": %" G_GUINT64_FORMAT
+      ", \"drop_rate\": %.6f,\n", probe->buffers, probe->bytes,
+      probe->dropped, offered ? (gdouble) probe->dropped / offered : 0.0);
+  g_print ("     \"throughput_bps\": %.0f, \"cpu_s\": %.3f, "
+      "\"cpu_s_per_gbit\": %.6f,\n", probe->bytes * 8 / elapsed, cpu,
+      gbits > 0 ? cpu / gbits : 0.0);
+  g_print ("     \"latency_us\": ");
+  bench_print_latency (probe);
+  g_print ("}");
+
+  bench_probe_free (probe);
+
+  return TRUE;
+}
+
+int
+main (int argc, char *argv[])
+{
+  gchar *chunk_sizes = NULL;
+  gchar *rates = NULL;
+  gchar *buffer_sizes = NULL;
+  gchar *params_str = NULL;
+  gchar *trace = NULL;
+  gdouble duration = 2;
+  gint stream_size = 64;
+  gint consumer_delay = 0;
+
+  GOptionEntry entries[] = {
+    {"chunk-sizes", 0, 0, G_OPTION_ARG_STRING, &chunk_sizes,
+        "Sample sizes in bytes, default " DEFAULT_CHUNK_SIZES, "N,..."},
+    {"rates", 0, 0, G_OPTION_ARG_STRING, &rates,
+        "Producer rates in bits/s, 0 for unpaced, default " DEFAULT_RATES,
+        "BPS,..."},
+    {"buffer-sizes", 0, 0, G_OPTION_ARG_STRING, &buffer_sizes,
+        "Queue limits in samples, default " DEFAULT_BUFFER_SIZES, "N,..."},
+    {"consumer-delay", 0, 0, G_OPTION_ARG_INT, &consumer_delay,
+        "Time spent downstream per sample in us", "US"},
+    {"duration", 'd', 0, G_OPTION_ARG_DOUBLE, &duration,
+        "Duration of each run in seconds", "S"},
+    {"stream-size", 0, 0, G_OPTION_ARG_INT, &stream_size,
+        "Size of the replayed stream in MiB", "MIB"},
+    {"params", 0, 0, G_OPTION_ARG_STRING, &params_str,
+        "Generator parameters, see the synthetic-params property", "K=V,..."},
+    {"trace", 0, 0, G_OPTION_ARG_FILENAME, &trace,
+        "Replay a sample trace instead of fixed size chunks", "FILE"},
+    {NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL}
+  };
+
+  GError *err = NULL;
+  GOptionContext *context =
+      g_option_context_new ("- benchmark the bdasrc ingest path");
+  g_option_context_add_main_entries (context, entries, NULL);
+  g_option_context_add_group (context, gst_init_get_option_group ());
+  if (!g_option_context_parse (context, &argc, &argv, &err)) {
+    g_printerr ("%s\n", err->message);
+    g_error_free (err);
+    g_option_context_free (context);
+    return 1;
+  }
+  g_option_context_free (context);
+
+  /* Sample sizes and timing come from the trace. */
+  if (trace) {
+    chunk_sizes = rates = (gchar *) "0";
+  }
+
+  GArray *chunks = bench_parse_list ("chunk size",
+      chunk_sizes ? chunk_sizes : DEFAULT_CHUNK_SIZES, trace ? 0 : 1,
+      G_MAXINT);
+  GArray *producers = bench_parse_list ("rate",
+      rates ? rates : DEFAULT_RATES, 0, G_MAXUINT);
+  GArray *limits = bench_parse_list ("buffer size",
+      buffer_sizes ? buffer_sizes : DEFAULT_BUFFER_SIZES, 1, BENCH_ARRIVALS / 2);
+  if (!chunks || !producers || !limits || stream_size <= 0
+      || consumer_delay < 0) {
+    return 1;
+  }
+
+  GstBdaTsGenParams params;
+  gst_bda_ts_gen_params_init (&params);
+  if (params_str && !gst_bda_ts_gen_params_parse (&params, params_str)) {
+    g_printerr ("Invalid generator parameters '%s'\n", params_str);
+    return 1;
+  }
+
+  bench_register ();
+
+  /* Generate the stream up front so that it doesn't count towards CPU
+     time, the replay backend maps it into memory. */
+  gsize size = (gsize) stream_size * 1024 * 1024 / 188 * 188;
+  gchar *location = trace ? trace : bench_write_stream (&params, size);
+  if (!location) {
+    return 1;
+  }
+
+  g_print ("{\"benchmark\": \"ingest\", \"duration\": %.3f, "
+      "\"stream_size\": %" G_GSIZE_FORMAT ",\n  \"runs\": [\n", duration,
+      size);
+
+  int ret = 0;
+  gboolean first = TRUE;
+
+  for (guint c = 0; c < chunks->len; c++) {
+    for (guint r = 0; r < producers->len; r++) {
+      for (guint b = 0; b < limits->len; b++) {
+        BenchRun run;
+        run.trace = trace != NULL;
+        run.chunk_size = g_array_index (chunks, guint, c);
+        run.rate = g_array_index (producers, guint, r);
+        run.buffer_size = g_array_index (limits, guint, b);
+
+        if (!first) {
+          g_print (",\n");
+        }
+        first = FALSE;
+        if (!bench_run (&run, location, params_str, consumer_delay,
+                duration)) {
+          ret = 1;
+          goto done;
+        }
+      }
+    }
+  }
+
+done:
+  g_print ("\n  ]\n}\n");
+
+  if (!trace) {
+    g_unlink (location);
+  }
+  g_free (location);
+  g_array_free (chunks, TRUE);
+  g_array_free (producers, TRUE);
+  g_array_free (limits, TRUE);
+
+  return ret;
+}
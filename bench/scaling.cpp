@@ -0,0 +1,230 @@
+/* GStreamer
+ * Copyright (C) 2015 Raimo Järvi <raimo.jarvi@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+/* Multi-instance scaling benchmark. Runs N bdasrc ! fakesink pipelines in
+ * one process, each replaying the same generated stream, and prints for
+ * every N the aggregate throughput, per-instance throughput, drops and
+ * latency, CPU time and context switches as JSON:
+ *
+ *   bench-scaling --instances=1,2,4,8,16 --rate=50000000 > scaling.json
+ *
+ * Flat per-instance numbers and context switches growing linearly with N
+ * mean the instances scale; anything worse points at contention between
+ * them, e.g. in the allocator or logging.
+ */
+
+#include <glib/gstdio.h>
+#include "bench.h"
+
+#define DEFAULT_INSTANCES "1,2,4,8,16"
+#define MAX_INSTANCES 256
+
+/* Runs count pipelines for duration seconds. */
+static gboolean
+bench_run (guint count, const gchar * location, guint rate, guint chunk_size,
+    guint buffer_size, guint consumer_delay, gdouble duration)
+{
+  GstElement **pipelines = g_new0 (GstElement *, count);
+  BenchProbe **probes = g_new0 (BenchProbe *, count);
+  gboolean ok = TRUE;
+
+  for (guint i = 0; i < count && ok; i++) {
+    GstElement *src;
+    probes[i] = bench_probe_new (consumer_delay);
+    pipelines[i] = bench_pipeline_new (probes[i], &src);
+    if (!pipelines[i]) {
+      ok = FALSE;
+      break;
+    }
+    g_object_set (src, "backend", GST_BDA_BACKEND_REPLAY,
+        "replay-location", location,
+        "pacing", rate ? GST_BDA_PACING_BITRATE : GST_BDA_PACING_NONE,
+        "bitrate", rate ? rate : 1, "chunk-size", chunk_size,
+        "buffer-size", buffer_size, "loop", TRUE, NULL);
+  }
+
+  BenchUsage before, after;
+  bench_get_usage (&before);
+  gint64 start = g_get_monotonic_time ();
+
+  for (guint i = 0; i < count && ok; i++) {
+    if (gst_element_set_state (pipelines[i],
+            GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE) {
+      g_printerr ("Unable to start pipeline %u\n", i);
+      ok = FALSE;
+    }
+  }
+
+  if (ok) {
+    g_usleep ((gulong) (duration * G_USEC_PER_SEC));
+  }
+  gdouble elapsed = (g_get_monotonic_time () - start) / 1e6;
+  bench_get_usage (&after);
+
+  for (guint i = 0; i < count; i++) {
+    if (pipelines[i]) {
+      gst_element_set_state (pipelines[i], GST_STATE_NULL);
+      gst_object_unref (pipelines[i]);
+    }
+  }
+
+  if (ok) {
+    /* All samples of all instances, for the overall latency. */
+    BenchProbe *all = bench_probe_new (0);
+    guint64 bytes = 0;
+    guint64 dropped = 0;
+    gdouble cpu = after.cpu - before.cpu;
+
+    for (guint i = 0; i < count; i++) {
+      bytes += probes[i]->bytes;
+      dropped += probes[i]->dropped;
+      g_array_append_vals (all->latencies, probes[i]->latencies->data,
+          probes[i]->latencies->len);
+    }
+
+    g_print ("    {\"instances\": %u, \"throughput_bps\": %.0f, "
+        "\"dropped\": %" G_GUINT64_FORMAT ",\n", count, bytes * 8 / elapsed,
+        dropped);
+    g_print ("     \"cpu_s\": %.3f, \"cpu_s_per_gbit\": %.6f, "
+        "\"voluntary_context_switches\": %" G_GINT64_FORMAT
+        ", \"involuntary_context_switches\": %" G_GINT64_FORMAT ",\n", cpu,
+        bytes ? cpu / (bytes * 8 / 1e9) : 0.0,
+        after.voluntary_switches - before.voluntary_switches,
+        after.involuntary_switches - before.involuntary_switches);
+    g_print ("     \"latency_us\": ");
+    bench_print_latency (all);
+    g_print (",\n     \"per_instance\": [\n");
+    for (guint i = 0; i < count; i++) {
+      g_print ("       {\"throughput_bps\": %.0f, \"dropped\": %"
+          G_GUINT64_FORMAT ", \"latency_us\": ",
+          probes[i]->bytes * 8 / elapsed, probes[i]->dropped);
+      bench_print_latency (probes[i]);
+      g_print ("}%s\n", i + 1 < count ? "," : "");
+    }
+    g_print ("     ]}");
+
+    bench_probe_free (all);
+  }
+
+  for (guint i = 0; i < count; i++) {
+    if (probes[i]) {
+      bench_probe_free (probes[i]);
+    }
+  }
+  g_free (probes);
+  g_free (pipelines);
+
+  return ok;
+}
+
+int
+main (int argc, char *argv[])
+{
+  gchar *instances = NULL;
+  gchar *params_str = NULL;
+  gint rate = 50000000;
+  gint chunk_size = 348 * 188;
+  gint buffer_size = 50;
+  gint consumer_delay = 0;
+  gint stream_size = 64;
+  gdouble duration = 5;
+
+  GOptionEntry entries[] = {
+    {"instances", 'n', 0, G_OPTION_ARG_STRING, &instances,
+        "Numbers of concurrent instances, default " DEFAULT_INSTANCES,
+        "N,..."},
+    {"rate", 0, 0, G_OPTION_ARG_INT, &rate,
+        "Producer rate per instance in bits/s, 0 for unpaced", "BPS"},
+    {"chunk-size", 0, 0, G_OPTION_ARG_INT, &chunk_size,
+        "Sample size in bytes", "N"},
+    {"buffer-size", 0, 0, G_OPTION_ARG_INT, &buffer_size,
+        "Queue limit in samples", "N"},
+    {"consumer-delay", 0, 0, G_OPTION_ARG_INT, &consumer_delay,
+        "Time spent downstream per sample in us", "US"},
+    {"duration", 'd', 0, G_OPTION_ARG_DOUBLE, &duration,
+        "Duration of each run in seconds", "S"},
+    {"stream-size", 0, 0, G_OPTION_ARG_INT, &stream_size,
+        "Size of the replayed stream in MiB", "MIB"},
+    {"params", 0, 0, G_OPTION_ARG_STRING, &params_str,
+        "Generator parameters, see the synthetic-params property", "K=V,..."},
+    {NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL}
+  };
+
+  GError *err = NULL;
+  GOptionContext *context =
+      g_option_context_new ("- benchmark concurrent bdasrc instances");
+  g_option_context_add_main_entries (context, entries, NULL);
+  g_option_context_add_group (context, gst_init_get_option_group ());
+  if (!g_option_context_parse (context, &argc, &argv, &err)) {
+    g_printerr ("%s\n", err->message);
+    g_error_free (err);
+    g_option_context_free (context);
+    return 1;
+  }
+  g_option_context_free (context);
+
+  GArray *counts = bench_parse_list ("instance count",
+      instances ? instances : DEFAULT_INSTANCES, 1, MAX_INSTANCES);
+  if (!counts || rate < 0 || chunk_size <= 0 || buffer_size <= 0
+      || buffer_size > BENCH_ARRIVALS / 2 || consumer_delay < 0
+      || stream_size <= 0) {
+    g_printerr ("Invalid arguments\n");
+    return 1;
+  }
+
+  GstBdaTsGenParams params;
+  gst_bda_ts_gen_params_init (&params);
+  if (params_str && !gst_bda_ts_gen_params_parse (&params, params_str)) {
+    g_printerr ("Invalid generator parameters '%s'\n", params_str);
+    return 1;
+  }
+
+  bench_register ();
+
+  /* All instances map the same file. */
+  gchar *location = bench_write_stream (&params,
+      (gsize) stream_size * 1024 * 1024 / 188 * 188);
+  if (!location) {
+    return 1;
+  }
+
+  g_print ("{\"benchmark\": \"scaling\", \"duration\": %.3f, \"rate\": %d, "
+      "\"chunk_size\": %d, \"buffer_size\": %d, \"consumer_delay_us\": %d,\n"
+      "  \"runs\": [\n", duration, rate, chunk_size, buffer_size,
+      consumer_delay);
+
+  int ret = 0;
+  for (guint i = 0; i < counts->len; i++) {
+    if (i > 0) {
+      g_print (",\n");
+    }
+    if (!bench_run (g_array_index (counts, guint, i), location, rate,
+            chunk_size, buffer_size, consumer_delay, duration)) {
+      ret = 1;
+      break;
+    }
+  }
+  g_print ("\n  ]\n}\n");
+
+  g_unlink (location);
+  g_free (location);
+  g_array_free (counts, TRUE);
+
+  return ret;
+}
@@ -0,0 +1,73 @@
+/* GStreamer
+ * Copyright (C) 2015 Raimo Järvi <raimo.jarvi@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef __GST_BDABACKEND_H__
+#define __GST_BDABACKEND_H__
+
+#include "gstbdasrc.h"
+
+/**
+ * Device control backend. A backend delivers transport stream samples to
+ * the element by calling GstBdaSrc::sample_received from its own thread.
+ */
+typedef struct _GstBdaBackend GstBdaBackend;
+
+struct _GstBdaBackend {
+  const gchar *name;
+
+  /* Opens the device, called on NULL -> READY. */
+  gboolean (*open) (GstBdaSrc * src);
+  /* Starts delivering samples, called on PAUSED -> PLAYING. */
+  gboolean (*start) (GstBdaSrc * src);
+  /* Stops delivering samples, called on PLAYING -> PAUSED. */
+  void (*stop) (GstBdaSrc * src);
+  /* Releases the device. Must be safe to call when the device is not open.
+     The device may be pooled for reuse unless pool is FALSE. */
+  void (*close) (GstBdaSrc * src, gboolean pool);
+  /* Applies changed tuning properties to the open device without closing
+     it. Called from the streaming thread while running, and before start
+     if the properties changed after open. */
+  gboolean (*retune) (GstBdaSrc * src);
+  /* Reads the signal lock status of the running device, polled from a
+     background thread after start and retune. Returns FALSE if the status
+     is not available. */
+  gboolean (*get_signal_locked) (GstBdaSrc * src, gboolean * locked);
+};
+
+#ifdef HAVE_DIRECTSHOW
+/* BDA tuner device through a DirectShow filter graph. */
+extern const GstBdaBackend gst_bda_dshow_backend;
+#endif
+
+/* Transport stream file replay. */
+extern const GstBdaBackend gst_bda_replay_backend;
+
+/* Synthetic transport stream, see gstbdatsgen.h. */
+extern const GstBdaBackend gst_bda_synthetic_backend;
+
+/* Sample timing trace, see gstbdatrace.h. */
+extern const GstBdaBackend gst_bda_trace_backend;
+
+/**
+ * Returns the backend for the specified type, or NULL if it is not
+ * available in this build.
+ */
+const GstBdaBackend *gst_bda_backend_get (GstBdaBackendType type);
+
+#endif
@@ -0,0 +1,812 @@
+/* GStreamer
+ * Copyright (C) 2015 Raimo Järvi <raimo.jarvi@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include "gstbdabackend.h"
+#include <control.h>
+#include <dshow.h>
+#include <mmreg.h>
+#include <ks.h>
+#include <ksmedia.h>
+#include <bdatypes.h>
+#include <bdamedia.h>
+#include <bdaiface.h>
+#include "gstbdagrabber.h"
+#include "gstbdautil.h"
+#include <utility>
+
+/* Submits a tune request for the current tuning properties. This is all
+   it takes to change channels in a built graph. */
+static gboolean
+gst_bdasrc_submit_tune_request (GstBdaSrc * self)
+{
+  IDVBTuneRequestPtr dvb_tune_request;
+  ITuneRequestPtr tune_request;
+
+  HRESULT res = self->tuning_space->CreateTuneRequest (&tune_request);
+  if (FAILED (res)) {
+    GST_ERROR_OBJECT (self, "Unable to create tune request");
+    return FALSE;
+  }
+
+  res = tune_request->QueryInterface (&dvb_tune_request);
+  if (FAILED (res)) {
+    GST_ERROR_OBJECT (self, "Unable to get DVB tune request interface");
+    return FALSE;
+  }
+
+  if (!gst_bdasrc_init_tune_request (self, dvb_tune_request)) {
+    GST_ERROR_OBJECT (self, "Unable to initialise tune request");
+    return FALSE;
+  }
+
+  res = self->scanning_tuner->Validate (dvb_tune_request);
+  if (FAILED (res)) {
+    GST_ERROR_OBJECT (self, "Unable to validate tune request");
+    return FALSE;
+  }
+
+  res = self->scanning_tuner->put_TuneRequest (dvb_tune_request);
+  if (FAILED (res)) {
+    GST_ERROR_OBJECT (self, "Unable to submit tune request: %s (0x%lx)",
+        bda_err_to_str (res).c_str (), res);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* Creates the DirectShow filter graph. */
+static gboolean
+gst_bdasrc_create_graph (GstBdaSrc * self)
+{
+  HRESULT res = CoCreateInstance (CLSID_FilterGraph, NULL, CLSCTX_ALL,
+      __uuidof (IGraphBuilder), (LPVOID *) & self->filter_graph);
+  if (FAILED (res)) {
+    GST_ERROR_OBJECT (self, "Unable to create filter graph");
+    return FALSE;
+  }
+
+  res = self->filter_graph->QueryInterface (&self->media_control);
+  if (FAILED (res)) {
+    GST_ERROR_OBJECT (self, "Unable to get media control");
+    return FALSE;
+  }
+
+  ICreateDevEnumPtr sys_dev_enum;
+  res = sys_dev_enum.CreateInstance (CLSID_SystemDeviceEnum);
+  if (FAILED (res)) {
+    GST_ERROR_OBJECT (self, "Unable to enumerate BDA devices");
+    return FALSE;
+  }
+
+  IEnumMonikerPtr enum_tuner;
+  res =
+      sys_dev_enum->CreateClassEnumerator (KSCATEGORY_BDA_NETWORK_TUNER,
+      &enum_tuner, 0);
+  if (res == S_FALSE) {
+    /* The device category does not exist or is empty. */
+    GST_ERROR_OBJECT (self, "No BDA tuner devices");
+    return FALSE;
+  } else if (FAILED (res)) {
+    GST_ERROR_OBJECT (self, "Unable to enumerate BDA tuner devices");
+    return FALSE;
+  }
+
+  if (self->selected_device > 0) {
+    res = enum_tuner->Skip (self->selected_device);
+    if (FAILED (res)) {
+      GST_ERROR_OBJECT (self, "BDA device %d doesn't exist",
+          self->selected_device);
+      return FALSE;
+    }
+  }
+
+  IMonikerPtr tuner_moniker;
+  ULONG fetched;
+  res = enum_tuner->Next (1, &tuner_moniker, &fetched);
+  if (FAILED (res)) {
+    GST_ERROR_OBJECT (self, "Unable to get BDA tuner");
+    return FALSE;
+  }
+
+  std::string tuner_name = bda_get_tuner_name (tuner_moniker);
+  std::string tuner_path = bda_get_moniker_name (tuner_moniker);
+
+  res = tuner_moniker->BindToObject (NULL, NULL, IID_IBaseFilter,
+      (void **) &self->network_tuner);
+  if (FAILED (res)) {
+    GST_ERROR_OBJECT (self, "Unable to bind to BDA tuner '%s'",
+        tuner_name.c_str ());
+    return FALSE;
+  }
+
+  self->input_type = gst_bdasrc_get_input_type (self->network_tuner);
+  if (self->input_type == GST_BDA_UNKNOWN) {
+    GST_ERROR_OBJECT (self, "Can't determine device type for BDA tuner '%s'",
+        tuner_name.c_str ());
+    return FALSE;
+  }
+
+  GST_INFO_OBJECT (self, "Using %s tuner device %d '%s'",
+      gst_bdasrc_get_input_type_name (self->input_type),
+      self->selected_device, tuner_name.c_str ());
+
+  ITuningSpacePtr tuning_space;
+  if (!gst_bdasrc_create_tuning_space (self, tuning_space)) {
+    GST_ERROR_OBJECT (self, "Unable to create tuning space");
+    return FALSE;
+  }
+
+  CLSID network_type;
+  if (!gst_bdasrc_get_network_type (self->input_type, network_type)) {
+    GST_ERROR_OBJECT (self, "Can't determine network type");
+    return FALSE;
+  }
+
+  IBaseFilterPtr network_provider;
+
+  res = network_provider.CreateInstance (network_type);
+  if (FAILED (res)) {
+    GST_ERROR_OBJECT (self, "Unable to create network provider");
+    return FALSE;
+  }
+
+  res = self->filter_graph->AddFilter (network_provider, L"Network Provider");
+  if (FAILED (res)) {
+    GST_ERROR_OBJECT (self, "Unable to add network provider to graph");
+    return FALSE;
+  }
+
+  IScanningTunerPtr tuner;
+  res = network_provider->QueryInterface (&tuner);
+  if (FAILED (res)) {
+    GST_ERROR_OBJECT (self, "Unable to get tuner interface");
+    return FALSE;
+  }
+
+  self->scanning_tuner = tuner;
+  self->scanning_tuner->AddRef ();
+  self->tuning_space = tuning_space;
+  self->tuning_space->AddRef ();
+
+  if (!gst_bdasrc_submit_tune_request (self)) {
+    return FALSE;
+  }
+
+  res = self->filter_graph->AddFilter (self->network_tuner, L"Tuner device");
+  if (FAILED (res)) {
+    GST_ERROR_OBJECT (self, "Unable to add tuner to filter graph");
+    return FALSE;
+  }
+
+  res =
+      gst_bdasrc_connect_filters (self, network_provider, self->network_tuner);
+  if (FAILED (res)) {
+    GST_ERROR_OBJECT (self, "Unable to connect tuner: %s (0x%lx)",
+        bda_err_to_str (res).c_str (), res);
+    return FALSE;
+  }
+
+  IBaseFilterPtr demux;
+  res = demux.CreateInstance (CLSID_MPEG2Demultiplexer);
+  if (FAILED (res)) {
+    GST_ERROR_OBJECT (self, "Unable to create MPEG2Demultiplexer");
+    return FALSE;
+  }
+
+  res = self->filter_graph->AddFilter (demux, L"Demux");
+  if (FAILED (res)) {
+    GST_ERROR_OBJECT (self, "Unable to add demux filter to graph");
+    return FALSE;
+  }
+
+  /* Skip trying every receiver filter and media subtype if this device has
+     been used before. */
+  GstBdaGraphHint hint = { NULL, 0 };
+  gboolean cached = !tuner_path.empty ()
+      && gst_bda_graph_cache_lookup (self->graph_cache, tuner_path.c_str (),
+      &hint);
+  if (cached) {
+    GST_DEBUG_OBJECT (self, "Using cached graph for '%s': receiver '%s',"
+        " TS subtype %u", tuner_name.c_str (),
+        hint.receiver ? hint.receiver : "none", hint.ts_subtype);
+  }
+
+  IBaseFilterPtr ts_capture;
+  if (!gst_bdasrc_create_ts_capture (self, sys_dev_enum, ts_capture, &hint,
+          cached)) {
+    if (cached) {
+      /* The next graph build tries everything again. */
+      gst_bda_graph_cache_remove (self->graph_cache, tuner_path.c_str ());
+    }
+    gst_bda_graph_hint_clear (&hint);
+    return FALSE;
+  }
+
+  if (!tuner_path.empty ()
+      && !gst_bda_graph_cache_store (self->graph_cache, tuner_path.c_str (),
+          &hint)) {
+    GST_WARNING_OBJECT (self, "Unable to write graph cache '%s'",
+        self->graph_cache);
+  }
+  gst_bda_graph_hint_clear (&hint);
+
+  res = gst_bdasrc_connect_filters (self, ts_capture, demux);
+  if (FAILED (res)) {
+    GST_ERROR_OBJECT (self, "Unable to connect TS capture to demux: %s (0x%lx)",
+        bda_err_to_str (res).c_str (), res);
+    return FALSE;
+  }
+
+  IBaseFilterPtr tif;
+  res =
+      gst_bdasrc_load_filter (self, sys_dev_enum,
+      KSCATEGORY_BDA_TRANSPORT_INFORMATION, demux, &tif);
+
+  if (FAILED (res)) {
+    GST_ERROR_OBJECT (self, "Unable to load transport information filter");
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* Releases the DirectShow filter graph. */
+static void
+gst_bdasrc_release_graph (GstBdaSrc * self)
+{
+  if (self->media_control) {
+    self->media_control->Stop ();
+    self->media_control->Release ();
+    self->media_control = NULL;
+  }
+  if (self->scanning_tuner) {
+    self->scanning_tuner->Release ();
+    self->scanning_tuner = NULL;
+  }
+  if (self->tuning_space) {
+    self->tuning_space->Release ();
+    self->tuning_space = NULL;
+  }
+  if (self->receiver && self->receiver != self->network_tuner) {
+    self->receiver->Release ();
+    self->receiver = NULL;
+  }
+  if (self->network_tuner) {
+    self->network_tuner->Release ();
+    self->network_tuner = NULL;
+  }
+  if (self->filter_graph) {
+    self->filter_graph->Release ();
+    self->filter_graph = NULL;
+  }
+}
+
+/* Runs the graph. Signal lock is waited for by the element. */
+static gboolean
+gst_bdasrc_tune (GstBdaSrc * self)
+{
+  HRESULT res = self->media_control->Run ();
+  if (FAILED (res)) {
+    GST_ERROR_OBJECT (self, "Error starting media control: %s (0x%lx)",
+        bda_err_to_str (res).c_str (), res);
+    self->media_control->Stop ();
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* Reads the lock status from the signal statistics of the first control
+   node of the tuner. */
+static gboolean
+gst_bdasrc_get_signal_locked (GstBdaSrc * self, gboolean * locked)
+{
+  IBDA_TopologyPtr bda_topology;
+  HRESULT res = self->network_tuner->QueryInterface (&bda_topology);
+  if (FAILED (res)) {
+    GST_WARNING_OBJECT (self,
+        "Error getting BDA topology interface: %s (0x%lx)",
+        bda_err_to_str (res).c_str (), res);
+    return FALSE;
+  }
+
+  ULONG node_type_count = 0;
+  ULONG node_types[32] = { };
+  res =
+      bda_topology->GetNodeTypes (&node_type_count, _countof (node_types),
+      node_types);
+  if (FAILED (res)) {
+    GST_WARNING_OBJECT (self,
+        "Error getting BDA topology node types: %s (0x%lx)",
+        bda_err_to_str (res).c_str (), res);
+    return FALSE;
+  }
+
+  for (ULONG i = 0; i < node_type_count; i++) {
+    IUnknownPtr node;
+    res = bda_topology->GetControlNode (0, 1, node_types[i], &node);
+    if (res == S_OK) {
+      IBDA_SignalStatisticsPtr signal_stats;
+      BOOLEAN signal_locked = FALSE;
+      if (FAILED (node->QueryInterface (&signal_stats))
+          || FAILED (signal_stats->get_SignalLocked (&signal_locked))) {
+        return FALSE;
+      }
+      *locked = signal_locked;
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+/* Process-wide pool of built but stopped graphs, kept for pool-idle-time
+   after an element closes so that the next element for the same device,
+   input type and network type only needs to submit a tune request. */
+typedef struct _GstBdaPooledGraph GstBdaPooledGraph;
+
+struct _GstBdaPooledGraph {
+  int device_index;
+  /* Frequency the graph was last tuned to. */
+  int frequency;
+  GstBdaInputType input_type;
+  /* Network provider of the graph. */
+  CLSID network_type;
+  IBaseFilter *network_tuner;
+  IBaseFilter *receiver;
+  IScanningTuner *scanning_tuner;
+  ITuningSpace *tuning_space;
+  IGraphBuilder *filter_graph;
+  IMediaControl *media_control;
+  GstBdaGrabber *ts_grabber;
+  /* Released at this monotonic time. */
+  gint64 expires;
+};
+
+static GMutex pool_lock;
+static GCond pool_cond;
+static GList *pool_graphs;
+/* Runs while graphs are pooled, protected by pool_lock. */
+static GThread *pool_thread;
+/* The thread found the pool empty and is exiting, to be joined. */
+static gboolean pool_thread_done;
+
+/* Moves the graph between the element and a pool entry. */
+static void
+gst_bdasrc_swap_graph (GstBdaSrc * self, GstBdaPooledGraph * graph)
+{
+  std::swap (self->input_type, graph->input_type);
+  std::swap (self->network_tuner, graph->network_tuner);
+  std::swap (self->receiver, graph->receiver);
+  std::swap (self->scanning_tuner, graph->scanning_tuner);
+  std::swap (self->tuning_space, graph->tuning_space);
+  std::swap (self->filter_graph, graph->filter_graph);
+  std::swap (self->media_control, graph->media_control);
+  std::swap (self->ts_grabber, graph->ts_grabber);
+}
+
+static void
+gst_bdasrc_free_pooled_graph (GstBdaPooledGraph * graph)
+{
+  GST_DEBUG ("Releasing pooled graph of device %d", graph->device_index);
+
+  graph->media_control->Release ();
+  graph->scanning_tuner->Release ();
+  graph->tuning_space->Release ();
+  if (graph->receiver != graph->network_tuner) {
+    graph->receiver->Release ();
+  }
+  graph->network_tuner->Release ();
+  graph->filter_graph->Release ();
+  delete graph->ts_grabber;
+  g_free (graph);
+}
+
+/* Releases pooled graphs once they expire, and exits once none are
+   left. */
+static gpointer
+gst_bdasrc_pool_thread (gpointer /*data */ )
+{
+  CoInitializeEx (NULL, COINIT_MULTITHREADED);
+
+  g_mutex_lock (&pool_lock);
+  while (pool_graphs) {
+    gint64 now = g_get_monotonic_time ();
+    gint64 next = G_MAXINT64;
+    GList *expired = NULL;
+
+    for (GList * l = pool_graphs; l;) {
+      GList *next_link = l->next;
+      GstBdaPooledGraph *graph = (GstBdaPooledGraph *) l->data;
+      if (graph->expires <= now) {
+        pool_graphs = g_list_remove_link (pool_graphs, l);
+        expired = g_list_concat (expired, l);
+      } else {
+        next = MIN (next, graph->expires);
+      }
+      l = next_link;
+    }
+
+    if (expired) {
+      g_mutex_unlock (&pool_lock);
+      g_list_free_full (expired, (GDestroyNotify) gst_bdasrc_free_pooled_graph);
+      g_mutex_lock (&pool_lock);
+      continue;
+    }
+
+    g_cond_wait_until (&pool_cond, &pool_lock, next);
+  }
+  pool_thread_done = TRUE;
+  g_mutex_unlock (&pool_lock);
+
+  CoUninitialize ();
+
+  return NULL;
+}
+
+/* Joins the pool thread once it has exited, called with pool_lock. */
+static void
+gst_bdasrc_reap_pool_thread (void)
+{
+  if (pool_thread && pool_thread_done) {
+    g_thread_join (pool_thread);
+    pool_thread = NULL;
+    pool_thread_done = FALSE;
+  }
+}
+
+/* Returns TRUE if the graph can be used for device_type on the device. An
+   unknown device_type takes whatever the device was opened as. */
+static gboolean
+gst_bdasrc_pooled_graph_matches (GstBdaPooledGraph * graph,
+    int device_index, GstBdaInputType device_type)
+{
+  if (graph->device_index != device_index) {
+    return FALSE;
+  } else if (device_type == GST_BDA_UNKNOWN) {
+    return TRUE;
+  }
+
+  CLSID network_type;
+  return graph->input_type == device_type
+      && gst_bdasrc_get_network_type (device_type, network_type)
+      && IsEqualCLSID (network_type, graph->network_type);
+}
+
+/* Takes a pooled graph for the element's device and type. */
+static gboolean
+gst_bdasrc_take_pooled_graph (GstBdaSrc * self)
+{
+  GstBdaPooledGraph *graph = NULL;
+
+  g_mutex_lock (&pool_lock);
+  for (GList * l = pool_graphs; l; l = l->next) {
+    GstBdaPooledGraph *candidate = (GstBdaPooledGraph *) l->data;
+    if (gst_bdasrc_pooled_graph_matches (candidate, self->selected_device,
+            self->device_type)) {
+      graph = candidate;
+      pool_graphs = g_list_delete_link (pool_graphs, l);
+      break;
+    }
+  }
+  g_mutex_unlock (&pool_lock);
+
+  if (!graph) {
+    return FALSE;
+  }
+
+  gst_bdasrc_swap_graph (self, graph);
+  g_free (graph);
+
+  return TRUE;
+}
+
+/* Moves the element's stopped graph to the pool. */
+static void
+gst_bdasrc_pool_graph (GstBdaSrc * self)
+{
+  GstBdaPooledGraph *graph = g_new0 (GstBdaPooledGraph, 1);
+  graph->device_index = self->selected_device;
+  graph->frequency = self->frequency;
+  gst_bdasrc_get_network_type (self->input_type, graph->network_type);
+  graph->expires = g_get_monotonic_time () +
+      self->pool_idle_time * G_TIME_SPAN_MILLISECOND;
+  self->ts_grabber->Attach (NULL, NULL);
+  gst_bdasrc_swap_graph (self, graph);
+
+  GST_DEBUG_OBJECT (self, "Pooling graph of device %d for %u ms",
+      graph->device_index, self->pool_idle_time);
+
+  g_mutex_lock (&pool_lock);
+  pool_graphs = g_list_append (pool_graphs, graph);
+  gst_bdasrc_reap_pool_thread ();
+  if (!pool_thread) {
+    pool_thread = g_thread_new ("bdasrc-pool", gst_bdasrc_pool_thread, NULL);
+  }
+  g_cond_signal (&pool_cond);
+  g_mutex_unlock (&pool_lock);
+}
+
+/* Returns TRUE if a graph of the device for the element's type tuned to
+   its frequency is pooled. */
+static gboolean
+gst_bdasrc_has_pooled_graph (GstBdaSrc * self, int device_index)
+{
+  gboolean found = FALSE;
+
+  g_mutex_lock (&pool_lock);
+  for (GList * l = pool_graphs; l && !found; l = l->next) {
+    GstBdaPooledGraph *graph = (GstBdaPooledGraph *) l->data;
+    found = gst_bdasrc_pooled_graph_matches (graph, device_index,
+        self->device_type) && graph->frequency == self->frequency;
+  }
+  g_mutex_unlock (&pool_lock);
+
+  return found;
+}
+
+/* Process-wide registry of tuner devices by index, used to select a free
+   device for device -1. Devices opened with a fixed index are counted too. */
+typedef struct _GstBdaTunerEntry GstBdaTunerEntry;
+
+struct _GstBdaTunerEntry {
+  /* GST_BDA_UNKNOWN until probed, or if the type can't be determined. */
+  GstBdaInputType input_type;
+  gboolean probed;
+  /* Elements of this process that have the device open. */
+  guint users;
+};
+
+static GMutex tuners_lock;
+static GArray *tuners;
+
+/* Returns the registry entry of the device, called with tuners_lock. */
+static GstBdaTunerEntry *
+gst_bdasrc_get_tuner_entry (int device_index)
+{
+  if (!tuners) {
+    tuners = g_array_new (FALSE, TRUE, sizeof (GstBdaTunerEntry));
+  }
+  if ((guint) device_index >= tuners->len) {
+    g_array_set_size (tuners, device_index + 1);
+  }
+  return &g_array_index (tuners, GstBdaTunerEntry, device_index);
+}
+
+/* Enumerates tuner devices and determines the input type of new ones,
+   called with tuners_lock. Each device is bound only once per process. */
+static void
+gst_bdasrc_probe_tuners (GstBdaSrc * self)
+{
+  ICreateDevEnumPtr sys_dev_enum;
+  HRESULT res = sys_dev_enum.CreateInstance (CLSID_SystemDeviceEnum);
+  if (FAILED (res)) {
+    return;
+  }
+
+  IEnumMonikerPtr enum_tuner;
+  res = sys_dev_enum->CreateClassEnumerator (KSCATEGORY_BDA_NETWORK_TUNER,
+      &enum_tuner, 0);
+  if (res != S_OK) {
+    return;
+  }
+
+  IMonikerPtr tuner_moniker;
+  for (int i = 0; enum_tuner->Next (1, &tuner_moniker, NULL) == S_OK; i++) {
+    GstBdaTunerEntry *tuner = gst_bdasrc_get_tuner_entry (i);
+    if (!tuner->probed) {
+      IBaseFilterPtr filter;
+      res = tuner_moniker->BindToObject (NULL, NULL, IID_IBaseFilter,
+          (void **) &filter);
+      if (SUCCEEDED (res)) {
+        tuner->input_type = gst_bdasrc_get_input_type (filter);
+      }
+      tuner->probed = TRUE;
+      GST_DEBUG_OBJECT (self, "BDA device %d is %s", i,
+          gst_bdasrc_get_input_type_name (tuner->input_type));
+    }
+  }
+}
+
+/* Reserves a free device of the element's device type, skipping the devices
+   in the tried bitmask. A device with a pooled graph already tuned to the
+   element's frequency is preferred. Returns -1 if there is none. */
+static int
+gst_bdasrc_select_tuner (GstBdaSrc * self, guint64 tried)
+{
+  int selected = -1;
+
+  g_mutex_lock (&tuners_lock);
+  gst_bdasrc_probe_tuners (self);
+  for (guint i = 0; tuners && i < MIN (tuners->len, 64); i++) {
+    GstBdaTunerEntry *tuner = &g_array_index (tuners, GstBdaTunerEntry, i);
+    if (tuner->users > 0 || (tried & (G_GUINT64_CONSTANT (1) << i))
+        || tuner->input_type == GST_BDA_UNKNOWN
+        || (self->device_type != GST_BDA_UNKNOWN
+            && tuner->input_type != self->device_type)) {
+      continue;
+    }
+    if (gst_bdasrc_has_pooled_graph (self, i)) {
+      selected = i;
+      break;
+    }
+    if (selected < 0) {
+      selected = i;
+    }
+  }
+  if (selected >= 0) {
+    gst_bdasrc_get_tuner_entry (selected)->users++;
+  }
+  g_mutex_unlock (&tuners_lock);
+
+  return selected;
+}
+
+/* Counts the element as a user of its selected device. */
+static void
+gst_bdasrc_use_tuner (GstBdaSrc * self)
+{
+  g_mutex_lock (&tuners_lock);
+  gst_bdasrc_get_tuner_entry (self->selected_device)->users++;
+  g_mutex_unlock (&tuners_lock);
+}
+
+/* Releases the element's selected device. */
+static void
+gst_bdasrc_release_tuner (GstBdaSrc * self)
+{
+  if (self->selected_device < 0) {
+    return;
+  }
+
+  g_mutex_lock (&tuners_lock);
+  gst_bdasrc_get_tuner_entry (self->selected_device)->users--;
+  g_mutex_unlock (&tuners_lock);
+  self->selected_device = -1;
+  g_object_notify (G_OBJECT (self), "current-device");
+}
+
+/* Builds the graph of the selected device, or reuses a pooled one. */
+static gboolean
+gst_bdasrc_open_tuner (GstBdaSrc * self)
+{
+  if (gst_bdasrc_take_pooled_graph (self)) {
+    if (gst_bdasrc_submit_tune_request (self)) {
+      GST_INFO_OBJECT (self, "Reusing pooled graph of device %d",
+          self->selected_device);
+      self->graph_ready = TRUE;
+      return TRUE;
+    }
+    GST_WARNING_OBJECT (self, "Unable to reuse pooled graph");
+    gst_bdasrc_release_graph (self);
+    delete self->ts_grabber;
+    self->ts_grabber = NULL;
+  }
+
+  self->ts_grabber = new GstBdaGrabber (self, NULL);
+
+  self->graph_ready = gst_bdasrc_create_graph (self);
+  return self->graph_ready;
+}
+
+/* Opens the first free device of the right type that works. */
+static gboolean
+gst_bdasrc_open_free_tuner (GstBdaSrc * self)
+{
+  guint64 tried = 0;
+
+  for (;;) {
+    self->selected_device = gst_bdasrc_select_tuner (self, tried);
+    if (self->selected_device < 0) {
+      GST_ERROR_OBJECT (self, "No free %s tuner device",
+          self->device_type == GST_BDA_UNKNOWN ? "BDA" :
+          gst_bdasrc_get_input_type_name (self->device_type));
+      return FALSE;
+    }
+
+    if (gst_bdasrc_open_tuner (self)) {
+      return TRUE;
+    }
+
+    GST_WARNING_OBJECT (self, "Unable to open device %d, trying the next one",
+        self->selected_device);
+    tried |= G_GUINT64_CONSTANT (1) << self->selected_device;
+    self->graph_ready = FALSE;
+    gst_bdasrc_release_graph (self);
+    delete self->ts_grabber;
+    self->ts_grabber = NULL;
+    gst_bdasrc_release_tuner (self);
+  }
+}
+
+static gboolean
+gst_bdasrc_dshow_open (GstBdaSrc * self)
+{
+  GstBdaTraceWriter *trace = NULL;
+
+  if (self->trace_location) {
+    GError *err = NULL;
+    trace = gst_bda_trace_writer_new (self->trace_location,
+        self->trace_payload, &err);
+    if (!trace) {
+      GST_ERROR_OBJECT (self, "Unable to record trace: %s", err->message);
+      g_error_free (err);
+      return FALSE;
+    }
+    GST_INFO_OBJECT (self, "Recording sample trace to '%s'",
+        self->trace_location);
+  }
+
+  gboolean opened;
+  if (self->device_index >= 0) {
+    self->selected_device = self->device_index;
+    gst_bdasrc_use_tuner (self);
+    opened = gst_bdasrc_open_tuner (self);
+  } else {
+    opened = gst_bdasrc_open_free_tuner (self);
+  }
+  g_object_notify (G_OBJECT (self), "current-device");
+
+  if (!opened) {
+    gst_bda_trace_writer_free (trace);
+    return FALSE;
+  }
+  self->ts_grabber->Attach (self, trace);
+
+  return TRUE;
+}
+
+static void
+gst_bdasrc_dshow_stop (GstBdaSrc * self)
+{
+  if (self->media_control) {
+    self->media_control->Stop ();
+  }
+}
+
+static void
+gst_bdasrc_dshow_close (GstBdaSrc * self, gboolean pool)
+{
+  /* Only complete graphs are pooled. */
+  if (pool && self->pool_idle_time > 0 && self->graph_ready) {
+    self->graph_ready = FALSE;
+    self->media_control->Stop ();
+    gst_bdasrc_pool_graph (self);
+  } else {
+    self->graph_ready = FALSE;
+
+    gst_bdasrc_release_graph (self);
+
+    delete self->ts_grabber;
+    self->ts_grabber = NULL;
+  }
+
+  gst_bdasrc_release_tuner (self);
+}
+
+const GstBdaBackend gst_bda_dshow_backend = {
+  "dshow",
+  gst_bdasrc_dshow_open,
+  gst_bdasrc_tune,
+  gst_bdasrc_dshow_stop,
+  gst_bdasrc_dshow_close,
+  gst_bdasrc_submit_tune_request,
+  gst_bdasrc_get_signal_locked
+};
@@ -0,0 +1,811 @@
+/* GStreamer
+ * Copyright (C) 2015 Raimo Järvi <raimo.jarvi@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include "gstbdaepg.h"
+#include "gstbdasection.h"
+#include "gstbdats.h"
+#include "gstbdatuner.h"
+#include <string.h>
+
+#define SDT_PID 0x0011
+#define EIT_PID 0x0012
+#define SDT_ACTUAL_TABLE_ID 0x42
+#define EIT_SCHEDULE_FIRST_TABLE_ID 0x50
+#define EIT_SCHEDULE_LAST_TABLE_ID 0x5f
+#define SHORT_EVENT_DESCRIPTOR 0x4d
+/* Days from 1858-11-17 (MJD 0) to 1970-01-01. */
+#define MJD_EPOCH 40587
+
+/* Pause before the next round of the EPG carousel when no transponder
+   locked. */
+#define EPG_RETRY_INTERVAL (5000 * G_TIME_SPAN_MILLISECOND)
+
+typedef struct _GstBdaEpgEvent GstBdaEpgEvent;
+typedef struct _GstBdaEpgService GstBdaEpgService;
+typedef struct _GstBdaEpgTable GstBdaEpgTable;
+
+struct _GstBdaEpgEvent {
+  guint16 id;
+  gint64 start;
+  guint duration;
+  guint8 running_status;
+  gboolean scrambled;
+  gchar language[4];
+  gchar *title;
+  gchar *text;
+};
+
+struct _GstBdaEpgService {
+  /* Key in the store, see gst_bda_epg_service_key () */
+  guint64 key;
+  guint16 original_network_id;
+  guint16 transport_stream_id;
+  guint16 service_id;
+  /* GstBdaEpgEvent in start order */
+  GSequence *events;
+  /* Event ID -> GSequenceIter */
+  GHashTable *ids;
+};
+
+struct _GstBdaEpgStore {
+  GMutex lock;
+  /* Network, transport stream and service ID -> GstBdaEpgService */
+  GHashTable *services;
+  guint size;
+};
+
+/* Sections received of the current version of a table. EIT schedule
+   tables are divided into segments of 8 sections, of which only the ones
+   up to the segment's last section number are sent. */
+struct _GstBdaEpgTable {
+  /* -1 until a section is received. */
+  gint version;
+  guint last_section;
+  /* A byte per segment, a bit per section. */
+  guint8 sections[32];
+  guint8 segment_last[32];
+};
+
+struct _GstBdaEpgCollector {
+  GstBdaSectionAssembler *assembler;
+  GstBdaEpgStore *store;
+  GstBdaEpgTable sdt;
+  /* IDs of services with the EIT schedule flag set in the SDT */
+  GHashTable *scheduled;
+  /* Service ID << 8 | table ID -> GstBdaEpgTable */
+  GHashTable *tables;
+  /* Service ID -> last table ID of its schedule */
+  GHashTable *last_tables;
+  guint events;
+};
+
+static void
+gst_bda_epg_event_free (GstBdaEpgEvent * event)
+{
+  g_free (event->title);
+  g_free (event->text);
+  g_free (event);
+}
+
+static gint
+gst_bda_epg_event_compare (gconstpointer a, gconstpointer b,
+    gpointer /*user_data */ )
+{
+  gint64 start_a = ((const GstBdaEpgEvent *) a)->start;
+  gint64 start_b = ((const GstBdaEpgEvent *) b)->start;
+
+  return start_a < start_b ? -1 : start_a > start_b;
+}
+
+static void
+gst_bda_epg_service_free (GstBdaEpgService * service)
+{
+  g_hash_table_destroy (service->ids);
+  g_sequence_free (service->events);
+  g_free (service);
+}
+
+static guint64
+gst_bda_epg_service_key (guint16 original_network_id,
+    guint16 transport_stream_id, guint16 service_id)
+{
+  return ((guint64) original_network_id << 32) |
+      ((guint64) transport_stream_id << 16) | service_id;
+}
+
+GstBdaEpgStore *
+gst_bda_epg_store_new (void)
+{
+  GstBdaEpgStore *store = g_new0 (GstBdaEpgStore, 1);
+  g_mutex_init (&store->lock);
+  store->services = g_hash_table_new_full (g_int64_hash, g_int64_equal,
+      NULL, (GDestroyNotify) gst_bda_epg_service_free);
+
+  return store;
+}
+
+void
+gst_bda_epg_store_free (GstBdaEpgStore * store)
+{
+  if (!store) {
+    return;
+  }
+
+  g_hash_table_destroy (store->services);
+  g_mutex_clear (&store->lock);
+  g_free (store);
+}
+
+guint
+gst_bda_epg_store_get_size (GstBdaEpgStore * store)
+{
+  g_mutex_lock (&store->lock);
+  guint size = store->size;
+  g_mutex_unlock (&store->lock);
+
+  return size;
+}
+
+/* Adds the event to the store, replacing an earlier version of it. Returns
+   TRUE if the event wasn't in the store. */
+static gboolean
+gst_bda_epg_store_add (GstBdaEpgStore * store, guint16 original_network_id,
+    guint16 transport_stream_id, guint16 service_id, GstBdaEpgEvent * event)
+{
+  guint64 key = gst_bda_epg_service_key (original_network_id,
+      transport_stream_id, service_id);
+  gboolean added = TRUE;
+
+  g_mutex_lock (&store->lock);
+  GstBdaEpgService *service = (GstBdaEpgService *)
+      g_hash_table_lookup (store->services, &key);
+  if (!service) {
+    service = g_new0 (GstBdaEpgService, 1);
+    service->key = key;
+    service->original_network_id = original_network_id;
+    service->transport_stream_id = transport_stream_id;
+    service->service_id = service_id;
+    service->events =
+        g_sequence_new ((GDestroyNotify) gst_bda_epg_event_free);
+    service->ids = g_hash_table_new (g_direct_hash, g_direct_equal);
+    g_hash_table_insert (store->services, &service->key, service);
+  }
+
+  GSequenceIter *iter = (GSequenceIter *) g_hash_table_lookup (service->ids,
+      GUINT_TO_POINTER (event->id));
+  if (iter) {
+    g_sequence_remove (iter);
+    added = FALSE;
+  } else {
+    store->size++;
+  }
+  iter = g_sequence_insert_sorted (service->events, event,
+      gst_bda_epg_event_compare, NULL);
+  g_hash_table_insert (service->ids, GUINT_TO_POINTER (event->id), iter);
+  g_mutex_unlock (&store->lock);
+
+  return added;
+}
+
+void
+gst_bda_epg_store_expire (GstBdaEpgStore * store, gint64 time)
+{
+  GHashTableIter iter;
+  gpointer value;
+
+  g_mutex_lock (&store->lock);
+  g_hash_table_iter_init (&iter, store->services);
+  while (g_hash_table_iter_next (&iter, NULL, &value)) {
+    GstBdaEpgService *service = (GstBdaEpgService *) value;
+    /* Events don't overlap, so the ended ones come first. */
+    GSequenceIter *first;
+    while (!g_sequence_iter_is_end (first =
+            g_sequence_get_begin_iter (service->events))) {
+      GstBdaEpgEvent *event = (GstBdaEpgEvent *) g_sequence_get (first);
+      if (event->start + event->duration >= time) {
+        break;
+      }
+      g_hash_table_remove (service->ids, GUINT_TO_POINTER (event->id));
+      g_sequence_remove (first);
+      store->size--;
+    }
+    if (g_sequence_get_length (service->events) == 0) {
+      g_hash_table_iter_remove (&iter);
+    }
+  }
+  g_mutex_unlock (&store->lock);
+}
+
+static void
+gst_bda_epg_service_get_events (GstBdaEpgService * service, gint64 start,
+    gint64 end, GValue * events, guint * count)
+{
+  GstBdaEpgEvent probe;
+  probe.start = start;
+
+  /* The event before the first one starting after start may still be
+     running. */
+  GSequenceIter *iter = g_sequence_search (service->events, &probe,
+      gst_bda_epg_event_compare, NULL);
+  if (!g_sequence_iter_is_begin (iter)) {
+    GSequenceIter *prev = g_sequence_iter_prev (iter);
+    GstBdaEpgEvent *event = (GstBdaEpgEvent *) g_sequence_get (prev);
+    if (event->start + event->duration > start) {
+      iter = prev;
+    }
+  }
+
+  for (; !g_sequence_iter_is_end (iter); iter = g_sequence_iter_next (iter)) {
+    GstBdaEpgEvent *event = (GstBdaEpgEvent *) g_sequence_get (iter);
+    if (end > 0 && event->start >= end) {
+      break;
+    }
+
+    GstStructure *s = gst_structure_new ("event",
+        "original-network-id", G_TYPE_UINT,
+        (guint) service->original_network_id,
+        "transport-stream-id", G_TYPE_UINT,
+        (guint) service->transport_stream_id,
+        "service-id", G_TYPE_UINT, (guint) service->service_id,
+        "event-id", G_TYPE_UINT, (guint) event->id,
+        "start", G_TYPE_INT64, event->start,
+        "duration", G_TYPE_UINT, event->duration,
+        "running-status", G_TYPE_UINT, (guint) event->running_status,
+        "scrambled", G_TYPE_BOOLEAN, event->scrambled, NULL);
+    if (event->title) {
+      gst_structure_set (s, "language", G_TYPE_STRING, event->language,
+          "title", G_TYPE_STRING, event->title,
+          "text", G_TYPE_STRING, event->text ? event->text : "", NULL);
+    }
+
+    GValue value = G_VALUE_INIT;
+    g_value_init (&value, GST_TYPE_STRUCTURE);
+    g_value_take_boxed (&value, s);
+    gst_value_list_append_and_take_value (events, &value);
+    (*count)++;
+  }
+}
+
+guint
+gst_bda_epg_store_get_events (GstBdaEpgStore * store, guint service_id,
+    gint64 start, gint64 end, GValue * events)
+{
+  GHashTableIter iter;
+  gpointer value;
+  guint count = 0;
+
+  g_mutex_lock (&store->lock);
+  g_hash_table_iter_init (&iter, store->services);
+  while (g_hash_table_iter_next (&iter, NULL, &value)) {
+    GstBdaEpgService *service = (GstBdaEpgService *) value;
+    if (service_id == 0 || service->service_id == service_id) {
+      gst_bda_epg_service_get_events (service, start, end, events, &count);
+    }
+  }
+  g_mutex_unlock (&store->lock);
+
+  return count;
+}
+
+static void
+gst_bda_epg_table_init (GstBdaEpgTable * table)
+{
+  memset (table, 0, sizeof (GstBdaEpgTable));
+  table->version = -1;
+}
+
+/* Records a section of the table. Returns TRUE if it wasn't received
+   before, and a new version restarts the table. */
+static gboolean
+gst_bda_epg_table_add (GstBdaEpgTable * table, const guint8 * section,
+    guint segment_last)
+{
+  gint version = (section[5] >> 1) & 0x1f;
+  guint number = section[6];
+  guint segment = number / 8;
+
+  if (version != table->version) {
+    gst_bda_epg_table_init (table);
+    table->version = version;
+    table->last_section = section[7];
+  }
+  if (number > table->last_section
+      || (table->sections[segment] & (1 << (number % 8)))) {
+    return FALSE;
+  }
+  table->sections[segment] |= 1 << (number % 8);
+  table->segment_last[segment] = MAX (segment_last, number);
+
+  return TRUE;
+}
+
+static gboolean
+gst_bda_epg_table_complete (GstBdaEpgTable * table)
+{
+  if (table->version < 0) {
+    return FALSE;
+  }
+
+  for (guint segment = 0; segment <= table->last_section / 8; segment++) {
+    /* Every segment has at least one section, which tells the last. */
+    if (!table->sections[segment]) {
+      return FALSE;
+    }
+    guint last = MIN (MIN (table->segment_last[segment], table->last_section),
+        segment * 8 + 7);
+    guint mask = (1 << (last - segment * 8 + 1)) - 1;
+    if ((table->sections[segment] & mask) != mask) {
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+/* Converts a two digit BCD byte to a number. */
+static guint
+gst_bda_epg_bcd (guint8 value)
+{
+  return (value >> 4) * 10 + (value & 0x0f);
+}
+
+/* Reads an EIT event at data, which has the 12 byte header and the
+   descriptors up to end. Returns NULL if the start time is undefined. */
+static GstBdaEpgEvent *
+gst_bda_epg_parse_event (const guint8 * data, const guint8 * end)
+{
+  guint mjd = (data[2] << 8) | data[3];
+  if (mjd == 0xffff) {
+    return NULL;
+  }
+
+  GstBdaEpgEvent *event = g_new0 (GstBdaEpgEvent, 1);
+  event->id = (data[0] << 8) | data[1];
+  event->start = ((gint64) mjd - MJD_EPOCH) * 86400 +
+      gst_bda_epg_bcd (data[4]) * 3600 + gst_bda_epg_bcd (data[5]) * 60 +
+      gst_bda_epg_bcd (data[6]);
+  event->duration = gst_bda_epg_bcd (data[7]) * 3600 +
+      gst_bda_epg_bcd (data[8]) * 60 + gst_bda_epg_bcd (data[9]);
+  event->running_status = data[10] >> 5;
+  event->scrambled = (data[10] & 0x10) != 0;
+
+  for (const guint8 * desc = data + 12; desc + 2 <= end;
+      desc += 2 + desc[1]) {
+    if (desc[0] != SHORT_EVENT_DESCRIPTOR || desc + 2 + desc[1] > end
+        || desc[1] < 5 || event->title) {
+      continue;
+    }
+    const guint8 *desc_end = desc + 2 + desc[1];
+    const guint8 *name = desc + 6;
+    gsize name_length = MIN ((gsize) desc[5], (gsize) (desc_end - name));
+    memcpy (event->language, desc + 2, 3);
+    event->title = gst_bda_ts_decode_string (name, name_length);
+    const guint8 *text = name + name_length;
+    if (text < desc_end) {
+      gsize text_length = MIN ((gsize) text[0],
+          (gsize) (desc_end - text - 1));
+      event->text = gst_bda_ts_decode_string (text + 1, text_length);
+    }
+  }
+
+  return event;
+}
+
+static void
+gst_bda_epg_collector_parse_sdt (GstBdaEpgCollector * collector,
+    const guint8 * section, gsize size)
+{
+  gint version = collector->sdt.version;
+  if (!gst_bda_epg_table_add (&collector->sdt, section, section[7])) {
+    return;
+  }
+  if (version != collector->sdt.version) {
+    g_hash_table_remove_all (collector->scheduled);
+  }
+
+  /* Service loop after the 11 byte header, up to the CRC. */
+  gsize offset = 11;
+  while (offset + 5 <= size - 4) {
+    guint16 id = (section[offset] << 8) | section[offset + 1];
+    if (section[offset + 2] & 0x02) {
+      g_hash_table_add (collector->scheduled, GUINT_TO_POINTER (id));
+    }
+    offset += 5 + (((section[offset + 3] & 0x0f) << 8) | section[offset + 4]);
+  }
+}
+
+static void
+gst_bda_epg_collector_parse_eit (GstBdaEpgCollector * collector,
+    const guint8 * section, gsize size)
+{
+  guint16 service_id = (section[3] << 8) | section[4];
+  guint key = (service_id << 8) | section[0];
+  GstBdaEpgTable *table = (GstBdaEpgTable *)
+      g_hash_table_lookup (collector->tables, GUINT_TO_POINTER (key));
+  if (!table) {
+    table = g_new (GstBdaEpgTable, 1);
+    gst_bda_epg_table_init (table);
+    g_hash_table_insert (collector->tables, GUINT_TO_POINTER (key), table);
+  }
+  if (!gst_bda_epg_table_add (table, section, section[12])) {
+    return;
+  }
+  g_hash_table_insert (collector->last_tables, GUINT_TO_POINTER (service_id),
+      GUINT_TO_POINTER ((guint) section[13]));
+
+  guint16 transport_stream_id = (section[8] << 8) | section[9];
+  guint16 original_network_id = (section[10] << 8) | section[11];
+  /* Event loop after the 14 byte header, up to the CRC. */
+  const guint8 *end = section + size - 4;
+  const guint8 *p = section + 14;
+  while (p + 12 <= end) {
+    const guint8 *event_end =
+        MIN (p + 12 + (((p[10] & 0x0f) << 8) | p[11]), end);
+    GstBdaEpgEvent *event = gst_bda_epg_parse_event (p, event_end);
+    if (event && gst_bda_epg_store_add (collector->store, original_network_id,
+            transport_stream_id, service_id, event)) {
+      collector->events++;
+    }
+    p = event_end;
+  }
+}
+
+static void
+gst_bda_epg_collector_section (guint16 pid, const guint8 * section,
+    gsize size, gpointer user_data)
+{
+  GstBdaEpgCollector *collector = (GstBdaEpgCollector *) user_data;
+
+  /* Long form sections of the current version only. */
+  if (size < 12 || !(section[1] & 0x80) || !(section[5] & 0x01)) {
+    return;
+  }
+
+  if (pid == SDT_PID && section[0] == SDT_ACTUAL_TABLE_ID) {
+    gst_bda_epg_collector_parse_sdt (collector, section, size);
+  } else if (pid == EIT_PID && size >= 18
+      && section[0] >= EIT_SCHEDULE_FIRST_TABLE_ID
+      && section[0] <= EIT_SCHEDULE_LAST_TABLE_ID) {
+    gst_bda_epg_collector_parse_eit (collector, section, size);
+  }
+}
+
+GstBdaEpgCollector *
+gst_bda_epg_collector_new (GstBdaEpgStore * store)
+{
+  GstBdaEpgCollector *collector = g_new0 (GstBdaEpgCollector, 1);
+  collector->store = store;
+  collector->assembler =
+      gst_bda_section_assembler_new (gst_bda_epg_collector_section,
+      collector);
+  gst_bda_section_assembler_set_deduplicate (collector->assembler, TRUE);
+  gst_bda_section_assembler_add_pid (collector->assembler, SDT_PID);
+  gst_bda_section_assembler_add_pid (collector->assembler, EIT_PID);
+  gst_bda_epg_table_init (&collector->sdt);
+  collector->scheduled = g_hash_table_new (g_direct_hash, g_direct_equal);
+  collector->tables = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+      NULL, g_free);
+  collector->last_tables = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+  return collector;
+}
+
+void
+gst_bda_epg_collector_free (GstBdaEpgCollector * collector)
+{
+  if (!collector) {
+    return;
+  }
+
+  gst_bda_section_assembler_free (collector->assembler);
+  g_hash_table_destroy (collector->scheduled);
+  g_hash_table_destroy (collector->tables);
+  g_hash_table_destroy (collector->last_tables);
+  g_free (collector);
+}
+
+/* Checks if all tables of the schedule of a service are complete. */
+static gboolean
+gst_bda_epg_collector_service_complete (GstBdaEpgCollector * collector,
+    guint16 service_id)
+{
+  gpointer last_table;
+  if (!g_hash_table_lookup_extended (collector->last_tables,
+          GUINT_TO_POINTER (service_id), NULL, &last_table)) {
+    return FALSE;
+  }
+
+  for (guint table_id = EIT_SCHEDULE_FIRST_TABLE_ID;
+      table_id <= MIN (GPOINTER_TO_UINT (last_table),
+          EIT_SCHEDULE_LAST_TABLE_ID); table_id++) {
+    GstBdaEpgTable *table = (GstBdaEpgTable *)
+        g_hash_table_lookup (collector->tables,
+        GUINT_TO_POINTER ((service_id << 8) | table_id));
+    if (!table || !gst_bda_epg_table_complete (table)) {
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+gboolean
+gst_bda_epg_collector_push (GstBdaEpgCollector * collector,
+    const guint8 * data, gsize size)
+{
+  gst_bda_section_assembler_push (collector->assembler, data, size);
+
+  if (!gst_bda_epg_table_complete (&collector->sdt)) {
+    return FALSE;
+  }
+
+  GHashTableIter iter;
+  gpointer key;
+  g_hash_table_iter_init (&iter, collector->scheduled);
+  while (g_hash_table_iter_next (&iter, &key, NULL)) {
+    if (!gst_bda_epg_collector_service_complete (collector,
+            GPOINTER_TO_UINT (key))) {
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+guint
+gst_bda_epg_collector_get_events (GstBdaEpgCollector * collector)
+{
+  return collector->events;
+}
+
+/* EPG carousel. A hidden tuner element moves through the transponders in
+   turn, staying on each until its EIT schedule is complete. */
+typedef struct _GstBdaEpg GstBdaEpg;
+
+struct _GstBdaEpg {
+  GstBdaSrc *element;
+  /* "transponder" structures */
+  GPtrArray *transponders;
+  GstBdaSrc *tuner;
+  GThread *thread;
+  gboolean started;
+  GMutex lock;
+  GCond cond;
+  /* Protected by lock. */
+  gboolean cancelled;
+  /* Schedule of the current transponder, protected by lock. */
+  GstBdaEpgCollector *collector;
+  gboolean complete;
+  /* Carries packets split between samples, protected by lock. */
+  GstBdaTsAligner aligner;
+};
+
+/* Feeds whole packets of the carousel tuner to the collector. Called with
+   the lock held. */
+static void
+gst_bdasrc_epg_packets (const guint8 * packets, gsize size,
+    gpointer user_data)
+{
+  GstBdaEpg *epg = (GstBdaEpg *) user_data;
+
+  if (!epg->complete) {
+    epg->complete = gst_bda_epg_collector_push (epg->collector, packets,
+        size);
+    if (epg->complete) {
+      g_cond_broadcast (&epg->cond);
+    }
+  }
+}
+
+/* Feeds the samples of the carousel tuner to the schedule of its
+   transponder. */
+static void
+gst_bdasrc_epg_received (GstBdaSrc * tuner, gpointer data, gsize size)
+{
+  GstBdaEpg *epg = tuner->epg_for;
+
+  g_mutex_lock (&epg->lock);
+  if (epg->collector && !epg->complete) {
+    gst_bda_ts_align (&epg->aligner, (const guint8 *) data, size,
+        gst_bdasrc_epg_packets, epg);
+  }
+  g_mutex_unlock (&epg->lock);
+}
+
+/* Tunes the carousel tuner to the transponder and stays until its schedule
+   is complete or epg-timeout passes. Returns TRUE if the tuner locked. */
+static gboolean
+gst_bdasrc_epg_transponder (GstBdaEpg * epg, const GstStructure * transponder)
+{
+  GstBdaSrc *self = epg->element;
+  GstBdaSrc *tuner = epg->tuner;
+
+  gst_bdasrc_configure_transponder (tuner, transponder);
+  gboolean tuned =
+      gst_bdasrc_call (tuner, gst_bdasrc_do_retune, "retune", TRUE);
+  if (tuned && !epg->started) {
+    tuned = epg->started =
+        gst_bdasrc_call (tuner, gst_bdasrc_do_start, "start", TRUE);
+  }
+  gboolean locked = tuned && gst_bdasrc_wait_tuner_lock (tuner,
+      self->scan_lock_timeout, &epg->lock, &epg->cond, &epg->cancelled);
+
+  guint events = 0;
+  gboolean complete = FALSE;
+  if (locked) {
+    g_mutex_lock (&epg->lock);
+    epg->collector = gst_bda_epg_collector_new (self->epg_store);
+    epg->complete = FALSE;
+    gst_bda_ts_aligner_reset (&epg->aligner);
+    gint64 deadline = g_get_monotonic_time () +
+        self->epg_timeout * G_TIME_SPAN_MILLISECOND;
+    while (!epg->complete && !epg->cancelled
+        && g_cond_wait_until (&epg->cond, &epg->lock, deadline));
+    complete = epg->complete;
+    events = gst_bda_epg_collector_get_events (epg->collector);
+    gst_bda_epg_collector_free (epg->collector);
+    epg->collector = NULL;
+    g_mutex_unlock (&epg->lock);
+  }
+
+  GST_INFO_OBJECT (self, "EPG of %d kHz: %s, %u new events%s",
+      tuner->frequency, locked ? "locked" : "no lock", events,
+      locked && !complete ? ", schedule incomplete" : "");
+  gst_element_post_message (GST_ELEMENT (self),
+      gst_message_new_element (GST_OBJECT (self),
+          gst_structure_new ("epg-transponder",
+              "frequency", G_TYPE_INT, tuner->frequency,
+              "locked", G_TYPE_BOOLEAN, locked,
+              "complete", G_TYPE_BOOLEAN, complete,
+              "events", G_TYPE_UINT, events, NULL)));
+
+  return locked;
+}
+
+/* Cycles through the transponders until the carousel is stopped. Events
+   that have ended are dropped after every round. */
+static gpointer
+gst_bdasrc_epg_thread (gpointer data)
+{
+  GstBdaEpg *epg = (GstBdaEpg *) data;
+  guint next = 0;
+  gboolean locked = FALSE;
+
+  g_mutex_lock (&epg->lock);
+  while (!epg->cancelled) {
+    const GstStructure *transponder = (const GstStructure *)
+        g_ptr_array_index (epg->transponders, next);
+    g_mutex_unlock (&epg->lock);
+    locked |= gst_bdasrc_epg_transponder (epg, transponder);
+    g_mutex_lock (&epg->lock);
+
+    next = (next + 1) % epg->transponders->len;
+    if (next > 0) {
+      continue;
+    }
+    gst_bda_epg_store_expire (epg->element->epg_store,
+        g_get_real_time () / G_USEC_PER_SEC);
+    if (!locked) {
+      gint64 deadline = g_get_monotonic_time () + EPG_RETRY_INTERVAL;
+      while (!epg->cancelled
+          && g_cond_wait_until (&epg->cond, &epg->lock, deadline));
+    }
+    locked = FALSE;
+  }
+  g_mutex_unlock (&epg->lock);
+
+  return NULL;
+}
+
+/* Opens the carousel tuner on the element's device. */
+gboolean
+gst_bdasrc_epg_open (GstBdaSrc * self)
+{
+  GPtrArray *transponders = gst_bdasrc_parse_transponders (self,
+      self->epg_transponders);
+  if (transponders->len == 0) {
+    GST_ERROR_OBJECT (self, "No valid transponders in '%s'",
+        self->epg_transponders);
+    g_ptr_array_free (transponders, TRUE);
+    return FALSE;
+  }
+
+  GstBdaSrc *tuner = GST_BDASRC (g_object_new (GST_TYPE_BDASRC, NULL));
+  gst_object_ref_sink (tuner);
+  gst_bdasrc_copy_properties (self, tuner);
+
+  GstBdaEpg *epg = g_new0 (GstBdaEpg, 1);
+  epg->element = self;
+  epg->transponders = transponders;
+  epg->tuner = tuner;
+  g_mutex_init (&epg->lock);
+  g_cond_init (&epg->cond);
+  tuner->epg_for = epg;
+  tuner->sample_received = gst_bdasrc_epg_received;
+  self->epg = epg;
+
+  if (!gst_bdasrc_call (tuner, gst_bdasrc_do_open, "open", TRUE)) {
+    GST_ERROR_OBJECT (self, "Unable to open a tuner for the EPG carousel");
+    gst_bdasrc_epg_close (self);
+    return FALSE;
+  }
+
+  g_mutex_lock (&self->lock);
+  if (!self->epg_store) {
+    self->epg_store = gst_bda_epg_store_new ();
+  }
+  g_mutex_unlock (&self->lock);
+  self->need_tune = FALSE;
+  GST_INFO_OBJECT (self, "EPG carousel over %u transponders",
+      transponders->len);
+
+  return TRUE;
+}
+
+gboolean
+gst_bdasrc_epg_start (GstBdaSrc * self)
+{
+  GstBdaEpg *epg = self->epg;
+
+  g_mutex_lock (&epg->lock);
+  epg->cancelled = FALSE;
+  g_mutex_unlock (&epg->lock);
+  epg->thread = g_thread_new ("bdasrc-epg", gst_bdasrc_epg_thread, epg);
+
+  return TRUE;
+}
+
+/* Stops the carousel and its tuner. */
+void
+gst_bdasrc_epg_stop (GstBdaSrc * self)
+{
+  GstBdaEpg *epg = self->epg;
+
+  g_mutex_lock (&epg->lock);
+  epg->cancelled = TRUE;
+  g_cond_broadcast (&epg->cond);
+  g_mutex_unlock (&epg->lock);
+
+  if (epg->thread) {
+    g_thread_join (epg->thread);
+    epg->thread = NULL;
+  }
+  if (epg->started) {
+    gst_bdasrc_call (epg->tuner, gst_bdasrc_do_stop, "stop", TRUE);
+    epg->started = FALSE;
+  }
+}
+
+void
+gst_bdasrc_epg_close (GstBdaSrc * self)
+{
+  GstBdaEpg *epg = self->epg;
+  if (!epg) {
+    return;
+  }
+
+  gst_bdasrc_epg_stop (self);
+  /* Closes the device on finalize. */
+  gst_object_unref (epg->tuner);
+  g_ptr_array_free (epg->transponders, TRUE);
+  g_mutex_clear (&epg->lock);
+  g_cond_clear (&epg->cond);
+  g_free (epg);
+  self->epg = NULL;
+}
@@ -0,0 +1,102 @@
+/* GStreamer
+ * Copyright (C) 2015 Raimo Järvi <raimo.jarvi@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef __GST_BDAEPG_H__
+#define __GST_BDAEPG_H__
+
+#include "gstbdasrc.h"
+
+/* EIT schedule collection for the EPG carousel, and the store of events it
+   fills, indexed by service and start time. */
+
+typedef struct _GstBdaEpgStore GstBdaEpgStore;
+typedef struct _GstBdaEpgCollector GstBdaEpgCollector;
+
+/**
+ * Creates an empty store. The store has its own lock, so it can be queried
+ * while a collector adds events to it.
+ */
+GstBdaEpgStore *gst_bda_epg_store_new (void);
+void gst_bda_epg_store_free (GstBdaEpgStore * store);
+
+/**
+ * Returns the number of events in the store.
+ */
+guint gst_bda_epg_store_get_size (GstBdaEpgStore * store);
+
+/**
+ * Removes events that ended before time, in seconds since the epoch.
+ */
+void gst_bda_epg_store_expire (GstBdaEpgStore * store, gint64 time);
+
+/**
+ * Appends an "event" structure to events, a GST_TYPE_LIST, for each event
+ * of service_id, or of all services if 0, that overlaps start to end in
+ * seconds since the epoch. An end of 0 has no limit. The structures have
+ * "original-network-id", "transport-stream-id", "service-id", "event-id",
+ * "start" (gint64 seconds since the epoch), "duration" (seconds),
+ * "running-status", "scrambled" and, if the event has a short event
+ * descriptor, "language", "title" and "text". Events of each service are
+ * in start order.
+ * @return the number of events appended
+ */
+guint gst_bda_epg_store_get_events (GstBdaEpgStore * store, guint service_id,
+    gint64 start, gint64 end, GValue * events);
+
+/**
+ * Creates a collector that adds the EIT schedule events of a transponder
+ * to store.
+ */
+GstBdaEpgCollector *gst_bda_epg_collector_new (GstBdaEpgStore * store);
+void gst_bda_epg_collector_free (GstBdaEpgCollector * collector);
+
+/**
+ * Collects the SDT and EIT schedule from whole packets at the start of
+ * data. Sections already received of the current version of their table
+ * are not parsed again.
+ * @return TRUE once the SDT and every section of the schedule of each
+ * service with the EIT schedule flag set are received
+ */
+gboolean gst_bda_epg_collector_push (GstBdaEpgCollector * collector,
+    const guint8 * data, gsize size);
+
+/**
+ * Returns the number of events added to the store by the collector.
+ */
+guint gst_bda_epg_collector_get_events (GstBdaEpgCollector * collector);
+
+/* EPG carousel of the elements with epg-transponders set. These are called
+   on the worker of the element. */
+
+/**
+ * Opens the carousel tuner on the element's device, and creates the store
+ * of the element if it has none.
+ */
+gboolean gst_bdasrc_epg_open (GstBdaSrc * self);
+void gst_bdasrc_epg_close (GstBdaSrc * self);
+
+/**
+ * Starts or stops the thread that moves the tuner through the
+ * transponders, staying on each until its schedule is complete or
+ * epg-timeout passes.
+ */
+gboolean gst_bdasrc_epg_start (GstBdaSrc * self);
+void gst_bdasrc_epg_stop (GstBdaSrc * self);
+
+#endif
@@ -0,0 +1,476 @@
+/* GStreamer
+ * Copyright (C) 2015 Raimo Järvi <raimo.jarvi@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include "gstbdaes.h"
+#include "gstbdapes.h"
+#include "gstbdats.h"
+
+typedef struct _GstBdaEsBuffer GstBdaEsBuffer;
+
+/* A PES packet queued for an es_%u pad and its caps. */
+struct _GstBdaEsBuffer {
+  GstCaps *caps;
+  GstBuffer *buffer;
+};
+
+typedef struct _GstBdaEsPad GstBdaEsPad;
+
+/* An es_%u request pad, the PID it carries and the GstBdaEsBuffers its
+   task pushes. Protected by the lock of src. */
+struct _GstBdaEsPad {
+  GstBdaSrc *src;
+  GstPad *pad;
+  guint16 pid;
+  GQueue buffers;
+  /* Set while the pad is inactive or flushing, the task pauses. */
+  gboolean flushing;
+  /* No more samples, EOS follows the queued buffers. */
+  gboolean eos;
+};
+
+typedef struct _GstBdaEsClock GstBdaEsClock;
+
+/* First ES timestamp of a program and the running time it maps to. */
+struct _GstBdaEsClock {
+  guint16 program;
+  GstClockTime base;
+  GstClockTime base_time;
+};
+
+static void
+gst_bdasrc_es_buffer_free (GstBdaEsBuffer * out)
+{
+  gst_caps_unref (out->caps);
+  gst_buffer_unref (out->buffer);
+  g_free (out);
+}
+
+/* Drops the queued buffers of a pad. Called with the lock held. */
+static void
+gst_bdasrc_es_clear (GstBdaEsPad * es)
+{
+  g_queue_foreach (&es->buffers, (GFunc) gst_bdasrc_es_buffer_free, NULL);
+  g_queue_clear (&es->buffers);
+}
+
+static void
+gst_bdasrc_es_pad_free (GstBdaEsPad * es)
+{
+  gst_bdasrc_es_clear (es);
+  g_free (es);
+}
+
+static GstBdaEsPad *
+gst_bdasrc_find_es_pad (GstBdaSrc * self, guint16 pid)
+{
+  for (GList * l = self->es_pads; l; l = l->next) {
+    if (((GstBdaEsPad *) l->data)->pid == pid) {
+      return (GstBdaEsPad *) l->data;
+    }
+  }
+
+  return NULL;
+}
+
+/* Maps an ES timestamp to running time. Called with the lock held. */
+static GstClockTime
+gst_bdasrc_es_time (GstBdaEsClock * clock, GstClockTime ts)
+{
+  if (!GST_CLOCK_TIME_IS_VALID (ts) || ts + clock->base_time < clock->base) {
+    return GST_CLOCK_TIME_NONE;
+  }
+
+  return ts + clock->base_time - clock->base;
+}
+
+/* Returns the clock of a program, mapping ts to the current running time
+   for a new one. NULL until a timestamp is known. Called with the lock
+   held. */
+static GstBdaEsClock *
+gst_bdasrc_es_clock (GstBdaSrc * self, guint16 program, GstClockTime ts)
+{
+  if (!self->es_clocks) {
+    self->es_clocks = g_array_new (FALSE, FALSE, sizeof (GstBdaEsClock));
+  }
+  for (guint i = 0; i < self->es_clocks->len; i++) {
+    GstBdaEsClock *clock = &g_array_index (self->es_clocks, GstBdaEsClock, i);
+    if (clock->program == program) {
+      return clock;
+    }
+  }
+  if (!GST_CLOCK_TIME_IS_VALID (ts)) {
+    return NULL;
+  }
+
+  GstBdaEsClock clock;
+  clock.program = program;
+  clock.base = ts;
+  clock.base_time = 0;
+  GstClock *element_clock = gst_element_get_clock (GST_ELEMENT (self));
+  if (element_clock) {
+    GstClockTime now = gst_clock_get_time (element_clock);
+    GstClockTime base_time = gst_element_get_base_time (GST_ELEMENT (self));
+    if (now > base_time) {
+      clock.base_time = now - base_time;
+    }
+    gst_object_unref (element_clock);
+  }
+  g_array_append_val (self->es_clocks, clock);
+
+  return &g_array_index (self->es_clocks, GstBdaEsClock,
+      self->es_clocks->len - 1);
+}
+
+/* Queues a PES packet for its es_%u pad. Called with the lock held. */
+static void
+gst_bdasrc_es_buffer (guint16 pid, GstBuffer * buffer, gpointer user_data)
+{
+  GstBdaSrc *self = GST_BDASRC (user_data);
+
+  GstBdaEsPad *es = gst_bdasrc_find_es_pad (self, pid);
+  if (!es || es->flushing || es->eos) {
+    gst_buffer_unref (buffer);
+    return;
+  }
+
+  /* Programs have unrelated timelines. */
+  GstBdaEsClock *clock = gst_bdasrc_es_clock (self,
+      gst_bda_pes_demux_get_program (self->pes_demux, pid),
+      GST_BUFFER_DTS_OR_PTS (buffer));
+  if (clock) {
+    GST_BUFFER_PTS (buffer) = gst_bdasrc_es_time (clock,
+        GST_BUFFER_PTS (buffer));
+    GST_BUFFER_DTS (buffer) = gst_bdasrc_es_time (clock,
+        GST_BUFFER_DTS (buffer));
+  } else {
+    GST_BUFFER_PTS (buffer) = GST_CLOCK_TIME_NONE;
+    GST_BUFFER_DTS (buffer) = GST_CLOCK_TIME_NONE;
+  }
+
+  /* A blocked pad only loses its own oldest buffers. */
+  while (g_queue_get_length (&es->buffers) >= self->buffer_size) {
+    GST_WARNING_OBJECT (self, "Dropping ES buffer of %s",
+        GST_PAD_NAME (es->pad));
+    gst_bdasrc_es_buffer_free ((GstBdaEsBuffer *)
+        g_queue_pop_head (&es->buffers));
+  }
+
+  GstBdaEsBuffer *out = g_new (GstBdaEsBuffer, 1);
+  out->caps = gst_bda_pes_demux_get_caps (self->pes_demux, pid);
+  out->buffer = buffer;
+  g_queue_push_tail (&es->buffers, out);
+  g_cond_broadcast (&self->es_cond);
+}
+
+/* Pushes an ES buffer, preceded by the stream start, caps and segment
+   events its pad hasn't had yet. */
+static GstFlowReturn
+gst_bdasrc_push_es (GstBdaSrc * self, GstPad * pad, GstBdaEsBuffer * out)
+{
+  GstEvent *event = gst_pad_get_sticky_event (pad, GST_EVENT_STREAM_START, 0);
+  if (event) {
+    gst_event_unref (event);
+  } else {
+    gchar *stream_id = gst_pad_create_stream_id (pad, GST_ELEMENT (self),
+        GST_PAD_NAME (pad));
+    event = gst_event_new_stream_start (stream_id);
+    gst_event_set_group_id (event, self->es_group_id);
+    gst_pad_push_event (pad, event);
+    g_free (stream_id);
+  }
+
+  GstCaps *caps = gst_pad_get_current_caps (pad);
+  if (!caps || !gst_caps_is_equal (caps, out->caps)) {
+    gst_pad_push_event (pad, gst_event_new_caps (out->caps));
+  }
+  if (caps) {
+    gst_caps_unref (caps);
+  }
+
+  event = gst_pad_get_sticky_event (pad, GST_EVENT_SEGMENT, 0);
+  if (event) {
+    gst_event_unref (event);
+  } else {
+    GstSegment segment;
+    gst_segment_init (&segment, GST_FORMAT_TIME);
+    gst_pad_push_event (pad, gst_event_new_segment (&segment));
+  }
+
+  GstFlowReturn ret = gst_pad_push (pad, out->buffer);
+  gst_caps_unref (out->caps);
+  g_free (out);
+
+  return ret;
+}
+
+/* Sends EOS on an es_%u pad that has started streaming. */
+static void
+gst_bdasrc_es_push_eos (GstPad * pad)
+{
+  GstEvent *event = gst_pad_get_sticky_event (pad, GST_EVENT_STREAM_START, 0);
+  if (event) {
+    gst_event_unref (event);
+    gst_pad_push_event (pad, gst_event_new_eos ());
+  }
+}
+
+/* Task of an es_%u pad. The pads don't depend on the src pad or on each
+   other, and an unlinked ES pad only drops its own buffers. */
+static void
+gst_bdasrc_es_loop (gpointer user_data)
+{
+  GstBdaEsPad *es = (GstBdaEsPad *) user_data;
+  GstBdaSrc *self = es->src;
+
+  g_mutex_lock (&self->lock);
+  while (g_queue_is_empty (&es->buffers) && !es->flushing && !es->eos) {
+    g_cond_wait (&self->es_cond, &self->lock);
+  }
+  /* Paused under the lock, so that a flush stop restarts it. */
+  if (es->flushing) {
+    gst_pad_pause_task (es->pad);
+    g_mutex_unlock (&self->lock);
+    return;
+  }
+  GstBdaEsBuffer *out = (GstBdaEsBuffer *) g_queue_pop_head (&es->buffers);
+  g_mutex_unlock (&self->lock);
+
+  if (!out) {
+    GST_DEBUG_OBJECT (self, "End of stream on %s", GST_PAD_NAME (es->pad));
+    gst_bdasrc_es_push_eos (es->pad);
+    g_mutex_lock (&self->lock);
+    if (es->eos || es->flushing) {
+      gst_pad_pause_task (es->pad);
+    }
+    g_mutex_unlock (&self->lock);
+    return;
+  }
+
+  GstFlowReturn ret = gst_bdasrc_push_es (self, es->pad, out);
+
+  g_mutex_lock (&self->lock);
+  GstFlowReturn combined =
+      gst_flow_combiner_update_pad_flow (self->es_flow, es->pad, ret);
+  if (combined <= GST_FLOW_EOS) {
+    gst_pad_pause_task (es->pad);
+  }
+  g_mutex_unlock (&self->lock);
+
+  if (ret != GST_FLOW_OK) {
+    GST_DEBUG_OBJECT (self, "Pushing on %s: %s", GST_PAD_NAME (es->pad),
+        gst_flow_get_name (ret));
+  }
+  if (combined <= GST_FLOW_EOS) {
+    GST_DEBUG_OBJECT (self, "Pausing %s: %s", GST_PAD_NAME (es->pad),
+        gst_flow_get_name (combined));
+    if (combined != GST_FLOW_EOS) {
+      GST_ELEMENT_ERROR (self, STREAM, FAILED,
+          ("Internal data stream error."),
+          ("streaming stopped, reason %s", gst_flow_get_name (combined)));
+    }
+    gst_bdasrc_es_push_eos (es->pad);
+  }
+}
+
+static gboolean
+gst_bdasrc_es_activate_mode (GstPad * pad, GstObject * parent,
+    GstPadMode mode, gboolean active)
+{
+  GstBdaSrc *self = GST_BDASRC (parent);
+  GstBdaEsPad *es = (GstBdaEsPad *) gst_pad_get_element_private (pad);
+
+  if (mode != GST_PAD_MODE_PUSH) {
+    return FALSE;
+  }
+
+  g_mutex_lock (&self->lock);
+  es->flushing = !active;
+  es->eos = FALSE;
+  gst_bdasrc_es_clear (es);
+  g_cond_broadcast (&self->es_cond);
+  g_mutex_unlock (&self->lock);
+
+  if (active) {
+    return gst_pad_start_task (pad, gst_bdasrc_es_loop, es, NULL);
+  }
+
+  return gst_pad_stop_task (pad);
+}
+
+void
+gst_bdasrc_es_eos (GstBdaSrc * self)
+{
+  for (GList * l = self->es_pads; l; l = l->next) {
+    ((GstBdaEsPad *) l->data)->eos = TRUE;
+  }
+  g_cond_broadcast (&self->es_cond);
+}
+
+void
+gst_bdasrc_es_flush (GstBdaSrc * self, gboolean flushing)
+{
+  GList *pads = NULL;
+
+  g_mutex_lock (&self->lock);
+  for (GList * l = self->es_pads; l; l = l->next) {
+    GstBdaEsPad *es = (GstBdaEsPad *) l->data;
+    es->flushing = flushing;
+    es->eos = FALSE;
+    gst_bdasrc_es_clear (es);
+    pads = g_list_prepend (pads, gst_object_ref (es->pad));
+  }
+  if (!flushing) {
+    gst_flow_combiner_reset (self->es_flow);
+  }
+  g_cond_broadcast (&self->es_cond);
+  g_mutex_unlock (&self->lock);
+
+  for (GList * l = pads; l; l = l->next) {
+    GstPad *pad = (GstPad *) l->data;
+    if (flushing) {
+      gst_pad_push_event (pad, gst_event_new_flush_start ());
+    } else {
+      gst_pad_push_event (pad, gst_event_new_flush_stop (TRUE));
+      /* Inactive pads start their task on activation. */
+      if (GST_PAD_MODE (pad) == GST_PAD_MODE_PUSH) {
+        gst_pad_start_task (pad, gst_bdasrc_es_loop,
+            gst_pad_get_element_private (pad), NULL);
+      }
+    }
+    gst_object_unref (pad);
+  }
+  g_list_free (pads);
+}
+
+void
+gst_bdasrc_es_init (GstBdaSrc * self)
+{
+  self->es_pads = NULL;
+  g_cond_init (&self->es_cond);
+  self->pes_demux = NULL;
+  self->es_flow = gst_flow_combiner_new ();
+  self->es_clocks = NULL;
+  self->es_group_id = gst_util_group_id_next ();
+}
+
+void
+gst_bdasrc_es_free (GstBdaSrc * self)
+{
+  /* Pads are released, and their tasks stopped, before finalize. */
+  g_list_free_full (self->es_pads, (GDestroyNotify) gst_bdasrc_es_pad_free);
+  g_cond_clear (&self->es_cond);
+  gst_bda_pes_demux_free (self->pes_demux);
+  gst_flow_combiner_free (self->es_flow);
+  if (self->es_clocks) {
+    g_array_free (self->es_clocks, TRUE);
+  }
+}
+
+void
+gst_bdasrc_es_push (GstBdaSrc * self, GstBuffer * buffer)
+{
+  if (self->pes_demux && !self->flushing) {
+    gst_bda_pes_demux_push (self->pes_demux, buffer);
+  }
+}
+
+void
+gst_bdasrc_es_reset (GstBdaSrc * self)
+{
+  if (self->pes_demux) {
+    gst_bda_pes_demux_reset (self->pes_demux);
+  }
+  for (GList * l = self->es_pads; l; l = l->next) {
+    gst_bdasrc_es_clear ((GstBdaEsPad *) l->data);
+  }
+  if (self->es_clocks) {
+    g_array_set_size (self->es_clocks, 0);
+  }
+}
+
+GstPad *
+gst_bdasrc_request_new_pad (GstElement * element, GstPadTemplate * templ,
+    const gchar * name, const GstCaps * /*caps */ )
+{
+  GstBdaSrc *self = GST_BDASRC (element);
+
+  gchar *end = NULL;
+  guint64 pid = name && g_str_has_prefix (name, "es_") ?
+      g_ascii_strtoull (name + 3, &end, 10) : G_MAXUINT64;
+  if (!end || end == name + 3 || *end || pid >= GST_BDA_TS_NULL_PID) {
+    GST_ERROR_OBJECT (self, "Invalid pad name '%s', expected es_<PID>",
+        GST_STR_NULL (name));
+    return NULL;
+  }
+
+  g_mutex_lock (&self->lock);
+  if (gst_bdasrc_find_es_pad (self, (guint16) pid)) {
+    g_mutex_unlock (&self->lock);
+    GST_ERROR_OBJECT (self, "PID %u already has a pad", (guint) pid);
+    return NULL;
+  }
+  GstPad *pad = gst_pad_new_from_template (templ, name);
+  gst_pad_use_fixed_caps (pad);
+  GstBdaEsPad *es = g_new (GstBdaEsPad, 1);
+  es->src = self;
+  es->pad = pad;
+  es->pid = (guint16) pid;
+  g_queue_init (&es->buffers);
+  es->flushing = TRUE;
+  es->eos = FALSE;
+  gst_pad_set_element_private (pad, es);
+  gst_pad_set_activatemode_function (pad, gst_bdasrc_es_activate_mode);
+  self->es_pads = g_list_append (self->es_pads, es);
+  gst_flow_combiner_add_pad (self->es_flow, pad);
+  if (!self->pes_demux) {
+    self->pes_demux = gst_bda_pes_demux_new (gst_bdasrc_es_buffer, self);
+  }
+  gst_bda_pes_demux_add_pid (self->pes_demux, es->pid);
+  g_mutex_unlock (&self->lock);
+
+  GST_DEBUG_OBJECT (self, "Added pad %s for PID %u", name, (guint) pid);
+  /* Activated here if the element is already running. */
+  gst_element_add_pad (element, pad);
+
+  return pad;
+}
+
+void
+gst_bdasrc_release_pad (GstElement * element, GstPad * pad)
+{
+  GstBdaSrc *self = GST_BDASRC (element);
+
+  /* Stops the task before its state is freed. */
+  gst_pad_set_active (pad, FALSE);
+
+  g_mutex_lock (&self->lock);
+  for (GList * l = self->es_pads; l; l = l->next) {
+    GstBdaEsPad *es = (GstBdaEsPad *) l->data;
+    if (es->pad == pad) {
+      gst_bda_pes_demux_remove_pid (self->pes_demux, es->pid);
+      gst_flow_combiner_remove_pad (self->es_flow, pad);
+      self->es_pads = g_list_delete_link (self->es_pads, l);
+      gst_bdasrc_es_pad_free (es);
+      break;
+    }
+  }
+  g_mutex_unlock (&self->lock);
+
+  gst_element_remove_pad (element, pad);
+}
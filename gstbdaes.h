@@ -0,0 +1,61 @@
+/* GStreamer
+ * Copyright (C) 2015 Raimo Järvi <raimo.jarvi@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef __GST_BDAES_H__
+#define __GST_BDAES_H__
+
+#include "gstbdasrc.h"
+
+/* es_%u request pads, see gstbdaes.cpp. Each pad pushes the PES packets
+   of its PID from its own task. */
+
+void gst_bdasrc_es_init (GstBdaSrc * self);
+void gst_bdasrc_es_free (GstBdaSrc * self);
+
+/**
+ * GstElement::request_new_pad and GstElement::release_pad of the element.
+ */
+GstPad *gst_bdasrc_request_new_pad (GstElement * element,
+    GstPadTemplate * templ, const gchar * name, const GstCaps * caps);
+void gst_bdasrc_release_pad (GstElement * element, GstPad * pad);
+
+/**
+ * Reassembles the PES packets of the es_%u pads from a received sample
+ * and queues them for the pads. Called with the lock held.
+ */
+void gst_bdasrc_es_push (GstBdaSrc * self, GstBuffer * buffer);
+
+/**
+ * Drops the queued and partial PES packets and the timelines, e.g. after
+ * tuning to another multiplex. Called with the lock held.
+ */
+void gst_bdasrc_es_reset (GstBdaSrc * self);
+
+/**
+ * Sends EOS on the es_%u pads once their queues are drained. Called with
+ * the lock held.
+ */
+void gst_bdasrc_es_eos (GstBdaSrc * self);
+
+/**
+ * Starts or stops flushing the es_%u pads along with the src pad.
+ */
+void gst_bdasrc_es_flush (GstBdaSrc * self, gboolean flushing);
+
+#endif
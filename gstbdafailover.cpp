@@ -0,0 +1,475 @@
+/* GStreamer
+ * Copyright (C) 2015 Raimo Järvi <raimo.jarvi@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include "gstbdafailover.h"
+#include "gstbdatuner.h"
+#include "gstbdats.h"
+#include <string.h>
+
+/* Health check interval. */
+#define FAILOVER_POLL (50 * G_TIME_SPAN_MILLISECOND)
+
+/* Hot standby. A hidden standby element runs a second tuner on the same
+   transponder, and the samples of both tuners go through the failover,
+   which delivers whole packets of the active one to the element. */
+typedef struct _GstBdaFailoverSource GstBdaFailoverSource;
+
+struct _GstBdaFailoverSource {
+  /* Start of the incomplete packet at the end of the last sample. */
+  guint8 carry[GST_BDA_TS_PACKET_SIZE];
+  gsize carry_size;
+  /* Last continuity counter per PID, 0xff if none yet. */
+  guint8 cc[GST_BDA_TS_NULL_PID];
+  /* Continuity errors in the current one second window. */
+  guint cc_errors;
+  /* Monotonic time of the last sample. */
+  gint64 last_sample;
+  /* Signal lock read in progress, only used by the monitor. A new one is
+     only queued once it completes, so a hung worker doesn't pile them
+     up. */
+  GstBdaWorkerCommand *poll;
+  GstBdaSignalQuery *query;
+  gint64 poll_deadline;
+  /* Result of the last completed read. */
+  gboolean locked;
+};
+
+typedef struct _GstBdaFailover GstBdaFailover;
+
+struct _GstBdaFailover {
+  GstBdaSrc *primary;
+  GstBdaSrc *standby;
+  /* Sample callback of the primary element before the failover. */
+  void (*deliver) (GstBdaSrc * src, gpointer data, gsize size);
+
+  GMutex lock;
+  GCond cond;
+  /* The primary tuner and the standby tuner. */
+  GstBdaFailoverSource sources[2];
+  /* Index of the source delivering output. */
+  guint active;
+  /* The next delivered sample follows a switch. */
+  gboolean discont;
+  /* Whole packets of the active source are gathered here. */
+  guint8 *scratch;
+  gsize scratch_size;
+  GThread *monitor;
+  gboolean running;
+};
+
+/* Resets the packet and health state of both sources, called with the
+   failover lock. */
+static void
+gst_bdasrc_failover_reset (GstBdaFailover * failover)
+{
+  gint64 now = g_get_monotonic_time ();
+
+  for (guint i = 0; i < G_N_ELEMENTS (failover->sources); i++) {
+    GstBdaFailoverSource *source = &failover->sources[i];
+    source->carry_size = 0;
+    memset (source->cc, 0xff, sizeof (source->cc));
+    source->cc_errors = 0;
+    /* Stalls are only detected failover-timeout after (re)starting. */
+    source->last_sample = now;
+  }
+}
+
+static void
+gst_bdasrc_failover_check_packet (GstBdaFailoverSource * source,
+    const guint8 * packet)
+{
+  guint16 pid = gst_bda_ts_pid (packet);
+  if (pid == GST_BDA_TS_NULL_PID || !gst_bda_ts_has_payload (packet)) {
+    return;
+  }
+
+  /* A repeated counter is a duplicate packet. */
+  guint8 cc = gst_bda_ts_cc (packet);
+  guint8 last = source->cc[pid];
+  if (last <= 0x0f && cc != last && cc != ((last + 1) & 0x0f)) {
+    source->cc_errors++;
+  }
+  source->cc[pid] = cc;
+}
+
+/* Checks the continuity of the whole packets in a sample and copies them to
+   out unless it is NULL. The incomplete packet at the end is kept in carry,
+   so out must hold carry_size + size bytes. Returns the number of bytes
+   copied. */
+static gsize
+gst_bdasrc_failover_scan (GstBdaFailoverSource * source, const guint8 * data,
+    gsize size, guint8 * out)
+{
+  gsize copied = 0;
+  gsize i = 0;
+
+  if (source->carry_size > 0) {
+    i = MIN (GST_BDA_TS_PACKET_SIZE - source->carry_size, size);
+    memcpy (source->carry + source->carry_size, data, i);
+    source->carry_size += i;
+    if (source->carry_size < GST_BDA_TS_PACKET_SIZE) {
+      return 0;
+    }
+    source->carry_size = 0;
+    gst_bdasrc_failover_check_packet (source, source->carry);
+    if (out) {
+      memcpy (out, source->carry, GST_BDA_TS_PACKET_SIZE);
+      copied = GST_BDA_TS_PACKET_SIZE;
+    }
+  }
+
+  while (i < size) {
+    gsize start = i;
+    while (i + GST_BDA_TS_PACKET_SIZE <= size
+        && data[i] == GST_BDA_TS_SYNC_BYTE) {
+      gst_bdasrc_failover_check_packet (source, data + i);
+      i += GST_BDA_TS_PACKET_SIZE;
+    }
+    if (out && i > start) {
+      memcpy (out + copied, data + start, i - start);
+      copied += i - start;
+    }
+
+    if (i >= size) {
+      break;
+    } else if (data[i] == GST_BDA_TS_SYNC_BYTE) {
+      source->carry_size = size - i;
+      memcpy (source->carry, data + i, source->carry_size);
+      break;
+    }
+
+    /* Lost sync, skip to the next sync byte. */
+    const guint8 *sync = (const guint8 *) memchr (data + i + 1,
+        GST_BDA_TS_SYNC_BYTE, size - i - 1);
+    if (!sync) {
+      break;
+    }
+    i = sync - data;
+  }
+
+  return copied;
+}
+
+static void
+gst_bdasrc_failover_received (GstBdaFailover * failover, guint index,
+    gpointer data, gsize size)
+{
+  GstBdaFailoverSource *source = &failover->sources[index];
+
+  g_mutex_lock (&failover->lock);
+  source->last_sample = g_get_monotonic_time ();
+
+  if (index != failover->active) {
+    gst_bdasrc_failover_scan (source, (const guint8 *) data, size, NULL);
+    g_mutex_unlock (&failover->lock);
+    return;
+  }
+
+  if (failover->scratch_size < source->carry_size + size) {
+    failover->scratch_size = source->carry_size + size;
+    g_free (failover->scratch);
+    failover->scratch = (guint8 *) g_malloc (failover->scratch_size);
+  }
+
+  gsize copied = gst_bdasrc_failover_scan (source, (const guint8 *) data,
+      size, failover->scratch);
+  if (copied > 0) {
+    GstBdaSrc *primary = failover->primary;
+    primary->sample_discont = failover->discont;
+    failover->discont = FALSE;
+    failover->deliver (primary, failover->scratch, copied);
+    primary->sample_discont = FALSE;
+  }
+  g_mutex_unlock (&failover->lock);
+}
+
+static void
+gst_bdasrc_failover_primary_received (GstBdaSrc * self, gpointer data,
+    gsize size)
+{
+  gst_bdasrc_failover_received (self->failover, 0, data, size);
+}
+
+static void
+gst_bdasrc_failover_standby_received (GstBdaSrc * standby, gpointer data,
+    gsize size)
+{
+  gst_bdasrc_failover_received (standby->standby_for, 1, data, size);
+}
+
+/* Polls the signal lock status of a tuner without waiting for its worker,
+   so that a busy device doesn't hold up the monitor. Returns the status of
+   the last read while one is in progress, and no lock once a read misses
+   failover-timeout. An unknown status counts as locked, stalls are detected
+   from the samples. */
+static gboolean
+gst_bdasrc_failover_poll (GstBdaSrc * self, GstBdaSrc * src,
+    GstBdaFailoverSource * source)
+{
+  gint64 now = g_get_monotonic_time ();
+
+  if (source->poll && gst_bda_worker_command_is_done (source->poll)) {
+    gboolean result = FALSE;
+    if (!gst_bda_worker_command_wait (source->poll, 0, &result)) {
+      /* Dropped past its deadline. */
+      source->locked = FALSE;
+    } else {
+      source->locked = !result || source->query->locked;
+    }
+    gst_bda_worker_command_unref (source->poll);
+    source->poll = NULL;
+  } else if (source->poll) {
+    return source->locked && now < source->poll_deadline;
+  }
+
+  source->query = g_new0 (GstBdaSignalQuery, 1);
+  source->query->src = src;
+  source->poll_deadline = now +
+      self->failover_timeout * G_TIME_SPAN_MILLISECOND;
+  source->poll = gst_bda_worker_push (src->worker,
+      gst_bdasrc_do_get_signal_locked, source->query, g_free,
+      source->poll_deadline);
+
+  return source->locked;
+}
+
+/* Releases the read in progress, which completes on its own. */
+static void
+gst_bdasrc_failover_poll_clear (GstBdaFailoverSource * source)
+{
+  if (source->poll) {
+    gst_bda_worker_command_unref (source->poll);
+    source->poll = NULL;
+  }
+  source->query = NULL;
+  source->locked = TRUE;
+}
+
+/* Returns why the source should not deliver output, NULL if it is healthy.
+   Called with the failover lock. */
+static const gchar *
+gst_bdasrc_failover_fault (GstBdaSrc * self, GstBdaFailoverSource * source,
+    gboolean locked, gint64 now)
+{
+  if (!locked) {
+    return "lock-lost";
+  } else if (now - source->last_sample >
+      self->failover_timeout * G_TIME_SPAN_MILLISECOND) {
+    return "stall";
+  } else if (self->failover_cc_errors > 0
+      && source->cc_errors >= self->failover_cc_errors) {
+    return "cc-errors";
+  }
+
+  return NULL;
+}
+
+/* Switches output to the other tuner when the active one fails and the
+   other one is healthy. Output stays on the new tuner after the old one
+   recovers. */
+static gpointer
+gst_bdasrc_failover_monitor (gpointer data)
+{
+  GstBdaFailover *failover = (GstBdaFailover *) data;
+  GstBdaSrc *self = failover->primary;
+  gint64 window_end = g_get_monotonic_time () + G_TIME_SPAN_SECOND;
+
+  g_mutex_lock (&failover->lock);
+  while (failover->running) {
+    gint64 end_time = g_get_monotonic_time () + FAILOVER_POLL;
+    g_cond_wait_until (&failover->cond, &failover->lock, end_time);
+    if (!failover->running) {
+      break;
+    }
+    g_mutex_unlock (&failover->lock);
+
+    gboolean locked[2];
+    locked[0] = gst_bdasrc_failover_poll (self, self, &failover->sources[0]);
+    locked[1] = gst_bdasrc_failover_poll (self, failover->standby,
+        &failover->sources[1]);
+
+    g_mutex_lock (&failover->lock);
+    gint64 now = g_get_monotonic_time ();
+    guint active = failover->active;
+    const gchar *reason = gst_bdasrc_failover_fault (self,
+        &failover->sources[active], locked[active], now);
+    gboolean switched = reason && !gst_bdasrc_failover_fault (self,
+        &failover->sources[!active], locked[!active], now);
+    if (switched) {
+      failover->active = !active;
+      failover->discont = TRUE;
+    }
+    if (now >= window_end) {
+      failover->sources[0].cc_errors = 0;
+      failover->sources[1].cc_errors = 0;
+      window_end = now + G_TIME_SPAN_SECOND;
+    }
+
+    if (switched) {
+      g_mutex_unlock (&failover->lock);
+      GstBdaSrc *to = active ? self : failover->standby;
+      GST_WARNING_OBJECT (self, "Switching to %s tuner, device %d: %s",
+          active ? "primary" : "standby", to->selected_device, reason);
+      gst_element_post_message (GST_ELEMENT (self),
+          gst_message_new_element (GST_OBJECT (self),
+              gst_structure_new ("failover",
+                  "device", G_TYPE_INT, to->selected_device,
+                  "reason", G_TYPE_STRING, reason, NULL)));
+      g_mutex_lock (&failover->lock);
+    }
+  }
+  g_mutex_unlock (&failover->lock);
+
+  gst_bdasrc_failover_poll_clear (&failover->sources[0]);
+  gst_bdasrc_failover_poll_clear (&failover->sources[1]);
+
+  return NULL;
+}
+
+/* Sets the properties of the standby element from the primary one. */
+static void
+gst_bdasrc_failover_configure (GstBdaSrc * self, GstBdaSrc * standby)
+{
+  gst_bdasrc_copy_properties (self, standby);
+  standby->device_index = self->standby_device;
+  if (self->input_type != GST_BDA_UNKNOWN) {
+    standby->device_type = self->input_type;
+  }
+}
+
+/* Opens the standby tuner after the primary device. Without it the element
+   runs without failover. */
+void
+gst_bdasrc_failover_open (GstBdaSrc * self)
+{
+  GstBdaFailover *failover = g_new0 (GstBdaFailover, 1);
+  failover->primary = self;
+  g_mutex_init (&failover->lock);
+  g_cond_init (&failover->cond);
+
+  GstBdaSrc *standby = GST_BDASRC (g_object_new (GST_TYPE_BDASRC, NULL));
+  gst_object_ref_sink (standby);
+  gst_bdasrc_failover_configure (self, standby);
+  standby->standby_for = failover;
+  standby->sample_received = gst_bdasrc_failover_standby_received;
+  failover->standby = standby;
+
+  if (!gst_bdasrc_call (standby, gst_bdasrc_do_open, "open", TRUE)) {
+    GST_ELEMENT_WARNING (self, RESOURCE, OPEN_READ,
+        ("Unable to open the standby tuner, running without failover"),
+        (NULL));
+    gst_object_unref (standby);
+    g_mutex_clear (&failover->lock);
+    g_cond_clear (&failover->cond);
+    g_free (failover);
+    return;
+  }
+
+  GST_INFO_OBJECT (self, "Opened standby tuner, device %d",
+      standby->selected_device);
+  failover->deliver = self->sample_received;
+  self->sample_received = gst_bdasrc_failover_primary_received;
+  self->failover = failover;
+}
+
+void
+gst_bdasrc_failover_close (GstBdaSrc * self)
+{
+  GstBdaFailover *failover = self->failover;
+  if (!failover) {
+    return;
+  }
+
+  gst_bdasrc_failover_stop (self);
+  /* Closes the standby device on finalize. */
+  gst_object_unref (failover->standby);
+
+  self->sample_received = failover->deliver;
+  self->failover = NULL;
+  g_mutex_clear (&failover->lock);
+  g_cond_clear (&failover->cond);
+  g_free (failover->scratch);
+  g_free (failover);
+}
+
+/* Starts the standby tuner and the monitor after the primary device. */
+void
+gst_bdasrc_failover_start (GstBdaSrc * self)
+{
+  GstBdaFailover *failover = self->failover;
+  if (!failover || failover->monitor) {
+    return;
+  }
+
+  if (!gst_bdasrc_call (failover->standby, gst_bdasrc_do_start, "start",
+          TRUE)) {
+    GST_WARNING_OBJECT (self, "Unable to start the standby tuner");
+  }
+
+  g_mutex_lock (&failover->lock);
+  gst_bdasrc_failover_reset (failover);
+  failover->active = 0;
+  failover->running = TRUE;
+  g_mutex_unlock (&failover->lock);
+  gst_bdasrc_failover_poll_clear (&failover->sources[0]);
+  gst_bdasrc_failover_poll_clear (&failover->sources[1]);
+
+  failover->monitor =
+      g_thread_new ("bdasrc-failover", gst_bdasrc_failover_monitor, failover);
+}
+
+/* Stops the monitor and the standby tuner. The monitor never waits for a
+   worker, so it can be stopped from a worker. */
+void
+gst_bdasrc_failover_stop (GstBdaSrc * self)
+{
+  GstBdaFailover *failover = self->failover;
+  if (!failover || !failover->monitor) {
+    return;
+  }
+
+  g_mutex_lock (&failover->lock);
+  failover->running = FALSE;
+  g_cond_signal (&failover->cond);
+  g_mutex_unlock (&failover->lock);
+  g_thread_join (failover->monitor);
+  failover->monitor = NULL;
+
+  gst_bdasrc_call (failover->standby, gst_bdasrc_do_stop, "stop", TRUE);
+}
+
+/* Moves the standby tuner to the new tuning properties. */
+void
+gst_bdasrc_failover_retune (GstBdaSrc * self)
+{
+  GstBdaFailover *failover = self->failover;
+  if (!failover) {
+    return;
+  }
+
+  gst_bdasrc_failover_configure (self, failover->standby);
+  if (!gst_bdasrc_call (failover->standby, gst_bdasrc_do_retune, "retune",
+          TRUE)) {
+    GST_WARNING_OBJECT (self, "Unable to retune the standby tuner");
+  }
+
+  g_mutex_lock (&failover->lock);
+  gst_bdasrc_failover_reset (failover);
+  g_mutex_unlock (&failover->lock);
+}
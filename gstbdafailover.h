@@ -0,0 +1,48 @@
+/* GStreamer
+ * Copyright (C) 2015 Raimo Järvi <raimo.jarvi@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef __GST_BDAFAILOVER_H__
+#define __GST_BDAFAILOVER_H__
+
+#include "gstbdasrc.h"
+
+/* Hot standby of the elements with standby enabled, see
+   gstbdafailover.cpp. */
+
+/**
+ * Opens the standby tuner after the primary device. Without it the element
+ * runs without failover.
+ */
+void gst_bdasrc_failover_open (GstBdaSrc * self);
+void gst_bdasrc_failover_close (GstBdaSrc * self);
+
+/**
+ * Starts and stops the standby tuner and the monitor along with the
+ * primary device. Stopping never waits for a worker of the element, so it
+ * can be done from one.
+ */
+void gst_bdasrc_failover_start (GstBdaSrc * self);
+void gst_bdasrc_failover_stop (GstBdaSrc * self);
+
+/**
+ * Moves the standby tuner to the new tuning properties.
+ */
+void gst_bdasrc_failover_retune (GstBdaSrc * self);
+
+#endif
@@ -0,0 +1,345 @@
+/* GStreamer
+ * Copyright (C) 2015 Raimo Järvi <raimo.jarvi@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include "gstbdagopcache.h"
+#include "gstbdapsicache.h"
+#include "gstbdats.h"
+#include <string.h>
+
+#define PAT_PID 0
+#define PAT_TABLE_ID 0x00
+#define PMT_TABLE_ID 0x02
+
+typedef struct _GstBdaGopProgram GstBdaGopProgram;
+
+struct _GstBdaGopProgram {
+  guint16 pmt_pid;
+  guint8 pmt[GST_BDA_TS_PACKET_SIZE];
+  gboolean have_pmt;
+  /* Stream whose random access points restart the cache: the first video
+     stream, or the first stream if there is no video. */
+  guint16 key_pid;
+  guint8 key_type;
+  /* Packets since the last random access point of key_pid. */
+  GByteArray *packets;
+  gboolean have_rap;
+};
+
+struct _GstBdaGopCache {
+  gsize max_size;
+  guint8 pat[GST_BDA_TS_PACKET_SIZE];
+  gboolean have_pat;
+  GPtrArray *programs;
+  /* PMT PID -> program */
+  GHashTable *pmt_pids;
+  /* Elementary stream and PCR PID -> GSList of programs */
+  GHashTable *stream_pids;
+  /* Start of a packet split between samples. */
+  guint8 carry[GST_BDA_TS_PACKET_SIZE];
+  gsize carry_size;
+};
+
+static void
+gst_bda_gop_program_free (GstBdaGopProgram * program)
+{
+  g_byte_array_free (program->packets, TRUE);
+  g_free (program);
+}
+
+GstBdaGopCache *
+gst_bda_gop_cache_new (gsize max_size)
+{
+  GstBdaGopCache *cache = g_new0 (GstBdaGopCache, 1);
+  cache->max_size = max_size;
+  cache->programs =
+      g_ptr_array_new_with_free_func ((GDestroyNotify)
+      gst_bda_gop_program_free);
+  cache->pmt_pids = g_hash_table_new (g_direct_hash, g_direct_equal);
+  cache->stream_pids = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+      NULL, (GDestroyNotify) g_slist_free);
+
+  return cache;
+}
+
+void
+gst_bda_gop_cache_free (GstBdaGopCache * cache)
+{
+  if (!cache) {
+    return;
+  }
+
+  g_hash_table_destroy (cache->stream_pids);
+  g_hash_table_destroy (cache->pmt_pids);
+  g_ptr_array_free (cache->programs, TRUE);
+  g_free (cache);
+}
+
+/* Returns the section of a current single section table with table_id. */
+static const guint8 *
+gst_bda_gop_cache_get_table (const guint8 * packet, guint8 table_id,
+    gsize * size)
+{
+  const guint8 *section = gst_bda_psi_get_section (packet, size);
+  if (!section || section[0] != table_id || !(section[5] & 0x01)
+      || section[6] != 0 || section[7] != 0) {
+    return NULL;
+  }
+
+  return section;
+}
+
+/* Maps the stream PIDs of every program with a PMT. */
+static void
+gst_bda_gop_cache_map_streams (GstBdaGopCache * cache)
+{
+  g_hash_table_remove_all (cache->stream_pids);
+
+  for (guint i = 0; i < cache->programs->len; i++) {
+    GstBdaGopProgram *program =
+        (GstBdaGopProgram *) g_ptr_array_index (cache->programs, i);
+    gsize size;
+    const guint8 *section = program->have_pmt ?
+        gst_bda_gop_cache_get_table (program->pmt, PMT_TABLE_ID, &size) : NULL;
+    if (!section) {
+      continue;
+    }
+
+    guint16 pcr_pid = ((section[8] & 0x1f) << 8) | section[9];
+    gsize offset = 12 + (((section[10] & 0x0f) << 8) | section[11]);
+    GSList *pids = g_slist_prepend (NULL, GUINT_TO_POINTER (pcr_pid));
+    program->key_pid = GST_BDA_TS_NULL_PID;
+    program->key_type = 0;
+    /* Stream loop up to the CRC. */
+    while (offset + 5 <= size - 4) {
+      guint8 type = section[offset];
+      guint16 pid = ((section[offset + 1] & 0x1f) << 8) | section[offset + 2];
+      if (program->key_pid == GST_BDA_TS_NULL_PID
+          || (!gst_bda_ts_is_video (program->key_type)
+              && gst_bda_ts_is_video (type))) {
+        program->key_pid = pid;
+        program->key_type = type;
+      }
+      if (!g_slist_find (pids, GUINT_TO_POINTER (pid))) {
+        pids = g_slist_prepend (pids, GUINT_TO_POINTER (pid));
+      }
+      offset += 5 + (((section[offset + 3] & 0x0f) << 8) | section[offset + 4]);
+    }
+
+    for (GSList * l = pids; l; l = l->next) {
+      GSList *programs = (GSList *) g_hash_table_lookup (cache->stream_pids,
+          l->data);
+      g_hash_table_steal (cache->stream_pids, l->data);
+      g_hash_table_insert (cache->stream_pids, l->data,
+          g_slist_prepend (programs, program));
+    }
+    g_slist_free (pids);
+  }
+}
+
+/* Replaces the programs with the ones listed in a new PAT. */
+static void
+gst_bda_gop_cache_set_pat (GstBdaGopCache * cache, const guint8 * packet,
+    const guint8 * section, gsize size)
+{
+  memcpy (cache->pat, packet, GST_BDA_TS_PACKET_SIZE);
+  cache->have_pat = TRUE;
+
+  g_hash_table_remove_all (cache->stream_pids);
+  g_hash_table_remove_all (cache->pmt_pids);
+  g_ptr_array_set_size (cache->programs, 0);
+  /* Programs follow the 8 byte header and precede the CRC. */
+  for (gsize i = 8; i + 4 <= size - 4; i += 4) {
+    guint16 number = (section[i] << 8) | section[i + 1];
+    guint16 pid = ((section[i + 2] & 0x1f) << 8) | section[i + 3];
+    /* Program 0 is the network PID. */
+    if (number == 0
+        || g_hash_table_contains (cache->pmt_pids, GUINT_TO_POINTER (pid))) {
+      continue;
+    }
+
+    GstBdaGopProgram *program = g_new0 (GstBdaGopProgram, 1);
+    program->pmt_pid = pid;
+    program->key_pid = GST_BDA_TS_NULL_PID;
+    program->packets = g_byte_array_new ();
+    g_ptr_array_add (cache->programs, program);
+    g_hash_table_insert (cache->pmt_pids, GUINT_TO_POINTER (pid), program);
+  }
+}
+
+/* Appends an elementary stream packet to a program's cache. */
+static void
+gst_bda_gop_cache_add (GstBdaGopCache * cache, GstBdaGopProgram * program,
+    const guint8 * packet)
+{
+  guint16 pid = gst_bda_ts_pid (packet);
+  if (pid == program->key_pid
+      && (gst_bda_ts_is_random_access (packet, program->key_type)
+          || (!gst_bda_ts_is_video (program->key_type)
+              && gst_bda_ts_pusi (packet)))) {
+    g_byte_array_set_size (program->packets, 0);
+    program->have_rap = TRUE;
+  }
+  if (!program->have_rap) {
+    return;
+  }
+
+  if (program->packets->len + GST_BDA_TS_PACKET_SIZE > cache->max_size) {
+    /* Wait for the next random access point. */
+    g_byte_array_set_size (program->packets, 0);
+    program->have_rap = FALSE;
+    return;
+  }
+  g_byte_array_append (program->packets, packet, GST_BDA_TS_PACKET_SIZE);
+}
+
+static void
+gst_bda_gop_cache_push_packet (GstBdaGopCache * cache, const guint8 * packet)
+{
+  if (gst_bda_ts_tei (packet)) {
+    return;
+  }
+
+  guint16 pid = gst_bda_ts_pid (packet);
+  gpointer key = GUINT_TO_POINTER (pid);
+  GSList *programs = (GSList *) g_hash_table_lookup (cache->stream_pids, key);
+  if (programs) {
+    for (GSList * l = programs; l; l = l->next) {
+      gst_bda_gop_cache_add (cache, (GstBdaGopProgram *) l->data, packet);
+    }
+    return;
+  }
+
+  /* Tables are kept with the continuity counter cleared, so that
+     repetitions compare equal. */
+  guint8 table[GST_BDA_TS_PACKET_SIZE];
+  const guint8 *section;
+  gsize size;
+  if (pid == PAT_PID) {
+    memcpy (table, packet, GST_BDA_TS_PACKET_SIZE);
+    table[3] &= 0xf0;
+    section = gst_bda_gop_cache_get_table (table, PAT_TABLE_ID, &size);
+    if (section && (!cache->have_pat
+            || memcmp (cache->pat, table, GST_BDA_TS_PACKET_SIZE))) {
+      gst_bda_gop_cache_set_pat (cache, table, section, size);
+    }
+    return;
+  }
+
+  GstBdaGopProgram *program =
+      (GstBdaGopProgram *) g_hash_table_lookup (cache->pmt_pids, key);
+  if (!program) {
+    return;
+  }
+  memcpy (table, packet, GST_BDA_TS_PACKET_SIZE);
+  table[3] &= 0xf0;
+  section = gst_bda_gop_cache_get_table (table, PMT_TABLE_ID, &size);
+  if (section && (!program->have_pmt
+          || memcmp (program->pmt, table, GST_BDA_TS_PACKET_SIZE))) {
+    memcpy (program->pmt, table, GST_BDA_TS_PACKET_SIZE);
+    program->have_pmt = TRUE;
+    g_byte_array_set_size (program->packets, 0);
+    program->have_rap = FALSE;
+    gst_bda_gop_cache_map_streams (cache);
+  }
+}
+
+void
+gst_bda_gop_cache_push (GstBdaGopCache * cache, const guint8 * data,
+    gsize size)
+{
+  while (size > 0) {
+    if (cache->carry_size > 0) {
+      gsize n = MIN (size, GST_BDA_TS_PACKET_SIZE - cache->carry_size);
+      memcpy (cache->carry + cache->carry_size, data, n);
+      cache->carry_size += n;
+      data += n;
+      size -= n;
+      if (cache->carry_size < GST_BDA_TS_PACKET_SIZE) {
+        return;
+      }
+      gst_bda_gop_cache_push_packet (cache, cache->carry);
+      cache->carry_size = 0;
+      continue;
+    }
+
+    if (data[0] != GST_BDA_TS_SYNC_BYTE) {
+      const guint8 *sync =
+          (const guint8 *) memchr (data, GST_BDA_TS_SYNC_BYTE, size);
+      if (!sync) {
+        return;
+      }
+      size -= sync - data;
+      data = sync;
+      continue;
+    }
+
+    if (size < GST_BDA_TS_PACKET_SIZE) {
+      memcpy (cache->carry, data, size);
+      cache->carry_size = size;
+      return;
+    }
+    gst_bda_gop_cache_push_packet (cache, data);
+    data += GST_BDA_TS_PACKET_SIZE;
+    size -= GST_BDA_TS_PACKET_SIZE;
+  }
+}
+
+void
+gst_bda_gop_cache_clear (GstBdaGopCache * cache)
+{
+  for (guint i = 0; i < cache->programs->len; i++) {
+    GstBdaGopProgram *program =
+        (GstBdaGopProgram *) g_ptr_array_index (cache->programs, i);
+    g_byte_array_set_size (program->packets, 0);
+    program->have_rap = FALSE;
+  }
+  cache->carry_size = 0;
+}
+
+GBytes *
+gst_bda_gop_cache_get_packets (GstBdaGopCache * cache)
+{
+  gboolean have_rap = FALSE;
+  for (guint i = 0; i < cache->programs->len; i++) {
+    GstBdaGopProgram *program =
+        (GstBdaGopProgram *) g_ptr_array_index (cache->programs, i);
+    have_rap |= program->have_rap;
+  }
+  if (!have_rap) {
+    return NULL;
+  }
+
+  GByteArray *packets = g_byte_array_new ();
+  g_byte_array_append (packets, cache->pat, GST_BDA_TS_PACKET_SIZE);
+  for (guint i = 0; i < cache->programs->len; i++) {
+    GstBdaGopProgram *program =
+        (GstBdaGopProgram *) g_ptr_array_index (cache->programs, i);
+    if (program->have_pmt) {
+      g_byte_array_append (packets, program->pmt, GST_BDA_TS_PACKET_SIZE);
+    }
+  }
+  for (guint i = 0; i < cache->programs->len; i++) {
+    GstBdaGopProgram *program =
+        (GstBdaGopProgram *) g_ptr_array_index (cache->programs, i);
+    g_byte_array_append (packets, program->packets->data,
+        program->packets->len);
+  }
+
+  return g_byte_array_free_to_bytes (packets);
+}
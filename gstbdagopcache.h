@@ -0,0 +1,60 @@
+/* GStreamer
+ * Copyright (C) 2015 Raimo Järvi <raimo.jarvi@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef __GST_BDAGOPCACHE_H__
+#define __GST_BDAGOPCACHE_H__
+
+#include <glib.h>
+
+/* Rolling cache of the packets of each program since its last random
+   access point, with the current PAT and PMTs, so that a consumer joining
+   a running stream can start decoding right away. Programs are found from
+   PAT and PMT tables that fit in one packet. */
+
+typedef struct _GstBdaGopCache GstBdaGopCache;
+
+/**
+ * Creates a cache holding at most max_size bytes of packets per program.
+ * A program whose packets since its last random access point don't fit is
+ * dropped until its next random access point.
+ */
+GstBdaGopCache *gst_bda_gop_cache_new (gsize max_size);
+void gst_bda_gop_cache_free (GstBdaGopCache * cache);
+
+/**
+ * Adds a sample to the cache. Samples don't need to be split on packet
+ * boundaries.
+ */
+void gst_bda_gop_cache_push (GstBdaGopCache * cache, const guint8 * data,
+    gsize size);
+
+/**
+ * Drops the cached packets of all programs, e.g. after a discontinuity.
+ * The PSI is kept.
+ */
+void gst_bda_gop_cache_clear (GstBdaGopCache * cache);
+
+/**
+ * Returns the PAT and PMT packets followed by the packets of each program
+ * since its last random access point, or NULL if no program has a random
+ * access point cached.
+ */
+GBytes *gst_bda_gop_cache_get_packets (GstBdaGopCache * cache);
+
+#endif
@@ -20,13 +20,23 @@
 #include "gstbdagrabber.h"
 #include "gstbdautil.h"
 
-GstBdaGrabber::GstBdaGrabber (GstBdaSrc * bda_src)
-:  bda_src (bda_src)
+GstBdaGrabber::GstBdaGrabber (GstBdaSrc * bda_src, GstBdaTraceWriter * trace)
+:  bda_src (bda_src), trace (trace), trace_failed (FALSE)
 {
 }
 
 GstBdaGrabber::~GstBdaGrabber ()
 {
+  gst_bda_trace_writer_free (trace);
+}
+
+void
+GstBdaGrabber::Attach (GstBdaSrc * bda_src, GstBdaTraceWriter * trace)
+{
+  gst_bda_trace_writer_free (this->trace);
+  this->bda_src = bda_src;
+  this->trace = trace;
+  trace_failed = FALSE;
 }
 
 STDMETHODIMP_ (ULONG) GstBdaGrabber::AddRef ()
@@ -47,8 +57,14 @@ STDMETHODIMP
   return E_NOTIMPL;
 }
 
-STDMETHODIMP GstBdaGrabber::SampleCB (double /*time */ , IMediaSample * sample)
+STDMETHODIMP GstBdaGrabber::SampleCB (double time, IMediaSample * sample)
 {
+  if (!bda_src) {
+    return S_OK;
+  }
+
+  gint64
+      arrival = g_get_monotonic_time ();
   BYTE *
       data = NULL;
   HRESULT
@@ -60,7 +76,18 @@ STDMETHODIMP GstBdaGrabber::SampleCB (double /*time */ , IMediaSample * sample)
     return S_FALSE;
   }
 
-  bda_src->sample_received (bda_src, data, sample->GetActualDataLength ());
+  long
+      size = sample->GetActualDataLength ();
+
+  // The trace is written by its own thread, which is only waited for when
+  // the trace is freed outside of the sample callback.
+  if (trace && !trace_failed && !gst_bda_trace_writer_add (trace, arrival,
+          (gint64) (time * 10000000), data, size)) {
+    GST_ERROR_OBJECT (bda_src, "Unable to write trace, tracing stopped");
+    trace_failed = TRUE;
+  }
+
+  bda_src->sample_received (bda_src, data, size);
 
   return S_OK;
 }
@@ -23,12 +23,14 @@
 #include <winsock2.h>
 #include "gstbdasrc.h"
 #include "gstbdatypes.h"
+#include "gstbdatrace.h"
 
 /** ISampleGrabber filter calls SampleCB function on incoming transport stream
-    samples. */
+    samples. If trace is set, samples are also recorded to it. The grabber
+    takes ownership of the trace. */
 class GstBdaGrabber : public ISampleGrabberCB {
 public:
-  GstBdaGrabber(GstBdaSrc *bda_src);
+  GstBdaGrabber(GstBdaSrc *bda_src, GstBdaTraceWriter *trace = NULL);
   virtual ~GstBdaGrabber();
 
   virtual STDMETHODIMP_(ULONG) AddRef();
@@ -37,8 +39,15 @@ public:
   virtual STDMETHODIMP SampleCB(double time, IMediaSample* sample);
   virtual STDMETHODIMP BufferCB(double time, BYTE* buffer, long bufferLen);
 
+  /** Delivers samples to another element, or nowhere if bda_src is NULL,
+      e.g. when a pooled graph is reused. The previous trace is freed. Only
+      call while the graph is stopped. */
+  void Attach(GstBdaSrc *bda_src, GstBdaTraceWriter *trace);
+
 private:
   GstBdaSrc *bda_src;
+  GstBdaTraceWriter *trace;
+  gboolean trace_failed;
 };
 
 #endif
@@ -0,0 +1,168 @@
+/* GStreamer
+ * Copyright (C) 2015 Raimo Järvi <raimo.jarvi@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include "gstbdagraphcache.h"
+
+#define KEY_RECEIVER "receiver"
+#define KEY_TS_SUBTYPE "ts-subtype"
+
+G_LOCK_DEFINE_STATIC (cache);
+/* Device -> GstBdaGraphHint */
+static GHashTable *cache_hints;
+/* Key files already merged into cache_hints. */
+static GHashTable *cache_loaded;
+
+void
+gst_bda_graph_hint_clear (GstBdaGraphHint * hint)
+{
+  g_free (hint->receiver);
+  hint->receiver = NULL;
+}
+
+static void
+gst_bda_graph_hint_free (gpointer data)
+{
+  GstBdaGraphHint *hint = (GstBdaGraphHint *) data;
+
+  gst_bda_graph_hint_clear (hint);
+  g_free (hint);
+}
+
+static void
+gst_bda_graph_cache_insert (const gchar * device, const GstBdaGraphHint * hint)
+{
+  GstBdaGraphHint *copy = g_new0 (GstBdaGraphHint, 1);
+  copy->receiver = g_strdup (hint->receiver);
+  copy->ts_subtype = hint->ts_subtype;
+
+  g_hash_table_replace (cache_hints, g_strdup (device), copy);
+}
+
+/* Called with the cache lock held. */
+static void
+gst_bda_graph_cache_init (const gchar * location)
+{
+  if (!cache_hints) {
+    cache_hints = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+        gst_bda_graph_hint_free);
+    cache_loaded = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+        NULL);
+  }
+
+  if (!location || g_hash_table_contains (cache_loaded, location)) {
+    return;
+  }
+  g_hash_table_add (cache_loaded, g_strdup (location));
+
+  GKeyFile *key_file = g_key_file_new ();
+  if (g_key_file_load_from_file (key_file, location, G_KEY_FILE_NONE, NULL)) {
+    gchar **devices = g_key_file_get_groups (key_file, NULL);
+    for (gchar ** device = devices; *device; device++) {
+      if (g_hash_table_contains (cache_hints, *device)) {
+        continue;
+      }
+
+      GstBdaGraphHint hint;
+      hint.receiver = g_key_file_get_string (key_file, *device, KEY_RECEIVER,
+          NULL);
+      hint.ts_subtype = g_key_file_get_integer (key_file, *device,
+          KEY_TS_SUBTYPE, NULL);
+      gst_bda_graph_cache_insert (*device, &hint);
+      gst_bda_graph_hint_clear (&hint);
+    }
+    g_strfreev (devices);
+  }
+  g_key_file_free (key_file);
+}
+
+gboolean
+gst_bda_graph_cache_lookup (const gchar * location, const gchar * device,
+    GstBdaGraphHint * hint)
+{
+  G_LOCK (cache);
+  gst_bda_graph_cache_init (location);
+
+  GstBdaGraphHint *cached =
+      (GstBdaGraphHint *) g_hash_table_lookup (cache_hints, device);
+  if (cached) {
+    hint->receiver = g_strdup (cached->receiver);
+    hint->ts_subtype = cached->ts_subtype;
+  }
+  G_UNLOCK (cache);
+
+  return cached != NULL;
+}
+
+/* Called with the cache lock held. Rewrites the device's group in the key
+   file, merging with what other processes may have written. */
+static gboolean
+gst_bda_graph_cache_save (const gchar * location, const gchar * device,
+    const GstBdaGraphHint * hint)
+{
+  GKeyFile *key_file = g_key_file_new ();
+  g_key_file_load_from_file (key_file, location, G_KEY_FILE_KEEP_COMMENTS,
+      NULL);
+  g_key_file_remove_group (key_file, device, NULL);
+  if (hint) {
+    if (hint->receiver) {
+      g_key_file_set_string (key_file, device, KEY_RECEIVER, hint->receiver);
+    }
+    g_key_file_set_integer (key_file, device, KEY_TS_SUBTYPE,
+        hint->ts_subtype);
+  }
+  gboolean ret = g_key_file_save_to_file (key_file, location, NULL);
+  g_key_file_free (key_file);
+
+  return ret;
+}
+
+gboolean
+gst_bda_graph_cache_store (const gchar * location, const gchar * device,
+    const GstBdaGraphHint * hint)
+{
+  gboolean ret = TRUE;
+
+  G_LOCK (cache);
+  gst_bda_graph_cache_init (location);
+  gst_bda_graph_cache_insert (device, hint);
+
+  if (location) {
+    ret = gst_bda_graph_cache_save (location, device, hint);
+  }
+  G_UNLOCK (cache);
+
+  return ret;
+}
+
+gboolean
+gst_bda_graph_cache_remove (const gchar * location, const gchar * device)
+{
+  gboolean ret = TRUE;
+
+  G_LOCK (cache);
+  gst_bda_graph_cache_init (location);
+  g_hash_table_remove (cache_hints, device);
+
+  if (location) {
+    ret = gst_bda_graph_cache_save (location, device, NULL);
+  }
+  G_UNLOCK (cache);
+
+  return ret;
+}
@@ -0,0 +1,65 @@
+/* GStreamer
+ * Copyright (C) 2015 Raimo Järvi <raimo.jarvi@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef __GST_BDAGRAPHCACHE_H__
+#define __GST_BDAGRAPHCACHE_H__
+
+#include <glib.h>
+
+/* Process-wide cache of graph build decisions per tuner device, so that
+   later graph builds can skip trying every receiver filter and TS media
+   subtype. Optionally persisted to a key file. */
+
+typedef struct _GstBdaGraphHint GstBdaGraphHint;
+
+struct _GstBdaGraphHint {
+  /* Display name of the receiver filter moniker, NULL if the tuner is
+     connected to the TS capture directly. */
+  gchar *receiver;
+  /* Index of the TS media subtype that connected. */
+  guint ts_subtype;
+};
+
+void gst_bda_graph_hint_clear (GstBdaGraphHint * hint);
+
+/**
+ * Looks up the hint for the tuner device. If location is set, hints
+ * persisted there are loaded first.
+ * @return TRUE if a hint was found, hint must then be cleared by the caller
+ */
+gboolean gst_bda_graph_cache_lookup (const gchar * location,
+    const gchar * device, GstBdaGraphHint * hint);
+
+/**
+ * Stores the hint for the tuner device, and persists it to location if
+ * set.
+ * @return FALSE if the hint could not be persisted
+ */
+gboolean gst_bda_graph_cache_store (const gchar * location,
+    const gchar * device, const GstBdaGraphHint * hint);
+
+/**
+ * Removes the hint for the tuner device, e.g. after the graph could not be
+ * built with it.
+ * @return FALSE if the removal could not be persisted
+ */
+gboolean gst_bda_graph_cache_remove (const gchar * location,
+    const gchar * device);
+
+#endif
@@ -0,0 +1,212 @@
+/* GStreamer
+ * Copyright (C) 2015 Raimo Järvi <raimo.jarvi@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include "gstbdakeyframe.h"
+#include "gstbdapsicache.h"
+#include "gstbdats.h"
+#include <string.h>
+
+#define PAT_PID 0
+#define PAT_TABLE_ID 0x00
+#define PMT_TABLE_ID 0x02
+#define PID_COUNT 8192
+
+struct _GstBdaKeyframeScanner {
+  /* PMT stream type per PID, 0 if not listed. */
+  guint8 stream_types[PID_COUNT];
+  /* Bit per PMT PID listed in the PAT. */
+  guint8 pmt_pids[PID_COUNT / 8];
+};
+
+GType
+gst_bda_keyframe_meta_api_get_type (void)
+{
+  static gsize type = 0;
+  static const gchar *tags[] = { NULL };
+
+  if (g_once_init_enter (&type)) {
+    GType _type = gst_meta_api_type_register ("GstBdaKeyframeMetaAPI", tags);
+    g_once_init_leave (&type, _type);
+  }
+
+  return (GType) type;
+}
+
+static gboolean
+gst_bda_keyframe_meta_init (GstMeta * meta, gpointer /*params */ ,
+    GstBuffer * /*buffer */ )
+{
+  GstBdaKeyframeMeta *keyframe = (GstBdaKeyframeMeta *) meta;
+  keyframe->offset = 0;
+  keyframe->pid = GST_BDA_TS_NULL_PID;
+
+  return TRUE;
+}
+
+static gboolean
+gst_bda_keyframe_meta_transform (GstBuffer * dest, GstMeta * meta,
+    GstBuffer * /*buffer */ , GQuark type, gpointer data)
+{
+  GstBdaKeyframeMeta *keyframe = (GstBdaKeyframeMeta *) meta;
+
+  if (!GST_META_TRANSFORM_IS_COPY (type)) {
+    return FALSE;
+  }
+
+  /* A region keeps the meta only if it contains the random access
+     point. */
+  GstMetaTransformCopy *copy = (GstMetaTransformCopy *) data;
+  gsize offset = keyframe->offset;
+  if (copy->region) {
+    if (offset < copy->offset || (copy->size != (gsize) - 1
+            && offset >= copy->offset + copy->size)) {
+      return TRUE;
+    }
+    offset -= copy->offset;
+  }
+  gst_buffer_add_bda_keyframe_meta (dest, offset, keyframe->pid);
+
+  return TRUE;
+}
+
+const GstMetaInfo *
+gst_bda_keyframe_meta_get_info (void)
+{
+  static const GstMetaInfo *info = NULL;
+
+  if (g_once_init_enter ((GstMetaInfo **) & info)) {
+    const GstMetaInfo *meta_info =
+        gst_meta_register (GST_BDA_KEYFRAME_META_API_TYPE,
+        "GstBdaKeyframeMeta", sizeof (GstBdaKeyframeMeta),
+        gst_bda_keyframe_meta_init, NULL, gst_bda_keyframe_meta_transform);
+    g_once_init_leave ((GstMetaInfo **) & info, (GstMetaInfo *) meta_info);
+  }
+
+  return info;
+}
+
+GstBdaKeyframeMeta *
+gst_buffer_add_bda_keyframe_meta (GstBuffer * buffer, gsize offset,
+    guint16 pid)
+{
+  GstBdaKeyframeMeta *keyframe = (GstBdaKeyframeMeta *)
+      gst_buffer_add_meta (buffer, GST_BDA_KEYFRAME_META_INFO, NULL);
+  keyframe->offset = offset;
+  keyframe->pid = pid;
+
+  return keyframe;
+}
+
+GstBdaKeyframeScanner *
+gst_bda_keyframe_scanner_new (void)
+{
+  return g_new0 (GstBdaKeyframeScanner, 1);
+}
+
+void
+gst_bda_keyframe_scanner_free (GstBdaKeyframeScanner * scanner)
+{
+  g_free (scanner);
+}
+
+/* Returns the section of a current single section table with table_id. */
+static const guint8 *
+gst_bda_keyframe_scanner_get_table (const guint8 * packet, guint8 table_id,
+    gsize * size)
+{
+  const guint8 *section = gst_bda_psi_get_section (packet, size);
+  if (!section || section[0] != table_id || !(section[5] & 0x01)
+      || section[6] != 0 || section[7] != 0) {
+    return NULL;
+  }
+
+  return section;
+}
+
+static void
+gst_bda_keyframe_scanner_parse_pat (GstBdaKeyframeScanner * scanner,
+    const guint8 * packet)
+{
+  gsize size;
+  const guint8 *section =
+      gst_bda_keyframe_scanner_get_table (packet, PAT_TABLE_ID, &size);
+  if (!section) {
+    return;
+  }
+
+  memset (scanner->pmt_pids, 0, sizeof (scanner->pmt_pids));
+  /* Programs follow the 8 byte header and precede the CRC. */
+  for (gsize i = 8; i + 4 <= size - 4; i += 4) {
+    guint16 number = (section[i] << 8) | section[i + 1];
+    guint16 pid = ((section[i + 2] & 0x1f) << 8) | section[i + 3];
+    /* Program 0 is the network PID. */
+    if (number != 0) {
+      scanner->pmt_pids[pid / 8] |= 1 << (pid % 8);
+    }
+  }
+}
+
+static void
+gst_bda_keyframe_scanner_parse_pmt (GstBdaKeyframeScanner * scanner,
+    const guint8 * packet)
+{
+  gsize size;
+  const guint8 *section =
+      gst_bda_keyframe_scanner_get_table (packet, PMT_TABLE_ID, &size);
+  if (!section) {
+    return;
+  }
+
+  gsize offset = 12 + (((section[10] & 0x0f) << 8) | section[11]);
+  /* Stream loop up to the CRC. */
+  while (offset + 5 <= size - 4) {
+    guint16 pid = ((section[offset + 1] & 0x1f) << 8) | section[offset + 2];
+    scanner->stream_types[pid] = section[offset];
+    offset += 5 + (((section[offset + 3] & 0x0f) << 8) | section[offset + 4]);
+  }
+}
+
+gssize
+gst_bda_keyframe_scanner_scan (GstBdaKeyframeScanner * scanner,
+    const guint8 * data, gsize size, guint16 * pid)
+{
+  gssize ret = -1;
+
+  for (gsize i = 0; i + GST_BDA_TS_PACKET_SIZE <= size;
+      i += GST_BDA_TS_PACKET_SIZE) {
+    const guint8 *packet = data + i;
+    if (gst_bda_ts_tei (packet)) {
+      continue;
+    }
+
+    guint16 packet_pid = gst_bda_ts_pid (packet);
+    guint8 type = scanner->stream_types[packet_pid];
+    if (packet_pid == PAT_PID) {
+      gst_bda_keyframe_scanner_parse_pat (scanner, packet);
+    } else if (scanner->pmt_pids[packet_pid / 8] & (1 << (packet_pid % 8))) {
+      gst_bda_keyframe_scanner_parse_pmt (scanner, packet);
+    } else if (ret < 0 && gst_bda_ts_is_video (type)
+        && gst_bda_ts_is_random_access (packet, type)) {
+      ret = i;
+      *pid = packet_pid;
+    }
+  }
+
+  return ret;
+}
@@ -0,0 +1,67 @@
+/* GStreamer
+ * Copyright (C) 2015 Raimo Järvi <raimo.jarvi@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef __GST_BDAKEYFRAME_H__
+#define __GST_BDAKEYFRAME_H__
+
+#include <gst/gst.h>
+
+/* Random access point detection on the ingest path. Video streams are found
+   from PAT and PMT tables that fit in one packet, see
+   gst_bda_ts_is_random_access () for what counts as a random access point. */
+
+typedef struct _GstBdaKeyframeScanner GstBdaKeyframeScanner;
+typedef struct _GstBdaKeyframeMeta GstBdaKeyframeMeta;
+
+/**
+ * Locates the first random access point of a video stream in a buffer.
+ * Attached to packet aligned buffers that are not marked as delta units.
+ */
+struct _GstBdaKeyframeMeta {
+  GstMeta meta;
+
+  /* Offset of the packet starting the random access point. */
+  gsize offset;
+  guint16 pid;
+};
+
+GType gst_bda_keyframe_meta_api_get_type (void);
+#define GST_BDA_KEYFRAME_META_API_TYPE (gst_bda_keyframe_meta_api_get_type ())
+
+const GstMetaInfo *gst_bda_keyframe_meta_get_info (void);
+#define GST_BDA_KEYFRAME_META_INFO (gst_bda_keyframe_meta_get_info ())
+
+#define gst_buffer_get_bda_keyframe_meta(b) \
+  ((GstBdaKeyframeMeta *) gst_buffer_get_meta ((b), GST_BDA_KEYFRAME_META_API_TYPE))
+
+GstBdaKeyframeMeta *gst_buffer_add_bda_keyframe_meta (GstBuffer * buffer,
+    gsize offset, guint16 pid);
+
+GstBdaKeyframeScanner *gst_bda_keyframe_scanner_new (void);
+void gst_bda_keyframe_scanner_free (GstBdaKeyframeScanner * scanner);
+
+/**
+ * Scans packet aligned data for the first random access point of a video
+ * stream, and follows the PAT and PMTs in it.
+ * @return the offset of the packet starting the random access point, or -1
+ */
+gssize gst_bda_keyframe_scanner_scan (GstBdaKeyframeScanner * scanner,
+    const guint8 * data, gsize size, guint16 * pid);
+
+#endif
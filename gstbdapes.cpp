@@ -0,0 +1,620 @@
+/* GStreamer
+ * Copyright (C) 2015 Raimo Järvi <raimo.jarvi@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include "gstbdapes.h"
+#include "gstbdasection.h"
+#include "gstbdats.h"
+#include <string.h>
+
+#define PAT_PID 0
+#define PAT_TABLE_ID 0x00
+#define PMT_TABLE_ID 0x02
+#define PID_COUNT 8192
+/* PTS and DTS are 33 bit counters at 90 kHz. */
+#define PES_TS_WRAP (G_GUINT64_CONSTANT (1) << 33)
+#define PES_TS_HZ 90000
+
+/* PMT stream types with caps besides the video ones in gstbdats.h. */
+#define STREAM_MPEG1_AUDIO 0x03
+#define STREAM_MPEG2_AUDIO 0x04
+#define STREAM_PRIVATE_PES 0x06
+#define STREAM_AAC_ADTS 0x0f
+#define STREAM_AAC_LATM 0x11
+#define STREAM_AC3 0x81
+
+/* Descriptors telling what a private PES stream carries. */
+#define TELETEXT_DESCRIPTOR 0x56
+#define SUBTITLING_DESCRIPTOR 0x59
+#define AC3_DESCRIPTOR 0x6a
+#define EAC3_DESCRIPTOR 0x7a
+
+typedef struct _GstBdaPesStream GstBdaPesStream;
+
+struct _GstBdaPesStream {
+  /* NULL until a PMT lists the PID. */
+  GstCaps *caps;
+  /* Continuity counter of the last packet, -1 if unknown. */
+  gint cc;
+  /* Set on the next PES packet passed on. */
+  gboolean discont;
+  /* PES packet in progress, shared with the sample while it is within one
+     TS packet and copied to data once it continues. */
+  GstBuffer *head;
+  GByteArray *data;
+  gsize size;
+  /* Size from the PES header, 0 if unbounded. */
+  gsize expected;
+};
+
+typedef struct _GstBdaPesClock GstBdaPesClock;
+
+/* Timestamp state of a program, whose streams share a clock. */
+struct _GstBdaPesClock {
+  guint16 pmt_pid;
+  /* Last PTS or DTS, extended beyond 33 bits. */
+  guint64 last_ts;
+  gboolean have_ts;
+};
+
+struct _GstBdaPesDemux {
+  GstBdaPesFunc func;
+  gpointer user_data;
+  GstBdaSectionAssembler *assembler;
+  /* Bit per PMT PID listed in the PAT. */
+  guint8 pmt_pids[PID_COUNT / 8];
+  /* PMT stream type per PID, 0 if not listed, and the descriptor that
+     tells what a private stream carries. */
+  guint8 stream_types[PID_COUNT];
+  guint8 descriptor_tags[PID_COUNT];
+  /* PMT PID of the program listing each PID, 0 if not listed. */
+  guint16 programs[PID_COUNT];
+  /* GstBdaPesClock per program seen. */
+  GPtrArray *clocks;
+  GstBdaPesStream *streams[PID_COUNT];
+  /* Start of the incomplete packet at the end of the last buffer. */
+  guint8 carry[GST_BDA_TS_PACKET_SIZE];
+  gsize carry_size;
+};
+
+static GstCaps *
+gst_bda_pes_demux_make_caps (guint8 stream_type, guint8 descriptor_tag)
+{
+  switch (stream_type) {
+    case GST_BDA_TS_STREAM_MPEG1_VIDEO:
+    case GST_BDA_TS_STREAM_MPEG2_VIDEO:
+      return gst_caps_new_simple ("video/mpeg",
+          "mpegversion", G_TYPE_INT,
+          stream_type == GST_BDA_TS_STREAM_MPEG1_VIDEO ? 1 : 2,
+          "systemstream", G_TYPE_BOOLEAN, FALSE, NULL);
+    case GST_BDA_TS_STREAM_H264:
+      return gst_caps_new_simple ("video/x-h264",
+          "stream-format", G_TYPE_STRING, "byte-stream", NULL);
+    case GST_BDA_TS_STREAM_HEVC:
+      return gst_caps_new_simple ("video/x-h265",
+          "stream-format", G_TYPE_STRING, "byte-stream", NULL);
+    case STREAM_MPEG1_AUDIO:
+    case STREAM_MPEG2_AUDIO:
+      return gst_caps_new_simple ("audio/mpeg",
+          "mpegversion", G_TYPE_INT, 1, NULL);
+    case STREAM_AAC_ADTS:
+      return gst_caps_new_simple ("audio/mpeg",
+          "mpegversion", G_TYPE_INT, 2,
+          "stream-format", G_TYPE_STRING, "adts", NULL);
+    case STREAM_AAC_LATM:
+      return gst_caps_new_simple ("audio/mpeg",
+          "mpegversion", G_TYPE_INT, 4,
+          "stream-format", G_TYPE_STRING, "loas", NULL);
+    case STREAM_AC3:
+      return gst_caps_new_empty_simple ("audio/x-ac3");
+    case STREAM_PRIVATE_PES:
+      switch (descriptor_tag) {
+        case TELETEXT_DESCRIPTOR:
+          return gst_caps_new_empty_simple ("application/x-teletext");
+        case SUBTITLING_DESCRIPTOR:
+          return gst_caps_new_empty_simple ("subpicture/x-dvb");
+        case AC3_DESCRIPTOR:
+          return gst_caps_new_empty_simple ("audio/x-ac3");
+        case EAC3_DESCRIPTOR:
+          return gst_caps_new_empty_simple ("audio/x-eac3");
+      }
+      break;
+  }
+
+  return gst_caps_new_simple ("application/x-bda-es",
+      "stream-type", G_TYPE_INT, stream_type, NULL);
+}
+
+/* Drops the PES packet in progress. */
+static void
+gst_bda_pes_stream_drop (GstBdaPesStream * stream)
+{
+  if (stream->head) {
+    gst_buffer_unref (stream->head);
+    stream->head = NULL;
+  }
+  if (stream->data) {
+    g_byte_array_free (stream->data, TRUE);
+    stream->data = NULL;
+  }
+  stream->size = 0;
+  stream->expected = 0;
+  stream->discont = TRUE;
+}
+
+static void
+gst_bda_pes_stream_free (GstBdaPesStream * stream)
+{
+  gst_bda_pes_stream_drop (stream);
+  if (stream->caps) {
+    gst_caps_unref (stream->caps);
+  }
+  g_free (stream);
+}
+
+static void
+gst_bda_pes_demux_parse_pat (GstBdaPesDemux * demux, const guint8 * section,
+    gsize size)
+{
+  /* Programs follow the 8 byte header and precede the CRC. */
+  for (gsize i = 8; i + 4 <= size - 4; i += 4) {
+    guint16 number = (section[i] << 8) | section[i + 1];
+    guint16 pid = ((section[i + 2] & 0x1f) << 8) | section[i + 3];
+    /* Program 0 is the network PID. */
+    if (number != 0) {
+      demux->pmt_pids[pid / 8] |= 1 << (pid % 8);
+      gst_bda_section_assembler_add_pid (demux->assembler, pid);
+    }
+  }
+}
+
+static void
+gst_bda_pes_demux_parse_pmt (GstBdaPesDemux * demux, guint16 pmt_pid,
+    const guint8 * section, gsize size)
+{
+  gsize offset = 12 + (((section[10] & 0x0f) << 8) | section[11]);
+  /* Stream loop up to the CRC. */
+  while (offset + 5 <= size - 4) {
+    guint8 type = section[offset];
+    guint16 pid = ((section[offset + 1] & 0x1f) << 8) | section[offset + 2];
+    gsize end = offset + 5 +
+        (((section[offset + 3] & 0x0f) << 8) | section[offset + 4]);
+
+    guint8 tag = 0;
+    for (gsize i = offset + 5; i + 2 <= MIN (end, size - 4);
+        i += 2 + section[i + 1]) {
+      if (section[i] == TELETEXT_DESCRIPTOR
+          || section[i] == SUBTITLING_DESCRIPTOR
+          || section[i] == AC3_DESCRIPTOR || section[i] == EAC3_DESCRIPTOR) {
+        tag = section[i];
+        break;
+      }
+    }
+
+    GstBdaPesStream *stream = demux->streams[pid];
+    if (stream && (!stream->caps || demux->stream_types[pid] != type
+            || demux->descriptor_tags[pid] != tag)) {
+      if (stream->caps) {
+        gst_caps_unref (stream->caps);
+      }
+      stream->caps = gst_bda_pes_demux_make_caps (type, tag);
+    }
+    demux->stream_types[pid] = type;
+    demux->descriptor_tags[pid] = tag;
+    demux->programs[pid] = pmt_pid;
+    offset = end;
+  }
+}
+
+static void
+gst_bda_pes_demux_section (guint16 pid, const guint8 * section, gsize size,
+    gpointer user_data)
+{
+  GstBdaPesDemux *demux = (GstBdaPesDemux *) user_data;
+
+  /* Only current long form sections, which have passed the CRC check. */
+  if (!(section[1] & 0x80) || !(section[5] & 0x01) || size < 12) {
+    return;
+  }
+
+  if (pid == PAT_PID && section[0] == PAT_TABLE_ID) {
+    gst_bda_pes_demux_parse_pat (demux, section, size);
+  } else if (section[0] == PMT_TABLE_ID && size >= 16) {
+    gst_bda_pes_demux_parse_pmt (demux, pid, section, size);
+  }
+}
+
+/* Returns the timestamp state of the program with the PMT on pmt_pid. */
+static GstBdaPesClock *
+gst_bda_pes_demux_get_clock (GstBdaPesDemux * demux, guint16 pmt_pid)
+{
+  for (guint i = 0; i < demux->clocks->len; i++) {
+    GstBdaPesClock *clock =
+        (GstBdaPesClock *) g_ptr_array_index (demux->clocks, i);
+    if (clock->pmt_pid == pmt_pid) {
+      return clock;
+    }
+  }
+
+  GstBdaPesClock *clock = g_new0 (GstBdaPesClock, 1);
+  clock->pmt_pid = pmt_pid;
+  g_ptr_array_add (demux->clocks, clock);
+
+  return clock;
+}
+
+/* Reads a PTS or DTS, and extends it to the value closest to the last one
+   of the program. */
+static GstClockTime
+gst_bda_pes_demux_read_ts (GstBdaPesClock * clock, const guint8 * p)
+{
+  guint64 ts = ((guint64) (p[0] & 0x0e) << 29) | (p[1] << 22) |
+      ((p[2] & 0xfe) << 14) | (p[3] << 7) | (p[4] >> 1);
+
+  if (clock->have_ts) {
+    ts += clock->last_ts - clock->last_ts % PES_TS_WRAP;
+    if (ts + PES_TS_WRAP / 2 < clock->last_ts) {
+      ts += PES_TS_WRAP;
+    } else if (ts > clock->last_ts + PES_TS_WRAP / 2 && ts >= PES_TS_WRAP) {
+      ts -= PES_TS_WRAP;
+    }
+  }
+  clock->last_ts = ts;
+  clock->have_ts = TRUE;
+
+  return gst_util_uint64_scale (ts, GST_SECOND, PES_TS_HZ);
+}
+
+/* Returns the size of the PES header, 0 if it isn't valid. */
+static gsize
+gst_bda_pes_demux_parse_header (GstBdaPesClock * clock, const guint8 * data,
+    gsize size, GstClockTime * pts, GstClockTime * dts)
+{
+  *pts = GST_CLOCK_TIME_NONE;
+  *dts = GST_CLOCK_TIME_NONE;
+
+  if (size < 6 || data[0] != 0x00 || data[1] != 0x00 || data[2] != 0x01) {
+    return 0;
+  }
+
+  switch (data[3]) {
+    case 0xbc:
+    case 0xbe:
+    case 0xbf:
+    case 0xf0:
+    case 0xf1:
+    case 0xf2:
+    case 0xf8:
+    case 0xff:
+      /* Stream IDs without the optional header. */
+      return 6;
+  }
+
+  if (size < 9 || 9 + (gsize) data[8] > size) {
+    return 0;
+  }
+
+  guint flags = data[7] >> 6;
+  if ((flags & 0x02) && data[8] >= 5) {
+    *pts = gst_bda_pes_demux_read_ts (clock, data + 9);
+  }
+  if (flags == 0x03 && data[8] >= 10) {
+    *dts = gst_bda_pes_demux_read_ts (clock, data + 14);
+  }
+
+  return 9 + data[8];
+}
+
+/* Passes on the PES packet in progress. */
+static void
+gst_bda_pes_demux_finish (GstBdaPesDemux * demux, guint16 pid,
+    GstBdaPesStream * stream)
+{
+  GstBuffer *buffer = stream->head;
+  if (stream->data) {
+    gsize size = stream->data->len;
+    buffer = gst_buffer_new_wrapped (g_byte_array_free (stream->data, FALSE),
+        size);
+  }
+  gboolean truncated = stream->expected && stream->size < stream->expected;
+  stream->head = NULL;
+  stream->data = NULL;
+  stream->size = 0;
+  stream->expected = 0;
+  if (!buffer) {
+    return;
+  }
+  if (truncated || !stream->caps) {
+    gst_buffer_unref (buffer);
+    stream->discont = TRUE;
+    return;
+  }
+
+  GstMapInfo map;
+  GstClockTime pts, dts;
+  gst_buffer_map (buffer, &map, GST_MAP_READ);
+  gsize header = gst_bda_pes_demux_parse_header (gst_bda_pes_demux_get_clock
+      (demux, demux->programs[pid]), map.data, map.size, &pts, &dts);
+  gst_buffer_unmap (buffer, &map);
+
+  if (header == 0) {
+    gst_buffer_unref (buffer);
+    stream->discont = TRUE;
+    return;
+  }
+
+  gst_buffer_resize (buffer, header, -1);
+  GST_BUFFER_PTS (buffer) = pts;
+  GST_BUFFER_DTS (buffer) = dts;
+  if (stream->discont) {
+    GST_BUFFER_FLAG_SET (buffer, GST_BUFFER_FLAG_DISCONT);
+    stream->discont = FALSE;
+  }
+  demux->func (pid, buffer, demux->user_data);
+}
+
+/* Adds the payload at offset of buffer to the PES packet in progress.
+   buffer is NULL for a packet that straddled two buffers, whose payload is
+   always copied. */
+static void
+gst_bda_pes_stream_append (GstBdaPesStream * stream, GstBuffer * buffer,
+    const guint8 * payload, gsize offset, gsize size)
+{
+  if (stream->size == 0 && size >= 6) {
+    guint length = (payload[4] << 8) | payload[5];
+    stream->expected = length ? 6 + length : 0;
+  }
+  if (stream->expected) {
+    /* Stuffing after the end of the PES packet. */
+    size = MIN (size, stream->expected - stream->size);
+  }
+
+  if (!stream->head && !stream->data && buffer) {
+    stream->head =
+        gst_buffer_copy_region (buffer, GST_BUFFER_COPY_MEMORY, offset, size);
+  } else {
+    if (!stream->data) {
+      GstMapInfo map;
+      stream->data = g_byte_array_sized_new (MAX (stream->expected,
+              stream->size + size));
+      if (stream->head) {
+        gst_buffer_map (stream->head, &map, GST_MAP_READ);
+        g_byte_array_append (stream->data, map.data, map.size);
+        gst_buffer_unmap (stream->head, &map);
+        gst_buffer_unref (stream->head);
+        stream->head = NULL;
+      }
+    }
+    g_byte_array_append (stream->data, payload, size);
+  }
+  stream->size += size;
+}
+
+static void
+gst_bda_pes_demux_packet (GstBdaPesDemux * demux, guint16 pid,
+    GstBdaPesStream * stream, GstBuffer * buffer, const guint8 * packet,
+    gsize offset)
+{
+  if (gst_bda_ts_tei (packet)) {
+    gst_bda_pes_stream_drop (stream);
+    return;
+  }
+  if (!gst_bda_ts_has_payload (packet)) {
+    return;
+  }
+
+  guint8 cc = gst_bda_ts_cc (packet);
+  if (stream->cc == cc) {
+    /* Duplicate packet */
+    return;
+  }
+  if (stream->cc >= 0 && cc != ((stream->cc + 1) & 0x0f)) {
+    gst_bda_pes_stream_drop (stream);
+  }
+  stream->cc = cc;
+
+  gsize start = 4;
+  if (gst_bda_ts_has_adaptation (packet)) {
+    start += 1 + packet[4];
+  }
+  if (start >= GST_BDA_TS_PACKET_SIZE) {
+    return;
+  }
+
+  if (gst_bda_ts_pusi (packet)) {
+    gst_bda_pes_demux_finish (demux, pid, stream);
+  } else if (!stream->head && !stream->data) {
+    /* Not within a PES packet, e.g. after lost packets. */
+    return;
+  }
+
+  gst_bda_pes_stream_append (stream, buffer, packet + start, offset + start,
+      GST_BDA_TS_PACKET_SIZE - start);
+  if (stream->expected && stream->size >= stream->expected) {
+    gst_bda_pes_demux_finish (demux, pid, stream);
+  }
+}
+
+GstBdaPesDemux *
+gst_bda_pes_demux_new (GstBdaPesFunc func, gpointer user_data)
+{
+  GstBdaPesDemux *demux = g_new0 (GstBdaPesDemux, 1);
+  demux->func = func;
+  demux->user_data = user_data;
+  demux->clocks = g_ptr_array_new_with_free_func (g_free);
+  demux->assembler =
+      gst_bda_section_assembler_new (gst_bda_pes_demux_section, demux);
+  gst_bda_section_assembler_set_deduplicate (demux->assembler, TRUE);
+  gst_bda_section_assembler_add_pid (demux->assembler, PAT_PID);
+
+  return demux;
+}
+
+void
+gst_bda_pes_demux_free (GstBdaPesDemux * demux)
+{
+  if (!demux) {
+    return;
+  }
+
+  for (guint pid = 0; pid < PID_COUNT; pid++) {
+    if (demux->streams[pid]) {
+      gst_bda_pes_stream_free (demux->streams[pid]);
+    }
+  }
+  gst_bda_section_assembler_free (demux->assembler);
+  g_ptr_array_free (demux->clocks, TRUE);
+  g_free (demux);
+}
+
+void
+gst_bda_pes_demux_add_pid (GstBdaPesDemux * demux, guint16 pid)
+{
+  if (pid >= PID_COUNT || demux->streams[pid]) {
+    return;
+  }
+
+  GstBdaPesStream *stream = g_new0 (GstBdaPesStream, 1);
+  stream->cc = -1;
+  stream->discont = TRUE;
+  if (demux->stream_types[pid]) {
+    stream->caps = gst_bda_pes_demux_make_caps (demux->stream_types[pid],
+        demux->descriptor_tags[pid]);
+  }
+  demux->streams[pid] = stream;
+}
+
+void
+gst_bda_pes_demux_remove_pid (GstBdaPesDemux * demux, guint16 pid)
+{
+  if (pid >= PID_COUNT || !demux->streams[pid]) {
+    return;
+  }
+
+  gst_bda_pes_stream_free (demux->streams[pid]);
+  demux->streams[pid] = NULL;
+}
+
+GstCaps *
+gst_bda_pes_demux_get_caps (GstBdaPesDemux * demux, guint16 pid)
+{
+  if (pid >= PID_COUNT || !demux->streams[pid] || !demux->streams[pid]->caps) {
+    return NULL;
+  }
+
+  return gst_caps_ref (demux->streams[pid]->caps);
+}
+
+/* Feeds a whole packet at offset of buffer, or a carried one if buffer is
+   NULL. */
+static void
+gst_bda_pes_demux_push_packet (GstBdaPesDemux * demux, GstBuffer * buffer,
+    const guint8 * packet, gsize offset)
+{
+  /* Stream types first, so a PMT applies to the packets after it. */
+  gst_bda_section_assembler_push (demux->assembler, packet,
+      GST_BDA_TS_PACKET_SIZE);
+
+  guint16 pid = gst_bda_ts_pid (packet);
+  if (demux->streams[pid]) {
+    gst_bda_pes_demux_packet (demux, pid, demux->streams[pid], buffer,
+        packet, offset);
+  }
+}
+
+void
+gst_bda_pes_demux_push (GstBdaPesDemux * demux, GstBuffer * buffer)
+{
+  GstMapInfo map;
+  gst_buffer_map (buffer, &map, GST_MAP_READ);
+  const guint8 *data = map.data;
+  gsize size = map.size;
+
+  while (size > 0) {
+    if (demux->carry_size > 0) {
+      gsize n = MIN (size, GST_BDA_TS_PACKET_SIZE - demux->carry_size);
+      memcpy (demux->carry + demux->carry_size, data, n);
+      demux->carry_size += n;
+      data += n;
+      size -= n;
+      if (demux->carry_size < GST_BDA_TS_PACKET_SIZE) {
+        break;
+      }
+      gst_bda_pes_demux_push_packet (demux, NULL, demux->carry, 0);
+      demux->carry_size = 0;
+      continue;
+    }
+
+    /* Resync on a sync byte that the next packet starts with too, so that
+       one in a payload isn't taken for a packet start. */
+    if (data[0] != GST_BDA_TS_SYNC_BYTE || (size > GST_BDA_TS_PACKET_SIZE
+            && data[GST_BDA_TS_PACKET_SIZE] != GST_BDA_TS_SYNC_BYTE)) {
+      const guint8 *sync =
+          (const guint8 *) memchr (data + 1, GST_BDA_TS_SYNC_BYTE, size - 1);
+      if (!sync) {
+        break;
+      }
+      size -= sync - data;
+      data = sync;
+      continue;
+    }
+
+    if (size < GST_BDA_TS_PACKET_SIZE) {
+      memcpy (demux->carry, data, size);
+      demux->carry_size = size;
+      break;
+    }
+    gst_bda_pes_demux_push_packet (demux, buffer, data, data - map.data);
+    data += GST_BDA_TS_PACKET_SIZE;
+    size -= GST_BDA_TS_PACKET_SIZE;
+  }
+
+  gst_buffer_unmap (buffer, &map);
+}
+
+guint16
+gst_bda_pes_demux_get_program (GstBdaPesDemux * demux, guint16 pid)
+{
+  return pid < PID_COUNT ? demux->programs[pid] : 0;
+}
+
+void
+gst_bda_pes_demux_reset (GstBdaPesDemux * demux)
+{
+  for (guint pid = 0; pid < PID_COUNT; pid++) {
+    GstBdaPesStream *stream = demux->streams[pid];
+    if (stream) {
+      gst_bda_pes_stream_drop (stream);
+      stream->cc = -1;
+      if (stream->caps) {
+        gst_caps_unref (stream->caps);
+        stream->caps = NULL;
+      }
+    }
+    if (pid != PAT_PID && (demux->pmt_pids[pid / 8] & (1 << (pid % 8)))) {
+      gst_bda_section_assembler_remove_pid (demux->assembler, pid);
+    }
+  }
+  gst_bda_section_assembler_reset (demux->assembler);
+  memset (demux->pmt_pids, 0, sizeof (demux->pmt_pids));
+  memset (demux->stream_types, 0, sizeof (demux->stream_types));
+  memset (demux->descriptor_tags, 0, sizeof (demux->descriptor_tags));
+  memset (demux->programs, 0, sizeof (demux->programs));
+  g_ptr_array_set_size (demux->clocks, 0);
+  demux->carry_size = 0;
+}
@@ -0,0 +1,76 @@
+/* GStreamer
+ * Copyright (C) 2015 Raimo Järvi <raimo.jarvi@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef __GST_BDAPES_H__
+#define __GST_BDAPES_H__
+
+#include <gst/gst.h>
+
+/* PES reassembly of selected elementary streams of a transport stream.
+   Stream types are read from the PAT and PMTs of the same stream. */
+
+typedef struct _GstBdaPesDemux GstBdaPesDemux;
+
+/**
+ * Called with the elementary stream data of each complete PES packet of a
+ * PID, takes ownership of buffer. PTS and DTS are in ns on a timeline of
+ * the PID's program that is continuous across PTS wrap-around, and DISCONT
+ * is set after lost packets.
+ */
+typedef void (*GstBdaPesFunc) (guint16 pid, GstBuffer * buffer,
+    gpointer user_data);
+
+GstBdaPesDemux *gst_bda_pes_demux_new (GstBdaPesFunc func,
+    gpointer user_data);
+void gst_bda_pes_demux_free (GstBdaPesDemux * demux);
+
+/**
+ * Starts or stops reassembling the PES packets of pid.
+ */
+void gst_bda_pes_demux_add_pid (GstBdaPesDemux * demux, guint16 pid);
+void gst_bda_pes_demux_remove_pid (GstBdaPesDemux * demux, guint16 pid);
+
+/**
+ * Returns the caps of the stream on pid derived from its PMT stream type
+ * and descriptors, or NULL until a PMT lists it. Stream types without
+ * specific caps are "application/x-bda-es" with a "stream-type" field.
+ */
+GstCaps *gst_bda_pes_demux_get_caps (GstBdaPesDemux * demux, guint16 pid);
+
+/**
+ * Returns the PMT PID of the program listing pid, which identifies the
+ * timeline of its timestamps, or 0 until a PMT lists it.
+ */
+guint16 gst_bda_pes_demux_get_program (GstBdaPesDemux * demux, guint16 pid);
+
+/**
+ * Reassembles PES packets from the packets of buffer. A packet split
+ * between buffers is completed from the next one. A PES packet within one
+ * TS packet of buffer shares its memory, longer ones are copied once. PES
+ * packets of a PID are passed on only once a PMT lists it.
+ */
+void gst_bda_pes_demux_push (GstBdaPesDemux * demux, GstBuffer * buffer);
+
+/**
+ * Drops the PES packets in progress and forgets the PAT and PMTs, e.g.
+ * after tuning to another multiplex.
+ */
+void gst_bda_pes_demux_reset (GstBdaPesDemux * demux);
+
+#endif
@@ -0,0 +1,311 @@
+/* GStreamer
+ * Copyright (C) 2015 Raimo Järvi <raimo.jarvi@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include "gstbdapsicache.h"
+#include "gstbdats.h"
+#include <string.h>
+
+#define KEY_PACKETS "packets"
+
+#define PAT_PID 0
+#define PAT_TABLE_ID 0x00
+#define PMT_TABLE_ID 0x02
+
+struct _GstBdaPsiCollector {
+  guint8 pat[GST_BDA_TS_PACKET_SIZE];
+  gboolean have_pat;
+  /* PMT PIDs in PAT order. */
+  GArray *pmt_pids;
+  /* PMT PID -> packet, NULL until seen. */
+  GHashTable *pmts;
+  guint missing;
+};
+
+G_LOCK_DEFINE_STATIC (cache);
+/* Serialises writing key files, taken without the cache lock. */
+G_LOCK_DEFINE_STATIC (cache_file);
+/* Transponder -> GBytes */
+static GHashTable *cache_packets;
+/* Key files already merged into cache_packets. */
+static GHashTable *cache_loaded;
+
+const guint8 *
+gst_bda_psi_get_section (const guint8 * packet, gsize * size)
+{
+  if (packet[0] != GST_BDA_TS_SYNC_BYTE || gst_bda_ts_tei (packet)
+      || !gst_bda_ts_pusi (packet) || !gst_bda_ts_has_payload (packet)) {
+    return NULL;
+  }
+
+  gsize offset = 4;
+  if (gst_bda_ts_has_adaptation (packet)) {
+    offset += 1 + packet[4];
+  }
+  if (offset >= GST_BDA_TS_PACKET_SIZE) {
+    return NULL;
+  }
+  /* Pointer field */
+  offset += 1 + packet[offset];
+  if (offset + 3 > GST_BDA_TS_PACKET_SIZE) {
+    return NULL;
+  }
+
+  const guint8 *section = packet + offset;
+  gsize length = 3 + (((section[1] & 0x0f) << 8) | section[2]);
+  /* Header up to last_section_number and the CRC. */
+  if (length < 12 || offset + length > GST_BDA_TS_PACKET_SIZE
+      || gst_bda_ts_crc32 (section, length) != 0) {
+    return NULL;
+  }
+
+  *size = length;
+  return section;
+}
+
+/* Returns the section of a current single section table with table_id. */
+static const guint8 *
+gst_bda_psi_get_table (const guint8 * packet, guint8 table_id, gsize * size)
+{
+  const guint8 *section = gst_bda_psi_get_section (packet, size);
+  if (!section || section[0] != table_id || !(section[5] & 0x01)
+      || section[6] != 0 || section[7] != 0) {
+    return NULL;
+  }
+
+  return section;
+}
+
+GstBdaPsiCollector *
+gst_bda_psi_collector_new (void)
+{
+  GstBdaPsiCollector *collector = g_new0 (GstBdaPsiCollector, 1);
+  collector->pmt_pids = g_array_new (FALSE, FALSE, sizeof (guint16));
+  collector->pmts = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+      NULL, g_free);
+
+  return collector;
+}
+
+void
+gst_bda_psi_collector_free (GstBdaPsiCollector * collector)
+{
+  if (!collector) {
+    return;
+  }
+
+  g_array_free (collector->pmt_pids, TRUE);
+  g_hash_table_destroy (collector->pmts);
+  g_free (collector);
+}
+
+/* Starts waiting for the PMTs listed in a new PAT. */
+static void
+gst_bda_psi_collector_set_pat (GstBdaPsiCollector * collector,
+    const guint8 * packet, const guint8 * section, gsize size)
+{
+  memcpy (collector->pat, packet, GST_BDA_TS_PACKET_SIZE);
+  collector->have_pat = TRUE;
+
+  g_array_set_size (collector->pmt_pids, 0);
+  g_hash_table_remove_all (collector->pmts);
+  /* Programs follow the 8 byte header and precede the CRC. */
+  for (gsize i = 8; i + 4 <= size - 4; i += 4) {
+    guint16 program = (section[i] << 8) | section[i + 1];
+    guint16 pid = ((section[i + 2] & 0x1f) << 8) | section[i + 3];
+    /* Program 0 is the network PID. */
+    if (program == 0
+        || g_hash_table_contains (collector->pmts, GUINT_TO_POINTER (pid))) {
+      continue;
+    }
+    g_array_append_val (collector->pmt_pids, pid);
+    g_hash_table_insert (collector->pmts, GUINT_TO_POINTER (pid), NULL);
+  }
+  collector->missing = collector->pmt_pids->len;
+}
+
+gboolean
+gst_bda_psi_collector_push (GstBdaPsiCollector * collector,
+    const guint8 * data, gsize size)
+{
+  for (gsize i = 0; i + GST_BDA_TS_PACKET_SIZE <= size;
+      i += GST_BDA_TS_PACKET_SIZE) {
+    /* Packets are kept with the continuity counter cleared, so that
+       repetitions of a table compare equal. */
+    guint8 packet[GST_BDA_TS_PACKET_SIZE];
+    memcpy (packet, data + i, GST_BDA_TS_PACKET_SIZE);
+    packet[3] &= 0xf0;
+    guint16 pid = gst_bda_ts_pid (packet);
+    const guint8 *section;
+    gsize section_size;
+
+    if (pid == PAT_PID) {
+      section = gst_bda_psi_get_table (packet, PAT_TABLE_ID, &section_size);
+      if (section && (!collector->have_pat
+              || memcmp (collector->pat, packet, GST_BDA_TS_PACKET_SIZE))) {
+        gst_bda_psi_collector_set_pat (collector, packet, section,
+            section_size);
+      }
+      continue;
+    }
+
+    gpointer key = GUINT_TO_POINTER (pid);
+    gpointer pmt;
+    if (!g_hash_table_lookup_extended (collector->pmts, key, NULL, &pmt)) {
+      continue;
+    }
+    section = gst_bda_psi_get_table (packet, PMT_TABLE_ID, &section_size);
+    if (section) {
+      if (!pmt) {
+        collector->missing--;
+        pmt = g_malloc (GST_BDA_TS_PACKET_SIZE);
+        g_hash_table_insert (collector->pmts, key, pmt);
+      }
+      memcpy (pmt, packet, GST_BDA_TS_PACKET_SIZE);
+    }
+  }
+
+  return collector->have_pat && collector->missing == 0;
+}
+
+GBytes *
+gst_bda_psi_collector_get_packets (GstBdaPsiCollector * collector)
+{
+  GByteArray *packets = g_byte_array_new ();
+
+  if (collector->have_pat) {
+    g_byte_array_append (packets, collector->pat, GST_BDA_TS_PACKET_SIZE);
+  }
+  for (guint i = 0; i < collector->pmt_pids->len; i++) {
+    guint16 pid = g_array_index (collector->pmt_pids, guint16, i);
+    const guint8 *pmt = (const guint8 *) g_hash_table_lookup (collector->pmts,
+        GUINT_TO_POINTER (pid));
+    if (pmt) {
+      g_byte_array_append (packets, pmt, GST_BDA_TS_PACKET_SIZE);
+    }
+  }
+
+  return g_byte_array_free_to_bytes (packets);
+}
+
+/* Called with the cache lock held. */
+static void
+gst_bda_psi_cache_init (const gchar * location)
+{
+  if (!cache_packets) {
+    cache_packets = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+        (GDestroyNotify) g_bytes_unref);
+    cache_loaded = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+        NULL);
+  }
+
+  if (!location || g_hash_table_contains (cache_loaded, location)) {
+    return;
+  }
+  g_hash_table_add (cache_loaded, g_strdup (location));
+
+  GKeyFile *key_file = g_key_file_new ();
+  if (g_key_file_load_from_file (key_file, location, G_KEY_FILE_NONE, NULL)) {
+    gchar **transponders = g_key_file_get_groups (key_file, NULL);
+    for (gchar ** transponder = transponders; *transponder; transponder++) {
+      if (g_hash_table_contains (cache_packets, *transponder)) {
+        continue;
+      }
+
+      gchar *encoded = g_key_file_get_string (key_file, *transponder,
+          KEY_PACKETS, NULL);
+      if (!encoded) {
+        continue;
+      }
+      gsize size;
+      guchar *packets = g_base64_decode (encoded, &size);
+      if (size > 0 && size % GST_BDA_TS_PACKET_SIZE == 0) {
+        g_hash_table_replace (cache_packets, g_strdup (*transponder),
+            g_bytes_new_take (packets, size));
+      } else {
+        g_free (packets);
+      }
+      g_free (encoded);
+    }
+    g_strfreev (transponders);
+  }
+  g_key_file_free (key_file);
+}
+
+GBytes *
+gst_bda_psi_cache_lookup (const gchar * location, const gchar * transponder)
+{
+  G_LOCK (cache);
+  gst_bda_psi_cache_init (location);
+
+  GBytes *packets = (GBytes *) g_hash_table_lookup (cache_packets,
+      transponder);
+  if (packets) {
+    g_bytes_ref (packets);
+  }
+  G_UNLOCK (cache);
+
+  return packets;
+}
+
+gboolean
+gst_bda_psi_cache_store (const gchar * transponder, GBytes * packets)
+{
+  G_LOCK (cache);
+  gst_bda_psi_cache_init (NULL);
+
+  GBytes *cached = (GBytes *) g_hash_table_lookup (cache_packets,
+      transponder);
+  gboolean changed = !cached || !g_bytes_equal (cached, packets);
+  if (changed) {
+    g_hash_table_replace (cache_packets, g_strdup (transponder),
+        g_bytes_ref (packets));
+  }
+  G_UNLOCK (cache);
+
+  return changed;
+}
+
+/* Rewrites the transponder's group in the key file, merging with what
+   other processes may have written. */
+gboolean
+gst_bda_psi_cache_save (const gchar * location, const gchar * transponder)
+{
+  GBytes *packets = gst_bda_psi_cache_lookup (NULL, transponder);
+  if (!packets) {
+    return TRUE;
+  }
+
+  G_LOCK (cache_file);
+  GKeyFile *key_file = g_key_file_new ();
+  g_key_file_load_from_file (key_file, location, G_KEY_FILE_KEEP_COMMENTS,
+      NULL);
+
+  gsize size;
+  const guchar *data = (const guchar *) g_bytes_get_data (packets, &size);
+  gchar *encoded = g_base64_encode (data, size);
+  g_key_file_set_string (key_file, transponder, KEY_PACKETS, encoded);
+  g_free (encoded);
+
+  gboolean ret = g_key_file_save_to_file (key_file, location, NULL);
+  g_key_file_free (key_file);
+  G_UNLOCK (cache_file);
+  g_bytes_unref (packets);
+
+  return ret;
+}
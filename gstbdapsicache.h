@@ -0,0 +1,79 @@
+/* GStreamer
+ * Copyright (C) 2015 Raimo Järvi <raimo.jarvi@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef __GST_BDAPSICACHE_H__
+#define __GST_BDAPSICACHE_H__
+
+#include <glib.h>
+
+/* PAT and PMT packets of each transponder, so that they can be sent ahead
+   of the stream right after tuning instead of waiting for their next
+   repetition. Cached for the process and optionally persisted to a key
+   file. Only tables that fit in one packet are supported. */
+
+typedef struct _GstBdaPsiCollector GstBdaPsiCollector;
+
+/**
+ * Returns the complete section starting in a packet, NULL if the packet
+ * doesn't start one, or the section doesn't fit in the packet or fails its
+ * CRC check.
+ */
+const guint8 *gst_bda_psi_get_section (const guint8 * packet, gsize * size);
+
+GstBdaPsiCollector *gst_bda_psi_collector_new (void);
+void gst_bda_psi_collector_free (GstBdaPsiCollector * collector);
+
+/**
+ * Collects the PAT and the PMTs it lists from whole packets at the start
+ * of data. The latest version of each table is kept.
+ * @return TRUE once the PAT and all its PMTs have been seen
+ */
+gboolean gst_bda_psi_collector_push (GstBdaPsiCollector * collector,
+    const guint8 * data, gsize size);
+
+/**
+ * Returns the collected PAT packet followed by the PMT packets in PAT
+ * order.
+ */
+GBytes *gst_bda_psi_collector_get_packets (GstBdaPsiCollector * collector);
+
+/**
+ * Looks up the PSI packets of the transponder. If location is set, packets
+ * persisted there are loaded first.
+ * @return the packets, or NULL if none are cached
+ */
+GBytes *gst_bda_psi_cache_lookup (const gchar * location,
+    const gchar * transponder);
+
+/**
+ * Stores the PSI packets of the transponder in the cache of the process.
+ * Doesn't do file I/O, so it can be called from the sample callback.
+ * @return TRUE if the packets changed and need to be persisted
+ */
+gboolean gst_bda_psi_cache_store (const gchar * transponder,
+    GBytes * packets);
+
+/**
+ * Persists the cached PSI packets of the transponder to location.
+ * @return FALSE if the packets could not be persisted
+ */
+gboolean gst_bda_psi_cache_save (const gchar * location,
+    const gchar * transponder);
+
+#endif
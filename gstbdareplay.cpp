@@ -0,0 +1,511 @@
+/* GStreamer
+ * Copyright (C) 2015 Raimo Järvi <raimo.jarvi@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+/* Tuner emulator backends. Replay a memory mapped transport stream file,
+   a synthetic stream generated in memory, or the samples of a recorded
+   trace through GstBdaSrc::sample_received, the same entry point
+   GstBdaGrabber uses for samples from a real tuner. */
+
+#include "gstbdabackend.h"
+#include "gstbdats.h"
+#include "gstbdatrace.h"
+#include "gstbdatsgen.h"
+
+/* A PCR jump larger than this is treated as a discontinuity. */
+#define MAX_PCR_GAP (GST_BDA_TS_PCR_HZ)
+
+typedef struct _GstBdaReplay GstBdaReplay;
+
+struct _GstBdaReplay {
+  /* A file, a generator or a trace. Traces without payload are filled
+     by the generator. */
+  GMappedFile *file;
+  const guint8 *data;
+  gsize size;
+  /* Read position. */
+  gsize pos;
+  GstBdaTsGen *gen;
+  GstBdaTraceReader *trace;
+
+  GThread *thread;
+  GMutex lock;
+  GCond cond;
+  gboolean running;
+
+  /* Pacing state, see gst_bda_replay_due (). */
+  GstBdaPacing pacing;
+  guint bitrate;
+  gint64 epoch;
+  guint64 bytes;
+  /* Offset of the next packet in the next sample. */
+  gsize skip;
+  int pcr_pid;
+  gboolean have_pcr;
+  guint64 last_pcr;
+  gint64 last_pcr_due;
+  guint64 last_pcr_bytes;
+  /* Stream rate estimated from consecutive PCRs, 0 if unknown. */
+  gdouble bytes_per_us;
+  /* Due time of the previous sample. */
+  gint64 last_due;
+};
+
+/* Updates PCR pacing state from the packets in the next sample. Packets
+   split between samples are skipped. */
+static void
+gst_bda_replay_scan_pcr (GstBdaReplay * replay, const guint8 * data,
+    gsize len)
+{
+  gsize p = replay->skip;
+
+  while (p + GST_BDA_TS_PACKET_SIZE <= len) {
+    const guint8 *packet = data + p;
+    guint64 pcr;
+
+    if (packet[0] != GST_BDA_TS_SYNC_BYTE) {
+      p++;
+      continue;
+    }
+    p += GST_BDA_TS_PACKET_SIZE;
+
+    if (!gst_bda_ts_get_pcr (packet, &pcr)) {
+      continue;
+    }
+
+    int pid = gst_bda_ts_pid (packet);
+    if (replay->pcr_pid < 0) {
+      replay->pcr_pid = pid;
+    } else if (pid != replay->pcr_pid) {
+      continue;
+    }
+
+    guint64 bytes = replay->bytes + (packet - data);
+    gint64 predicted = replay->last_pcr_due;
+    if (replay->bytes_per_us > 0) {
+      predicted += (gint64) ((bytes - replay->last_pcr_bytes) /
+          replay->bytes_per_us);
+    }
+
+    guint64 diff = replay->have_pcr ?
+        gst_bda_ts_pcr_diff (replay->last_pcr, pcr) : 0;
+    if (diff == 0 || diff > MAX_PCR_GAP) {
+      /* First PCR or a discontinuity, anchor it where the estimated stream
+         rate puts it. */
+      replay->last_pcr_due = predicted;
+    } else {
+      gint64 diff_us = (gint64) (diff * G_USEC_PER_SEC / GST_BDA_TS_PCR_HZ);
+      replay->bytes_per_us =
+          (gdouble) (bytes - replay->last_pcr_bytes) / diff_us;
+      replay->last_pcr_due += diff_us;
+    }
+
+    replay->have_pcr = TRUE;
+    replay->last_pcr = pcr;
+    replay->last_pcr_bytes = bytes;
+  }
+
+  if (p >= len) {
+    replay->skip = p - len;
+  } else if (data[p] == GST_BDA_TS_SYNC_BYTE) {
+    replay->skip = p + GST_BDA_TS_PACKET_SIZE - len;
+  } else {
+    replay->skip = 0;
+  }
+}
+
+/* Returns the monotonic time when the next sample is due, i.e. when its
+   last byte would have arrived from a tuner. */
+static gint64
+gst_bda_replay_due (GstBdaSrc * self, const guint8 * data, gsize len)
+{
+  GstBdaReplay *replay = (GstBdaReplay *) self->backend_data;
+  guint64 end = replay->bytes + len;
+
+  if (replay->pacing == GST_BDA_PACING_PCR) {
+    gst_bda_replay_scan_pcr (replay, data, len);
+    if (replay->pcr_pid < 0 && end * 8 >= replay->bitrate) {
+      GST_WARNING_OBJECT (self, "No PCR in the first second of the stream,"
+          " pacing at %u bit/s", replay->bitrate);
+      replay->pacing = GST_BDA_PACING_BITRATE;
+    }
+  }
+
+  switch (replay->pacing) {
+    case GST_BDA_PACING_BITRATE:
+      return replay->epoch +
+          (gint64) (end * 8 * G_USEC_PER_SEC / replay->bitrate);
+    case GST_BDA_PACING_PCR:
+    {
+      /* At the bitrate property until two PCRs give the stream rate. */
+      gdouble bytes_per_us = replay->bytes_per_us;
+      if (bytes_per_us <= 0) {
+        bytes_per_us = replay->bitrate / 8.0 / G_USEC_PER_SEC;
+      }
+      return replay->last_pcr_due +
+          (gint64) ((end - replay->last_pcr_bytes) / bytes_per_us);
+    }
+    default:
+      return 0;
+  }
+}
+
+static void
+gst_bda_replay_eos (GstBdaSrc * self)
+{
+  GST_DEBUG_OBJECT (self, "Replay reached end of file");
+
+  gst_bdasrc_end_of_stream (self);
+}
+
+static gpointer
+gst_bda_replay_thread (gpointer data)
+{
+  GstBdaSrc *self = GST_BDASRC (data);
+  GstBdaReplay *replay = (GstBdaReplay *) self->backend_data;
+  gsize chunk_size = self->chunk_size;
+  gint jitter = self->jitter;
+  gboolean loop = self->loop;
+  GRand *rand = g_rand_new_with_seed (0);
+  guint8 *chunk = NULL;
+  gsize chunk_alloc = 0;
+
+  GST_DEBUG_OBJECT (self, "Replay started at offset %" G_GSIZE_FORMAT,
+      replay->pos);
+
+  g_mutex_lock (&replay->lock);
+  while (replay->running) {
+    const guint8 *data;
+    gsize len;
+    GstBdaTraceRecord record;
+    gint64 due;
+
+    if (replay->trace) {
+      if (!gst_bda_trace_reader_next (replay->trace, &record)) {
+        if (!loop || replay->bytes == 0) {
+          gst_bda_replay_eos (self);
+          break;
+        }
+        /* Start over right after the last sample. */
+        gst_bda_trace_reader_rewind (replay->trace);
+        replay->epoch = replay->last_due;
+        continue;
+      }
+      len = record.size;
+    } else if (replay->gen) {
+      len = chunk_size;
+    } else {
+      len = MIN (chunk_size, replay->size - replay->pos);
+    }
+
+    if (replay->trace && record.payload) {
+      data = record.payload;
+    } else if (replay->gen) {
+      if (len > chunk_alloc) {
+        chunk_alloc = len;
+        chunk = (guint8 *) g_realloc (chunk, chunk_alloc);
+      }
+      gst_bda_ts_gen_fill (replay->gen, chunk, len);
+      data = chunk;
+    } else {
+      data = replay->data + replay->pos;
+    }
+
+    if (replay->trace) {
+      due = replay->pacing == GST_BDA_PACING_NONE ? 0 :
+          replay->epoch + record.arrival;
+    } else {
+      due = gst_bda_replay_due (self, data, len);
+    }
+    replay->last_due = due;
+    if (due && jitter) {
+      due += g_rand_int_range (rand, -jitter, jitter + 1);
+    }
+
+    while (replay->running && g_get_monotonic_time () < due) {
+      g_cond_wait_until (&replay->cond, &replay->lock, due);
+    }
+    if (!replay->running) {
+      break;
+    }
+
+    g_mutex_unlock (&replay->lock);
+    self->sample_received (self, (gpointer) data, len);
+    g_mutex_lock (&replay->lock);
+
+    replay->bytes += len;
+    if (!replay->file) {
+      continue;
+    }
+
+    replay->pos += len;
+    if (replay->pos >= replay->size) {
+      if (!loop) {
+        gst_bda_replay_eos (self);
+        break;
+      }
+
+      /* The PCR starts over, re-anchor on the next one. */
+      replay->pos = 0;
+      replay->skip = 0;
+      replay->have_pcr = FALSE;
+    }
+  }
+  g_mutex_unlock (&replay->lock);
+
+  g_rand_free (rand);
+  g_free (chunk);
+
+  return NULL;
+}
+
+static gboolean
+gst_bda_replay_open (GstBdaSrc * self)
+{
+  if (!self->replay_location) {
+    GST_ERROR_OBJECT (self, "No replay-location set");
+    return FALSE;
+  }
+
+  GError *err = NULL;
+  GMappedFile *file = g_mapped_file_new (self->replay_location, FALSE, &err);
+  if (!file) {
+    GST_ERROR_OBJECT (self, "Unable to map '%s': %s", self->replay_location,
+        err->message);
+    g_error_free (err);
+    return FALSE;
+  }
+
+  gsize size = g_mapped_file_get_length (file);
+  if (size < GST_BDA_TS_PACKET_SIZE) {
+    GST_ERROR_OBJECT (self, "'%s' is too small for a transport stream",
+        self->replay_location);
+    g_mapped_file_unref (file);
+    return FALSE;
+  }
+
+  GstBdaReplay *replay = g_new0 (GstBdaReplay, 1);
+  replay->file = file;
+  replay->data = (const guint8 *) g_mapped_file_get_contents (file);
+  replay->size = size;
+  g_mutex_init (&replay->lock);
+  g_cond_init (&replay->cond);
+
+  self->backend_data = replay;
+
+  GST_INFO_OBJECT (self, "Replaying '%s', %" G_GSIZE_FORMAT " bytes",
+      self->replay_location, size);
+
+  return TRUE;
+}
+
+/* Creates a generator from the synthetic-params property. */
+static GstBdaTsGen *
+gst_bda_replay_new_gen (GstBdaSrc * self)
+{
+  GstBdaTsGenParams params;
+  gst_bda_ts_gen_params_init (&params);
+  params.bitrate = self->bitrate;
+
+  if (self->synthetic_params
+      && !gst_bda_ts_gen_params_parse (&params, self->synthetic_params)) {
+    GST_ERROR_OBJECT (self, "Invalid synthetic-params '%s'",
+        self->synthetic_params);
+    return NULL;
+  }
+
+  GST_INFO_OBJECT (self, "Generating %u programs at %u bit/s",
+      params.programs, params.bitrate);
+
+  return gst_bda_ts_gen_new (&params);
+}
+
+static gboolean
+gst_bda_synthetic_open (GstBdaSrc * self)
+{
+  GstBdaTsGen *gen = gst_bda_replay_new_gen (self);
+  if (!gen) {
+    return FALSE;
+  }
+
+  GstBdaReplay *replay = g_new0 (GstBdaReplay, 1);
+  replay->gen = gen;
+  g_mutex_init (&replay->lock);
+  g_cond_init (&replay->cond);
+
+  self->backend_data = replay;
+
+  return TRUE;
+}
+
+static gboolean
+gst_bda_trace_open (GstBdaSrc * self)
+{
+  if (!self->replay_location) {
+    GST_ERROR_OBJECT (self, "No replay-location set");
+    return FALSE;
+  }
+
+  GError *err = NULL;
+  GstBdaTraceReader *trace =
+      gst_bda_trace_reader_new (self->replay_location, &err);
+  if (!trace) {
+    GST_ERROR_OBJECT (self, "Unable to open trace: %s", err->message);
+    g_error_free (err);
+    return FALSE;
+  }
+
+  GstBdaTsGen *gen = NULL;
+  if (!gst_bda_trace_reader_has_payload (trace)) {
+    gen = gst_bda_replay_new_gen (self);
+    if (!gen) {
+      gst_bda_trace_reader_free (trace);
+      return FALSE;
+    }
+  }
+
+  GstBdaReplay *replay = g_new0 (GstBdaReplay, 1);
+  replay->trace = trace;
+  replay->gen = gen;
+  g_mutex_init (&replay->lock);
+  g_cond_init (&replay->cond);
+
+  self->backend_data = replay;
+
+  GST_INFO_OBJECT (self, "Replaying trace '%s'", self->replay_location);
+
+  return TRUE;
+}
+
+static gboolean
+gst_bda_replay_start (GstBdaSrc * self)
+{
+  GstBdaReplay *replay = (GstBdaReplay *) self->backend_data;
+
+  replay->pacing = self->pacing;
+  replay->bitrate = self->bitrate;
+  replay->epoch = g_get_monotonic_time ();
+  replay->bytes = 0;
+  replay->skip = 0;
+  replay->pcr_pid = -1;
+  replay->have_pcr = FALSE;
+  replay->last_pcr_due = replay->epoch;
+  replay->last_pcr_bytes = 0;
+  replay->bytes_per_us = 0;
+  replay->last_due = replay->epoch;
+  replay->running = TRUE;
+
+  /* Trace timing is relative to the first sample. */
+  if (replay->trace) {
+    gst_bda_trace_reader_rewind (replay->trace);
+  }
+
+  replay->thread = g_thread_new ("bdasrc-replay", gst_bda_replay_thread, self);
+
+  return TRUE;
+}
+
+static void
+gst_bda_replay_stop (GstBdaSrc * self)
+{
+  GstBdaReplay *replay = (GstBdaReplay *) self->backend_data;
+
+  if (!replay || !replay->thread) {
+    return;
+  }
+
+  g_mutex_lock (&replay->lock);
+  replay->running = FALSE;
+  g_cond_signal (&replay->cond);
+  g_mutex_unlock (&replay->lock);
+
+  g_thread_join (replay->thread);
+  replay->thread = NULL;
+}
+
+static void
+gst_bda_replay_close (GstBdaSrc * self, gboolean /*pool */ )
+{
+  GstBdaReplay *replay = (GstBdaReplay *) self->backend_data;
+
+  if (!replay) {
+    return;
+  }
+
+  gst_bda_replay_stop (self);
+
+  if (replay->file) {
+    g_mapped_file_unref (replay->file);
+  }
+  gst_bda_ts_gen_free (replay->gen);
+  gst_bda_trace_reader_free (replay->trace);
+  g_mutex_clear (&replay->lock);
+  g_cond_clear (&replay->cond);
+  g_free (replay);
+
+  self->backend_data = NULL;
+}
+
+/* There is no tuner, the stream just continues. */
+static gboolean
+gst_bda_replay_retune (GstBdaSrc * self)
+{
+  GST_DEBUG_OBJECT (self, "Retune requested, frequency %d kHz",
+      self->frequency);
+
+  return TRUE;
+}
+
+/* The emulated signal is always locked. */
+static gboolean
+gst_bda_replay_get_signal_locked (GstBdaSrc * /*self */ , gboolean * locked)
+{
+  *locked = TRUE;
+
+  return TRUE;
+}
+
+const GstBdaBackend gst_bda_replay_backend = {
+  "replay",
+  gst_bda_replay_open,
+  gst_bda_replay_start,
+  gst_bda_replay_stop,
+  gst_bda_replay_close,
+  gst_bda_replay_retune,
+  gst_bda_replay_get_signal_locked
+};
+
+const GstBdaBackend gst_bda_synthetic_backend = {
+  "synthetic",
+  gst_bda_synthetic_open,
+  gst_bda_replay_start,
+  gst_bda_replay_stop,
+  gst_bda_replay_close,
+  gst_bda_replay_retune,
+  gst_bda_replay_get_signal_locked
+};
+
+const GstBdaBackend gst_bda_trace_backend = {
+  "trace",
+  gst_bda_trace_open,
+  gst_bda_replay_start,
+  gst_bda_replay_stop,
+  gst_bda_replay_close,
+  gst_bda_replay_retune,
+  gst_bda_replay_get_signal_locked
+};
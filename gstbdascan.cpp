@@ -0,0 +1,740 @@
+/* GStreamer
+ * Copyright (C) 2015 Raimo Järvi <raimo.jarvi@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include "gstbdascan.h"
+#include "gstbdasection.h"
+#include "gstbdats.h"
+#include "gstbdatuner.h"
+#include <string.h>
+
+#define PAT_PID 0x0000
+#define NIT_PID 0x0010
+#define SDT_PID 0x0011
+#define PAT_TABLE_ID 0x00
+#define PMT_TABLE_ID 0x02
+#define NIT_ACTUAL_TABLE_ID 0x40
+#define SDT_ACTUAL_TABLE_ID 0x42
+#define NETWORK_NAME_DESCRIPTOR 0x40
+#define SERVICE_DESCRIPTOR 0x48
+
+/* Time to wait for the tables of a locked transponder in ms, the NIT is
+   repeated at least every 10 seconds. */
+#define SCAN_TABLE_TIMEOUT 10000
+#define SCAN_MAX_TUNERS 16
+
+typedef struct _GstBdaScanTable GstBdaScanTable;
+typedef struct _GstBdaScanProgram GstBdaScanProgram;
+typedef struct _GstBdaScanService GstBdaScanService;
+
+/* Sections received of the current version of a table. */
+struct _GstBdaScanTable {
+  /* -1 until a section is received. */
+  gint version;
+  guint last_section;
+  guint8 sections[32];
+  guint received;
+};
+
+struct _GstBdaScanProgram {
+  guint16 number;
+  guint16 pmt_pid;
+  GstBdaScanTable pmt;
+  guint16 pcr_pid;
+  /* Stream PIDs and types, alternating. */
+  GArray *streams;
+};
+
+struct _GstBdaScanService {
+  guint8 type;
+  gboolean scrambled;
+  gchar *name;
+  gchar *provider;
+};
+
+struct _GstBdaScanCollector {
+  GstBdaSectionAssembler *assembler;
+  GstBdaScanTable pat;
+  GstBdaScanTable sdt;
+  GstBdaScanTable nit;
+  guint16 transport_stream_id;
+  guint16 original_network_id;
+  guint16 network_id;
+  gchar *network_name;
+  GPtrArray *programs;
+  /* Service ID -> GstBdaScanService */
+  GHashTable *services;
+};
+
+static void
+gst_bda_scan_table_init (GstBdaScanTable * table)
+{
+  memset (table, 0, sizeof (GstBdaScanTable));
+  table->version = -1;
+}
+
+/* Records a section of the table. Returns TRUE if it wasn't received
+   before, and a new version restarts the table. */
+static gboolean
+gst_bda_scan_table_add (GstBdaScanTable * table, const guint8 * section)
+{
+  gint version = (section[5] >> 1) & 0x1f;
+  guint number = section[6];
+
+  if (version != table->version) {
+    gst_bda_scan_table_init (table);
+    table->version = version;
+    table->last_section = section[7];
+  }
+  if (number > table->last_section
+      || (table->sections[number / 8] & (1 << (number % 8)))) {
+    return FALSE;
+  }
+  table->sections[number / 8] |= 1 << (number % 8);
+  table->received++;
+
+  return TRUE;
+}
+
+static gboolean
+gst_bda_scan_table_complete (GstBdaScanTable * table)
+{
+  return table->version >= 0 && table->received == table->last_section + 1;
+}
+
+static void
+gst_bda_scan_program_free (GstBdaScanProgram * program)
+{
+  g_array_free (program->streams, TRUE);
+  g_free (program);
+}
+
+static void
+gst_bda_scan_service_free (GstBdaScanService * service)
+{
+  g_free (service->name);
+  g_free (service->provider);
+  g_free (service);
+}
+
+static GstBdaScanProgram *
+gst_bda_scan_collector_find_program (GstBdaScanCollector * collector,
+    guint16 pmt_pid, guint16 number)
+{
+  for (guint i = 0; i < collector->programs->len; i++) {
+    GstBdaScanProgram *program =
+        (GstBdaScanProgram *) g_ptr_array_index (collector->programs, i);
+    if (program->pmt_pid == pmt_pid && program->number == number) {
+      return program;
+    }
+  }
+
+  return NULL;
+}
+
+static void
+gst_bda_scan_collector_parse_pat (GstBdaScanCollector * collector,
+    const guint8 * section, gsize size)
+{
+  gint version = collector->pat.version;
+  if (!gst_bda_scan_table_add (&collector->pat, section)) {
+    return;
+  }
+  if (version != collector->pat.version) {
+    for (guint i = 0; i < collector->programs->len; i++) {
+      GstBdaScanProgram *program =
+          (GstBdaScanProgram *) g_ptr_array_index (collector->programs, i);
+      gst_bda_section_assembler_remove_pid (collector->assembler,
+          program->pmt_pid);
+    }
+    g_ptr_array_set_size (collector->programs, 0);
+  }
+  collector->transport_stream_id = (section[3] << 8) | section[4];
+
+  /* Programs follow the 8 byte header and precede the CRC. */
+  for (gsize i = 8; i + 4 <= size - 4; i += 4) {
+    guint16 number = (section[i] << 8) | section[i + 1];
+    guint16 pid = ((section[i + 2] & 0x1f) << 8) | section[i + 3];
+    /* Program 0 is the network PID. */
+    if (number == 0
+        || gst_bda_scan_collector_find_program (collector, pid, number)) {
+      continue;
+    }
+
+    GstBdaScanProgram *program = g_new0 (GstBdaScanProgram, 1);
+    program->number = number;
+    program->pmt_pid = pid;
+    program->pcr_pid = GST_BDA_TS_NULL_PID;
+    program->streams = g_array_new (FALSE, FALSE, sizeof (guint16));
+    gst_bda_scan_table_init (&program->pmt);
+    g_ptr_array_add (collector->programs, program);
+    gst_bda_section_assembler_add_pid (collector->assembler, pid);
+  }
+}
+
+static void
+gst_bda_scan_collector_parse_pmt (GstBdaScanCollector * collector,
+    guint16 pid, const guint8 * section, gsize size)
+{
+  GstBdaScanProgram *program = gst_bda_scan_collector_find_program (collector,
+      pid, (section[3] << 8) | section[4]);
+  if (!program || !gst_bda_scan_table_add (&program->pmt, section)) {
+    return;
+  }
+
+  program->pcr_pid = ((section[8] & 0x1f) << 8) | section[9];
+  g_array_set_size (program->streams, 0);
+  gsize offset = 12 + (((section[10] & 0x0f) << 8) | section[11]);
+  /* Stream loop up to the CRC. */
+  while (offset + 5 <= size - 4) {
+    guint16 type = section[offset];
+    guint16 stream_pid = ((section[offset + 1] & 0x1f) << 8) |
+        section[offset + 2];
+    g_array_append_val (program->streams, stream_pid);
+    g_array_append_val (program->streams, type);
+    offset += 5 + (((section[offset + 3] & 0x0f) << 8) | section[offset + 4]);
+  }
+}
+
+static void
+gst_bda_scan_collector_parse_sdt (GstBdaScanCollector * collector,
+    const guint8 * section, gsize size)
+{
+  if (!gst_bda_scan_table_add (&collector->sdt, section) || size < 15) {
+    return;
+  }
+
+  collector->original_network_id = (section[8] << 8) | section[9];
+  /* Service loop after the 11 byte header, up to the CRC. */
+  gsize offset = 11;
+  while (offset + 5 <= size - 4) {
+    guint16 id = (section[offset] << 8) | section[offset + 1];
+    gboolean scrambled = (section[offset + 3] & 0x10) != 0;
+    gsize length = ((section[offset + 3] & 0x0f) << 8) | section[offset + 4];
+    gsize end = MIN (offset + 5 + length, size - 4);
+
+    GstBdaScanService *service = g_new0 (GstBdaScanService, 1);
+    service->scrambled = scrambled;
+    for (gsize d = offset + 5; d + 2 <= end; d += 2 + section[d + 1]) {
+      const guint8 *desc = section + d;
+      if (desc[0] != SERVICE_DESCRIPTOR || d + 2 + desc[1] > end
+          || desc[1] < 3) {
+        continue;
+      }
+      gsize provider_length = MIN ((gsize) desc[3], (gsize) desc[1] - 2);
+      gsize name_offset = 4 + provider_length;
+      service->type = desc[2];
+      g_free (service->provider);
+      service->provider = gst_bda_ts_decode_string (desc + 4,
+          provider_length);
+      if (name_offset < 2 + (gsize) desc[1]) {
+        gsize name_length = MIN ((gsize) desc[name_offset],
+            2 + (gsize) desc[1] - name_offset - 1);
+        g_free (service->name);
+        service->name = gst_bda_ts_decode_string (desc + name_offset + 1,
+            name_length);
+      }
+    }
+    g_hash_table_replace (collector->services, GUINT_TO_POINTER (id),
+        service);
+    offset += 5 + length;
+  }
+}
+
+static void
+gst_bda_scan_collector_parse_nit (GstBdaScanCollector * collector,
+    const guint8 * section, gsize size)
+{
+  if (!gst_bda_scan_table_add (&collector->nit, section) || size < 14) {
+    return;
+  }
+
+  collector->network_id = (section[3] << 8) | section[4];
+  gsize length = ((section[8] & 0x0f) << 8) | section[9];
+  gsize end = MIN (10 + length, size - 4);
+  for (gsize d = 10; d + 2 <= end; d += 2 + section[d + 1]) {
+    const guint8 *desc = section + d;
+    if (desc[0] == NETWORK_NAME_DESCRIPTOR && d + 2 + desc[1] <= end) {
+      g_free (collector->network_name);
+      collector->network_name = gst_bda_ts_decode_string (desc + 2,
+          desc[1]);
+    }
+  }
+}
+
+static void
+gst_bda_scan_collector_section (guint16 pid, const guint8 * section,
+    gsize size, gpointer user_data)
+{
+  GstBdaScanCollector *collector = (GstBdaScanCollector *) user_data;
+
+  /* Long form sections of the current version only. */
+  if (size < 12 || !(section[1] & 0x80) || !(section[5] & 0x01)) {
+    return;
+  }
+
+  if (pid == PAT_PID && section[0] == PAT_TABLE_ID) {
+    gst_bda_scan_collector_parse_pat (collector, section, size);
+  } else if (pid == NIT_PID && section[0] == NIT_ACTUAL_TABLE_ID) {
+    gst_bda_scan_collector_parse_nit (collector, section, size);
+  } else if (pid == SDT_PID && section[0] == SDT_ACTUAL_TABLE_ID) {
+    gst_bda_scan_collector_parse_sdt (collector, section, size);
+  } else if (section[0] == PMT_TABLE_ID) {
+    gst_bda_scan_collector_parse_pmt (collector, pid, section, size);
+  }
+}
+
+GstBdaScanCollector *
+gst_bda_scan_collector_new (void)
+{
+  GstBdaScanCollector *collector = g_new0 (GstBdaScanCollector, 1);
+  collector->assembler =
+      gst_bda_section_assembler_new (gst_bda_scan_collector_section,
+      collector);
+  gst_bda_section_assembler_set_deduplicate (collector->assembler, TRUE);
+  gst_bda_section_assembler_add_pid (collector->assembler, PAT_PID);
+  gst_bda_section_assembler_add_pid (collector->assembler, NIT_PID);
+  gst_bda_section_assembler_add_pid (collector->assembler, SDT_PID);
+  gst_bda_scan_table_init (&collector->pat);
+  gst_bda_scan_table_init (&collector->sdt);
+  gst_bda_scan_table_init (&collector->nit);
+  collector->programs =
+      g_ptr_array_new_with_free_func ((GDestroyNotify)
+      gst_bda_scan_program_free);
+  collector->services = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+      NULL, (GDestroyNotify) gst_bda_scan_service_free);
+
+  return collector;
+}
+
+void
+gst_bda_scan_collector_free (GstBdaScanCollector * collector)
+{
+  if (!collector) {
+    return;
+  }
+
+  gst_bda_section_assembler_free (collector->assembler);
+  g_ptr_array_free (collector->programs, TRUE);
+  g_hash_table_destroy (collector->services);
+  g_free (collector->network_name);
+  g_free (collector);
+}
+
+gboolean
+gst_bda_scan_collector_push (GstBdaScanCollector * collector,
+    const guint8 * data, gsize size)
+{
+  gst_bda_section_assembler_push (collector->assembler, data, size);
+
+  if (!gst_bda_scan_table_complete (&collector->pat)
+      || !gst_bda_scan_table_complete (&collector->sdt)
+      || !gst_bda_scan_table_complete (&collector->nit)) {
+    return FALSE;
+  }
+  for (guint i = 0; i < collector->programs->len; i++) {
+    GstBdaScanProgram *program =
+        (GstBdaScanProgram *) g_ptr_array_index (collector->programs, i);
+    if (!gst_bda_scan_table_complete (&program->pmt)) {
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+/* Returns the list of "stream" structures of a program. */
+static void
+gst_bda_scan_program_get_streams (GstBdaScanProgram * program,
+    GValue * streams)
+{
+  g_value_init (streams, GST_TYPE_LIST);
+  for (guint i = 0; i + 1 < program->streams->len; i += 2) {
+    GValue stream = G_VALUE_INIT;
+    g_value_init (&stream, GST_TYPE_STRUCTURE);
+    g_value_take_boxed (&stream, gst_structure_new ("stream",
+            "pid", G_TYPE_UINT,
+            (guint) g_array_index (program->streams, guint16, i),
+            "stream-type", G_TYPE_UINT,
+            (guint) g_array_index (program->streams, guint16, i + 1), NULL));
+    gst_value_list_append_and_take_value (streams, &stream);
+  }
+}
+
+guint
+gst_bda_scan_collector_get_channels (GstBdaScanCollector * collector,
+    const GstStructure * transponder, GValue * channels)
+{
+  guint count = 0;
+
+  for (guint i = 0; i < collector->programs->len; i++) {
+    GstBdaScanProgram *program =
+        (GstBdaScanProgram *) g_ptr_array_index (collector->programs, i);
+    GstStructure *channel = gst_structure_copy (transponder);
+    gst_structure_set_name (channel, "channel");
+    gst_structure_set (channel,
+        "transport-stream-id", G_TYPE_UINT,
+        (guint) collector->transport_stream_id,
+        "service-id", G_TYPE_UINT, (guint) program->number,
+        "pmt-pid", G_TYPE_UINT, (guint) program->pmt_pid, NULL);
+
+    if (program->pmt.version >= 0) {
+      GValue streams = G_VALUE_INIT;
+      gst_bda_scan_program_get_streams (program, &streams);
+      gst_structure_set (channel, "pcr-pid", G_TYPE_UINT,
+          (guint) program->pcr_pid, NULL);
+      gst_structure_take_value (channel, "streams", &streams);
+    }
+
+    GstBdaScanService *service = (GstBdaScanService *)
+        g_hash_table_lookup (collector->services,
+        GUINT_TO_POINTER (program->number));
+    if (service) {
+      gst_structure_set (channel,
+          "original-network-id", G_TYPE_UINT,
+          (guint) collector->original_network_id,
+          "service-type", G_TYPE_UINT, (guint) service->type,
+          "scrambled", G_TYPE_BOOLEAN, service->scrambled, NULL);
+      if (service->name) {
+        gst_structure_set (channel, "service-name", G_TYPE_STRING,
+            service->name, NULL);
+      }
+      if (service->provider) {
+        gst_structure_set (channel, "provider-name", G_TYPE_STRING,
+            service->provider, NULL);
+      }
+    }
+
+    if (collector->nit.version >= 0) {
+      gst_structure_set (channel, "network-id", G_TYPE_UINT,
+          (guint) collector->network_id, NULL);
+      if (collector->network_name) {
+        gst_structure_set (channel, "network-name", G_TYPE_STRING,
+            collector->network_name, NULL);
+      }
+    }
+
+    GValue value = G_VALUE_INIT;
+    g_value_init (&value, GST_TYPE_STRUCTURE);
+    g_value_take_boxed (&value, channel);
+    gst_value_list_append_and_take_value (channels, &value);
+    count++;
+  }
+
+  return count;
+}
+
+/* Channel scan. Each hidden tuner element has a thread that takes
+   transponders from the list until none are left. */
+typedef struct _GstBdaScan GstBdaScan;
+typedef struct _GstBdaScanTuner GstBdaScanTuner;
+
+struct _GstBdaScanTuner {
+  GstBdaScan *scan;
+  GstBdaSrc *element;
+  GThread *thread;
+  gboolean started;
+  /* Tables of the transponder being scanned, protected by the scan
+     lock. */
+  GstBdaScanCollector *collector;
+  gboolean complete;
+  /* Carries packets split between samples, protected by the scan lock. */
+  GstBdaTsAligner aligner;
+};
+
+struct _GstBdaScan {
+  GstBdaSrc *element;
+  /* "transponder" structures */
+  GPtrArray *transponders;
+  GPtrArray *tuners;
+  GMutex lock;
+  GCond cond;
+  /* Protected by lock. */
+  guint next;
+  guint running;
+  guint locked;
+  gboolean cancelled;
+  /* Channels found so far, a GST_TYPE_LIST protected by lock. */
+  GValue channels;
+};
+
+/* Feeds whole packets of a scan tuner to the collector. Called with the
+   scan lock held. */
+static void
+gst_bdasrc_scan_packets (const guint8 * packets, gsize size,
+    gpointer user_data)
+{
+  GstBdaScanTuner *scan_tuner = (GstBdaScanTuner *) user_data;
+
+  if (!scan_tuner->complete) {
+    scan_tuner->complete =
+        gst_bda_scan_collector_push (scan_tuner->collector, packets, size);
+    if (scan_tuner->complete) {
+      g_cond_broadcast (&scan_tuner->scan->cond);
+    }
+  }
+}
+
+/* Feeds the samples of a scan tuner to the tables of its transponder. */
+static void
+gst_bdasrc_scan_received (GstBdaSrc * tuner, gpointer data, gsize size)
+{
+  GstBdaScanTuner *scan_tuner = tuner->scan_for;
+  GstBdaScan *scan = scan_tuner->scan;
+
+  g_mutex_lock (&scan->lock);
+  if (scan_tuner->collector && !scan_tuner->complete) {
+    gst_bda_ts_align (&scan_tuner->aligner, (const guint8 *) data, size,
+        gst_bdasrc_scan_packets, scan_tuner);
+  }
+  g_mutex_unlock (&scan->lock);
+}
+
+/* Tunes a scan tuner to the transponder and collects its channels. */
+static void
+gst_bdasrc_scan_transponder (GstBdaScanTuner * scan_tuner,
+    const GstStructure * transponder)
+{
+  GstBdaScan *scan = scan_tuner->scan;
+  GstBdaSrc *self = scan->element;
+  GstBdaSrc *tuner = scan_tuner->element;
+
+  gst_bdasrc_configure_transponder (tuner, transponder);
+  gboolean tuned =
+      gst_bdasrc_call (tuner, gst_bdasrc_do_retune, "retune", TRUE);
+  if (tuned && !scan_tuner->started) {
+    tuned = scan_tuner->started =
+        gst_bdasrc_call (tuner, gst_bdasrc_do_start, "start", TRUE);
+  }
+  gboolean locked = tuned && gst_bdasrc_wait_tuner_lock (tuner,
+      self->scan_lock_timeout, &scan->lock, &scan->cond, &scan->cancelled);
+
+  guint channels = 0;
+  gboolean complete = FALSE;
+  if (locked) {
+    g_mutex_lock (&scan->lock);
+    scan_tuner->collector = gst_bda_scan_collector_new ();
+    scan_tuner->complete = FALSE;
+    gst_bda_ts_aligner_reset (&scan_tuner->aligner);
+    gint64 deadline = g_get_monotonic_time () +
+        SCAN_TABLE_TIMEOUT * G_TIME_SPAN_MILLISECOND;
+    while (!scan_tuner->complete && !scan->cancelled
+        && g_cond_wait_until (&scan->cond, &scan->lock, deadline));
+    complete = scan_tuner->complete;
+    channels = gst_bda_scan_collector_get_channels (scan_tuner->collector,
+        transponder, &scan->channels);
+    gst_bda_scan_collector_free (scan_tuner->collector);
+    scan_tuner->collector = NULL;
+    scan->locked++;
+    g_mutex_unlock (&scan->lock);
+  }
+
+  GST_INFO_OBJECT (self, "Scanned %d kHz on device %d: %s, %u channels%s",
+      tuner->frequency, tuner->selected_device, locked ? "locked" : "no lock",
+      channels, locked && !complete ? ", tables incomplete" : "");
+  gst_element_post_message (GST_ELEMENT (self),
+      gst_message_new_element (GST_OBJECT (self),
+          gst_structure_new ("scan-transponder",
+              "frequency", G_TYPE_INT, tuner->frequency,
+              "device", G_TYPE_INT, tuner->selected_device,
+              "locked", G_TYPE_BOOLEAN, locked,
+              "channels", G_TYPE_UINT, channels, NULL)));
+}
+
+/* Posts the channel list and ends the stream. */
+static void
+gst_bdasrc_scan_complete (GstBdaScan * scan)
+{
+  GstBdaSrc *self = scan->element;
+
+  GstStructure *s = gst_structure_new ("scan-complete",
+      "transponders", G_TYPE_UINT, scan->transponders->len,
+      "locked", G_TYPE_UINT, scan->locked, NULL);
+  gst_structure_set_value (s, "channels", &scan->channels);
+  GST_INFO_OBJECT (self, "Scan complete, %u of %u transponders locked, %u"
+      " channels", scan->locked, scan->transponders->len,
+      gst_value_list_get_size (&scan->channels));
+  gst_element_post_message (GST_ELEMENT (self),
+      gst_message_new_element (GST_OBJECT (self), s));
+
+  gst_bdasrc_end_of_stream (self);
+}
+
+/* Takes transponders from the list until none are left. The last thread
+   to finish completes the scan. */
+static gpointer
+gst_bdasrc_scan_thread (gpointer data)
+{
+  GstBdaScanTuner *scan_tuner = (GstBdaScanTuner *) data;
+  GstBdaScan *scan = scan_tuner->scan;
+
+  g_mutex_lock (&scan->lock);
+  while (!scan->cancelled && scan->next < scan->transponders->len) {
+    const GstStructure *transponder = (const GstStructure *)
+        g_ptr_array_index (scan->transponders, scan->next++);
+    g_mutex_unlock (&scan->lock);
+    gst_bdasrc_scan_transponder (scan_tuner, transponder);
+    g_mutex_lock (&scan->lock);
+  }
+  gboolean complete = --scan->running == 0 && !scan->cancelled;
+  g_mutex_unlock (&scan->lock);
+
+  if (complete) {
+    gst_bdasrc_scan_complete (scan);
+  }
+
+  return NULL;
+}
+
+/* Opens a tuner for every transponder, up to SCAN_MAX_TUNERS, until no
+   free device is left. */
+gboolean
+gst_bdasrc_scan_open (GstBdaSrc * self)
+{
+  GPtrArray *transponders = gst_bdasrc_parse_transponders (self,
+      self->scan_transponders);
+  if (transponders->len == 0) {
+    GST_ERROR_OBJECT (self, "No valid transponders in '%s'",
+        self->scan_transponders);
+    g_ptr_array_free (transponders, TRUE);
+    return FALSE;
+  }
+
+  GstBdaScan *scan = g_new0 (GstBdaScan, 1);
+  scan->element = self;
+  scan->transponders = transponders;
+  scan->tuners = g_ptr_array_new ();
+  g_mutex_init (&scan->lock);
+  g_cond_init (&scan->cond);
+  g_value_init (&scan->channels, GST_TYPE_LIST);
+  self->scan = scan;
+
+  guint count = MIN (transponders->len, SCAN_MAX_TUNERS);
+  for (guint i = 0; i < count; i++) {
+    GstBdaSrc *tuner = GST_BDASRC (g_object_new (GST_TYPE_BDASRC, NULL));
+    gst_object_ref_sink (tuner);
+    gst_bdasrc_copy_properties (self, tuner);
+    if (i > 0) {
+      GstBdaScanTuner *first =
+          (GstBdaScanTuner *) g_ptr_array_index (scan->tuners, 0);
+      tuner->device_index = -1;
+      tuner->device_type = first->element->input_type != GST_BDA_UNKNOWN ?
+          first->element->input_type : self->device_type;
+    }
+
+    GstBdaScanTuner *scan_tuner = g_new0 (GstBdaScanTuner, 1);
+    scan_tuner->scan = scan;
+    scan_tuner->element = tuner;
+    tuner->scan_for = scan_tuner;
+    tuner->sample_received = gst_bdasrc_scan_received;
+
+    if (!gst_bdasrc_call (tuner, gst_bdasrc_do_open, "open", TRUE)) {
+      gst_object_unref (tuner);
+      g_free (scan_tuner);
+      break;
+    }
+    g_ptr_array_add (scan->tuners, scan_tuner);
+  }
+
+  if (scan->tuners->len == 0) {
+    GST_ERROR_OBJECT (self, "Unable to open a tuner for scanning");
+    gst_bdasrc_scan_close (self);
+    return FALSE;
+  }
+  self->need_tune = FALSE;
+  GST_INFO_OBJECT (self, "Scanning %u transponders with %u tuners",
+      transponders->len, scan->tuners->len);
+
+  return TRUE;
+}
+
+/* Starts a scan thread per tuner. */
+gboolean
+gst_bdasrc_scan_start (GstBdaSrc * self)
+{
+  GstBdaScan *scan = self->scan;
+
+  g_mutex_lock (&scan->lock);
+  scan->next = 0;
+  scan->locked = 0;
+  scan->cancelled = FALSE;
+  scan->running = scan->tuners->len;
+  g_value_unset (&scan->channels);
+  g_value_init (&scan->channels, GST_TYPE_LIST);
+  g_mutex_unlock (&scan->lock);
+
+  for (guint i = 0; i < scan->tuners->len; i++) {
+    GstBdaScanTuner *scan_tuner =
+        (GstBdaScanTuner *) g_ptr_array_index (scan->tuners, i);
+    scan_tuner->thread = g_thread_new ("bdasrc-scan", gst_bdasrc_scan_thread,
+        scan_tuner);
+  }
+
+  return TRUE;
+}
+
+/* Cancels the scan and stops the tuners. */
+void
+gst_bdasrc_scan_stop (GstBdaSrc * self)
+{
+  GstBdaScan *scan = self->scan;
+
+  g_mutex_lock (&scan->lock);
+  scan->cancelled = TRUE;
+  g_cond_broadcast (&scan->cond);
+  g_mutex_unlock (&scan->lock);
+
+  for (guint i = 0; i < scan->tuners->len; i++) {
+    GstBdaScanTuner *scan_tuner =
+        (GstBdaScanTuner *) g_ptr_array_index (scan->tuners, i);
+    if (scan_tuner->thread) {
+      g_thread_join (scan_tuner->thread);
+      scan_tuner->thread = NULL;
+    }
+    if (scan_tuner->started) {
+      gst_bdasrc_call (scan_tuner->element, gst_bdasrc_do_stop, "stop",
+          TRUE);
+      scan_tuner->started = FALSE;
+    }
+  }
+}
+
+void
+gst_bdasrc_scan_close (GstBdaSrc * self)
+{
+  GstBdaScan *scan = self->scan;
+  if (!scan) {
+    return;
+  }
+
+  gst_bdasrc_scan_stop (self);
+  for (guint i = 0; i < scan->tuners->len; i++) {
+    GstBdaScanTuner *scan_tuner =
+        (GstBdaScanTuner *) g_ptr_array_index (scan->tuners, i);
+    /* Closes the device on finalize. */
+    gst_object_unref (scan_tuner->element);
+    g_free (scan_tuner);
+  }
+  g_ptr_array_free (scan->tuners, TRUE);
+  g_ptr_array_free (scan->transponders, TRUE);
+  g_value_unset (&scan->channels);
+  g_mutex_clear (&scan->lock);
+  g_cond_clear (&scan->cond);
+  g_free (scan);
+  self->scan = NULL;
+}
@@ -0,0 +1,71 @@
+/* GStreamer
+ * Copyright (C) 2015 Raimo Järvi <raimo.jarvi@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef __GST_BDASCAN_H__
+#define __GST_BDASCAN_H__
+
+#include "gstbdasrc.h"
+
+/* Collects the PAT, PMTs, SDT and NIT of a transponder during a channel
+   scan, and turns them into a channel list. */
+
+typedef struct _GstBdaScanCollector GstBdaScanCollector;
+
+GstBdaScanCollector *gst_bda_scan_collector_new (void);
+void gst_bda_scan_collector_free (GstBdaScanCollector * collector);
+
+/**
+ * Collects tables from whole packets at the start of data.
+ * @return TRUE once the PAT, all its PMTs, the SDT and the NIT of the
+ * transponder are complete
+ */
+gboolean gst_bda_scan_collector_push (GstBdaScanCollector * collector,
+    const guint8 * data, gsize size);
+
+/**
+ * Appends a "channel" structure for each program of the PAT to channels, a
+ * GST_TYPE_LIST. Each one has the fields of transponder, and
+ * "transport-stream-id", "original-network-id", "network-id",
+ * "network-name", "service-id", "service-name", "provider-name",
+ * "service-type", "scrambled", "pmt-pid", "pcr-pid" and "streams", a list
+ * of "stream" structures with "pid" and "stream-type". Fields of tables
+ * that were not received are left out.
+ * @return the number of channels appended
+ */
+guint gst_bda_scan_collector_get_channels (GstBdaScanCollector * collector,
+    const GstStructure * transponder, GValue * channels);
+
+/* Channel scan of the elements with scan-transponders set. These are
+   called on the worker of the element. */
+
+/**
+ * Opens a hidden tuner for every transponder, up to the number of free
+ * devices. Fails only if none can be opened.
+ */
+gboolean gst_bdasrc_scan_open (GstBdaSrc * self);
+void gst_bdasrc_scan_close (GstBdaSrc * self);
+
+/**
+ * Starts a thread per tuner that scans transponders until none are left,
+ * and posts "scan-complete" once they all have been scanned.
+ */
+gboolean gst_bdasrc_scan_start (GstBdaSrc * self);
+void gst_bdasrc_scan_stop (GstBdaSrc * self);
+
+#endif
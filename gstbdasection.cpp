@@ -0,0 +1,347 @@
+/* GStreamer
+ * Copyright (C) 2015 Raimo Järvi <raimo.jarvi@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include "gstbdasection.h"
+#include "gstbdats.h"
+#include <string.h>
+
+#define PID_COUNT 8192
+/* Long form header up to last_section_number */
+#define LONG_HEADER_SIZE 8
+
+typedef struct _GstBdaSectionPid GstBdaSectionPid;
+typedef struct _GstBdaSectionTable GstBdaSectionTable;
+
+struct _GstBdaSectionPid {
+  /* Section in progress, empty between sections. */
+  guint8 data[GST_BDA_SECTION_MAX_SIZE];
+  gsize size;
+  /* The section in progress repeats one passed on, only its size is
+     tracked. */
+  gboolean repeated;
+  /* Continuity counter of the last packet, -1 if none. */
+  gint cc;
+  /* Table key -> GstBdaSectionTable, NULL until a section is passed on
+     with deduplication. */
+  GHashTable *tables;
+};
+
+/* Sections of a table passed on. */
+struct _GstBdaSectionTable {
+  guint version;
+  guint8 sections[32];
+};
+
+struct _GstBdaSectionAssembler {
+  GstBdaSectionFunc func;
+  gpointer user_data;
+  gboolean deduplicate;
+  guint64 repeated;
+  /* PID -> GstBdaSectionPid, NULL if not assembled. */
+  GstBdaSectionPid *pids[PID_COUNT];
+};
+
+static void
+gst_bda_section_pid_free (GstBdaSectionPid * state)
+{
+  if (!state) {
+    return;
+  }
+
+  if (state->tables) {
+    g_hash_table_destroy (state->tables);
+  }
+  g_free (state);
+}
+
+/* Current and next versions of a table are tracked separately. */
+static guint
+gst_bda_section_table_key (const guint8 * section)
+{
+  return ((section[5] & 0x01) << 24) | (section[0] << 16) |
+      (section[3] << 8) | section[4];
+}
+
+/* Checks if the long form section was passed on before. */
+static gboolean
+gst_bda_section_pid_is_repeated (GstBdaSectionPid * state,
+    const guint8 * section)
+{
+  if (!state->tables) {
+    return FALSE;
+  }
+
+  GstBdaSectionTable *table = (GstBdaSectionTable *)
+      g_hash_table_lookup (state->tables,
+      GUINT_TO_POINTER (gst_bda_section_table_key (section)));
+  guint number = section[6];
+
+  return table && table->version == ((section[5] >> 1) & 0x1f)
+      && (table->sections[number / 8] & (1 << (number % 8)));
+}
+
+/* Records a long form section as passed on. A new version of the table
+   forgets the sections of the previous one. */
+static void
+gst_bda_section_pid_add (GstBdaSectionPid * state, const guint8 * section)
+{
+  if (!state->tables) {
+    state->tables = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+        NULL, g_free);
+  }
+
+  guint key = gst_bda_section_table_key (section);
+  guint version = (section[5] >> 1) & 0x1f;
+  GstBdaSectionTable *table = (GstBdaSectionTable *)
+      g_hash_table_lookup (state->tables, GUINT_TO_POINTER (key));
+  if (!table) {
+    table = g_new0 (GstBdaSectionTable, 1);
+    table->version = version;
+    g_hash_table_insert (state->tables, GUINT_TO_POINTER (key), table);
+  } else if (table->version != version) {
+    memset (table->sections, 0, sizeof (table->sections));
+    table->version = version;
+  }
+
+  guint number = section[6];
+  table->sections[number / 8] |= 1 << (number % 8);
+}
+
+GstBdaSectionAssembler *
+gst_bda_section_assembler_new (GstBdaSectionFunc func, gpointer user_data)
+{
+  GstBdaSectionAssembler *assembler = g_new0 (GstBdaSectionAssembler, 1);
+  assembler->func = func;
+  assembler->user_data = user_data;
+
+  return assembler;
+}
+
+void
+gst_bda_section_assembler_free (GstBdaSectionAssembler * assembler)
+{
+  if (!assembler) {
+    return;
+  }
+
+  for (guint pid = 0; pid < PID_COUNT; pid++) {
+    gst_bda_section_pid_free (assembler->pids[pid]);
+  }
+  g_free (assembler);
+}
+
+void
+gst_bda_section_assembler_add_pid (GstBdaSectionAssembler * assembler,
+    guint16 pid)
+{
+  if (pid >= PID_COUNT || assembler->pids[pid]) {
+    return;
+  }
+
+  GstBdaSectionPid *state = g_new (GstBdaSectionPid, 1);
+  state->size = 0;
+  state->repeated = FALSE;
+  state->cc = -1;
+  state->tables = NULL;
+  assembler->pids[pid] = state;
+}
+
+void
+gst_bda_section_assembler_remove_pid (GstBdaSectionAssembler * assembler,
+    guint16 pid)
+{
+  if (pid >= PID_COUNT) {
+    return;
+  }
+
+  gst_bda_section_pid_free (assembler->pids[pid]);
+  assembler->pids[pid] = NULL;
+}
+
+void
+gst_bda_section_assembler_set_deduplicate (GstBdaSectionAssembler *
+    assembler, gboolean deduplicate)
+{
+  assembler->deduplicate = deduplicate;
+}
+
+void
+gst_bda_section_assembler_reset (GstBdaSectionAssembler * assembler)
+{
+  for (guint pid = 0; pid < PID_COUNT; pid++) {
+    GstBdaSectionPid *state = assembler->pids[pid];
+    if (!state) {
+      continue;
+    }
+    state->size = 0;
+    state->cc = -1;
+    if (state->tables) {
+      g_hash_table_remove_all (state->tables);
+    }
+  }
+}
+
+guint64
+gst_bda_section_assembler_get_repeated (GstBdaSectionAssembler * assembler)
+{
+  return assembler->repeated;
+}
+
+/* Total size of the section in progress, 0 while its header is
+   incomplete. */
+static gsize
+gst_bda_section_length (GstBdaSectionPid * state)
+{
+  if (state->size < 3) {
+    return 0;
+  }
+
+  return 3 + (((state->data[1] & 0x0f) << 8) | state->data[2]);
+}
+
+/* Adds bytes to the section in progress, and passes it on once complete.
+   Returns the number of bytes used. */
+static gsize
+gst_bda_section_assembler_feed (GstBdaSectionAssembler * assembler,
+    guint16 pid, GstBdaSectionPid * state, const guint8 * p, gsize size)
+{
+  gsize used = 0;
+
+  if (state->size == 0) {
+    state->repeated = FALSE;
+  }
+
+  /* Header first, then up to the end of the section. */
+  if (state->size < 3) {
+    gsize n = MIN (size, 3 - state->size);
+    memcpy (state->data + state->size, p, n);
+    state->size += n;
+    used += n;
+    if (state->size < 3) {
+      return used;
+    }
+  }
+
+  gsize length = gst_bda_section_length (state);
+  if (length > GST_BDA_SECTION_MAX_SIZE) {
+    /* Corrupt header, skip to the next section start. */
+    state->size = 0;
+    return size;
+  }
+
+  /* Section syntax indicator */
+  gboolean long_form = (state->data[1] & 0x80) != 0;
+  if (assembler->deduplicate && long_form && length >= LONG_HEADER_SIZE + 4
+      && state->size < LONG_HEADER_SIZE) {
+    /* Enough of the header to recognise a repeat. */
+    gsize n = MIN (size - used, LONG_HEADER_SIZE - state->size);
+    memcpy (state->data + state->size, p + used, n);
+    state->size += n;
+    used += n;
+    if (state->size < LONG_HEADER_SIZE) {
+      return used;
+    }
+    state->repeated = gst_bda_section_pid_is_repeated (state, state->data);
+  }
+
+  gsize n = MIN (size - used, length - state->size);
+  if (!state->repeated) {
+    memcpy (state->data + state->size, p + used, n);
+  }
+  state->size += n;
+  used += n;
+  if (state->size < length) {
+    return used;
+  }
+
+  if (state->repeated) {
+    assembler->repeated++;
+  } else if (!long_form || gst_bda_ts_crc32 (state->data, length) == 0) {
+    if (assembler->deduplicate && long_form && length >= LONG_HEADER_SIZE + 4) {
+      gst_bda_section_pid_add (state, state->data);
+    }
+    assembler->func (pid, state->data, length, assembler->user_data);
+  }
+  state->size = 0;
+
+  return used;
+}
+
+void
+gst_bda_section_assembler_push (GstBdaSectionAssembler * assembler,
+    const guint8 * data, gsize size)
+{
+  for (gsize i = 0; i + GST_BDA_TS_PACKET_SIZE <= size;
+      i += GST_BDA_TS_PACKET_SIZE) {
+    const guint8 *packet = data + i;
+    GstBdaSectionPid *state = assembler->pids[gst_bda_ts_pid (packet)];
+    if (!state || packet[0] != GST_BDA_TS_SYNC_BYTE || gst_bda_ts_tei (packet)
+        || !gst_bda_ts_has_payload (packet)) {
+      continue;
+    }
+
+    gint cc = gst_bda_ts_cc (packet);
+    if (cc == state->cc) {
+      /* Duplicate packet */
+      continue;
+    }
+    if (state->cc >= 0 && cc != ((state->cc + 1) & 0x0f)) {
+      state->size = 0;
+    }
+    state->cc = cc;
+
+    gsize offset = 4;
+    if (gst_bda_ts_has_adaptation (packet)) {
+      offset += 1 + packet[4];
+    }
+    if (offset >= GST_BDA_TS_PACKET_SIZE) {
+      continue;
+    }
+    const guint8 *p = packet + offset;
+    gsize left = GST_BDA_TS_PACKET_SIZE - offset;
+
+    if (gst_bda_ts_pusi (packet)) {
+      gsize pointer = MIN ((gsize) p[0], left - 1);
+      p++;
+      left--;
+      /* The pointer field covers the end of the previous section. */
+      if (state->size > 0) {
+        gst_bda_section_assembler_feed (assembler, gst_bda_ts_pid (packet),
+            state, p, pointer);
+        state->size = 0;
+      }
+      p += pointer;
+      left -= pointer;
+    } else if (state->size == 0) {
+      /* Not within a section. */
+      continue;
+    }
+
+    while (left > 0) {
+      /* Stuffing after the last section. */
+      if (state->size == 0 && p[0] == 0xff) {
+        break;
+      }
+      gsize used = gst_bda_section_assembler_feed (assembler,
+          gst_bda_ts_pid (packet), state, p, left);
+      p += used;
+      left -= used;
+    }
+  }
+}
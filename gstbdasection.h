@@ -0,0 +1,82 @@
+/* GStreamer
+ * Copyright (C) 2015 Raimo Järvi <raimo.jarvi@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef __GST_BDASECTION_H__
+#define __GST_BDASECTION_H__
+
+#include <glib.h>
+
+/* PSI/SI section assembly from transport stream packets. Sections may
+   span packets and several may start in one packet. Repetitions of
+   unchanged sections can be dropped before they are copied or checked. */
+
+#define GST_BDA_SECTION_MAX_SIZE 4096
+
+typedef struct _GstBdaSectionAssembler GstBdaSectionAssembler;
+
+/**
+ * Called for each complete section of a PID. Sections with the syntax
+ * indicator set have passed their CRC check.
+ */
+typedef void (*GstBdaSectionFunc) (guint16 pid, const guint8 * section,
+    gsize size, gpointer user_data);
+
+GstBdaSectionAssembler *gst_bda_section_assembler_new (GstBdaSectionFunc
+    func, gpointer user_data);
+void gst_bda_section_assembler_free (GstBdaSectionAssembler * assembler);
+
+/**
+ * Starts or stops assembling sections of pid.
+ */
+void gst_bda_section_assembler_add_pid (GstBdaSectionAssembler * assembler,
+    guint16 pid);
+void gst_bda_section_assembler_remove_pid (GstBdaSectionAssembler *
+    assembler, guint16 pid);
+
+/**
+ * Drops repeated sections. A section with the syntax indicator set whose
+ * table ID, table ID extension, version, current/next indicator and
+ * section number were passed on before is recognised from its header, and
+ * its remaining bytes are neither copied nor CRC checked. The section
+ * function then only sees new sections and new versions. Short sections
+ * are always passed on.
+ */
+void gst_bda_section_assembler_set_deduplicate (GstBdaSectionAssembler *
+    assembler, gboolean deduplicate);
+
+/**
+ * Forgets the sections in progress and the ones passed on, e.g. after
+ * tuning to another multiplex.
+ */
+void gst_bda_section_assembler_reset (GstBdaSectionAssembler * assembler);
+
+/**
+ * Returns the number of sections dropped as repeats.
+ */
+guint64 gst_bda_section_assembler_get_repeated (GstBdaSectionAssembler *
+    assembler);
+
+/**
+ * Assembles sections from whole packets at the start of data, and calls
+ * the section function for each completed one.
+ */
+void gst_bda_section_assembler_push (GstBdaSectionAssembler * assembler,
+    const guint8 * data, gsize size);
+
+#endif
@@ -0,0 +1,329 @@
+/* GStreamer
+ * Copyright (C) 2015 Raimo Järvi <raimo.jarvi@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include "gstbdashared.h"
+#include "gstbdatuner.h"
+#include "gstbdagopcache.h"
+#include <string.h>
+
+/* Tuner shared by the elements with share-tuner enabled that use the same
+   device and tuning properties. The device is opened by a hidden owner
+   element, which is never added to a pipeline, and its samples are fanned
+   out to the attached elements. */
+typedef struct _GstBdaSharedTuner GstBdaSharedTuner;
+
+struct _GstBdaSharedTuner {
+  gchar *key;
+  /* Serialises opening, starting and stopping the owner. */
+  GMutex lock;
+  GstBdaSrc *owner;
+  /* Protects elements, their shared_active and gop_cache. Taken after
+     shared_lock. */
+  GMutex elements_lock;
+  /* Attached elements. */
+  GList *elements;
+  /* Attached elements that are started. */
+  guint running;
+  /* Packets since the last random access points, NULL if no attached
+     element has gop-cache-size set. */
+  GstBdaGopCache *gop_cache;
+  /* The last element detached and the device is being closed, protected
+     by shared_lock. */
+  gboolean closing;
+};
+
+/* Protects shared_tuners. */
+static GMutex shared_lock;
+/* Signalled when a closed tuner is removed from shared_tuners. */
+static GCond shared_cond;
+static GHashTable *shared_tuners;
+
+/* Identifies the device and everything that determines the stream. */
+static gchar *
+gst_bdasrc_shared_key (GstBdaSrc * self)
+{
+  gchar *tuning = gst_bdasrc_tuning_key (self, self->frequency);
+  gchar *key = g_strdup_printf ("%d:%d:%d:%s", self->backend_type,
+      self->device_index, self->device_type, tuning);
+  g_free (tuning);
+
+  return key;
+}
+
+/* Delivers a sample of the owner to every started attached element. The
+   buffers share the sample's memory. */
+static void
+gst_bdasrc_shared_sample_received (GstBdaSrc * owner, gpointer data,
+    gsize size)
+{
+  GstMapInfo map;
+  GstBuffer *buffer = gst_buffer_new_and_alloc (size);
+
+  gst_buffer_map (buffer, &map, GST_MAP_WRITE);
+  memcpy (map.data, data, size);
+  gst_buffer_unmap (buffer, &map);
+  if (owner->sample_discont) {
+    GST_BUFFER_FLAG_SET (buffer, GST_BUFFER_FLAG_DISCONT);
+  }
+
+  /* Only the tuner's own lock is held, and not while queueing, so that
+     shared tuners and their elements don't hold up each other. */
+  GstBdaSharedTuner *tuner = owner->owned_tuner;
+  GList *active = NULL;
+  g_mutex_lock (&tuner->elements_lock);
+  if (tuner->gop_cache) {
+    if (owner->sample_discont) {
+      gst_bda_gop_cache_clear (tuner->gop_cache);
+    }
+    gst_bda_gop_cache_push (tuner->gop_cache, (const guint8 *) data, size);
+  }
+  for (GList * l = tuner->elements; l; l = l->next) {
+    GstBdaSrc *element = GST_BDASRC (l->data);
+    if (element->shared_active) {
+      active = g_list_prepend (active, gst_object_ref (element));
+    }
+  }
+  g_mutex_unlock (&tuner->elements_lock);
+
+  for (GList * l = active; l; l = l->next) {
+    gst_bdasrc_queue_sample (GST_BDASRC (l->data), gst_buffer_copy (buffer));
+  }
+  g_list_free_full (active, gst_object_unref);
+  gst_buffer_unref (buffer);
+}
+
+/* Creates the owner element of a shared tuner with the properties of the
+   first attached element. */
+static GstBdaSrc *
+gst_bdasrc_shared_owner_new (GstBdaSrc * self, GstBdaSharedTuner * tuner)
+{
+  GstBdaSrc *owner = GST_BDASRC (g_object_new (GST_TYPE_BDASRC, NULL));
+  gst_object_ref_sink (owner);
+  gst_bdasrc_copy_properties (self, owner);
+
+  owner->owned_tuner = tuner;
+  owner->sample_received = gst_bdasrc_shared_sample_received;
+
+  return owner;
+}
+
+/* Attaches the element to the shared tuner for its device and tuning
+   properties, opening the device if it isn't open yet. */
+gboolean
+gst_bdasrc_shared_attach (GstBdaSrc * self)
+{
+  gchar *key = gst_bdasrc_shared_key (self);
+
+  g_mutex_lock (&shared_lock);
+  if (!shared_tuners) {
+    shared_tuners = g_hash_table_new (g_str_hash, g_str_equal);
+  }
+  GstBdaSharedTuner *tuner =
+      (GstBdaSharedTuner *) g_hash_table_lookup (shared_tuners, key);
+  /* The device can't be opened again until the last element has closed
+     it. */
+  while (tuner && tuner->closing) {
+    g_cond_wait (&shared_cond, &shared_lock);
+    tuner = (GstBdaSharedTuner *) g_hash_table_lookup (shared_tuners, key);
+  }
+  if (!tuner) {
+    tuner = g_new0 (GstBdaSharedTuner, 1);
+    tuner->key = key;
+    key = NULL;
+    g_mutex_init (&tuner->lock);
+    g_mutex_init (&tuner->elements_lock);
+    g_hash_table_insert (shared_tuners, tuner->key, tuner);
+  }
+  g_mutex_lock (&tuner->elements_lock);
+  tuner->elements = g_list_prepend (tuner->elements, self);
+  self->shared = tuner;
+  if (self->gop_cache_size > 0 && !tuner->gop_cache) {
+    tuner->gop_cache = gst_bda_gop_cache_new (self->gop_cache_size);
+  }
+  g_mutex_unlock (&tuner->elements_lock);
+  g_mutex_unlock (&shared_lock);
+  g_free (key);
+
+  gboolean ret = TRUE;
+  g_mutex_lock (&tuner->lock);
+  if (!tuner->owner) {
+    GST_INFO_OBJECT (self, "Opening shared tuner %s", tuner->key);
+    tuner->owner = gst_bdasrc_shared_owner_new (self, tuner);
+    if (!gst_bdasrc_call (tuner->owner, gst_bdasrc_do_open, "open", TRUE)) {
+      gst_object_unref (tuner->owner);
+      tuner->owner = NULL;
+      ret = FALSE;
+    }
+  } else {
+    GST_INFO_OBJECT (self, "Attached to shared tuner %s", tuner->key);
+  }
+  if (ret) {
+    self->selected_device = tuner->owner->selected_device;
+  }
+  g_mutex_unlock (&tuner->lock);
+
+  if (!ret) {
+    gst_bdasrc_shared_detach (self);
+  }
+
+  return ret;
+}
+
+/* Detaches the element from its shared tuner. The last element closes the
+   device. */
+void
+gst_bdasrc_shared_detach (GstBdaSrc * self)
+{
+  GstBdaSharedTuner *tuner = self->shared;
+  if (!tuner) {
+    return;
+  }
+
+  gst_bdasrc_shared_stop (self);
+
+  g_mutex_lock (&shared_lock);
+  g_mutex_lock (&tuner->elements_lock);
+  tuner->elements = g_list_remove (tuner->elements, self);
+  self->shared = NULL;
+  self->selected_device = -1;
+  gboolean last = tuner->elements == NULL;
+  g_mutex_unlock (&tuner->elements_lock);
+  tuner->closing = last;
+  g_mutex_unlock (&shared_lock);
+
+  if (!last) {
+    return;
+  }
+
+  GST_INFO_OBJECT (self, "Closing shared tuner %s", tuner->key);
+  if (tuner->owner) {
+    /* Closes the device on finalize. */
+    gst_object_unref (tuner->owner);
+  }
+
+  g_mutex_lock (&shared_lock);
+  g_hash_table_remove (shared_tuners, tuner->key);
+  g_cond_broadcast (&shared_cond);
+  g_mutex_unlock (&shared_lock);
+
+  gst_bda_gop_cache_free (tuner->gop_cache);
+  g_mutex_clear (&tuner->lock);
+  g_mutex_clear (&tuner->elements_lock);
+  g_free (tuner->key);
+  g_free (tuner);
+}
+
+/* Starts delivering samples to the element, starting the device for the
+   first one. An element joining the running device first receives the GOP
+   cache. */
+gboolean
+gst_bdasrc_shared_start (GstBdaSrc * self)
+{
+  GstBdaSharedTuner *tuner = self->shared;
+  gboolean ret = TRUE;
+
+  g_mutex_lock (&tuner->lock);
+  gboolean joining = tuner->running > 0;
+  if (!joining) {
+    ret = gst_bdasrc_call (tuner->owner, gst_bdasrc_do_start, "start", TRUE);
+  }
+  if (ret) {
+    tuner->running++;
+    g_mutex_lock (&tuner->elements_lock);
+    if (joining && self->gop_cache_size > 0 && tuner->gop_cache) {
+      GBytes *packets = gst_bda_gop_cache_get_packets (tuner->gop_cache);
+      if (packets) {
+        gsize size;
+        gconstpointer data = g_bytes_get_data (packets, &size);
+        GstBuffer *buffer = gst_buffer_new_and_alloc (size);
+        gst_buffer_fill (buffer, 0, data, size);
+        g_bytes_unref (packets);
+        GST_DEBUG_OBJECT (self, "Sending %" G_GSIZE_FORMAT " bytes of GOP"
+            " cache", size);
+        gst_bdasrc_queue_sample (self, buffer);
+      }
+    }
+    self->shared_active = TRUE;
+    g_mutex_unlock (&tuner->elements_lock);
+  }
+  g_mutex_unlock (&tuner->lock);
+
+  return ret;
+}
+
+/* Stops delivering samples to the element, stopping the device after the
+   last one. */
+void
+gst_bdasrc_shared_stop (GstBdaSrc * self)
+{
+  GstBdaSharedTuner *tuner = self->shared;
+
+  g_mutex_lock (&tuner->lock);
+  g_mutex_lock (&tuner->elements_lock);
+  gboolean active = self->shared_active;
+  self->shared_active = FALSE;
+  g_mutex_unlock (&tuner->elements_lock);
+
+  if (active && --tuner->running == 0) {
+    gst_bdasrc_call (tuner->owner, gst_bdasrc_do_stop, "stop", TRUE);
+    g_mutex_lock (&tuner->elements_lock);
+    if (tuner->gop_cache) {
+      gst_bda_gop_cache_clear (tuner->gop_cache);
+    }
+    g_mutex_unlock (&tuner->elements_lock);
+  }
+  g_mutex_unlock (&tuner->lock);
+}
+
+/* Moves the element to the shared tuner for its new tuning properties. */
+gboolean
+gst_bdasrc_shared_retune (GstBdaSrc * self)
+{
+  gboolean active = FALSE;
+  if (self->shared) {
+    g_mutex_lock (&self->shared->elements_lock);
+    active = self->shared_active;
+    g_mutex_unlock (&self->shared->elements_lock);
+    gst_bdasrc_shared_detach (self);
+  }
+
+  if (!gst_bdasrc_shared_attach (self)) {
+    return FALSE;
+  }
+
+  return !active || gst_bdasrc_shared_start (self);
+}
+
+gboolean
+gst_bdasrc_shared_read_signal_locked (GstBdaSrc * self, gboolean * locked)
+{
+  return gst_bdasrc_read_signal_locked (self->shared->owner, locked);
+}
+
+void
+gst_bdasrc_shared_end_of_stream (GstBdaSrc * owner)
+{
+  GstBdaSharedTuner *tuner = owner->owned_tuner;
+
+  g_mutex_lock (&tuner->elements_lock);
+  for (GList * l = tuner->elements; l; l = l->next) {
+    gst_bdasrc_end_of_stream (GST_BDASRC (l->data));
+  }
+  g_mutex_unlock (&tuner->elements_lock);
+}
@@ -0,0 +1,63 @@
+/* GStreamer
+ * Copyright (C) 2015 Raimo Järvi <raimo.jarvi@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef __GST_BDASHARED_H__
+#define __GST_BDASHARED_H__
+
+#include "gstbdasrc.h"
+
+/* Tuners shared by the elements with share-tuner enabled, see
+   gstbdashared.cpp. */
+
+/**
+ * Attaches the element to the shared tuner for its device and tuning
+ * properties, opening the device if it isn't open yet.
+ */
+gboolean gst_bdasrc_shared_attach (GstBdaSrc * self);
+
+/**
+ * Detaches the element from its shared tuner, if any. The last element
+ * closes the device.
+ */
+void gst_bdasrc_shared_detach (GstBdaSrc * self);
+
+/**
+ * Starts or stops delivering samples to the element. The device runs while
+ * any attached element is started.
+ */
+gboolean gst_bdasrc_shared_start (GstBdaSrc * self);
+void gst_bdasrc_shared_stop (GstBdaSrc * self);
+
+/**
+ * Moves the element to the shared tuner for its new tuning properties.
+ */
+gboolean gst_bdasrc_shared_retune (GstBdaSrc * self);
+
+/**
+ * Reads the signal lock status of the shared tuner of the element.
+ */
+gboolean gst_bdasrc_shared_read_signal_locked (GstBdaSrc * self,
+    gboolean * locked);
+
+/**
+ * Ends the stream of the elements attached to the shared tuner of owner.
+ */
+void gst_bdasrc_shared_end_of_stream (GstBdaSrc * owner);
+
+#endif
@@ -0,0 +1,356 @@
+/* GStreamer
+ * Copyright (C) 2015 Raimo Järvi <raimo.jarvi@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include "gstbdasifilter.h"
+#include "gstbdasection.h"
+#include "gstbdats.h"
+#include <string.h>
+
+#define PAT_PID 0x0000
+#define CAT_PID 0x0001
+#define NIT_PID 0x0010
+#define SDT_PID 0x0011
+#define EIT_PID 0x0012
+#define PAT_TABLE_ID 0x00
+#define PID_COUNT 8192
+
+typedef struct _GstBdaSiTable GstBdaSiTable;
+
+/* Latest version of a table on a PID. */
+struct _GstBdaSiTable {
+  /* PID << 32 | table ID, extension and current/next indicator */
+  guint64 key;
+  guint16 pid;
+  guint version;
+  /* Sections by number, NULL until received. */
+  GBytes *sections[256];
+  /* Refresh queue the table is in, NULL if it isn't repeated. */
+  GQueue *queue;
+  GList link;
+  /* Time of the last refresh. */
+  gint64 sent;
+};
+
+struct _GstBdaSiFilter {
+  gint64 psi_refresh;
+  gint64 si_refresh;
+  GstBdaSectionAssembler *assembler;
+  /* A bit per PID replaced by its sections. */
+  guint8 reduced[PID_COUNT / 8];
+  /* Continuity counter of the next packet per PID. */
+  guint8 cc[PID_COUNT];
+  /* Key -> GstBdaSiTable */
+  GHashTable *tables;
+  /* Tables in refresh order, oldest first. */
+  GQueue psi_queue;
+  GQueue si_queue;
+  /* State of the push in progress. */
+  gint64 now;
+  GArray *runs;
+  GByteArray *written;
+};
+
+static void
+gst_bda_si_table_free (GstBdaSiTable * table)
+{
+  if (table->queue) {
+    g_queue_unlink (table->queue, &table->link);
+  }
+  for (guint i = 0; i < G_N_ELEMENTS (table->sections); i++) {
+    if (table->sections[i]) {
+      g_bytes_unref (table->sections[i]);
+    }
+  }
+  g_free (table);
+}
+
+/* Adds size bytes at offset of the pushed data, or of the written packets,
+   to the output. */
+static void
+gst_bda_si_filter_add_run (GstBdaSiFilter * filter, gsize offset, gsize size,
+    gboolean written)
+{
+  if (filter->runs->len > 0) {
+    GstBdaSiFilterRun *last = &g_array_index (filter->runs,
+        GstBdaSiFilterRun, filter->runs->len - 1);
+    if (last->written == written && last->offset + last->size == offset) {
+      last->size += size;
+      return;
+    }
+  }
+
+  GstBdaSiFilterRun run = { offset, size, written };
+  g_array_append_val (filter->runs, run);
+}
+
+static void
+gst_bda_si_filter_write_packet (GstBdaSiFilter * filter,
+    const guint8 * packet)
+{
+  gst_bda_si_filter_add_run (filter, filter->written->len,
+      GST_BDA_TS_PACKET_SIZE, TRUE);
+  g_byte_array_append (filter->written, packet, GST_BDA_TS_PACKET_SIZE);
+}
+
+/* Keeps the adaptation field of a packet on a replaced PID that carries a
+   PCR, as the PMT PID may be the PCR PID of its program. */
+static void
+gst_bda_si_filter_write_pcr (GstBdaSiFilter * filter, const guint8 * packet)
+{
+  guint8 pcr[GST_BDA_TS_PACKET_SIZE];
+  guint16 pid = gst_bda_ts_pid (packet);
+  gsize length = MIN (packet[4], GST_BDA_TS_PACKET_SIZE - 5);
+
+  pcr[0] = GST_BDA_TS_SYNC_BYTE;
+  pcr[1] = pid >> 8;
+  pcr[2] = pid & 0xff;
+  /* The continuity counter doesn't advance without payload. */
+  pcr[3] = 0x20 | ((filter->cc[pid] - 1) & 0x0f);
+  pcr[4] = GST_BDA_TS_PACKET_SIZE - 5;
+  memcpy (pcr + 5, packet + 5, length);
+  memset (pcr + 5 + length, 0xff, GST_BDA_TS_PACKET_SIZE - 5 - length);
+  gst_bda_si_filter_write_packet (filter, pcr);
+}
+
+/* Packetizes a section on pid, padding the last packet with stuffing. */
+static void
+gst_bda_si_filter_write_section (GstBdaSiFilter * filter, guint16 pid,
+    const guint8 * section, gsize size)
+{
+  gsize offset = 0;
+
+  while (offset < size) {
+    guint8 packet[GST_BDA_TS_PACKET_SIZE];
+    gsize header = 4;
+    packet[0] = GST_BDA_TS_SYNC_BYTE;
+    packet[1] = (offset == 0 ? 0x40 : 0x00) | (pid >> 8);
+    packet[2] = pid & 0xff;
+    packet[3] = 0x10 | filter->cc[pid];
+    filter->cc[pid] = (filter->cc[pid] + 1) & 0x0f;
+    if (offset == 0) {
+      /* Pointer field */
+      packet[header++] = 0;
+    }
+
+    gsize n = MIN (size - offset, GST_BDA_TS_PACKET_SIZE - header);
+    memcpy (packet + header, section + offset, n);
+    memset (packet + header + n, 0xff, GST_BDA_TS_PACKET_SIZE - header - n);
+    offset += n;
+    gst_bda_si_filter_write_packet (filter, packet);
+  }
+}
+
+static void
+gst_bda_si_filter_write_table (GstBdaSiFilter * filter, GstBdaSiTable * table)
+{
+  for (guint i = 0; i < G_N_ELEMENTS (table->sections); i++) {
+    if (table->sections[i]) {
+      gsize size;
+      const guint8 *data = (const guint8 *)
+          g_bytes_get_data (table->sections[i], &size);
+      gst_bda_si_filter_write_section (filter, table->pid, data, size);
+    }
+  }
+}
+
+static void
+gst_bda_si_filter_add_pid (GstBdaSiFilter * filter, guint16 pid)
+{
+  filter->reduced[pid / 8] |= 1 << (pid % 8);
+  gst_bda_section_assembler_add_pid (filter->assembler, pid);
+}
+
+/* Reduces the PMTs listed in a PAT section too. */
+static void
+gst_bda_si_filter_parse_pat (GstBdaSiFilter * filter, const guint8 * section,
+    gsize size)
+{
+  /* Programs follow the 8 byte header and precede the CRC. */
+  for (gsize i = 8; i + 4 <= size - 4; i += 4) {
+    guint16 number = (section[i] << 8) | section[i + 1];
+    guint16 pid = ((section[i + 2] & 0x1f) << 8) | section[i + 3];
+    /* Program 0 is the network PID. */
+    if (number != 0) {
+      gst_bda_si_filter_add_pid (filter, pid);
+    }
+  }
+}
+
+/* Passes on a new section, and keeps it for refresh. */
+static void
+gst_bda_si_filter_section (guint16 pid, const guint8 * section, gsize size,
+    gpointer user_data)
+{
+  GstBdaSiFilter *filter = (GstBdaSiFilter *) user_data;
+
+  gst_bda_si_filter_write_section (filter, pid, section, size);
+  /* Short sections, e.g. stuffing, have no version to refresh. */
+  if (!(section[1] & 0x80) || size < 12) {
+    return;
+  }
+
+  guint64 key = ((guint64) pid << 32) | ((section[5] & 0x01) << 24) |
+      (section[0] << 16) | (section[3] << 8) | section[4];
+  guint version = (section[5] >> 1) & 0x1f;
+  GstBdaSiTable *table = (GstBdaSiTable *)
+      g_hash_table_lookup (filter->tables, &key);
+  if (!table) {
+    gboolean psi = pid < NIT_PID || pid > EIT_PID;
+    gint64 refresh = psi ? filter->psi_refresh : filter->si_refresh;
+    table = g_new0 (GstBdaSiTable, 1);
+    table->key = key;
+    table->pid = pid;
+    table->version = version;
+    table->link.data = table;
+    table->sent = filter->now;
+    if (refresh > 0) {
+      table->queue = psi ? &filter->psi_queue : &filter->si_queue;
+      g_queue_push_tail_link (table->queue, &table->link);
+    }
+    g_hash_table_insert (filter->tables, &table->key, table);
+  } else if (table->version != version) {
+    /* Sections of the previous version must not be repeated. */
+    for (guint i = 0; i < G_N_ELEMENTS (table->sections); i++) {
+      if (table->sections[i]) {
+        g_bytes_unref (table->sections[i]);
+        table->sections[i] = NULL;
+      }
+    }
+    table->version = version;
+  }
+
+  guint number = section[6];
+  if (table->sections[number]) {
+    g_bytes_unref (table->sections[number]);
+  }
+  table->sections[number] = g_bytes_new (section, size);
+
+  if (pid == PAT_PID && section[0] == PAT_TABLE_ID) {
+    gst_bda_si_filter_parse_pat (filter, section, size);
+  }
+}
+
+/* Repeats the tables of a queue that were last sent refresh ago. */
+static void
+gst_bda_si_filter_refresh (GstBdaSiFilter * filter, GQueue * queue,
+    gint64 refresh)
+{
+  GList *link;
+  while ((link = g_queue_peek_head_link (queue))) {
+    GstBdaSiTable *table = (GstBdaSiTable *) link->data;
+    if (filter->now - table->sent < refresh) {
+      break;
+    }
+    gst_bda_si_filter_write_table (filter, table);
+    table->sent = filter->now;
+    g_queue_unlink (queue, link);
+    g_queue_push_tail_link (queue, link);
+  }
+}
+
+static void
+gst_bda_si_filter_init_pids (GstBdaSiFilter * filter)
+{
+  memset (filter->reduced, 0, sizeof (filter->reduced));
+  gst_bda_si_filter_add_pid (filter, PAT_PID);
+  gst_bda_si_filter_add_pid (filter, CAT_PID);
+  gst_bda_si_filter_add_pid (filter, NIT_PID);
+  gst_bda_si_filter_add_pid (filter, SDT_PID);
+  gst_bda_si_filter_add_pid (filter, EIT_PID);
+}
+
+GstBdaSiFilter *
+gst_bda_si_filter_new (guint psi_refresh, guint si_refresh)
+{
+  GstBdaSiFilter *filter = g_new0 (GstBdaSiFilter, 1);
+  filter->psi_refresh = psi_refresh * G_TIME_SPAN_MILLISECOND;
+  filter->si_refresh = si_refresh * G_TIME_SPAN_MILLISECOND;
+  filter->assembler =
+      gst_bda_section_assembler_new (gst_bda_si_filter_section, filter);
+  gst_bda_section_assembler_set_deduplicate (filter->assembler, TRUE);
+  filter->tables = g_hash_table_new_full (g_int64_hash, g_int64_equal, NULL,
+      (GDestroyNotify) gst_bda_si_table_free);
+  g_queue_init (&filter->psi_queue);
+  g_queue_init (&filter->si_queue);
+  gst_bda_si_filter_init_pids (filter);
+
+  return filter;
+}
+
+void
+gst_bda_si_filter_free (GstBdaSiFilter * filter)
+{
+  if (!filter) {
+    return;
+  }
+
+  g_hash_table_destroy (filter->tables);
+  gst_bda_section_assembler_free (filter->assembler);
+  g_free (filter);
+}
+
+void
+gst_bda_si_filter_push (GstBdaSiFilter * filter, const guint8 * data,
+    gsize size, gint64 now, GArray * runs, GByteArray * written)
+{
+  filter->now = now;
+  filter->runs = runs;
+  filter->written = written;
+
+  for (gsize i = 0; i + GST_BDA_TS_PACKET_SIZE <= size;
+      i += GST_BDA_TS_PACKET_SIZE) {
+    const guint8 *packet = data + i;
+    guint16 pid = gst_bda_ts_pid (packet);
+    if (packet[0] != GST_BDA_TS_SYNC_BYTE
+        || !(filter->reduced[pid / 8] & (1 << (pid % 8)))) {
+      gst_bda_si_filter_add_run (filter, i, GST_BDA_TS_PACKET_SIZE, FALSE);
+      continue;
+    }
+
+    guint64 pcr;
+    if (gst_bda_ts_get_pcr (packet, &pcr)) {
+      gst_bda_si_filter_write_pcr (filter, packet);
+    }
+    gst_bda_section_assembler_push (filter->assembler, packet,
+        GST_BDA_TS_PACKET_SIZE);
+  }
+
+  if (filter->psi_refresh > 0) {
+    gst_bda_si_filter_refresh (filter, &filter->psi_queue,
+        filter->psi_refresh);
+  }
+  if (filter->si_refresh > 0) {
+    gst_bda_si_filter_refresh (filter, &filter->si_queue, filter->si_refresh);
+  }
+  filter->runs = NULL;
+  filter->written = NULL;
+}
+
+void
+gst_bda_si_filter_reset (GstBdaSiFilter * filter)
+{
+  g_hash_table_remove_all (filter->tables);
+  /* PMT PIDs of the previous multiplex are no longer reduced. */
+  for (guint pid = 0; pid < PID_COUNT; pid++) {
+    if (filter->reduced[pid / 8] & (1 << (pid % 8))) {
+      gst_bda_section_assembler_remove_pid (filter->assembler, pid);
+    }
+  }
+  gst_bda_si_filter_init_pids (filter);
+}
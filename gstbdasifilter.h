@@ -0,0 +1,66 @@
+/* GStreamer
+ * Copyright (C) 2015 Raimo Järvi <raimo.jarvi@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef __GST_BDASIFILTER_H__
+#define __GST_BDASIFILTER_H__
+
+#include <glib.h>
+
+/* Reduces the PSI/SI of a stream to its changes. The packets of the PAT,
+   CAT, PMTs, NIT, SDT/BAT and EIT are replaced by packets of the sections
+   that are new or belong to a new table version, and each table is
+   repeated at a low refresh rate instead of at broadcast rate. */
+
+typedef struct _GstBdaSiFilter GstBdaSiFilter;
+typedef struct _GstBdaSiFilterRun GstBdaSiFilterRun;
+
+/* Part of the output of a push. */
+struct _GstBdaSiFilterRun {
+  /* Offset in the packets written by the filter if written is set,
+     otherwise in the pushed data. */
+  gsize offset;
+  gsize size;
+  gboolean written;
+};
+
+/**
+ * Creates a filter that repeats unchanged PAT, CAT and PMT tables every
+ * psi_refresh ms, and NIT, SDT, BAT and EIT tables every si_refresh ms. 0
+ * doesn't repeat them.
+ */
+GstBdaSiFilter *gst_bda_si_filter_new (guint psi_refresh, guint si_refresh);
+void gst_bda_si_filter_free (GstBdaSiFilter * filter);
+
+/**
+ * Filters whole packets at the start of data. The output is appended to
+ * runs as GstBdaSiFilterRun, ranges of data passed on as is and of packets
+ * appended to written. The sections passed on are packetized in place of
+ * the packet that completes them, and the PCR of a packet on a replaced PID
+ * is kept in an adaptation field only packet. Tables due for refresh at
+ * now, a monotonic time in us, follow at the end.
+ */
+void gst_bda_si_filter_push (GstBdaSiFilter * filter, const guint8 * data,
+    gsize size, gint64 now, GArray * runs, GByteArray * written);
+
+/**
+ * Forgets all tables, e.g. after tuning to another multiplex.
+ */
+void gst_bda_si_filter_reset (GstBdaSiFilter * filter);
+
+#endif
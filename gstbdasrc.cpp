@@ -21,6 +21,119 @@
  * SECTION:element-bdasrc
  *
  * bdasrc can be used to capture MPEG-2 transport stream from Windows BDA devices: DVB-C, DVB-S or DVB-T.
+ *
+ * With backend=replay a transport stream file, and with backend=synthetic a
+ * generated stream, is fed through the same capture path instead of a tuner,
+ * e.g. for benchmarking on hosts without BDA. trace-location records the
+ * sample sizes and timing of a tuner, and backend=trace reproduces them.
+ *
+ * Tuning properties can be changed in PLAYING. The device is retuned without
+ * rebuilding the graph, queued samples are dropped, the next buffer is marked
+ * DISCONT and a "retune-complete" element message is posted with the
+ * "frequency" and "success" fields.
+ *
+ * Signal lock is waited for in the background after every tune, so that
+ * state changes don't block on slow demodulators. A "lock-acquired" element
+ * message with "frequency" and "time-to-lock" (ns), or "lock-timeout" with
+ * "frequency" and "timeout" (ns) after tune-timeout, is posted.
+ *
+ * With async-open=true the device is opened on a worker thread and
+ * NULL -> READY returns ASYNC, so that many tuners can be brought up in
+ * parallel. Completion is reported with an async-done message, failure with
+ * an error message.
+ *
+ * All device operations run in order on a worker thread of the element,
+ * which makes all filter graph calls. Callers wait for them at most
+ * device-timeout, so a hung driver call can't block the streaming thread
+ * indefinitely.
+ *
+ * Elements with share-tuner=true that use the same device and tuning
+ * properties share one open device. Every sample is delivered to each of
+ * them, as a buffer that shares its memory with the other elements. Each
+ * element has its own queue, and can select the packets it needs with the
+ * pids property. With gop-cache-size set, the tuner keeps the packets of
+ * each program since its last random access point, and an element started
+ * while the tuner is already running receives them, with the current PAT
+ * and PMTs, ahead of the live samples. Decoding can then start without
+ * waiting for the next keyframe.
+ *
+ * With mark-keyframes=true packet aligned buffers that don't contain a
+ * random access point of a video stream are flagged DELTA_UNIT, and the
+ * others get a GstBdaKeyframeMeta with the offset of the packet where the
+ * first one starts, so that recorders and segmenters can cut without
+ * parsing video.
+ *
+ * With standby=true a second tuner is kept running on the same transponder
+ * with its own graph. Output switches to the other tuner at a packet
+ * boundary when the signal lock is lost, no sample arrives for
+ * failover-timeout or failover-cc-errors continuity errors occur within a
+ * second. The first buffer from the other tuner is marked DISCONT and a
+ * "failover" element message with the "device" now delivering output and
+ * the "reason" (lock-lost, stall or cc-errors) is posted.
+ *
+ * When no sample arrives for stall-timeout the device is recovered in
+ * stages: the tune request is submitted again, then the device is stopped
+ * and started, then the graph is closed and rebuilt, without changing the
+ * element state. Each step posts a "stall-recovery" element message with
+ * the "action" (retune, restart or rebuild), "success" and the "retunes",
+ * "restarts" and "rebuilds" taken so far. The stages start over once
+ * samples arrive again.
+ *
+ * warm-frequencies keeps a spare tuner running on each of the listed
+ * frequencies, e.g. the neighbours of the current channel. Changing the
+ * frequency to one of them switches the output to the already locked
+ * tuner instead of tuning. The other tuners then move to the listed
+ * frequencies that no tuner is on, so the list can follow the channel.
+ *
+ * With inject-psi=true the PAT and PMT packets last seen on a transponder
+ * are queued ahead of its stream after every tune, so that players don't
+ * wait for their next repetition. They are replaced in the cache once a
+ * fresh PAT and all of its PMTs have been seen, and can be persisted with
+ * psi-cache.
+ *
+ * With scan-transponders set the element scans instead of streaming. On
+ * open a tuner is opened for each transponder, the element's own device
+ * first and then free devices of the same type, and in PLAYING every tuner
+ * takes transponders from the list in turn. Each waits scan-lock-timeout
+ * for lock and then for the PAT, PMTs, SDT and NIT, and posts a
+ * "scan-transponder" element message with "frequency", "device", "locked"
+ * and the number of "channels" found. Once the list is done a
+ * "scan-complete" message with the "channels", see gstbdascan.h, and the
+ * number of "transponders" and "locked" ones is posted, followed by EOS.
+ *
+ * With epg-transponders set the element collects the EPG instead of
+ * streaming. A tuner on the element's device moves through the
+ * transponders in turn and stays on each one only until the SDT and every
+ * section of the EIT schedule of its services are received, or at most
+ * epg-timeout, and posts an "epg-transponder" element message with
+ * "frequency", "locked", "complete" and the number of new "events". The
+ * events are kept in a store indexed by service and start time, which
+ * answers custom "epg-events" queries with optional "service-id", "start"
+ * and "end" fields by setting "events", see gstbdaepg.h.
+ *
+ * si-pids reads the PSI/SI sections of the listed PIDs from the ingested
+ * stream and posts an "si-section" element message with "pid", "table-id"
+ * and the "section" bytes for each section that passes its CRC check and
+ * wasn't seen before on the multiplex. Long form sections add
+ * "table-id-extension", "version", "current", "section-number" and
+ * "last-section-number". Repetitions of unchanged sections are recognised
+ * from their header and dropped before they are copied or checked, so a
+ * message means new content.
+ *
+ * reduce-si shrinks the PSI/SI in the output to its changes. The packets of
+ * the PAT, CAT, PMTs, NIT, SDT/BAT and EIT are replaced by the sections that
+ * are new or of a new table version, and unchanged tables are repeated only
+ * every psi-refresh (PAT, CAT and PMTs) or si-refresh (the others) ms, so
+ * downstream demuxers parse far fewer sections.
+ *
+ * An es_%u request pad, e.g. es_257, carries the elementary stream of the
+ * PID in its name, reassembled from the PES packets of the received
+ * samples, so a single stream doesn't need a tsdemux. Caps follow the PMT
+ * stream type and descriptors, and buffers are pushed once the PMT listing
+ * the PID is seen. PTS and DTS are mapped to the running time at which the
+ * first PES packet with a timestamp was pushed. Each es_%u pad is pushed
+ * from its own task and is not affected by pids, but the src pad still
+ * needs to be linked.
  */
 
 #ifdef HAVE_CONFIG_H
@@ -30,6 +143,7 @@
 #include "gstbdasrc.h"
 #include <gst/gst.h>
 #include <string.h>
+#ifdef HAVE_DIRECTSHOW
 #include <control.h>
 #include <dshow.h>
 #include <mmreg.h>
@@ -38,8 +152,21 @@
 #include <bdatypes.h>
 #include <bdamedia.h>
 #include <bdaiface.h>
-#include "gstbdagrabber.h"
-#include "gstbdautil.h"
+#endif
+#include "gstbdabackend.h"
+#include "gstbdapsicache.h"
+#include "gstbdakeyframe.h"
+#include "gstbdascan.h"
+#include "gstbdaepg.h"
+#include "gstbdasection.h"
+#include "gstbdasifilter.h"
+#include "gstbdats.h"
+#include "gstbdaworker.h"
+#include "gstbdatuner.h"
+#include "gstbdashared.h"
+#include "gstbdafailover.h"
+#include "gstbdawarm.h"
+#include "gstbdaes.h"
 
 GST_DEBUG_CATEGORY (gstbdasrc_debug);
 
@@ -60,7 +187,45 @@ enum
   PROP_ORBITAL_POSITION,
   PROP_WEST_POSITION,
   PROP_POLARISATION,
-  PROP_INNER_FEC_RATE
+  PROP_INNER_FEC_RATE,
+  PROP_BACKEND,
+  PROP_REPLAY_LOCATION,
+  PROP_PACING,
+  PROP_BITRATE,
+  PROP_CHUNK_SIZE,
+  PROP_JITTER,
+  PROP_LOOP,
+  PROP_SYNTHETIC_PARAMS,
+  PROP_TRACE_LOCATION,
+  PROP_TRACE_PAYLOAD,
+  PROP_TUNE_TIMEOUT,
+  PROP_GRAPH_CACHE,
+  PROP_ASYNC_OPEN,
+  PROP_DEVICE_TIMEOUT,
+  PROP_POOL_IDLE_TIME,
+  PROP_SHARE_TUNER,
+  PROP_PIDS,
+  PROP_DEVICE_TYPE,
+  PROP_CURRENT_DEVICE,
+  PROP_STANDBY,
+  PROP_STANDBY_DEVICE,
+  PROP_FAILOVER_TIMEOUT,
+  PROP_FAILOVER_CC_ERRORS,
+  PROP_STALL_TIMEOUT,
+  PROP_STALL_RECOVERIES,
+  PROP_WARM_FREQUENCIES,
+  PROP_INJECT_PSI,
+  PROP_PSI_CACHE,
+  PROP_GOP_CACHE_SIZE,
+  PROP_MARK_KEYFRAMES,
+  PROP_SCAN_TRANSPONDERS,
+  PROP_SCAN_LOCK_TIMEOUT,
+  PROP_EPG_TRANSPONDERS,
+  PROP_EPG_TIMEOUT,
+  PROP_SI_PIDS,
+  PROP_REDUCE_SI,
+  PROP_PSI_REFRESH,
+  PROP_SI_REFRESH
 };
 
 #define DEFAULT_BUFFER_SIZE 50
@@ -76,6 +241,50 @@ enum
 #define DEFAULT_WEST_POSITION FALSE
 #define DEFAULT_POLARISATION BDA_POLARISATION_NOT_SET
 #define DEFAULT_INNER_FEC_RATE BDA_BCC_RATE_NOT_SET
+#ifdef HAVE_DIRECTSHOW
+#define DEFAULT_BACKEND GST_BDA_BACKEND_DSHOW
+#else
+#define DEFAULT_BACKEND GST_BDA_BACKEND_REPLAY
+#endif
+#define DEFAULT_REPLAY_LOCATION NULL
+#define DEFAULT_PACING GST_BDA_PACING_PCR
+#define DEFAULT_BITRATE 24000000
+#define DEFAULT_CHUNK_SIZE (348 * GST_BDA_TS_PACKET_SIZE)
+#define DEFAULT_JITTER 0
+#define DEFAULT_LOOP TRUE
+#define DEFAULT_SYNTHETIC_PARAMS NULL
+#define DEFAULT_TRACE_LOCATION NULL
+#define DEFAULT_TRACE_PAYLOAD FALSE
+#define DEFAULT_TUNE_TIMEOUT 5000
+#define DEFAULT_GRAPH_CACHE NULL
+#define DEFAULT_ASYNC_OPEN FALSE
+#define DEFAULT_DEVICE_TIMEOUT 10000
+#define DEFAULT_POOL_IDLE_TIME 0
+#define DEFAULT_SHARE_TUNER FALSE
+#define DEFAULT_PIDS NULL
+#define DEFAULT_DEVICE_TYPE GST_BDA_UNKNOWN
+#define DEFAULT_STANDBY FALSE
+#define DEFAULT_STANDBY_DEVICE -1
+#define DEFAULT_FAILOVER_TIMEOUT 500
+#define DEFAULT_FAILOVER_CC_ERRORS 50
+#define DEFAULT_STALL_TIMEOUT 0
+#define DEFAULT_WARM_FREQUENCIES NULL
+#define DEFAULT_INJECT_PSI FALSE
+#define DEFAULT_PSI_CACHE NULL
+#define DEFAULT_GOP_CACHE_SIZE 0
+#define DEFAULT_MARK_KEYFRAMES FALSE
+#define DEFAULT_SCAN_TRANSPONDERS NULL
+#define DEFAULT_SCAN_LOCK_TIMEOUT 1500
+#define DEFAULT_EPG_TRANSPONDERS NULL
+#define DEFAULT_EPG_TIMEOUT 60000
+#define DEFAULT_SI_PIDS NULL
+#define DEFAULT_REDUCE_SI FALSE
+#define DEFAULT_PSI_REFRESH 1000
+#define DEFAULT_SI_REFRESH 10000
+
+/* Signal lock polling interval, doubled after every poll. */
+#define LOCK_POLL_MIN (10 * G_TIME_SPAN_MILLISECOND)
+#define LOCK_POLL_MAX (500 * G_TIME_SPAN_MILLISECOND)
 
 #define GST_TYPE_BDASRC_MODULATION (gst_bdasrc_modulation_get_type ())
 static GType
@@ -208,6 +417,66 @@ gst_bdasrc_polarisation_get_type (void)
   return bdasrc_polarisation_type;
 }
 
+#define GST_TYPE_BDASRC_BACKEND (gst_bdasrc_backend_get_type ())
+static GType
+gst_bdasrc_backend_get_type (void)
+{
+  static GType bdasrc_backend_type = 0;
+  static GEnumValue backend_types[] = {
+    {GST_BDA_BACKEND_DSHOW, "dshow", "dshow"},
+    {GST_BDA_BACKEND_REPLAY, "replay", "replay"},
+    {GST_BDA_BACKEND_SYNTHETIC, "synthetic", "synthetic"},
+    {GST_BDA_BACKEND_TRACE, "trace", "trace"},
+    {0, NULL, NULL},
+  };
+
+  if (!bdasrc_backend_type) {
+    bdasrc_backend_type =
+        g_enum_register_static ("GstBdaSrcBackend", backend_types);
+  }
+  return bdasrc_backend_type;
+}
+
+#define GST_TYPE_BDASRC_INPUT_TYPE (gst_bdasrc_input_type_get_type ())
+static GType
+gst_bdasrc_input_type_get_type (void)
+{
+  static GType bdasrc_input_type_type = 0;
+  static GEnumValue input_types[] = {
+    {GST_BDA_UNKNOWN, "Any", "any"},
+    {GST_BDA_ATSC, "ATSC", "atsc"},
+    {GST_BDA_DVB_C, "DVB-C", "dvb-c"},
+    {GST_BDA_DVB_S, "DVB-S", "dvb-s"},
+    {GST_BDA_DVB_T, "DVB-T", "dvb-t"},
+    {0, NULL, NULL},
+  };
+
+  if (!bdasrc_input_type_type) {
+    bdasrc_input_type_type =
+        g_enum_register_static ("GstBdaSrcInputType", input_types);
+  }
+  return bdasrc_input_type_type;
+}
+
+#define GST_TYPE_BDASRC_PACING (gst_bdasrc_pacing_get_type ())
+static GType
+gst_bdasrc_pacing_get_type (void)
+{
+  static GType bdasrc_pacing_type = 0;
+  static GEnumValue pacing_types[] = {
+    {GST_BDA_PACING_PCR, "pcr", "pcr"},
+    {GST_BDA_PACING_BITRATE, "bitrate", "bitrate"},
+    {GST_BDA_PACING_NONE, "none", "none"},
+    {0, NULL, NULL},
+  };
+
+  if (!bdasrc_pacing_type) {
+    bdasrc_pacing_type =
+        g_enum_register_static ("GstBdaSrcPacing", pacing_types);
+  }
+  return bdasrc_pacing_type;
+}
+
 static void gst_bdasrc_finalize (GObject * object);
 static void gst_bdasrc_set_property (GObject * object, guint prop_id,
     const GValue * value, GParamSpec * pspec);
@@ -223,8 +492,15 @@ static GstStateChangeReturn gst_bdasrc_change_state (GstElement * element,
 
 static gboolean gst_bdasrc_unlock (GstBaseSrc * bsrc);
 static gboolean gst_bdasrc_unlock_stop (GstBaseSrc * bsrc);
+static gboolean gst_bdasrc_query (GstBaseSrc * bsrc, GstQuery * query);
 
-static gboolean gst_bdasrc_tune (GstBdaSrc * self);
+static void gst_bdasrc_cancel_tune_step (GstBdaSrc * self);
+static void gst_bdasrc_stop_lock_wait (GstBdaSrc * self);
+static GstBuffer *gst_bdasrc_filter_pids (const guint8 * pid_filter,
+    GstBuffer * buffer);
+static void gst_bdasrc_start_psi (GstBdaSrc * self);
+static void gst_bdasrc_enqueue (GstBdaSrc * self, GstBuffer * buffer);
+static guint8 *gst_bdasrc_parse_pids (GstBdaSrc * self, const gchar * pids);
 
 static GstStaticPadTemplate ts_src_factory = GST_STATIC_PAD_TEMPLATE ("src",
     GST_PAD_SRC,
@@ -233,6 +509,11 @@ static GstStaticPadTemplate ts_src_factory = GST_STATIC_PAD_TEMPLATE ("src",
     ("video/mpegts, "
         "mpegversion = (int) 2," "systemstream = (boolean) TRUE"));
 
+static GstStaticPadTemplate es_src_factory = GST_STATIC_PAD_TEMPLATE ("es_%u",
+    GST_PAD_SRC,
+    GST_PAD_REQUEST,
+    GST_STATIC_CAPS_ANY);
+
 /* GObject Related */
 
 #define gst_bdasrc_parent_class parent_class
@@ -258,6 +539,8 @@ gst_bdasrc_class_init (GstBdaSrcClass * klass)
 
   gst_element_class_add_pad_template (gstelement_class,
       gst_static_pad_template_get (&ts_src_factory));
+  gst_element_class_add_pad_template (gstelement_class,
+      gst_static_pad_template_get (&es_src_factory));
 
   gst_element_class_set_details_simple (gstelement_class, "BDA Source",
       "Source/Video",
@@ -265,8 +548,12 @@ gst_bdasrc_class_init (GstBdaSrcClass * klass)
       "Raimo Järvi <raimo.jarvi@gmail.com>");
 
   gstelement_class->change_state = GST_DEBUG_FUNCPTR (gst_bdasrc_change_state);
+  gstelement_class->request_new_pad =
+      GST_DEBUG_FUNCPTR (gst_bdasrc_request_new_pad);
+  gstelement_class->release_pad = GST_DEBUG_FUNCPTR (gst_bdasrc_release_pad);
   gstbasesrc_class->unlock = GST_DEBUG_FUNCPTR (gst_bdasrc_unlock);
   gstbasesrc_class->unlock_stop = GST_DEBUG_FUNCPTR (gst_bdasrc_unlock_stop);
+  gstbasesrc_class->query = GST_DEBUG_FUNCPTR (gst_bdasrc_query);
 
   gstpushsrc_class->create = GST_DEBUG_FUNCPTR (gst_bdasrc_create);
 
@@ -277,8 +564,9 @@ gst_bdasrc_class_init (GstBdaSrcClass * klass)
           (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
 
   g_object_class_install_property (gobject_class, PROP_DEVICE_INDEX,
-      g_param_spec_uint ("device", "Device index", "BDA device index, e.g. 0"
-          " for the first device", 0, 64, DEFAULT_DEVICE_INDEX,
+      g_param_spec_int ("device", "Device index", "BDA device index, e.g. 0"
+          " for the first device, -1 to select a free device of device-type"
+          " automatically", -1, 64, DEFAULT_DEVICE_INDEX,
           (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
 
   g_object_class_install_property (gobject_class, PROP_FREQUENCY,
@@ -344,19 +632,330 @@ gst_bdasrc_class_init (GstBdaSrcClass * klass)
           "Inner FEC rate (DVB-S)", GST_TYPE_BDASRC_FEC_RATE,
           DEFAULT_INNER_FEC_RATE,
           (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_BACKEND,
+      g_param_spec_enum ("backend", "Backend",
+          "Device control backend", GST_TYPE_BDASRC_BACKEND,
+          DEFAULT_BACKEND,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_REPLAY_LOCATION,
+      g_param_spec_string ("replay-location", "Replay location",
+          "Transport stream file or sample trace to replay (replay and trace"
+          " backends)",
+          DEFAULT_REPLAY_LOCATION,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_PACING,
+      g_param_spec_enum ("pacing", "Pacing",
+          "Replay pacing: stream PCR, fixed bitrate or as fast as possible"
+          " (replay and synthetic backends). A stream without PCR in its"
+          " first second is paced at bitrate. The trace backend follows the"
+          " recorded timing unless pacing is none", GST_TYPE_BDASRC_PACING,
+          DEFAULT_PACING,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_BITRATE,
+      g_param_spec_uint ("bitrate", "Bitrate",
+          "Bitrate in bits per second for pacing=bitrate, and of the"
+          " generated stream (replay and synthetic backends)", 1, G_MAXUINT,
+          DEFAULT_BITRATE,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_CHUNK_SIZE,
+      g_param_spec_uint ("chunk-size", "Chunk size",
+          "Size of each replayed sample in bytes (replay and synthetic"
+          " backends)", 1,
+          G_MAXINT, DEFAULT_CHUNK_SIZE,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_JITTER,
+      g_param_spec_uint ("jitter", "Jitter",
+          "Maximum random deviation of sample arrival in microseconds"
+          " (replay and synthetic backends)", 0, G_MAXINT - 1, DEFAULT_JITTER,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_LOOP,
+      g_param_spec_boolean ("loop", "Loop",
+          "Restart from the beginning at end of file, otherwise send EOS"
+          " (replay backend)", DEFAULT_LOOP,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_SYNTHETIC_PARAMS,
+      g_param_spec_string ("synthetic-params", "Synthetic stream parameters",
+          "Generator parameters, e.g. \"programs=8,null-share=5,"
+          "cc-errors=0.001\" (synthetic backend, and trace backend for"
+          " traces without payload)", DEFAULT_SYNTHETIC_PARAMS,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_TRACE_LOCATION,
+      g_param_spec_string ("trace-location", "Trace location",
+          "Record the size and timing of every sample to this file, replay"
+          " it with backend=trace (dshow backend)", DEFAULT_TRACE_LOCATION,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_TRACE_PAYLOAD,
+      g_param_spec_boolean ("trace-payload", "Trace payload",
+          "Include sample data in the trace (dshow backend)",
+          DEFAULT_TRACE_PAYLOAD,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_TUNE_TIMEOUT,
+      g_param_spec_uint ("tune-timeout", "Tune timeout",
+          "Time to wait for signal lock after tuning in ms, 0 to not wait",
+          0, G_MAXINT, DEFAULT_TUNE_TIMEOUT,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_GRAPH_CACHE,
+      g_param_spec_string ("graph-cache", "Graph cache",
+          "Persist the receiver filter and TS media type that worked for each"
+          " tuner device to this file. Graph builds are always cached within"
+          " the process (dshow backend)", DEFAULT_GRAPH_CACHE,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_ASYNC_OPEN,
+      g_param_spec_boolean ("async-open", "Asynchronous open",
+          "Open the device on a worker thread, NULL -> READY returns ASYNC"
+          " and completes with an async-done message", DEFAULT_ASYNC_OPEN,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_DEVICE_TIMEOUT,
+      g_param_spec_uint ("device-timeout", "Device timeout",
+          "Time to wait for a device operation (open, start, stop, retune,"
+          " signal statistics) in ms, 0 to wait forever. Operations not"
+          " started by then are dropped",
+          0, G_MAXINT, DEFAULT_DEVICE_TIMEOUT,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_POOL_IDLE_TIME,
+      g_param_spec_uint ("pool-idle-time", "Pool idle time",
+          "Keep the stopped graph this long in ms after closing, so that"
+          " another element for the same device only has to tune it, 0 to"
+          " release it immediately (dshow backend)",
+          0, G_MAXINT, DEFAULT_POOL_IDLE_TIME,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_SHARE_TUNER,
+      g_param_spec_boolean ("share-tuner", "Share tuner",
+          "Share the device with other elements that use the same device and"
+          " tuning properties. Change only in NULL state", DEFAULT_SHARE_TUNER,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_PIDS,
+      g_param_spec_string ("pids", "PIDs",
+          "Comma separated PIDs to output, e.g. \"0,16,256,257\", all if not"
+          " set. Samples must consist of whole packets", DEFAULT_PIDS,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_DEVICE_TYPE,
+      g_param_spec_enum ("device-type", "Device type",
+          "Input type of the device selected with device -1",
+          GST_TYPE_BDASRC_INPUT_TYPE, DEFAULT_DEVICE_TYPE,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_CURRENT_DEVICE,
+      g_param_spec_int ("current-device", "Current device",
+          "Index of the open BDA device, -1 if none", -1, G_MAXINT, -1,
+          (GParamFlags) (G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_STANDBY,
+      g_param_spec_boolean ("standby", "Hot standby",
+          "Keep a second tuner locked to the same transponder and switch to"
+          " it when the device fails", DEFAULT_STANDBY,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_STANDBY_DEVICE,
+      g_param_spec_int ("standby-device", "Standby device",
+          "BDA device index of the standby tuner, -1 to select a free device"
+          " of the same type automatically", -1, 64, DEFAULT_STANDBY_DEVICE,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_FAILOVER_TIMEOUT,
+      g_param_spec_uint ("failover-timeout", "Failover timeout",
+          "Switch to the standby tuner when no sample arrives for this long"
+          " in ms", 1, G_MAXINT, DEFAULT_FAILOVER_TIMEOUT,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_FAILOVER_CC_ERRORS,
+      g_param_spec_uint ("failover-cc-errors", "Failover CC errors",
+          "Switch to the standby tuner after this many continuity errors"
+          " within a second, 0 to ignore continuity errors", 0, G_MAXINT,
+          DEFAULT_FAILOVER_CC_ERRORS,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_STALL_TIMEOUT,
+      g_param_spec_uint ("stall-timeout", "Stall timeout",
+          "Recover the device when no sample arrives for this long in ms, 0"
+          " to wait forever. Ignored with share-tuner and warm-frequencies",
+          0, G_MAXINT,
+          DEFAULT_STALL_TIMEOUT,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_STALL_RECOVERIES,
+      g_param_spec_uint ("stall-recoveries", "Stall recoveries",
+          "Number of recovery steps taken after stalls", 0, G_MAXUINT, 0,
+          (GParamFlags) (G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_WARM_FREQUENCIES,
+      g_param_spec_string ("warm-frequencies", "Warm frequencies",
+          "Comma separated frequencies in kHz to keep spare tuners locked"
+          " on, so that changing frequency to one of them doesn't tune. The"
+          " number of spare tuners is fixed on open", DEFAULT_WARM_FREQUENCIES,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_INJECT_PSI,
+      g_param_spec_boolean ("inject-psi", "Inject PSI",
+          "Output the PAT and PMTs last seen on the transponder right after"
+          " tuning", DEFAULT_INJECT_PSI,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_PSI_CACHE,
+      g_param_spec_string ("psi-cache", "PSI cache",
+          "Persist the PAT and PMTs of each transponder to this file for"
+          " inject-psi. They are always cached within the process",
+          DEFAULT_PSI_CACHE,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_GOP_CACHE_SIZE,
+      g_param_spec_uint ("gop-cache-size", "GOP cache size",
+          "Bytes per program to cache since the last random access point of"
+          " a shared tuner, sent first when joining a running tuner. 0 to"
+          " disable", 0, G_MAXUINT, DEFAULT_GOP_CACHE_SIZE,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_MARK_KEYFRAMES,
+      g_param_spec_boolean ("mark-keyframes", "Mark keyframes",
+          "Flag packet aligned buffers without a video random access point"
+          " as delta units, and attach a GstBdaKeyframeMeta to the others",
+          DEFAULT_MARK_KEYFRAMES,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_SCAN_TRANSPONDERS,
+      g_param_spec_string ("scan-transponders", "Scan transponders",
+          "Scan these comma separated transponders on all free tuners instead"
+          " of streaming, as frequency[:symbol-rate[:modulation]] with the"
+          " element's values as defaults, e.g. 154000:6900:QAM 256,162000",
+          DEFAULT_SCAN_TRANSPONDERS,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_SCAN_LOCK_TIMEOUT,
+      g_param_spec_uint ("scan-lock-timeout", "Scan lock timeout",
+          "Time to wait for signal lock on each scanned transponder in ms,"
+          " also used by the EPG carousel",
+          0, G_MAXUINT, DEFAULT_SCAN_LOCK_TIMEOUT,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_EPG_TRANSPONDERS,
+      g_param_spec_string ("epg-transponders", "EPG transponders",
+          "Collect the EIT schedule of these comma separated transponders in"
+          " turn on one tuner instead of streaming, in the format of"
+          " scan-transponders. Query the events with an \"epg-events\""
+          " custom query", DEFAULT_EPG_TRANSPONDERS,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_EPG_TIMEOUT,
+      g_param_spec_uint ("epg-timeout", "EPG timeout",
+          "Longest time to stay on a transponder of the EPG carousel in ms",
+          1, G_MAXINT, DEFAULT_EPG_TIMEOUT,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_SI_PIDS,
+      g_param_spec_string ("si-pids", "SI PIDs",
+          "Comma separated PIDs to read PSI/SI sections of, e.g. \"0,16,17\"."
+          " An \"si-section\" element message is posted for each section"
+          " not seen before on the multiplex", DEFAULT_SI_PIDS,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_REDUCE_SI,
+      g_param_spec_boolean ("reduce-si", "Reduce SI",
+          "Output PSI/SI sections only when they change, repeating unchanged"
+          " tables at psi-refresh and si-refresh", DEFAULT_REDUCE_SI,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_PSI_REFRESH,
+      g_param_spec_uint ("psi-refresh", "PSI refresh",
+          "Interval to repeat unchanged PAT, CAT and PMT tables at with"
+          " reduce-si in ms, 0 to not repeat them",
+          0, G_MAXINT, DEFAULT_PSI_REFRESH,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_SI_REFRESH,
+      g_param_spec_uint ("si-refresh", "SI refresh",
+          "Interval to repeat unchanged NIT, SDT, BAT and EIT tables at with"
+          " reduce-si in ms, 0 to not repeat them",
+          0, G_MAXINT, DEFAULT_SI_REFRESH,
+          (GParamFlags) (G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
 }
 
 static void
 gst_bdasrc_init (GstBdaSrc * self)
 {
-  CoInitializeEx (NULL, COINIT_MULTITHREADED);
-
   gst_base_src_set_live (GST_BASE_SRC (self), TRUE);
 
   self->buffer_size = DEFAULT_BUFFER_SIZE;
   self->input_type = GST_BDA_UNKNOWN;
+  self->need_tune = FALSE;
+  self->discont = FALSE;
+  self->tune_timeout = DEFAULT_TUNE_TIMEOUT;
+  self->lock_generation = 0;
+  self->lock_polls = 0;
+  self->async_open = DEFAULT_ASYNC_OPEN;
+  self->open_command = NULL;
+  self->tune_step = NULL;
+  self->tune_command = NULL;
+  self->worker = gst_bda_worker_new ("bdasrc-device");
+  self->device_timeout = DEFAULT_DEVICE_TIMEOUT;
+  self->share_tuner = DEFAULT_SHARE_TUNER;
+  self->shared = NULL;
+  self->shared_active = FALSE;
+  self->owned_tuner = NULL;
+  self->pids = DEFAULT_PIDS;
+  self->pid_filter = NULL;
 
   self->device_index = DEFAULT_DEVICE_INDEX;
+  self->device_type = DEFAULT_DEVICE_TYPE;
+  self->selected_device = -1;
+  self->standby = DEFAULT_STANDBY;
+  self->standby_device = DEFAULT_STANDBY_DEVICE;
+  self->failover_timeout = DEFAULT_FAILOVER_TIMEOUT;
+  self->failover_cc_errors = DEFAULT_FAILOVER_CC_ERRORS;
+  self->failover = NULL;
+  self->standby_for = NULL;
+  self->sample_discont = FALSE;
+  self->stall_timeout = DEFAULT_STALL_TIMEOUT;
+  self->stall_stage = 0;
+  memset (self->stall_recoveries, 0, sizeof (self->stall_recoveries));
+  self->warm_frequencies = DEFAULT_WARM_FREQUENCIES;
+  self->warm = NULL;
+  self->warm_for = NULL;
+  self->inject_psi = DEFAULT_INJECT_PSI;
+  self->psi_cache = DEFAULT_PSI_CACHE;
+  self->psi_collector = NULL;
+  self->psi_aligner = g_new0 (GstBdaTsAligner, 1);
+  self->psi_packets = NULL;
+  self->psi_transponder = NULL;
+  self->gop_cache_size = DEFAULT_GOP_CACHE_SIZE;
+  self->mark_keyframes = DEFAULT_MARK_KEYFRAMES;
+  self->keyframe_scanner = NULL;
+  self->scan_transponders = DEFAULT_SCAN_TRANSPONDERS;
+  self->scan_lock_timeout = DEFAULT_SCAN_LOCK_TIMEOUT;
+  self->scan = NULL;
+  self->scan_for = NULL;
+  self->epg_transponders = DEFAULT_EPG_TRANSPONDERS;
+  self->epg_timeout = DEFAULT_EPG_TIMEOUT;
+  self->epg = NULL;
+  self->epg_for = NULL;
+  self->epg_store = NULL;
+  self->si_pids = DEFAULT_SI_PIDS;
+  self->si_pid_filter = NULL;
+  self->si_aligner = g_new0 (GstBdaTsAligner, 1);
+  self->si_assembler = NULL;
+  self->si_messages = NULL;
+  self->reduce_si = DEFAULT_REDUCE_SI;
+  self->psi_refresh = DEFAULT_PSI_REFRESH;
+  self->si_refresh = DEFAULT_SI_REFRESH;
+  self->si_filter = NULL;
+  gst_bdasrc_es_init (self);
   self->frequency = 0;
   self->symbol_rate = DEFAULT_SYMBOL_RATE;
   self->bandwidth = DEFAULT_BANDWIDTH;
@@ -369,16 +968,39 @@ gst_bdasrc_init (GstBdaSrc * self)
   self->polarisation = DEFAULT_POLARISATION;
   self->inner_fec_rate = DEFAULT_INNER_FEC_RATE;
 
+  self->backend_type = DEFAULT_BACKEND;
+  self->backend = NULL;
+  self->backend_data = NULL;
+
+  self->replay_location = DEFAULT_REPLAY_LOCATION;
+  self->pacing = DEFAULT_PACING;
+  self->bitrate = DEFAULT_BITRATE;
+  self->chunk_size = DEFAULT_CHUNK_SIZE;
+  self->jitter = DEFAULT_JITTER;
+  self->loop = DEFAULT_LOOP;
+  self->synthetic_params = DEFAULT_SYNTHETIC_PARAMS;
+  self->trace_location = DEFAULT_TRACE_LOCATION;
+  self->trace_payload = DEFAULT_TRACE_PAYLOAD;
+  self->graph_cache = DEFAULT_GRAPH_CACHE;
+  self->pool_idle_time = DEFAULT_POOL_IDLE_TIME;
+
+#ifdef HAVE_DIRECTSHOW
   self->network_tuner = NULL;
   self->receiver = NULL;
+  self->scanning_tuner = NULL;
+  self->tuning_space = NULL;
   self->filter_graph = NULL;
   self->media_control = NULL;
-  self->ts_grabber = new GstBdaGrabber (self);
+  self->ts_grabber = NULL;
+  self->graph_ready = FALSE;
+#endif
 
   g_mutex_init (&self->lock);
   g_cond_init (&self->cond);
+  g_cond_init (&self->lock_cond);
 
   g_queue_init (&self->ts_samples);
+  self->samples = 0;
 
   self->sample_received = gst_bdasrc_sample_received;
 }
@@ -397,7 +1019,7 @@ gst_bdasrc_set_property (GObject * _object, guint prop_id,
       self->buffer_size = g_value_get_uint (value);
       break;
     case PROP_DEVICE_INDEX:
-      self->device_index = g_value_get_uint (value);
+      self->device_index = g_value_get_int (value);
       break;
     case PROP_FREQUENCY:
       self->frequency = g_value_get_uint (value);
@@ -433,9 +1055,190 @@ gst_bdasrc_set_property (GObject * _object, guint prop_id,
       self->inner_fec_rate =
           (BinaryConvolutionCodeRate) g_value_get_enum (value);
       break;
+    case PROP_BACKEND:
+      self->backend_type = (GstBdaBackendType) g_value_get_enum (value);
+      break;
+    case PROP_REPLAY_LOCATION:
+      g_free (self->replay_location);
+      self->replay_location = g_value_dup_string (value);
+      break;
+    case PROP_PACING:
+      self->pacing = (GstBdaPacing) g_value_get_enum (value);
+      break;
+    case PROP_BITRATE:
+      self->bitrate = g_value_get_uint (value);
+      break;
+    case PROP_CHUNK_SIZE:
+      self->chunk_size = g_value_get_uint (value);
+      break;
+    case PROP_JITTER:
+      self->jitter = g_value_get_uint (value);
+      break;
+    case PROP_LOOP:
+      self->loop = g_value_get_boolean (value);
+      break;
+    case PROP_SYNTHETIC_PARAMS:
+      g_free (self->synthetic_params);
+      self->synthetic_params = g_value_dup_string (value);
+      break;
+    case PROP_TRACE_LOCATION:
+      g_free (self->trace_location);
+      self->trace_location = g_value_dup_string (value);
+      break;
+    case PROP_TRACE_PAYLOAD:
+      self->trace_payload = g_value_get_boolean (value);
+      break;
+    case PROP_TUNE_TIMEOUT:
+      self->tune_timeout = g_value_get_uint (value);
+      break;
+    case PROP_GRAPH_CACHE:
+      g_free (self->graph_cache);
+      self->graph_cache = g_value_dup_string (value);
+      break;
+    case PROP_ASYNC_OPEN:
+      self->async_open = g_value_get_boolean (value);
+      break;
+    case PROP_DEVICE_TIMEOUT:
+      self->device_timeout = g_value_get_uint (value);
+      break;
+    case PROP_POOL_IDLE_TIME:
+      self->pool_idle_time = g_value_get_uint (value);
+      break;
+    case PROP_SHARE_TUNER:
+      self->share_tuner = g_value_get_boolean (value);
+      break;
+    case PROP_PIDS:
+    {
+      guint8 *pid_filter = gst_bdasrc_parse_pids (self,
+          g_value_get_string (value));
+      g_mutex_lock (&self->lock);
+      g_free (self->pids);
+      self->pids = g_value_dup_string (value);
+      g_free (self->pid_filter);
+      self->pid_filter = pid_filter;
+      g_mutex_unlock (&self->lock);
+      break;
+    }
+    case PROP_DEVICE_TYPE:
+      self->device_type = (GstBdaInputType) g_value_get_enum (value);
+      break;
+    case PROP_STANDBY:
+      self->standby = g_value_get_boolean (value);
+      break;
+    case PROP_STANDBY_DEVICE:
+      self->standby_device = g_value_get_int (value);
+      break;
+    case PROP_FAILOVER_TIMEOUT:
+      self->failover_timeout = g_value_get_uint (value);
+      break;
+    case PROP_FAILOVER_CC_ERRORS:
+      self->failover_cc_errors = g_value_get_uint (value);
+      break;
+    case PROP_STALL_TIMEOUT:
+      self->stall_timeout = g_value_get_uint (value);
+      break;
+    case PROP_WARM_FREQUENCIES:
+    {
+      /* Read by the worker while running. */
+      gchar *frequencies = g_value_dup_string (value);
+      g_mutex_lock (&self->lock);
+      gchar *old = self->warm_frequencies;
+      self->warm_frequencies = frequencies;
+      g_mutex_unlock (&self->lock);
+      g_free (old);
+      gst_bdasrc_post_warm_plan (self, frequencies);
+      break;
+    }
+    case PROP_INJECT_PSI:
+      self->inject_psi = g_value_get_boolean (value);
+      break;
+    case PROP_PSI_CACHE:
+      g_free (self->psi_cache);
+      self->psi_cache = g_value_dup_string (value);
+      break;
+    case PROP_GOP_CACHE_SIZE:
+      self->gop_cache_size = g_value_get_uint (value);
+      break;
+    case PROP_MARK_KEYFRAMES:
+      self->mark_keyframes = g_value_get_boolean (value);
+      break;
+    case PROP_SCAN_TRANSPONDERS:
+      g_free (self->scan_transponders);
+      self->scan_transponders = g_value_dup_string (value);
+      break;
+    case PROP_SCAN_LOCK_TIMEOUT:
+      self->scan_lock_timeout = g_value_get_uint (value);
+      break;
+    case PROP_EPG_TRANSPONDERS:
+      g_free (self->epg_transponders);
+      self->epg_transponders = g_value_dup_string (value);
+      break;
+    case PROP_EPG_TIMEOUT:
+      self->epg_timeout = g_value_get_uint (value);
+      break;
+    case PROP_SI_PIDS:
+    {
+      guint8 *si_pid_filter = gst_bdasrc_parse_pids (self,
+          g_value_get_string (value));
+      g_mutex_lock (&self->lock);
+      g_free (self->si_pids);
+      self->si_pids = g_value_dup_string (value);
+      g_free (self->si_pid_filter);
+      self->si_pid_filter = si_pid_filter;
+      /* Created again for the new PIDs. */
+      gst_bda_section_assembler_free (self->si_assembler);
+      self->si_assembler = NULL;
+      gst_bda_ts_aligner_reset (self->si_aligner);
+      g_mutex_unlock (&self->lock);
+      break;
+    }
+    case PROP_REDUCE_SI:
+      g_mutex_lock (&self->lock);
+      self->reduce_si = g_value_get_boolean (value);
+      gst_bda_si_filter_free (self->si_filter);
+      self->si_filter = NULL;
+      g_mutex_unlock (&self->lock);
+      break;
+    case PROP_PSI_REFRESH:
+      g_mutex_lock (&self->lock);
+      self->psi_refresh = g_value_get_uint (value);
+      /* Created again with the new interval. */
+      gst_bda_si_filter_free (self->si_filter);
+      self->si_filter = NULL;
+      g_mutex_unlock (&self->lock);
+      break;
+    case PROP_SI_REFRESH:
+      g_mutex_lock (&self->lock);
+      self->si_refresh = g_value_get_uint (value);
+      gst_bda_si_filter_free (self->si_filter);
+      self->si_filter = NULL;
+      g_mutex_unlock (&self->lock);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (self, prop_id, pspec);
   }
+
+  switch (prop_id) {
+    case PROP_FREQUENCY:
+    case PROP_SYMBOL_RATE:
+    case PROP_BANDWIDTH:
+    case PROP_GUARD_INTERVAL:
+    case PROP_MODULATION:
+    case PROP_TRANSMISSION_MODE:
+    case PROP_HIERARCHY:
+    case PROP_ORBITAL_POSITION:
+    case PROP_WEST_POSITION:
+    case PROP_POLARISATION:
+    case PROP_INNER_FEC_RATE:
+      /* Picked up by the streaming thread, or on the next start. */
+      g_mutex_lock (&self->lock);
+      self->need_tune = TRUE;
+      g_cond_signal (&self->cond);
+      g_mutex_unlock (&self->lock);
+      break;
+    default:
+      break;
+  }
 }
 
 static void
@@ -452,7 +1255,7 @@ gst_bdasrc_get_property (GObject * _object, guint prop_id,
       g_value_set_uint (value, self->buffer_size);
       break;
     case PROP_DEVICE_INDEX:
-      g_value_set_uint (value, self->device_index);
+      g_value_set_int (value, self->device_index);
       break;
     case PROP_FREQUENCY:
       g_value_set_uint (value, self->frequency);
@@ -487,223 +1290,632 @@ gst_bdasrc_get_property (GObject * _object, guint prop_id,
     case PROP_INNER_FEC_RATE:
       g_value_set_enum (value, self->inner_fec_rate);
       break;
+    case PROP_BACKEND:
+      g_value_set_enum (value, self->backend_type);
+      break;
+    case PROP_REPLAY_LOCATION:
+      g_value_set_string (value, self->replay_location);
+      break;
+    case PROP_PACING:
+      g_value_set_enum (value, self->pacing);
+      break;
+    case PROP_BITRATE:
+      g_value_set_uint (value, self->bitrate);
+      break;
+    case PROP_CHUNK_SIZE:
+      g_value_set_uint (value, self->chunk_size);
+      break;
+    case PROP_JITTER:
+      g_value_set_uint (value, self->jitter);
+      break;
+    case PROP_LOOP:
+      g_value_set_boolean (value, self->loop);
+      break;
+    case PROP_SYNTHETIC_PARAMS:
+      g_value_set_string (value, self->synthetic_params);
+      break;
+    case PROP_TRACE_LOCATION:
+      g_value_set_string (value, self->trace_location);
+      break;
+    case PROP_TRACE_PAYLOAD:
+      g_value_set_boolean (value, self->trace_payload);
+      break;
+    case PROP_TUNE_TIMEOUT:
+      g_value_set_uint (value, self->tune_timeout);
+      break;
+    case PROP_GRAPH_CACHE:
+      g_value_set_string (value, self->graph_cache);
+      break;
+    case PROP_ASYNC_OPEN:
+      g_value_set_boolean (value, self->async_open);
+      break;
+    case PROP_DEVICE_TIMEOUT:
+      g_value_set_uint (value, self->device_timeout);
+      break;
+    case PROP_POOL_IDLE_TIME:
+      g_value_set_uint (value, self->pool_idle_time);
+      break;
+    case PROP_SHARE_TUNER:
+      g_value_set_boolean (value, self->share_tuner);
+      break;
+    case PROP_PIDS:
+      g_value_set_string (value, self->pids);
+      break;
+    case PROP_DEVICE_TYPE:
+      g_value_set_enum (value, self->device_type);
+      break;
+    case PROP_CURRENT_DEVICE:
+      g_value_set_int (value, self->selected_device);
+      break;
+    case PROP_STANDBY:
+      g_value_set_boolean (value, self->standby);
+      break;
+    case PROP_STANDBY_DEVICE:
+      g_value_set_int (value, self->standby_device);
+      break;
+    case PROP_FAILOVER_TIMEOUT:
+      g_value_set_uint (value, self->failover_timeout);
+      break;
+    case PROP_FAILOVER_CC_ERRORS:
+      g_value_set_uint (value, self->failover_cc_errors);
+      break;
+    case PROP_STALL_TIMEOUT:
+      g_value_set_uint (value, self->stall_timeout);
+      break;
+    case PROP_WARM_FREQUENCIES:
+      g_mutex_lock (&self->lock);
+      g_value_set_string (value, self->warm_frequencies);
+      g_mutex_unlock (&self->lock);
+      break;
+    case PROP_INJECT_PSI:
+      g_value_set_boolean (value, self->inject_psi);
+      break;
+    case PROP_PSI_CACHE:
+      g_value_set_string (value, self->psi_cache);
+      break;
+    case PROP_GOP_CACHE_SIZE:
+      g_value_set_uint (value, self->gop_cache_size);
+      break;
+    case PROP_MARK_KEYFRAMES:
+      g_value_set_boolean (value, self->mark_keyframes);
+      break;
+    case PROP_SCAN_TRANSPONDERS:
+      g_value_set_string (value, self->scan_transponders);
+      break;
+    case PROP_SCAN_LOCK_TIMEOUT:
+      g_value_set_uint (value, self->scan_lock_timeout);
+      break;
+    case PROP_EPG_TRANSPONDERS:
+      g_value_set_string (value, self->epg_transponders);
+      break;
+    case PROP_EPG_TIMEOUT:
+      g_value_set_uint (value, self->epg_timeout);
+      break;
+    case PROP_SI_PIDS:
+      g_value_set_string (value, self->si_pids);
+      break;
+    case PROP_REDUCE_SI:
+      g_value_set_boolean (value, self->reduce_si);
+      break;
+    case PROP_PSI_REFRESH:
+      g_value_set_uint (value, self->psi_refresh);
+      break;
+    case PROP_SI_REFRESH:
+      g_value_set_uint (value, self->si_refresh);
+      break;
+    case PROP_STALL_RECOVERIES:
+      g_mutex_lock (&self->lock);
+      g_value_set_uint (value, self->stall_recoveries[0] +
+          self->stall_recoveries[1] + self->stall_recoveries[2]);
+      g_mutex_unlock (&self->lock);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (self, prop_id, pspec);
   }
 }
 
-/* Creates the DirectShow filter graph. */
-static gboolean
-gst_bdasrc_create_graph (GstBdaSrc * self)
+const GstBdaBackend *
+gst_bda_backend_get (GstBdaBackendType type)
 {
-  HRESULT res = CoCreateInstance (CLSID_FilterGraph, NULL, CLSCTX_ALL,
-      __uuidof (IGraphBuilder), (LPVOID *) & self->filter_graph);
-  if (FAILED (res)) {
-    GST_ERROR_OBJECT (self, "Unable to create filter graph");
-    return FALSE;
+  switch (type) {
+#ifdef HAVE_DIRECTSHOW
+    case GST_BDA_BACKEND_DSHOW:
+      return &gst_bda_dshow_backend;
+#endif
+    case GST_BDA_BACKEND_REPLAY:
+      return &gst_bda_replay_backend;
+    case GST_BDA_BACKEND_SYNTHETIC:
+      return &gst_bda_synthetic_backend;
+    case GST_BDA_BACKEND_TRACE:
+      return &gst_bda_trace_backend;
+    default:
+      return NULL;
   }
+}
 
-  res = self->filter_graph->QueryInterface (&self->media_control);
-  if (FAILED (res)) {
-    GST_ERROR_OBJECT (self, "Unable to get media control");
-    return FALSE;
+/* Releases the device of the current backend, pooling it if pool is set
+   and pool-idle-time allows. */
+static void
+gst_bdasrc_release_backend (GstBdaSrc * self, gboolean pool)
+{
+  if (self->backend) {
+    self->backend->close (self, pool);
+    self->backend = NULL;
   }
+  gst_bdasrc_failover_close (self);
+}
 
-  ICreateDevEnumPtr sys_dev_enum;
-  res = sys_dev_enum.CreateInstance (CLSID_SystemDeviceEnum);
-  if (FAILED (res)) {
-    GST_ERROR_OBJECT (self, "Unable to enumerate BDA devices");
-    return FALSE;
-  }
+/* Opens the device of the selected backend, releases it on failure. */
+static gboolean
+gst_bdasrc_open_backend (GstBdaSrc * self)
+{
+  gint64 start = g_get_monotonic_time ();
 
-  IEnumMonikerPtr enum_tuner;
-  res =
-      sys_dev_enum->CreateClassEnumerator (KSCATEGORY_BDA_NETWORK_TUNER,
-      &enum_tuner, 0);
-  if (res == S_FALSE) {
-    /* The device category does not exist or is empty. */
-    GST_ERROR_OBJECT (self, "No BDA tuner devices");
-    return FALSE;
-  } else if (FAILED (res)) {
-    GST_ERROR_OBJECT (self, "Unable to enumerate BDA tuner devices");
+  self->backend = gst_bda_backend_get (self->backend_type);
+
+  if (!self->backend->open (self)) {
+    gst_bdasrc_release_backend (self, FALSE);
     return FALSE;
   }
+  /* Opened with the current tuning properties. */
+  self->need_tune = FALSE;
 
-  if (self->device_index > 0) {
-    res = enum_tuner->Skip (self->device_index);
-    if (FAILED (res)) {
-      GST_ERROR_OBJECT (self, "BDA device %d doesn't exist",
-          self->device_index);
-      return FALSE;
-    }
-  }
+  GST_INFO_OBJECT (self, "Opened %s backend in %" G_GINT64_FORMAT " ms",
+      self->backend->name, (g_get_monotonic_time () - start) / 1000);
 
-  IMonikerPtr tuner_moniker;
-  ULONG fetched;
-  res = enum_tuner->Next (1, &tuner_moniker, &fetched);
-  if (FAILED (res)) {
-    GST_ERROR_OBJECT (self, "Unable to get BDA tuner");
-    return FALSE;
+  if (self->standby) {
+    gst_bdasrc_failover_open (self);
   }
 
-  std::string tuner_name = bda_get_tuner_name (tuner_moniker);
+  return TRUE;
+}
 
-  res = tuner_moniker->BindToObject (NULL, NULL, IID_IBaseFilter,
-      (void **) &self->network_tuner);
-  if (FAILED (res)) {
-    GST_ERROR_OBJECT (self, "Unable to bind to BDA tuner '%s'",
-        tuner_name.c_str ());
-    return FALSE;
+/* Opens the device, or attaches to a shared tuner. */
+static gboolean
+gst_bdasrc_open_device (GstBdaSrc * self)
+{
+  if (self->scan_transponders && *self->scan_transponders) {
+    return gst_bdasrc_scan_open (self);
   }
 
-  self->input_type = gst_bdasrc_get_input_type (self);
-  if (self->input_type == GST_BDA_UNKNOWN) {
-    GST_ERROR_OBJECT (self, "Can't determine device type for BDA tuner '%s'",
-        tuner_name.c_str ());
-    return FALSE;
+  if (self->epg_transponders && *self->epg_transponders) {
+    return gst_bdasrc_epg_open (self);
   }
 
-  GST_INFO_OBJECT (self, "Using %s tuner device '%s'",
-      gst_bdasrc_get_input_type_name (self->input_type), tuner_name.c_str ());
+  g_mutex_lock (&self->lock);
+  gboolean warm = self->warm_frequencies && *self->warm_frequencies;
+  g_mutex_unlock (&self->lock);
+  if (warm) {
+    return gst_bdasrc_warm_open (self);
+  }
 
-  ITuningSpacePtr tuning_space;
-  if (!gst_bdasrc_create_tuning_space (self, tuning_space)) {
-    GST_ERROR_OBJECT (self, "Unable to create tuning space");
-    return FALSE;
+  if (!self->share_tuner) {
+    return gst_bdasrc_open_backend (self);
   }
 
-  CLSID network_type;
-  if (!gst_bdasrc_get_network_type (self->input_type, network_type)) {
-    GST_ERROR_OBJECT (self, "Can't determine network type");
+  if (!gst_bdasrc_shared_attach (self)) {
     return FALSE;
   }
+  self->need_tune = FALSE;
 
-  IBaseFilterPtr network_provider;
+  return TRUE;
+}
 
-  res = network_provider.CreateInstance (network_type);
-  if (FAILED (res)) {
-    GST_ERROR_OBJECT (self, "Unable to create network provider");
-    return FALSE;
-  }
+/* Device operations, run on the worker thread. */
 
-  res = self->filter_graph->AddFilter (network_provider, L"Network Provider");
-  if (FAILED (res)) {
-    GST_ERROR_OBJECT (self, "Unable to add network provider to graph");
-    return FALSE;
-  }
+gboolean
+gst_bdasrc_do_open (gpointer data)
+{
+  return gst_bdasrc_open_device (GST_BDASRC (data));
+}
+
+/* Opens the device and completes the asynchronous NULL -> READY. */
+static gboolean
+gst_bdasrc_do_async_open (gpointer data)
+{
+  GstBdaSrc *self = GST_BDASRC (data);
 
-  IScanningTunerPtr tuner;
-  res = network_provider->QueryInterface (&tuner);
-  if (FAILED (res)) {
-    GST_ERROR_OBJECT (self, "Unable to get tuner interface");
+  if (!gst_bdasrc_open_device (self)) {
+    GST_ELEMENT_ERROR (self, RESOURCE, OPEN_READ,
+        ("Unable to open the device"), (NULL));
+    gst_element_abort_state (GST_ELEMENT (self));
     return FALSE;
   }
 
-  IDVBTuneRequestPtr dvb_tune_request;
-  ITuneRequestPtr tune_request;
+  gst_element_continue_state (GST_ELEMENT (self), GST_STATE_CHANGE_SUCCESS);
+  gst_element_post_message (GST_ELEMENT (self),
+      gst_message_new_async_done (GST_OBJECT (self), GST_CLOCK_TIME_NONE));
 
-  res = tuning_space->CreateTuneRequest (&tune_request);
-  if (FAILED (res)) {
-    GST_ERROR_OBJECT (self, "Unable to create tune request");
-    return FALSE;
-  }
+  return TRUE;
+}
 
-  res = tune_request->QueryInterface (&dvb_tune_request);
-  if (FAILED (res)) {
-    GST_ERROR_OBJECT (self, "Unable to get DVB tune request interface");
-    return FALSE;
+gboolean
+gst_bdasrc_do_start (gpointer data)
+{
+  GstBdaSrc *self = GST_BDASRC (data);
+
+  if (self->shared) {
+    return gst_bdasrc_shared_start (self);
+  } else if (self->warm) {
+    return gst_bdasrc_warm_start (self);
+  } else if (self->scan) {
+    return gst_bdasrc_scan_start (self);
+  } else if (self->epg) {
+    return gst_bdasrc_epg_start (self);
   }
 
-  if (!gst_bdasrc_init_tune_request (self, dvb_tune_request)) {
-    GST_ERROR_OBJECT (self, "Unable to initialise tune request");
+  if (!self->backend || !self->backend->start (self)) {
     return FALSE;
   }
+  gst_bdasrc_failover_start (self);
 
-  res = tuner->Validate (dvb_tune_request);
-  if (FAILED (res)) {
-    GST_ERROR_OBJECT (self, "Unable to validate tune request");
-    return FALSE;
-  }
+  return TRUE;
+}
 
-  res = tuner->put_TuneRequest (dvb_tune_request);
-  if (FAILED (res)) {
-    GST_ERROR_OBJECT (self, "Unable to submit tune request");
-    return FALSE;
+gboolean
+gst_bdasrc_do_stop (gpointer data)
+{
+  GstBdaSrc *self = GST_BDASRC (data);
+
+  if (self->shared) {
+    gst_bdasrc_shared_stop (self);
+  } else if (self->warm) {
+    gst_bdasrc_warm_stop (self);
+  } else if (self->scan) {
+    gst_bdasrc_scan_stop (self);
+  } else if (self->epg) {
+    gst_bdasrc_epg_stop (self);
+  } else if (self->backend) {
+    gst_bdasrc_failover_stop (self);
+    self->backend->stop (self);
   }
 
-  res = self->filter_graph->AddFilter (self->network_tuner, L"Tuner device");
-  if (FAILED (res)) {
-    GST_ERROR_OBJECT (self, "Unable to add tuner to filter graph");
-    return FALSE;
+  return TRUE;
+}
+
+static gboolean
+gst_bdasrc_do_close (gpointer data)
+{
+  GstBdaSrc *self = GST_BDASRC (data);
+
+  gst_bdasrc_shared_detach (self);
+  gst_bdasrc_warm_close (self);
+  gst_bdasrc_scan_close (self);
+  gst_bdasrc_epg_close (self);
+  gst_bdasrc_release_backend (self, TRUE);
+
+  return TRUE;
+}
+
+gboolean
+gst_bdasrc_do_retune (gpointer data)
+{
+  GstBdaSrc *self = GST_BDASRC (data);
+
+  if (self->warm) {
+    return gst_bdasrc_warm_retune (self);
+  } else if (self->scan || self->epg) {
+    /* Tuning properties only provide defaults for the transponders. */
+    return TRUE;
+  } else if (self->share_tuner) {
+    return gst_bdasrc_shared_retune (self);
   }
 
-  res =
-      gst_bdasrc_connect_filters (self, network_provider, self->network_tuner);
-  if (FAILED (res)) {
-    GST_ERROR_OBJECT (self, "Unable to connect tuner: %s (0x%lx)",
-        bda_err_to_str (res).c_str (), res);
+  if (!self->backend || !self->backend->retune (self)) {
     return FALSE;
   }
+  gst_bdasrc_failover_retune (self);
 
-  IBaseFilterPtr demux;
-  res = demux.CreateInstance (CLSID_MPEG2Demultiplexer);
-  if (FAILED (res)) {
-    GST_ERROR_OBJECT (self, "Unable to create MPEG2Demultiplexer");
-    return FALSE;
+  return TRUE;
+}
+
+/* Stops and starts the device. */
+static gboolean
+gst_bdasrc_do_restart (gpointer data)
+{
+  gst_bdasrc_do_stop (data);
+
+  return gst_bdasrc_do_start (data);
+}
+
+/* Closes the device and opens it again with a new graph. */
+static gboolean
+gst_bdasrc_do_rebuild (gpointer data)
+{
+  GstBdaSrc *self = GST_BDASRC (data);
+
+  gst_bdasrc_do_stop (self);
+  /* The graph is suspect, don't pool it. */
+  gst_bdasrc_release_backend (self, FALSE);
+
+  return gst_bdasrc_open_backend (self) && gst_bdasrc_do_start (self);
+}
+
+gboolean
+gst_bdasrc_do_get_signal_locked (gpointer data)
+{
+  GstBdaSignalQuery *query = (GstBdaSignalQuery *) data;
+  GstBdaSrc *self = query->src;
+
+  if (self->shared) {
+    return gst_bdasrc_shared_read_signal_locked (self, &query->locked);
+  } else if (self->warm) {
+    return gst_bdasrc_warm_read_signal_locked (self, &query->locked);
   }
 
-  res = self->filter_graph->AddFilter (demux, L"Demux");
-  if (FAILED (res)) {
-    GST_ERROR_OBJECT (self, "Unable to add demux filter to graph");
-    return FALSE;
+  return self->backend && self->backend->get_signal_locked (self,
+      &query->locked);
+}
+
+/* Returns the time device-timeout from now, or -1 to wait forever if
+   bounded is FALSE. */
+static gint64
+gst_bdasrc_deadline (GstBdaSrc * self, gboolean bounded)
+{
+  if (!bounded || self->device_timeout == 0) {
+    return -1;
   }
 
-  IBaseFilterPtr ts_capture;
-  if (!gst_bdasrc_create_ts_capture (self, sys_dev_enum, ts_capture)) {
+  return g_get_monotonic_time () +
+      self->device_timeout * G_TIME_SPAN_MILLISECOND;
+}
+
+/* Waits for a device operation until end_time. Returns FALSE on timeout,
+   otherwise stores the return value of the operation to result. */
+static gboolean
+gst_bdasrc_wait (GstBdaSrc * self, GstBdaWorkerCommand * command,
+    const gchar * what, gint64 end_time, gboolean * result)
+{
+  if (!gst_bda_worker_command_wait (command, end_time, result)) {
+    GST_WARNING_OBJECT (self, "Device %s timed out after %u ms", what,
+        self->device_timeout);
     return FALSE;
   }
 
-  res = gst_bdasrc_connect_filters (self, ts_capture, demux);
-  if (FAILED (res)) {
-    GST_ERROR_OBJECT (self, "Unable to connect TS capture to demux: %s (0x%lx)",
-        bda_err_to_str (res).c_str (), res);
-    return FALSE;
+  return TRUE;
+}
+
+/* Runs a device operation on the worker thread. */
+gboolean
+gst_bdasrc_call (GstBdaSrc * self, GstBdaWorkerFunc func,
+    const gchar * what, gboolean bounded)
+{
+  if (gst_bda_worker_is_current (self->worker)) {
+    return func (self);
   }
 
-  IBaseFilterPtr tif;
-  res =
-      gst_bdasrc_load_filter (self, sys_dev_enum,
-      KSCATEGORY_BDA_TRANSPORT_INFORMATION, demux, &tif);
+  /* Not run at all once the wait times out before it starts. */
+  gint64 end_time = gst_bdasrc_deadline (self, bounded);
+  GstBdaWorkerCommand *command =
+      gst_bda_worker_push (self->worker, func, self, NULL, end_time);
+  gboolean result = FALSE;
+  gst_bdasrc_wait (self, command, what, end_time, &result);
+  gst_bda_worker_command_unref (command);
 
-  if (FAILED (res)) {
-    GST_ERROR_OBJECT (self, "Unable to load transport information filter");
-    return FALSE;
+  return result;
+}
+
+/* Queues a device operation without waiting for it. */
+void
+gst_bdasrc_post (GstBdaSrc * self, GstBdaWorkerFunc func)
+{
+  gst_bda_worker_command_unref (gst_bda_worker_push (self->worker, func, self,
+          NULL, -1));
+}
+
+/* Reads the signal lock status on the worker thread. A timed out read
+   counts as not locked. */
+gboolean
+gst_bdasrc_read_signal_locked (GstBdaSrc * self, gboolean * locked)
+{
+  GstBdaSignalQuery *query = g_new0 (GstBdaSignalQuery, 1);
+  query->src = self;
+
+  gint64 end_time = gst_bdasrc_deadline (self, TRUE);
+  GstBdaWorkerCommand *command = gst_bda_worker_push (self->worker,
+      gst_bdasrc_do_get_signal_locked, query, g_free, end_time);
+  gboolean result = FALSE;
+  if (!gst_bdasrc_wait (self, command, "signal statistics", end_time,
+          &result)) {
+    result = TRUE;
+    *locked = FALSE;
+  } else if (result) {
+    *locked = query->locked;
   }
+  gst_bda_worker_command_unref (command);
 
-  return TRUE;
+  return result;
 }
 
-/* Releases the DirectShow filter graph. */
+/* Waits for an asynchronous open to complete. */
 static void
-gst_bdasrc_release_graph (GstBdaSrc * self)
+gst_bdasrc_wait_open (GstBdaSrc * self)
+{
+  if (!self->open_command || gst_bda_worker_is_current (self->worker)) {
+    return;
+  }
+
+  gst_bda_worker_command_wait (self->open_command, -1, NULL);
+  gst_bda_worker_command_unref (self->open_command);
+  self->open_command = NULL;
+}
+
+/* Identifies everything that determines the stream at frequency. */
+gchar *
+gst_bdasrc_tuning_key (GstBdaSrc * self, int frequency)
 {
-  if (self->media_control) {
-    self->media_control->Stop ();
-    self->media_control->Release ();
-    self->media_control = NULL;
+  return g_strdup_printf ("%d:%d:%d:%d:%d:%d:%d:%d:%d:%d:%d:%s:%s",
+      frequency, self->symbol_rate, self->bandwidth, self->modulation,
+      self->guard_interval, self->transmission_mode,
+      self->hierarchy_information, self->orbital_position,
+      self->west_position, self->polarisation, self->inner_fec_rate,
+      GST_STR_NULL (self->replay_location),
+      GST_STR_NULL (self->synthetic_params));
+}
+
+/* Returns TRUE for the properties that select and tune the device. The
+   others configure the output of an element and stay with it. */
+static gboolean
+gst_bdasrc_is_device_property (guint prop_id)
+{
+  switch (prop_id) {
+    case PROP_BUFFER_SIZE:
+    case PROP_DEVICE_INDEX:
+    case PROP_DEVICE_TYPE:
+    case PROP_FREQUENCY:
+    case PROP_SYMBOL_RATE:
+    case PROP_BANDWIDTH:
+    case PROP_GUARD_INTERVAL:
+    case PROP_MODULATION:
+    case PROP_TRANSMISSION_MODE:
+    case PROP_HIERARCHY:
+    case PROP_ORBITAL_POSITION:
+    case PROP_WEST_POSITION:
+    case PROP_POLARISATION:
+    case PROP_INNER_FEC_RATE:
+    case PROP_BACKEND:
+    case PROP_REPLAY_LOCATION:
+    case PROP_PACING:
+    case PROP_BITRATE:
+    case PROP_CHUNK_SIZE:
+    case PROP_JITTER:
+    case PROP_LOOP:
+    case PROP_SYNTHETIC_PARAMS:
+    case PROP_GRAPH_CACHE:
+    case PROP_DEVICE_TIMEOUT:
+    case PROP_POOL_IDLE_TIME:
+      return TRUE;
+    default:
+      return FALSE;
   }
-  if (self->receiver && self->receiver != self->network_tuner) {
-    self->receiver->Release ();
-    self->receiver = NULL;
+}
+
+/* Copies the device and tuning properties of the element to a hidden
+   element. Hidden elements keep the defaults of everything else, so they
+   neither trace, filter nor fail over themselves. */
+void
+gst_bdasrc_copy_properties (GstBdaSrc * self, GstBdaSrc * dest)
+{
+  guint n_props;
+  GParamSpec **props =
+      g_object_class_list_properties (G_OBJECT_GET_CLASS (self), &n_props);
+  for (guint i = 0; i < n_props; i++) {
+    GParamSpec *pspec = props[i];
+    if (pspec->owner_type != GST_TYPE_BDASRC
+        || !gst_bdasrc_is_device_property (pspec->param_id)) {
+      continue;
+    }
+
+    GValue value = G_VALUE_INIT;
+    g_value_init (&value, pspec->value_type);
+    g_object_get_property (G_OBJECT (self), pspec->name, &value);
+    g_object_set_property (G_OBJECT (dest), pspec->name, &value);
+    g_value_unset (&value);
   }
-  if (self->network_tuner) {
-    self->network_tuner->Release ();
-    self->network_tuner = NULL;
+  g_free (props);
+}
+
+/* Parses comma separated transponders of the form
+   frequency[:symbol-rate[:modulation]], taking missing values from the
+   element. */
+GPtrArray *
+gst_bdasrc_parse_transponders (GstBdaSrc * self, const gchar * transponders)
+{
+  GPtrArray *result =
+      g_ptr_array_new_with_free_func ((GDestroyNotify) gst_structure_free);
+  GEnumClass *modulations =
+      (GEnumClass *) g_type_class_ref (GST_TYPE_BDASRC_MODULATION);
+
+  gchar **tokens = g_strsplit (transponders, ",", -1);
+  for (gchar ** token = tokens; *token; token++) {
+    gchar **fields = g_strsplit (g_strstrip (*token), ":", 3);
+    if (!fields[0]) {
+      g_strfreev (fields);
+      continue;
+    }
+
+    gchar *end;
+    guint64 frequency = g_ascii_strtoull (fields[0], &end, 10);
+    gboolean valid = end != fields[0] && !*end && frequency > 0
+        && frequency <= G_MAXINT;
+    guint64 symbol_rate = self->symbol_rate;
+    if (valid && fields[1] && *g_strstrip (fields[1])) {
+      symbol_rate = g_ascii_strtoull (fields[1], &end, 10);
+      valid = !*end && symbol_rate <= G_MAXINT;
+    }
+    ModulationType modulation = self->modulation;
+    if (valid && fields[1] && fields[2]) {
+      GEnumValue *value =
+          g_enum_get_value_by_nick (modulations, g_strstrip (fields[2]));
+      valid = value != NULL;
+      if (value) {
+        modulation = (ModulationType) value->value;
+      }
+    }
+
+    if (valid) {
+      g_ptr_array_add (result, gst_structure_new ("transponder",
+              "frequency", G_TYPE_INT, (int) frequency,
+              "symbol-rate", G_TYPE_INT, (int) symbol_rate,
+              "modulation", GST_TYPE_BDASRC_MODULATION, modulation, NULL));
+    } else {
+      GST_WARNING_OBJECT (self, "Ignoring invalid transponder '%s'", *token);
+    }
+    g_strfreev (fields);
   }
-  if (self->filter_graph) {
-    self->filter_graph->Release ();
-    self->filter_graph = NULL;
+  g_strfreev (tokens);
+  g_type_class_unref (modulations);
+
+  return result;
+}
+
+/* Polls the signal lock of a hidden tuner with backoff until it locks,
+   timeout ms pass or cancelled is set. cancelled is protected by lock, and
+   cond is signalled when it is set. */
+gboolean
+gst_bdasrc_wait_tuner_lock (GstBdaSrc * tuner, guint timeout, GMutex * lock,
+    GCond * cond, gboolean * cancelled)
+{
+  gint64 deadline = g_get_monotonic_time () +
+      timeout * G_TIME_SPAN_MILLISECOND;
+  gint64 interval = LOCK_POLL_MIN;
+  gboolean locked = FALSE;
+
+  g_mutex_lock (lock);
+  while (!*cancelled) {
+    g_mutex_unlock (lock);
+    if (!gst_bdasrc_read_signal_locked (tuner, &locked)) {
+      /* Devices without signal statistics are assumed to lock. */
+      locked = TRUE;
+    }
+    g_mutex_lock (lock);
+
+    gint64 now = g_get_monotonic_time ();
+    if (locked || now >= deadline) {
+      break;
+    }
+    g_cond_wait_until (cond, lock, MIN (now + interval, deadline));
+    interval = MIN (interval * 2, LOCK_POLL_MAX);
   }
+  locked &= !*cancelled;
+  g_mutex_unlock (lock);
+
+  return locked;
+}
+
+/* Sets the tuning properties of a hidden tuner from a "transponder"
+   structure. */
+void
+gst_bdasrc_configure_transponder (GstBdaSrc * tuner,
+    const GstStructure * transponder)
+{
+  gint modulation;
+
+  gst_structure_get_int (transponder, "frequency", &tuner->frequency);
+  gst_structure_get_int (transponder, "symbol-rate", &tuner->symbol_rate);
+  gst_structure_get_enum (transponder, "modulation",
+      GST_TYPE_BDASRC_MODULATION, &modulation);
+  tuner->modulation = (ModulationType) modulation;
 }
 
 static void
@@ -712,6 +1924,21 @@ gst_bda_release_samples (GstBdaSrc * self)
   g_mutex_lock (&self->lock);
   g_queue_foreach (&self->ts_samples, (GFunc) gst_buffer_unref, NULL);
   g_queue_clear (&self->ts_samples);
+  /* The next multiplex may use other PIDs. */
+  gst_bda_keyframe_scanner_free (self->keyframe_scanner);
+  self->keyframe_scanner = NULL;
+  /* Sections of the next multiplex are all new. */
+  if (self->si_assembler) {
+    GST_DEBUG_OBJECT (self, "Dropped %" G_GUINT64_FORMAT " repeated SI"
+        " sections", gst_bda_section_assembler_get_repeated
+        (self->si_assembler));
+    gst_bda_section_assembler_reset (self->si_assembler);
+  }
+  gst_bda_ts_aligner_reset (self->si_aligner);
+  if (self->si_filter) {
+    gst_bda_si_filter_reset (self->si_filter);
+  }
+  gst_bdasrc_es_reset (self);
   g_mutex_unlock (&self->lock);
 }
 
@@ -724,11 +1951,38 @@ gst_bdasrc_finalize (GObject * object)
   self = GST_BDASRC (object);
 
   gst_bda_release_samples (self);
-  gst_bdasrc_release_graph (self);
+  gst_bdasrc_wait_open (self);
+  gst_bdasrc_stop_lock_wait (self);
+  g_mutex_lock (&self->lock);
+  gst_bdasrc_cancel_tune_step (self);
+  g_mutex_unlock (&self->lock);
+  gst_bdasrc_call (self, gst_bdasrc_do_close, "close", FALSE);
+  gst_bda_worker_free (self->worker);
 
   g_mutex_clear (&self->lock);
   g_cond_clear (&self->cond);
-  delete self->ts_grabber;
+  g_cond_clear (&self->lock_cond);
+  g_free (self->replay_location);
+  g_free (self->synthetic_params);
+  g_free (self->trace_location);
+  g_free (self->graph_cache);
+  g_free (self->pids);
+  g_free (self->pid_filter);
+  g_free (self->warm_frequencies);
+  g_free (self->psi_cache);
+  g_free (self->psi_transponder);
+  g_free (self->scan_transponders);
+  g_free (self->epg_transponders);
+  gst_bda_epg_store_free (self->epg_store);
+  g_free (self->si_pids);
+  g_free (self->si_pid_filter);
+  gst_bda_section_assembler_free (self->si_assembler);
+  g_free (self->si_aligner);
+  gst_bda_si_filter_free (self->si_filter);
+  gst_bdasrc_es_free (self);
+  gst_bda_psi_collector_free (self->psi_collector);
+  g_free (self->psi_aligner);
+  gst_bda_keyframe_scanner_free (self->keyframe_scanner);
 
   if (G_OBJECT_CLASS (parent_class)->finalize)
     G_OBJECT_CLASS (parent_class)->finalize (object);
@@ -743,45 +1997,775 @@ gst_bdasrc_plugin_init (GstPlugin * plugin)
       GST_TYPE_BDASRC);
 }
 
+/* Parses a comma separated PID list into a bit per PID, NULL for all. */
+static guint8 *
+gst_bdasrc_parse_pids (GstBdaSrc * self, const gchar * pids)
+{
+  if (!pids || !*pids) {
+    return NULL;
+  }
+
+  guint8 *pid_filter = g_new0 (guint8, (GST_BDA_TS_NULL_PID + 1) / 8);
+  gchar **tokens = g_strsplit (pids, ",", -1);
+  for (gchar ** token = tokens; *token; token++) {
+    gchar *end;
+    guint64 pid = g_ascii_strtoull (g_strstrip (*token), &end, 0);
+    if (end == *token || *end || pid > GST_BDA_TS_NULL_PID) {
+      GST_WARNING_OBJECT (self, "Ignoring invalid PID '%s'", *token);
+      continue;
+    }
+    pid_filter[pid / 8] |= 1 << (pid % 8);
+  }
+  g_strfreev (tokens);
+
+  return pid_filter;
+}
+
+/* Returns a buffer with the packets of the PIDs in pid_filter, NULL if there
+   are none. Packets not aligned to the sample are skipped. */
+static GstBuffer *
+gst_bdasrc_filter_pids (const guint8 * pid_filter, GstBuffer * buffer)
+{
+  GstMapInfo in, out;
+  gst_buffer_map (buffer, &in, GST_MAP_READ);
+  GstBuffer *filtered = gst_buffer_new_and_alloc (in.size);
+  gst_buffer_map (filtered, &out, GST_MAP_WRITE);
+
+  gsize size = 0;
+  for (gsize i = 0; i + GST_BDA_TS_PACKET_SIZE <= in.size;
+      i += GST_BDA_TS_PACKET_SIZE) {
+    const guint8 *packet = in.data + i;
+    guint16 pid = gst_bda_ts_pid (packet);
+    if (packet[0] == GST_BDA_TS_SYNC_BYTE
+        && (pid_filter[pid / 8] & (1 << (pid % 8)))) {
+      memcpy (out.data + size, packet, GST_BDA_TS_PACKET_SIZE);
+      size += GST_BDA_TS_PACKET_SIZE;
+    }
+  }
+
+  gst_buffer_unmap (filtered, &out);
+  gst_buffer_unmap (buffer, &in);
+
+  if (size == 0) {
+    gst_buffer_unref (filtered);
+    return NULL;
+  }
+  gst_buffer_set_size (filtered, size);
+
+  return filtered;
+}
+
+/* Returns buffer with its PSI/SI reduced by the SI filter, NULL if nothing
+   is left. Takes ownership of buffer. Called with lock held. */
+static GstBuffer *
+gst_bdasrc_reduce_si (GstBdaSrc * self, GstBuffer * buffer)
+{
+  GstMapInfo map;
+  gst_buffer_map (buffer, &map, GST_MAP_READ);
+  if (map.size % GST_BDA_TS_PACKET_SIZE != 0
+      || (map.size > 0 && map.data[0] != GST_BDA_TS_SYNC_BYTE)) {
+    /* Not aligned to packets, passed on as is. */
+    gst_buffer_unmap (buffer, &map);
+    return buffer;
+  }
+
+  if (!self->si_filter) {
+    self->si_filter =
+        gst_bda_si_filter_new (self->psi_refresh, self->si_refresh);
+  }
+  GArray *runs = g_array_new (FALSE, FALSE, sizeof (GstBdaSiFilterRun));
+  GByteArray *written = g_byte_array_new ();
+  gst_bda_si_filter_push (self->si_filter, map.data, map.size,
+      g_get_monotonic_time (), runs, written);
+  gst_buffer_unmap (buffer, &map);
+
+  /* The packets passed on share the memory of the sample, only the
+     sections written by the filter are copied. */
+  GstBuffer *reduced = NULL;
+  for (guint i = 0; i < runs->len; i++) {
+    GstBdaSiFilterRun *run = &g_array_index (runs, GstBdaSiFilterRun, i);
+    GstBuffer *part;
+    if (run->written) {
+      part = gst_buffer_new_and_alloc (run->size);
+      gst_buffer_fill (part, 0, written->data + run->offset, run->size);
+    } else if (run->offset == 0 && run->size == map.size) {
+      part = gst_buffer_ref (buffer);
+    } else {
+      part = gst_buffer_copy_region (buffer, GST_BUFFER_COPY_MEMORY,
+          run->offset, run->size);
+    }
+    reduced = reduced ? gst_buffer_append (reduced, part) : part;
+  }
+  g_byte_array_free (written, TRUE);
+  g_array_free (runs, TRUE);
+
+  gboolean discont = GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DISCONT);
+  gst_buffer_unref (buffer);
+  if (!reduced) {
+    self->discont |= discont;
+    return NULL;
+  }
+
+  if (discont) {
+    reduced = gst_buffer_make_writable (reduced);
+    GST_BUFFER_FLAG_SET (reduced, GST_BUFFER_FLAG_DISCONT);
+  }
+
+  return reduced;
+}
+
+/* Queues the cached PSI of the transponder ahead of the samples after
+   tuning, and starts collecting fresh PSI to replace it. */
+static void
+gst_bdasrc_start_psi (GstBdaSrc * self)
+{
+  if (!self->inject_psi) {
+    return;
+  }
+
+  gchar *transponder = gst_bdasrc_tuning_key (self, self->frequency);
+  GBytes *packets = gst_bda_psi_cache_lookup (self->psi_cache, transponder);
+  GstBuffer *buffer = NULL;
+  if (packets) {
+    gsize size;
+    gconstpointer data = g_bytes_get_data (packets, &size);
+    buffer = gst_buffer_new_and_alloc (size);
+    gst_buffer_fill (buffer, 0, data, size);
+    g_bytes_unref (packets);
+  }
+
+  g_mutex_lock (&self->lock);
+  if (buffer) {
+    GST_DEBUG_OBJECT (self, "Injecting %" G_GSIZE_FORMAT " bytes of cached"
+        " PSI", gst_buffer_get_size (buffer));
+    gst_bdasrc_enqueue (self, buffer);
+  }
+
+  gst_bda_psi_collector_free (self->psi_collector);
+  self->psi_collector = gst_bda_psi_collector_new ();
+  gst_bda_ts_aligner_reset (self->psi_aligner);
+  g_free (self->psi_transponder);
+  self->psi_transponder = transponder;
+  g_mutex_unlock (&self->lock);
+}
+
+typedef struct _GstBdaPsiSave GstBdaPsiSave;
+
+struct _GstBdaPsiSave {
+  GstBdaSrc *src;
+  gchar *location;
+  gchar *transponder;
+};
+
+/* Persists the PSI cache of a transponder on the worker thread. */
+static gboolean
+gst_bdasrc_do_save_psi (gpointer data)
+{
+  GstBdaPsiSave *save = (GstBdaPsiSave *) data;
+
+  if (!gst_bda_psi_cache_save (save->location, save->transponder)) {
+    GST_WARNING_OBJECT (save->src, "Unable to write PSI cache '%s'",
+        save->location);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static void
+gst_bdasrc_psi_save_free (gpointer data)
+{
+  GstBdaPsiSave *save = (GstBdaPsiSave *) data;
+
+  g_free (save->location);
+  g_free (save->transponder);
+  g_free (save);
+}
+
+/* Feeds whole packets to the PSI collector. Called with the lock held. */
+static void
+gst_bdasrc_collect_psi_packets (const guint8 * packets, gsize size,
+    gpointer user_data)
+{
+  GstBdaSrc *self = GST_BDASRC (user_data);
+
+  if (self->psi_collector && !self->psi_packets
+      && gst_bda_psi_collector_push (self->psi_collector, packets, size)) {
+    self->psi_packets =
+        gst_bda_psi_collector_get_packets (self->psi_collector);
+  }
+}
+
+/* Feeds a sample to the PSI collector, and caches the PSI once it is
+   complete. The cache is persisted on the worker thread. */
+static void
+gst_bdasrc_collect_psi (GstBdaSrc * self, GstBuffer * buffer)
+{
+  g_mutex_lock (&self->lock);
+  if (!self->psi_collector) {
+    g_mutex_unlock (&self->lock);
+    return;
+  }
+
+  GstMapInfo map;
+  gst_buffer_map (buffer, &map, GST_MAP_READ);
+  gst_bda_ts_align (self->psi_aligner, map.data, map.size,
+      gst_bdasrc_collect_psi_packets, self);
+  gst_buffer_unmap (buffer, &map);
+
+  GBytes *packets = self->psi_packets;
+  gchar *transponder = NULL;
+  gchar *location = NULL;
+  if (packets) {
+    self->psi_packets = NULL;
+    gst_bda_psi_collector_free (self->psi_collector);
+    self->psi_collector = NULL;
+    transponder = self->psi_transponder;
+    self->psi_transponder = NULL;
+    location = g_strdup (self->psi_cache);
+  }
+  g_mutex_unlock (&self->lock);
+
+  if (!packets) {
+    return;
+  }
+
+  if (gst_bda_psi_cache_store (transponder, packets) && location) {
+    GstBdaPsiSave *save = g_new0 (GstBdaPsiSave, 1);
+    save->src = self;
+    save->location = location;
+    save->transponder = transponder;
+    gst_bda_worker_command_unref (gst_bda_worker_push (self->worker,
+            gst_bdasrc_do_save_psi, save, gst_bdasrc_psi_save_free, -1));
+  } else {
+    g_free (location);
+    g_free (transponder);
+  }
+  g_bytes_unref (packets);
+}
+
+/* Queues an "si-section" message for a section not seen before. Called
+   with the lock held. */
+static void
+gst_bdasrc_si_section (guint16 pid, const guint8 * section, gsize size,
+    gpointer user_data)
+{
+  GstBdaSrc *self = GST_BDASRC (user_data);
+
+  GBytes *bytes = g_bytes_new (section, size);
+  GstStructure *s = gst_structure_new ("si-section",
+      "pid", G_TYPE_UINT, (guint) pid,
+      "table-id", G_TYPE_UINT, (guint) section[0],
+      "section", G_TYPE_BYTES, bytes, NULL);
+  g_bytes_unref (bytes);
+  /* Section syntax indicator */
+  if ((section[1] & 0x80) && size >= 12) {
+    guint extension = (section[3] << 8) | section[4];
+    guint version = (section[5] >> 1) & 0x1f;
+    gst_structure_set (s,
+        "table-id-extension", G_TYPE_UINT, extension,
+        "version", G_TYPE_UINT, version,
+        "current", G_TYPE_BOOLEAN, (section[5] & 0x01) != 0,
+        "section-number", G_TYPE_UINT, (guint) section[6],
+        "last-section-number", G_TYPE_UINT, (guint) section[7], NULL);
+  }
+
+  self->si_messages = g_list_prepend (self->si_messages,
+      gst_message_new_element (GST_OBJECT (self), s));
+}
+
+static void
+gst_bdasrc_read_si_packets (const guint8 * packets, gsize size,
+    gpointer user_data)
+{
+  gst_bda_section_assembler_push ((GstBdaSectionAssembler *) user_data,
+      packets, size);
+}
+
+/* Reads the sections of si-pids from a sample, and posts the new ones. */
+static void
+gst_bdasrc_read_si (GstBdaSrc * self, GstBuffer * buffer)
+{
+  g_mutex_lock (&self->lock);
+  if (!self->si_pid_filter) {
+    g_mutex_unlock (&self->lock);
+    return;
+  }
+  if (!self->si_assembler) {
+    self->si_assembler =
+        gst_bda_section_assembler_new (gst_bdasrc_si_section, self);
+    gst_bda_section_assembler_set_deduplicate (self->si_assembler, TRUE);
+    for (guint pid = 0; pid <= GST_BDA_TS_NULL_PID; pid++) {
+      if (self->si_pid_filter[pid / 8] & (1 << (pid % 8))) {
+        gst_bda_section_assembler_add_pid (self->si_assembler, pid);
+      }
+    }
+  }
+
+  GstMapInfo map;
+  gst_buffer_map (buffer, &map, GST_MAP_READ);
+  gst_bda_ts_align (self->si_aligner, map.data, map.size,
+      gst_bdasrc_read_si_packets, self->si_assembler);
+  gst_buffer_unmap (buffer, &map);
+
+  GList *messages = g_list_reverse (self->si_messages);
+  self->si_messages = NULL;
+  g_mutex_unlock (&self->lock);
+
+  for (GList * l = messages; l; l = l->next) {
+    gst_element_post_message (GST_ELEMENT (self), (GstMessage *) l->data);
+  }
+  g_list_free (messages);
+}
+
+/* Flags the buffer as a delta unit, or attaches the offset of its first
+   random access point. Called with the lock held. */
+static void
+gst_bdasrc_mark_keyframe (GstBdaSrc * self, GstBuffer * buffer)
+{
+  GstMapInfo map;
+  gst_buffer_map (buffer, &map, GST_MAP_READ);
+  if (map.size == 0 || map.size % GST_BDA_TS_PACKET_SIZE != 0
+      || map.data[0] != GST_BDA_TS_SYNC_BYTE) {
+    gst_buffer_unmap (buffer, &map);
+    return;
+  }
+
+  if (!self->keyframe_scanner) {
+    self->keyframe_scanner = gst_bda_keyframe_scanner_new ();
+  }
+  guint16 pid;
+  gssize offset = gst_bda_keyframe_scanner_scan (self->keyframe_scanner,
+      map.data, map.size, &pid);
+  gst_buffer_unmap (buffer, &map);
+
+  if (offset < 0) {
+    GST_BUFFER_FLAG_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+  } else {
+    gst_buffer_add_bda_keyframe_meta (buffer, offset, pid);
+  }
+}
+
+/* Filters the buffer for the src pad and queues it with the next sample
+   offset, dropping the oldest samples over buffer-size. Takes ownership of
+   buffer. Called with the lock held. */
+static void
+gst_bdasrc_enqueue (GstBdaSrc * self, GstBuffer * buffer)
+{
+  if (self->pid_filter) {
+    gboolean discont = GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DISCONT);
+    GstBuffer *filtered = gst_bdasrc_filter_pids (self->pid_filter, buffer);
+    gst_buffer_unref (buffer);
+    if (!filtered) {
+      /* No packets of the selected PIDs, the next buffer is marked. */
+      self->discont |= discont;
+      return;
+    }
+    if (discont) {
+      GST_BUFFER_FLAG_SET (filtered, GST_BUFFER_FLAG_DISCONT);
+    }
+    buffer = filtered;
+  }
+
+  if (self->reduce_si) {
+    buffer = gst_bdasrc_reduce_si (self, buffer);
+    if (!buffer) {
+      return;
+    }
+  }
+
+  if (self->mark_keyframes) {
+    gst_bdasrc_mark_keyframe (self, buffer);
+  }
+
+  guint64 offset = self->samples++;
+
+  if (self->flushing) {
+    gst_buffer_unref (buffer);
+    return;
+  }
+
+  while (g_queue_get_length (&self->ts_samples) >= self->buffer_size) {
+    GstBuffer *dropped = (GstBuffer *) g_queue_pop_head (&self->ts_samples);
+    GST_WARNING_OBJECT (self, "Dropping TS sample");
+    gst_buffer_unref (dropped);
+  }
+
+  GST_BUFFER_OFFSET (buffer) = offset;
+  GST_BUFFER_OFFSET_END (buffer) = offset + 1;
+
+  g_queue_push_tail (&self->ts_samples, buffer);
+  g_cond_signal (&self->cond);
+}
+
+/* Queues a sample for the streaming thread, takes ownership of buffer. */
+void
+gst_bdasrc_queue_sample (GstBdaSrc * self, GstBuffer * buffer)
+{
+  gst_bdasrc_collect_psi (self, buffer);
+  gst_bdasrc_read_si (self, buffer);
+
+  g_mutex_lock (&self->lock);
+  /* The es_%u pads carry their PIDs whatever the src pad is filtered to. */
+  gst_bdasrc_es_push (self, buffer);
+  gst_bdasrc_enqueue (self, buffer);
+  g_mutex_unlock (&self->lock);
+}
+
 static void
 gst_bdasrc_sample_received (GstBdaSrc * self, gpointer data, gsize size)
 {
-  GstBuffer *buffer;
   GstMapInfo map;
+  GstBuffer *buffer = gst_buffer_new_and_alloc (size);
+
+  gst_buffer_map (buffer, &map, GST_MAP_WRITE);
+  memcpy (map.data, data, size);
+  gst_buffer_unmap (buffer, &map);
+  if (self->sample_discont) {
+    GST_BUFFER_FLAG_SET (buffer, GST_BUFFER_FLAG_DISCONT);
+  }
+
+  gst_bdasrc_queue_sample (self, buffer);
+}
+
+void
+gst_bdasrc_end_of_stream (GstBdaSrc * self)
+{
+  if (self->owned_tuner) {
+    gst_bdasrc_shared_end_of_stream (self);
+    return;
+  }
 
   g_mutex_lock (&self->lock);
+  self->eos = TRUE;
+  g_cond_signal (&self->cond);
+  gst_bdasrc_es_eos (self);
+  g_mutex_unlock (&self->lock);
+}
 
-  if (!self->flushing) {
-    while (g_queue_get_length (&self->ts_samples) >= self->buffer_size) {
-      buffer = (GstBuffer *) g_queue_pop_head (&self->ts_samples);
-      GST_WARNING_OBJECT (self, "Dropping TS sample");
-      gst_buffer_unref (buffer);
+/* Signal lock poll after a tune. Each tune starts a new poll, which
+   outlives the ones it replaces only until their next read returns, so
+   nothing waits for them but stop and finalize. */
+typedef struct _GstBdaLockWait GstBdaLockWait;
+
+struct _GstBdaLockWait {
+  GstBdaSrc *src;
+  /* lock_generation the poll was started for. */
+  guint generation;
+  /* Snapshots of the tune being waited for. */
+  int frequency;
+  guint timeout;
+};
+
+/* Polls the signal lock status with backoff until the signal locks or
+   tune-timeout passes. */
+static gpointer
+gst_bdasrc_lock_thread (gpointer data)
+{
+  GstBdaLockWait *wait = (GstBdaLockWait *) data;
+  GstBdaSrc *self = wait->src;
+  gint64 start = g_get_monotonic_time ();
+  gint64 deadline = start + wait->timeout * G_TIME_SPAN_MILLISECOND;
+  gint64 interval = LOCK_POLL_MIN;
+  gboolean locked = FALSE;
+
+  g_mutex_lock (&self->lock);
+  while (self->lock_generation == wait->generation) {
+    g_mutex_unlock (&self->lock);
+    if (!gst_bdasrc_read_signal_locked (self, &locked)) {
+      /* Devices without signal statistics are assumed to lock. */
+      GST_DEBUG_OBJECT (self, "Signal lock status not available");
+      locked = TRUE;
     }
+    g_mutex_lock (&self->lock);
 
-    buffer = gst_buffer_new_and_alloc (size);
-    gst_buffer_map (buffer, &map, GST_MAP_WRITE);
-    memcpy (map.data, data, size);
-    gst_buffer_unmap (buffer, &map);
+    gint64 now = g_get_monotonic_time ();
+    if (locked || now >= deadline) {
+      break;
+    }
+    g_cond_wait_until (&self->lock_cond, &self->lock,
+        MIN (now + interval, deadline));
+    interval = MIN (interval * 2, LOCK_POLL_MAX);
+  }
+  gboolean cancelled = self->lock_generation != wait->generation;
+  g_mutex_unlock (&self->lock);
 
-    g_queue_push_tail (&self->ts_samples, buffer);
-    g_cond_signal (&self->cond);
+  if (!cancelled) {
+    GstClockTime elapsed = (g_get_monotonic_time () - start) * GST_USECOND;
+    GstStructure *s;
+    if (locked) {
+      GST_INFO_OBJECT (self, "Signal locked after %" GST_TIME_FORMAT,
+          GST_TIME_ARGS (elapsed));
+      s = gst_structure_new ("lock-acquired",
+          "frequency", G_TYPE_INT, wait->frequency,
+          "time-to-lock", G_TYPE_UINT64, elapsed, NULL);
+    } else {
+      GST_WARNING_OBJECT (self, "No signal lock after %u ms", wait->timeout);
+      s = gst_structure_new ("lock-timeout",
+          "frequency", G_TYPE_INT, wait->frequency,
+          "timeout", G_TYPE_UINT64, elapsed, NULL);
+    }
+    gst_element_post_message (GST_ELEMENT (self),
+        gst_message_new_element (GST_OBJECT (self), s));
+  }
+
+  g_mutex_lock (&self->lock);
+  self->lock_polls--;
+  g_cond_broadcast (&self->lock_cond);
+  g_mutex_unlock (&self->lock);
+  g_free (wait);
+
+  return NULL;
+}
+
+/* Makes the running poll, if any, end after its current read. Called with
+   the lock held. */
+static void
+gst_bdasrc_cancel_lock_wait (GstBdaSrc * self)
+{
+  self->lock_generation++;
+  g_cond_broadcast (&self->lock_cond);
+}
+
+/* Starts waiting for signal lock in the background after tuning, in place
+   of a previous wait. Called with the lock held. */
+static void
+gst_bdasrc_start_lock_wait (GstBdaSrc * self)
+{
+  gst_bdasrc_cancel_lock_wait (self);
+
+  /* Scan and EPG carousel tuners wait for lock themselves. */
+  if (self->tune_timeout == 0 || self->scan || self->epg) {
+    return;
+  }
+
+  GstBdaLockWait *wait = g_new (GstBdaLockWait, 1);
+  wait->src = self;
+  wait->generation = self->lock_generation;
+  wait->frequency = self->frequency;
+  wait->timeout = self->tune_timeout;
+  self->lock_polls++;
+  g_thread_unref (g_thread_new ("bdasrc-lock", gst_bdasrc_lock_thread,
+          wait));
+}
+
+/* Stops waiting for signal lock, and waits for the polls to end. */
+static void
+gst_bdasrc_stop_lock_wait (GstBdaSrc * self)
+{
+  g_mutex_lock (&self->lock);
+  gst_bdasrc_cancel_lock_wait (self);
+  while (self->lock_polls > 0) {
+    g_cond_wait (&self->lock_cond, &self->lock);
+  }
+  g_mutex_unlock (&self->lock);
+}
+
+/* Retune or stall recovery step of the streaming thread, run on the worker
+   so that the streaming thread can still be unlocked meanwhile. */
+typedef struct _GstBdaTuneStep GstBdaTuneStep;
+
+struct _GstBdaTuneStep {
+  GstBdaSrc *src;
+  GstBdaWorkerFunc func;
+  const gchar *action;
+  /* Recovery stage, -1 for a retune. */
+  gint stage;
+  guint recoveries[3];
+  gint64 start;
+  /* Given up on if not done by then, -1 to wait forever. */
+  gint64 deadline;
+  /* Protected by the element lock. */
+  gboolean done;
+  gboolean success;
+};
+
+static gboolean
+gst_bdasrc_do_tune_step (gpointer data)
+{
+  GstBdaTuneStep *step = (GstBdaTuneStep *) data;
+  GstBdaSrc *self = step->src;
+
+  gboolean success = step->func (self);
+
+  g_mutex_lock (&self->lock);
+  step->success = success;
+  step->done = TRUE;
+  g_cond_signal (&self->cond);
+  g_mutex_unlock (&self->lock);
+
+  return success;
+}
+
+/* Queues a step for the worker. Called with the lock held. */
+static void
+gst_bdasrc_post_tune_step (GstBdaSrc * self, GstBdaWorkerFunc func,
+    const gchar * action, gint stage)
+{
+  GstBdaTuneStep *step = g_new0 (GstBdaTuneStep, 1);
+  step->src = self;
+  step->func = func;
+  step->action = action;
+  step->stage = stage;
+  memcpy (step->recoveries, self->stall_recoveries,
+      sizeof (step->recoveries));
+  step->start = g_get_monotonic_time ();
+  step->deadline = gst_bdasrc_deadline (self, TRUE);
+
+  self->tune_step = step;
+  self->tune_command = gst_bda_worker_push (self->worker,
+      gst_bdasrc_do_tune_step, step, g_free, step->deadline);
+}
+
+/* Forgets the pending step, e.g. when the device is stopped after it.
+   Called with the lock held. */
+static void
+gst_bdasrc_cancel_tune_step (GstBdaSrc * self)
+{
+  if (self->tune_command) {
+    gst_bda_worker_command_unref (self->tune_command);
+  }
+  self->tune_command = NULL;
+  self->tune_step = NULL;
+}
+
+/* Applies changed tuning properties to the running device. Called from the
+   streaming thread with the lock held. */
+static void
+gst_bdasrc_retune (GstBdaSrc * self)
+{
+  self->need_tune = FALSE;
+  gst_bdasrc_post_tune_step (self, gst_bdasrc_do_retune, "retune", -1);
+}
+
+/* Takes the next recovery step after no sample arrived for stall-timeout.
+   Called from the streaming thread with the lock held. */
+static void
+gst_bdasrc_recover (GstBdaSrc * self)
+{
+  static const gchar *actions[] = { "retune", "restart", "rebuild" };
+  static const GstBdaWorkerFunc steps[] = {
+    gst_bdasrc_do_retune, gst_bdasrc_do_restart, gst_bdasrc_do_rebuild
+  };
+  /* Rebuilding is repeated until samples arrive. */
+  guint stage = MIN (self->stall_stage, G_N_ELEMENTS (steps) - 1);
+  self->stall_stage++;
+  self->stall_recoveries[stage]++;
+
+  GST_WARNING_OBJECT (self, "No samples for %u ms, trying %s",
+      self->stall_timeout, actions[stage]);
+  gst_bdasrc_cancel_lock_wait (self);
+  gst_bdasrc_post_tune_step (self, steps[stage], actions[stage], stage);
+}
+
+/* Completes the pending step once it is done or past its deadline.
+   Called from the streaming thread with the lock held. */
+static void
+gst_bdasrc_finish_tune_step (GstBdaSrc * self)
+{
+  GstBdaTuneStep step = *self->tune_step;
+
+  if (!step.done && (step.deadline < 0
+          || g_get_monotonic_time () < step.deadline)) {
+    if (step.deadline < 0) {
+      g_cond_wait (&self->cond, &self->lock);
+    } else {
+      g_cond_wait_until (&self->cond, &self->lock, step.deadline);
+    }
+    return;
+  }
+  gst_bdasrc_cancel_tune_step (self);
+  gboolean success = step.done && step.success;
+  if (success) {
+    gst_bdasrc_start_lock_wait (self);
   }
   g_mutex_unlock (&self->lock);
+
+  if (!step.done) {
+    GST_WARNING_OBJECT (self, "Device %s timed out after %u ms", step.action,
+        self->device_timeout);
+  }
+
+  if (step.stage < 0) {
+    GST_INFO_OBJECT (self, "Retuned to %d kHz in %" G_GINT64_FORMAT " ms%s",
+        self->frequency, (g_get_monotonic_time () - step.start) / 1000,
+        success ? "" : ", failed");
+
+    /* Drop samples from the previous multiplex. */
+    gst_bda_release_samples (self);
+    if (success) {
+      gst_bdasrc_start_psi (self);
+    }
+
+    gst_element_post_message (GST_ELEMENT (self),
+        gst_message_new_element (GST_OBJECT (self),
+            gst_structure_new ("retune-complete",
+                "frequency", G_TYPE_INT, self->frequency,
+                "success", G_TYPE_BOOLEAN, success, NULL)));
+  } else {
+    gst_element_post_message (GST_ELEMENT (self),
+        gst_message_new_element (GST_OBJECT (self),
+            gst_structure_new ("stall-recovery",
+                "action", G_TYPE_STRING, step.action,
+                "success", G_TYPE_BOOLEAN, success,
+                "retunes", G_TYPE_UINT, step.recoveries[0],
+                "restarts", G_TYPE_UINT, step.recoveries[1],
+                "rebuilds", G_TYPE_UINT, step.recoveries[2], NULL)));
+  }
+
+  g_mutex_lock (&self->lock);
+  self->discont = TRUE;
 }
 
 static GstFlowReturn
 gst_bdasrc_create (GstPushSrc * src, GstBuffer ** buf)
 {
   GstBdaSrc *self = GST_BDASRC (src);
+  gint64 stall_deadline = -1;
 
   g_mutex_lock (&self->lock);
-  while (g_queue_is_empty (&self->ts_samples) && !self->flushing) {
-    g_cond_wait (&self->cond, &self->lock);
+  while (TRUE) {
+    if (self->flushing) {
+      break;
+    } else if (self->tune_step) {
+      /* Samples queued meanwhile are from before the step. */
+      gst_bdasrc_finish_tune_step (self);
+      stall_deadline = -1;
+    } else if (self->need_tune) {
+      gst_bdasrc_retune (self);
+    } else if (!g_queue_is_empty (&self->ts_samples) || self->eos) {
+      break;
+    } else if (self->stall_timeout == 0 || self->share_tuner || self->warm
+        || self->scan || self->epg) {
+      g_cond_wait (&self->cond, &self->lock);
+    } else {
+      gint64 now = g_get_monotonic_time ();
+      if (stall_deadline < 0) {
+        stall_deadline = now + self->stall_timeout * G_TIME_SPAN_MILLISECOND;
+      }
+      if (now >= stall_deadline) {
+        gst_bdasrc_recover (self);
+      } else {
+        g_cond_wait_until (&self->cond, &self->lock, stall_deadline);
+      }
+    }
   }
 
   *buf = (GstBuffer *) g_queue_pop_head (&self->ts_samples);
+  if (*buf) {
+    self->stall_stage = 0;
+  }
+  if (*buf && self->discont) {
+    GST_BUFFER_FLAG_SET (*buf, GST_BUFFER_FLAG_DISCONT);
+    self->discont = FALSE;
+  }
   g_mutex_unlock (&self->lock);
 
+  if (*buf == NULL && !self->flushing) {
+    GST_DEBUG_OBJECT (self, "End of stream");
+    return GST_FLOW_EOS;
+  }
+
   if (self->flushing) {
     if (*buf) {
       gst_buffer_unref (*buf);
@@ -802,19 +2786,46 @@ gst_bdasrc_change_state (GstElement * element, GstStateChange transition)
 
   self = GST_BDASRC (element);
 
+  /* Any other transition, including aborting NULL -> READY, needs the open
+     to be complete. */
+  if (transition != GST_STATE_CHANGE_NULL_TO_READY) {
+    gst_bdasrc_wait_open (self);
+  }
+
   switch (transition) {
     case GST_STATE_CHANGE_NULL_TO_READY:
-      if (!gst_bdasrc_create_graph (self)) {
+      if (!gst_bda_backend_get (self->backend_type)) {
+        GST_ERROR_OBJECT (self, "Backend not available in this build");
+        return GST_STATE_CHANGE_FAILURE;
+      }
+      if (self->async_open) {
+        ret = GST_ELEMENT_CLASS (parent_class)->change_state (element,
+            transition);
+        if (ret == GST_STATE_CHANGE_FAILURE) {
+          return ret;
+        }
+        gst_element_post_message (element,
+            gst_message_new_async_start (GST_OBJECT (self)));
+        self->open_command = gst_bda_worker_push (self->worker,
+            gst_bdasrc_do_async_open, self, NULL, -1);
+        return GST_STATE_CHANGE_ASYNC;
+      }
+      if (!gst_bdasrc_call (self, gst_bdasrc_do_open, "open", TRUE)) {
+        /* Releases the device once an open that timed out completes. */
+        gst_bdasrc_post (self, gst_bdasrc_do_close);
         return GST_STATE_CHANGE_FAILURE;
       }
       break;
     case GST_STATE_CHANGE_PLAYING_TO_PAUSED:
-      if (self->media_control) {
-        self->media_control->Stop ();
-      }
+      gst_bdasrc_stop_lock_wait (self);
+      gst_bdasrc_call (self, gst_bdasrc_do_stop, "stop", TRUE);
+      /* A pending retune or recovery ran before the stop. */
+      g_mutex_lock (&self->lock);
+      gst_bdasrc_cancel_tune_step (self);
+      g_mutex_unlock (&self->lock);
       break;
     case GST_STATE_CHANGE_READY_TO_NULL:
-      gst_bdasrc_release_graph (self);
+      gst_bdasrc_call (self, gst_bdasrc_do_close, "close", FALSE);
       break;
     default:
       break;
@@ -831,10 +2842,24 @@ gst_bdasrc_change_state (GstElement * element, GstStateChange transition)
       break;
     case GST_STATE_CHANGE_PAUSED_TO_PLAYING:
       self->flushing = FALSE;
-      if (!gst_bdasrc_tune (self)) {
+      self->eos = FALSE;
+      if (self->need_tune) {
+        self->need_tune = FALSE;
+        if (!gst_bdasrc_call (self, gst_bdasrc_do_retune, "retune", TRUE)) {
+          ret = GST_STATE_CHANGE_FAILURE;
+          break;
+        }
+      }
+      if (!gst_bdasrc_call (self, gst_bdasrc_do_start, "start", TRUE)) {
         ret = GST_STATE_CHANGE_FAILURE;
         gst_bda_release_samples (self);
+        break;
       }
+      gst_bdasrc_start_psi (self);
+      /* Completes without waiting for lock. */
+      g_mutex_lock (&self->lock);
+      gst_bdasrc_start_lock_wait (self);
+      g_mutex_unlock (&self->lock);
       break;
     default:
       break;
@@ -852,6 +2877,7 @@ gst_bdasrc_unlock (GstBaseSrc * bsrc)
   self->flushing = TRUE;
   g_cond_signal (&self->cond);
   g_mutex_unlock (&self->lock);
+  gst_bdasrc_es_flush (self, TRUE);
 
   return TRUE;
 }
@@ -866,58 +2892,45 @@ gst_bdasrc_unlock_stop (GstBaseSrc * bsrc)
   g_queue_foreach (&self->ts_samples, (GFunc) gst_buffer_unref, NULL);
   g_queue_clear (&self->ts_samples);
   g_mutex_unlock (&self->lock);
+  gst_bdasrc_es_flush (self, FALSE);
 
   return TRUE;
 }
 
+/* Answers "epg-events" custom queries from the EPG store. */
 static gboolean
-gst_bdasrc_tune (GstBdaSrc * self)
+gst_bdasrc_query (GstBaseSrc * bsrc, GstQuery * query)
 {
-  HRESULT res = self->media_control->Run ();
-  if (FAILED (res)) {
-    GST_ERROR_OBJECT (self, "Error starting media control: %s (0x%lx)",
-        bda_err_to_str (res).c_str (), res);
-    self->media_control->Stop ();
-    return FALSE;
-  }
+  GstBdaSrc *self = GST_BDASRC (bsrc);
 
-  IBDA_TopologyPtr bda_topology;
-  res = self->network_tuner->QueryInterface (&bda_topology);
-  if (FAILED (res)) {
-    GST_ERROR_OBJECT (self, "Error getting BDA topology interface: %s (0x%lx)",
-        bda_err_to_str (res).c_str (), res);
-    self->media_control->Stop ();
-    return FALSE;
+  const GstStructure *request = GST_QUERY_TYPE (query) == GST_QUERY_CUSTOM ?
+      gst_query_get_structure (query) : NULL;
+  if (!request || !gst_structure_has_name (request, "epg-events")) {
+    return GST_BASE_SRC_CLASS (parent_class)->query (bsrc, query);
   }
 
-  ULONG node_type_count = 0;
-  ULONG node_types[32] = { };
-  res =
-      bda_topology->GetNodeTypes (&node_type_count, _countof (node_types),
-      node_types);
-  if (FAILED (res)) {
-    self->media_control->Stop ();
-    GST_WARNING_OBJECT (self,
-        "Error getting BDA topology node types: %s (0x%lx)",
-        bda_err_to_str (res).c_str (), res);
+  /* The store is kept until finalize once created. */
+  g_mutex_lock (&self->lock);
+  GstBdaEpgStore *store = self->epg_store;
+  g_mutex_unlock (&self->lock);
+  if (!store) {
     return FALSE;
   }
 
-  IBDA_SignalStatisticsPtr signal_stats;
-  for (ULONG i = 0; i < node_type_count; i++) {
-    IUnknownPtr node;
-    res = bda_topology->GetControlNode (0, 1, node_types[i], &node);
-    if (res == S_OK) {
-      res = node->QueryInterface (&signal_stats);
-
-      BOOLEAN locked = FALSE;
-      if (SUCCEEDED (signal_stats->get_SignalLocked (&locked))) {
-        return locked;
-      }
-
-      break;
-    }
-  }
+  GstStructure *s = gst_query_writable_structure (query);
+  guint service_id = 0;
+  gint64 start = 0;
+  gint64 end = 0;
+  gst_structure_get_uint (s, "service-id", &service_id);
+  gst_structure_get_int64 (s, "start", &start);
+  gst_structure_get_int64 (s, "end", &end);
+
+  GValue events = G_VALUE_INIT;
+  g_value_init (&events, GST_TYPE_LIST);
+  guint count = gst_bda_epg_store_get_events (store, service_id, start, end,
+      &events);
+  gst_structure_take_value (s, "events", &events);
+  GST_DEBUG_OBJECT (self, "Answered EPG query with %u events", count);
 
   return TRUE;
 }
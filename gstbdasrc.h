@@ -22,16 +22,22 @@
 
 #include <gst/gst.h>
 #include <gst/base/gstpushsrc.h>
+#include <gst/base/gstflowcombiner.h>
+#ifdef HAVE_DIRECTSHOW
 #include <winsock2.h>
 #include <bdatypes.h>
 #include <control.h>
 #include <tuner.h>
+#endif
 #include "gstbdatypes.h"
 
 GST_DEBUG_CATEGORY_EXTERN(gstbdasrc_debug);
 #define GST_CAT_DEFAULT (gstbdasrc_debug)
 
+#ifdef HAVE_DIRECTSHOW
 class GstBdaGrabber;
+#endif
+struct _GstBdaBackend;
 
 G_BEGIN_DECLS
 
@@ -49,9 +55,158 @@ struct _GstBdaSrc {
   GstPushSrc element;
   GstPad *srcpad;
 
+  /* Tuning properties changed since the last tune request. */
   gboolean need_tune;
+  /* Mark the next buffer as a discontinuity. */
+  gboolean discont;
+  /* Signal lock timeout in ms after tuning, 0 to not wait for lock. */
+  guint tune_timeout;
+  /* Incremented to cancel the signal lock poll after tuning, protected by
+     lock. */
+  guint lock_generation;
+  /* Lock poll threads still running, protected by lock. */
+  guint lock_polls;
+  GCond lock_cond;
+  /* Open the device on a worker thread and complete NULL -> READY
+     asynchronously. */
+  gboolean async_open;
+  /* Pending asynchronous open, NULL otherwise. */
+  struct _GstBdaWorkerCommand *open_command;
+  /* Retune or stall recovery running on the worker for the streaming
+     thread, NULL otherwise. Protected by lock. */
+  struct _GstBdaTuneStep *tune_step;
+  struct _GstBdaWorkerCommand *tune_command;
+  /* Runs all device operations, see gstbdaworker.h. */
+  struct _GstBdaWorker *worker;
+  /* Time to wait for a device operation in ms, 0 to wait forever. */
+  guint device_timeout;
+  /* Attach to a tuner shared with other elements with the same device and
+     tuning properties. */
+  gboolean share_tuner;
+  /* Shared tuner this element is attached to, NULL otherwise. */
+  struct _GstBdaSharedTuner *shared;
+  /* Receives samples from the shared tuner, protected by the elements lock
+     of the shared tuner. */
+  gboolean shared_active;
+  /* Set for the hidden element that owns the device of a shared tuner. */
+  struct _GstBdaSharedTuner *owned_tuner;
+  /* Only packets of these PIDs are queued, NULL for all. */
+  gchar *pids;
+  /* Bit per PID, protected by lock. */
+  guint8 *pid_filter;
+  /* Keep a standby tuner locked to the same transponder and switch to it
+     when the device fails. */
+  gboolean standby;
+  /* Device index of the standby tuner, -1 to select one automatically. */
+  int standby_device;
+  /* Switch when no sample arrives for this long in ms. */
+  guint failover_timeout;
+  /* Switch after this many continuity errors within a second, 0 to ignore
+     continuity errors. */
+  guint failover_cc_errors;
+  /* Failover state while the standby tuner is open, NULL otherwise. */
+  struct _GstBdaFailover *failover;
+  /* Set for the hidden standby element of a failover. */
+  struct _GstBdaFailover *standby_for;
+  /* The sample being delivered follows a switch of tuner. */
+  gboolean sample_discont;
+  /* Recover the device when no sample arrives for this long in ms, 0 to
+     wait forever. */
+  guint stall_timeout;
+  /* Next recovery stage, reset when a sample arrives. Protected by lock. */
+  guint stall_stage;
+  /* Recovery steps taken per stage: retune, restart and rebuild. */
+  guint stall_recoveries[3];
+  /* Comma separated frequencies in kHz to keep spare tuners on. */
+  gchar *warm_frequencies;
+  /* Tuners of the element while warm_frequencies is used, NULL
+     otherwise. */
+  struct _GstBdaWarm *warm;
+  /* Set for the hidden tuner elements of a warm standby. */
+  struct _GstBdaWarm *warm_for;
+  /* Queue the cached PAT and PMTs of the transponder after tuning. */
+  gboolean inject_psi;
+  /* Persist the PSI cache to this file. */
+  gchar *psi_cache;
+  /* Collects fresh PSI after tuning until complete, protected by lock. */
+  struct _GstBdaPsiCollector *psi_collector;
+  /* Carries packets split between samples to the collector, protected by
+     lock. */
+  struct _GstBdaTsAligner *psi_aligner;
+  /* PSI completed by the collector in the sample being pushed to it. */
+  GBytes *psi_packets;
+  /* Tuning key the collected PSI is cached for. */
+  gchar *psi_transponder;
+  /* Bytes per program cached since the last random access point of a
+     shared tuner, 0 to disable. */
+  guint gop_cache_size;
+  /* Flag packet aligned buffers without a random access point as delta
+     units. */
+  gboolean mark_keyframes;
+  /* Follows the video streams of the multiplex, protected by lock. */
+  struct _GstBdaKeyframeScanner *keyframe_scanner;
+  /* Comma separated transponders to scan instead of streaming. */
+  gchar *scan_transponders;
+  /* Time to wait for signal lock on each transponder in ms. */
+  guint scan_lock_timeout;
+  /* Scan state while scan_transponders is used, NULL otherwise. */
+  struct _GstBdaScan *scan;
+  /* Set for the hidden tuner elements of a scan. */
+  struct _GstBdaScanTuner *scan_for;
+  /* Comma separated transponders to collect the EPG of instead of
+     streaming. */
+  gchar *epg_transponders;
+  /* Longest time to stay on a transponder in ms. */
+  guint epg_timeout;
+  /* EPG carousel state while epg_transponders is used, NULL otherwise. */
+  struct _GstBdaEpg *epg;
+  /* Set for the hidden tuner element of an EPG carousel. */
+  struct _GstBdaEpg *epg_for;
+  /* Events collected by the carousel, kept until finalize. Protected by
+     lock. */
+  struct _GstBdaEpgStore *epg_store;
+  /* Comma separated PIDs to post new PSI/SI sections of. */
+  gchar *si_pids;
+  /* A bit per PID of si_pids, NULL if not set. Protected by lock. */
+  guint8 *si_pid_filter;
+  /* Assembles the sections of si_pids, protected by lock. */
+  struct _GstBdaSectionAssembler *si_assembler;
+  /* Carries packets split between samples to si_assembler, protected by
+     lock. */
+  struct _GstBdaTsAligner *si_aligner;
+  /* "si-section" messages to post once the lock is released. */
+  GList *si_messages;
+  /* Pass on PSI/SI sections only when new or changed. */
+  gboolean reduce_si;
+  /* Repetition interval of unchanged PAT, CAT and PMTs in ms, 0 doesn't
+     repeat them. */
+  guint psi_refresh;
+  /* Repetition interval of unchanged NIT, SDT, BAT and EIT in ms, 0
+     doesn't repeat them. */
+  guint si_refresh;
+  /* Reduces the PSI/SI of the output, protected by lock. */
+  struct _GstBdaSiFilter *si_filter;
+  /* GstBdaEsPad per es_%u request pad, protected by lock. Each pad pushes
+     its queued buffers on its own task. */
+  GList *es_pads;
+  /* Signalled when an ES queue changes. */
+  GCond es_cond;
+  /* Reassembles the PES of the es_%u pads from the samples as they are
+     queued, protected by lock. */
+  struct _GstBdaPesDemux *pes_demux;
+  /* Flow returns of the es_%u pads, protected by lock. */
+  GstFlowCombiner *es_flow;
+  /* GstBdaEsClock per program, the first ES timestamp of the program and
+     the running time it maps to. Protected by lock. */
+  GArray *es_clocks;
+  /* Group ID of the stream-start events of the es_%u pads. */
+  guint es_group_id;
 
+  /* -1 to select a free device of device_type. */
   int device_index;
+  GstBdaInputType device_type;
+  /* Device opened by the backend, -1 if none. */
+  int selected_device;
 
   GstBdaInputType input_type;
 
@@ -73,22 +228,62 @@ struct _GstBdaSrc {
   Polarisation polarisation;
   BinaryConvolutionCodeRate inner_fec_rate;
 
+  GstBdaBackendType backend_type;
+  /* Backend opened on NULL -> READY, NULL otherwise. */
+  const struct _GstBdaBackend *backend;
+  /* Backend specific state. */
+  gpointer backend_data;
+
+  /* Replay: transport stream file */
+  gchar *replay_location;
+  GstBdaPacing pacing;
+  /* Replay: bitrate in bits per second for fixed bitrate pacing */
+  guint bitrate;
+  /* Replay: size of each sample in bytes */
+  guint chunk_size;
+  /* Replay: maximum random deviation from the sample schedule in us */
+  guint jitter;
+  /* Replay: restart from the beginning at end of file */
+  gboolean loop;
+  /* Synthetic: generator parameters, see gst_bda_ts_gen_params_parse () */
+  gchar *synthetic_params;
+  /* DirectShow: record sample timing to this file */
+  gchar *trace_location;
+  /* DirectShow: include sample data in the trace */
+  gboolean trace_payload;
+  /* DirectShow: persist graph build decisions to this file */
+  gchar *graph_cache;
+  /* DirectShow: keep the stopped graph for reuse this long in ms */
+  guint pool_idle_time;
+
+#ifdef HAVE_DIRECTSHOW
   /* BDA network tuner filter */
   IBaseFilter *network_tuner;
   /* BDA receiver filter */
   IBaseFilter *receiver;
+  /* Kept after the graph is built for retuning. */
+  IScanningTuner *scanning_tuner;
+  ITuningSpace *tuning_space;
   IGraphBuilder *filter_graph;
   IMediaControl *media_control;
 
   GstBdaGrabber *ts_grabber;
+  /* The graph was built completely and can be pooled. */
+  gboolean graph_ready;
+#endif
 
   GCond cond;
   GMutex lock;
   gboolean flushing;
+  /* Set by the backend when there is no more data. */
+  gboolean eos;
   /* Queue of MPEG-2 transport stream samples. */
   GQueue ts_samples;
   /* Max size of ts_samples. */
   guint buffer_size;
+  /* Sequence number of the next sample from the backend, stored in
+     GST_BUFFER_OFFSET so that consumers can detect dropped samples. */
+  guint64 samples;
 
   /* Callback function for GstBdaGrabber. */
   void (*sample_received) (GstBdaSrc *bda_src, gpointer data, gsize size);
@@ -101,6 +296,9 @@ struct _GstBdaSrcClass {
 GType gst_bdasrc_get_type (void);
 gboolean gst_bdasrc_plugin_init (GstPlugin *plugin);
 
+/* Called by the backend when there is no more data. */
+void gst_bdasrc_end_of_stream (GstBdaSrc *bda_src);
+
 G_END_DECLS
 
 #endif
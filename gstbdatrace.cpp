@@ -0,0 +1,311 @@
+/* GStreamer
+ * Copyright (C) 2015 Raimo Järvi <raimo.jarvi@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <glib/gstdio.h>
+#include "gstbdatrace.h"
+
+#define TRACE_MAGIC "BDATRACE"
+#define TRACE_MAGIC_SIZE 8
+#define TRACE_VERSION 1
+#define TRACE_HEADER_SIZE (TRACE_MAGIC_SIZE + 2)
+#define TRACE_FLAG_PAYLOAD 0x01
+/* Records are buffered for the writer thread, about a second of payload
+   at 32 Mbit/s. */
+#define TRACE_BUFFER_SIZE (4 * 1024 * 1024)
+/* Beyond this the writer thread doesn't keep up and tracing stops. */
+#define TRACE_MAX_PENDING (64 * 1024 * 1024)
+
+struct _GstBdaTraceWriter {
+  FILE *file;
+  gboolean payload;
+  gboolean first;
+  gint64 last_arrival;
+  gint64 last_sample_time;
+
+  /* Records are appended to pending and written by the thread from
+     writing, so the sample callback doesn't block on file I/O. */
+  GThread *thread;
+  GMutex lock;
+  GCond cond;
+  GByteArray *pending;
+  GByteArray *writing;
+  gboolean running;
+  gboolean failed;
+};
+
+struct _GstBdaTraceReader {
+  GMappedFile *file;
+  const guint8 *data;
+  gsize size;
+  gsize pos;
+  gboolean payload;
+  gint64 arrival;
+  gint64 sample_time;
+};
+
+/* Writes v as a varint, returns the number of bytes. */
+static gsize
+put_varint (guint8 * p, guint64 v)
+{
+  gsize n = 0;
+
+  while (v >= 0x80) {
+    p[n++] = (v & 0x7f) | 0x80;
+    v >>= 7;
+  }
+  p[n++] = (guint8) v;
+
+  return n;
+}
+
+static gboolean
+get_varint (GstBdaTraceReader * reader, guint64 * v)
+{
+  guint shift = 0;
+
+  *v = 0;
+  while (reader->pos < reader->size && shift < 64) {
+    guint8 b = reader->data[reader->pos++];
+    *v |= (guint64) (b & 0x7f) << shift;
+    if (!(b & 0x80)) {
+      return TRUE;
+    }
+    shift += 7;
+  }
+
+  return FALSE;
+}
+
+static gpointer
+gst_bda_trace_writer_thread (gpointer data)
+{
+  GstBdaTraceWriter *writer = (GstBdaTraceWriter *) data;
+
+  g_mutex_lock (&writer->lock);
+  for (;;) {
+    while (writer->running && writer->pending->len == 0) {
+      g_cond_wait (&writer->cond, &writer->lock);
+    }
+    if (writer->pending->len == 0) {
+      break;
+    }
+
+    GByteArray *records = writer->pending;
+    writer->pending = writer->writing;
+    writer->writing = records;
+    g_mutex_unlock (&writer->lock);
+
+    gboolean ok = fwrite (records->data, 1, records->len, writer->file) ==
+        records->len;
+    g_byte_array_set_size (records, 0);
+
+    g_mutex_lock (&writer->lock);
+    if (!ok) {
+      writer->failed = TRUE;
+      break;
+    }
+  }
+  g_mutex_unlock (&writer->lock);
+
+  return NULL;
+}
+
+GstBdaTraceWriter *
+gst_bda_trace_writer_new (const gchar * location, gboolean payload,
+    GError ** error)
+{
+  FILE *file = g_fopen (location, "wb");
+  if (!file) {
+    g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errno),
+        "Unable to create '%s': %s", location, g_strerror (errno));
+    return NULL;
+  }
+
+  guint8 header[TRACE_HEADER_SIZE];
+  memcpy (header, TRACE_MAGIC, TRACE_MAGIC_SIZE);
+  header[TRACE_MAGIC_SIZE] = TRACE_VERSION;
+  header[TRACE_MAGIC_SIZE + 1] = payload ? TRACE_FLAG_PAYLOAD : 0;
+  if (fwrite (header, 1, sizeof (header), file) != sizeof (header)) {
+    g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_IO,
+        "Unable to write '%s'", location);
+    fclose (file);
+    return NULL;
+  }
+
+  GstBdaTraceWriter *writer = g_new0 (GstBdaTraceWriter, 1);
+  writer->file = file;
+  writer->payload = payload;
+  writer->first = TRUE;
+  g_mutex_init (&writer->lock);
+  g_cond_init (&writer->cond);
+  writer->pending = g_byte_array_sized_new (TRACE_BUFFER_SIZE);
+  writer->writing = g_byte_array_sized_new (TRACE_BUFFER_SIZE);
+  writer->running = TRUE;
+  writer->thread = g_thread_new ("bdasrc-trace", gst_bda_trace_writer_thread,
+      writer);
+
+  return writer;
+}
+
+gboolean
+gst_bda_trace_writer_add (GstBdaTraceWriter * writer, gint64 arrival,
+    gint64 sample_time, const guint8 * data, gsize size)
+{
+  if (writer->first) {
+    writer->first = FALSE;
+    writer->last_arrival = arrival;
+    writer->last_sample_time = sample_time;
+  }
+
+  /* Three varints of at most 10 bytes each. */
+  guint8 record[30];
+  gsize n = put_varint (record, arrival - writer->last_arrival);
+  gint64 delta = sample_time - writer->last_sample_time;
+  n += put_varint (record + n, ((guint64) delta << 1) ^ (guint64) (delta >> 63));
+  n += put_varint (record + n, size);
+
+  writer->last_arrival = arrival;
+  writer->last_sample_time = sample_time;
+
+  gsize total = n + (writer->payload ? size : 0);
+  g_mutex_lock (&writer->lock);
+  if (writer->pending->len + total > TRACE_MAX_PENDING) {
+    writer->failed = TRUE;
+  }
+  gboolean ok = !writer->failed;
+  if (ok) {
+    g_byte_array_append (writer->pending, record, n);
+    if (writer->payload) {
+      g_byte_array_append (writer->pending, data, size);
+    }
+    g_cond_signal (&writer->cond);
+  }
+  g_mutex_unlock (&writer->lock);
+
+  return ok;
+}
+
+void
+gst_bda_trace_writer_free (GstBdaTraceWriter * writer)
+{
+  if (!writer) {
+    return;
+  }
+
+  /* The thread writes what is pending before it exits. */
+  g_mutex_lock (&writer->lock);
+  writer->running = FALSE;
+  g_cond_signal (&writer->cond);
+  g_mutex_unlock (&writer->lock);
+  g_thread_join (writer->thread);
+
+  fclose (writer->file);
+  g_byte_array_free (writer->pending, TRUE);
+  g_byte_array_free (writer->writing, TRUE);
+  g_mutex_clear (&writer->lock);
+  g_cond_clear (&writer->cond);
+  g_free (writer);
+}
+
+GstBdaTraceReader *
+gst_bda_trace_reader_new (const gchar * location, GError ** error)
+{
+  GMappedFile *file = g_mapped_file_new (location, FALSE, error);
+  if (!file) {
+    return NULL;
+  }
+
+  const guint8 *data = (const guint8 *) g_mapped_file_get_contents (file);
+  gsize size = g_mapped_file_get_length (file);
+  if (size < TRACE_HEADER_SIZE
+      || memcmp (data, TRACE_MAGIC, TRACE_MAGIC_SIZE) != 0
+      || data[TRACE_MAGIC_SIZE] != TRACE_VERSION) {
+    g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+        "'%s' is not a sample trace", location);
+    g_mapped_file_unref (file);
+    return NULL;
+  }
+
+  GstBdaTraceReader *reader = g_new0 (GstBdaTraceReader, 1);
+  reader->file = file;
+  reader->data = data;
+  reader->size = size;
+  reader->payload = (data[TRACE_MAGIC_SIZE + 1] & TRACE_FLAG_PAYLOAD) != 0;
+  gst_bda_trace_reader_rewind (reader);
+
+  return reader;
+}
+
+gboolean
+gst_bda_trace_reader_has_payload (GstBdaTraceReader * reader)
+{
+  return reader->payload;
+}
+
+gboolean
+gst_bda_trace_reader_next (GstBdaTraceReader * reader,
+    GstBdaTraceRecord * record)
+{
+  guint64 arrival, sample_time, size;
+
+  if (!get_varint (reader, &arrival) || !get_varint (reader, &sample_time)
+      || !get_varint (reader, &size)) {
+    return FALSE;
+  }
+
+  record->payload = NULL;
+  if (reader->payload) {
+    if (size > reader->size - reader->pos) {
+      return FALSE;
+    }
+    record->payload = reader->data + reader->pos;
+    reader->pos += size;
+  }
+
+  reader->arrival += arrival;
+  reader->sample_time += (gint64) (sample_time >> 1) ^ -(gint64) (sample_time & 1);
+
+  record->arrival = reader->arrival;
+  record->sample_time = reader->sample_time;
+  record->size = size;
+
+  return TRUE;
+}
+
+void
+gst_bda_trace_reader_rewind (GstBdaTraceReader * reader)
+{
+  reader->pos = TRACE_HEADER_SIZE;
+  reader->arrival = 0;
+  reader->sample_time = 0;
+}
+
+void
+gst_bda_trace_reader_free (GstBdaTraceReader * reader)
+{
+  if (!reader) {
+    return;
+  }
+
+  g_mapped_file_unref (reader->file);
+  g_free (reader);
+}
@@ -0,0 +1,92 @@
+/* GStreamer
+ * Copyright (C) 2015 Raimo Järvi <raimo.jarvi@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef __GST_BDATRACE_H__
+#define __GST_BDATRACE_H__
+
+#include <glib.h>
+
+/* Sample timing traces. A trace records the size, DirectShow sample time
+   and arrival time of every sample a tuner driver delivers, optionally with
+   the payload, so that the driver's burst pattern can be reproduced later
+   by the trace backend.
+
+   File format, integers in little endian:
+
+     "BDATRACE", version (1 byte), flags (1 byte, bit 0: payload present)
+
+   followed by one record per sample:
+
+     arrival time delta in us (varint)
+     sample time delta in 100 ns units (zigzag varint)
+     size in bytes (varint)
+     payload (size bytes, if present) */
+
+typedef struct _GstBdaTraceWriter GstBdaTraceWriter;
+typedef struct _GstBdaTraceReader GstBdaTraceReader;
+typedef struct _GstBdaTraceRecord GstBdaTraceRecord;
+
+struct _GstBdaTraceRecord {
+  /* Arrival time in us relative to the first sample. */
+  gint64 arrival;
+  /* DirectShow sample time in 100 ns units relative to the first sample. */
+  gint64 sample_time;
+  gsize size;
+  /* NULL if the trace has no payload. */
+  const guint8 *payload;
+};
+
+GstBdaTraceWriter *gst_bda_trace_writer_new (const gchar * location,
+    gboolean payload, GError ** error);
+
+/**
+ * Appends a sample. arrival is a g_get_monotonic_time () timestamp. The
+ * record is written to the file by a thread of the writer, so this doesn't
+ * block on file I/O.
+ * @return FALSE after a write error, or if the writer falls behind by more
+ * than its buffer
+ */
+gboolean gst_bda_trace_writer_add (GstBdaTraceWriter * writer, gint64 arrival,
+    gint64 sample_time, const guint8 * data, gsize size);
+
+/**
+ * Writes the pending records and closes the trace file.
+ */
+void gst_bda_trace_writer_free (GstBdaTraceWriter * writer);
+
+GstBdaTraceReader *gst_bda_trace_reader_new (const gchar * location,
+    GError ** error);
+
+gboolean gst_bda_trace_reader_has_payload (GstBdaTraceReader * reader);
+
+/**
+ * Reads the next record. The payload stays valid until the reader is freed.
+ * @return FALSE at the end of the trace or if the trace is truncated
+ */
+gboolean gst_bda_trace_reader_next (GstBdaTraceReader * reader,
+    GstBdaTraceRecord * record);
+
+/**
+ * Starts over from the first record.
+ */
+void gst_bda_trace_reader_rewind (GstBdaTraceReader * reader);
+
+void gst_bda_trace_reader_free (GstBdaTraceReader * reader);
+
+#endif
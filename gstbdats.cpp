@@ -0,0 +1,213 @@
+/* GStreamer
+ * Copyright (C) 2015 Raimo Järvi <raimo.jarvi@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include <string.h>
+#include "gstbdats.h"
+
+static guint32 crc_table[256];
+
+static gpointer
+gst_bda_ts_init_crc_table (gpointer /*data */ )
+{
+  for (guint32 i = 0; i < 256; i++) {
+    guint32 crc = i << 24;
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04c11db7 : crc << 1;
+    }
+    crc_table[i] = crc;
+  }
+
+  return NULL;
+}
+
+guint32
+gst_bda_ts_crc32 (const guint8 * data, gsize size)
+{
+  static GOnce crc_once = G_ONCE_INIT;
+  g_once (&crc_once, gst_bda_ts_init_crc_table, NULL);
+
+  guint32 crc = 0xffffffff;
+  for (gsize i = 0; i < size; i++) {
+    crc = (crc << 8) ^ crc_table[((crc >> 24) ^ data[i]) & 0xff];
+  }
+
+  return crc;
+}
+
+gboolean
+gst_bda_ts_is_video (guint8 stream_type)
+{
+  return stream_type == GST_BDA_TS_STREAM_MPEG1_VIDEO
+      || stream_type == GST_BDA_TS_STREAM_MPEG2_VIDEO
+      || stream_type == GST_BDA_TS_STREAM_H264
+      || stream_type == GST_BDA_TS_STREAM_HEVC;
+}
+
+/* Checks the start code at p, size bytes including the 00 00 01 prefix. */
+static gboolean
+gst_bda_ts_is_random_access_code (const guint8 * p, gsize size,
+    guint8 stream_type)
+{
+  switch (stream_type) {
+    case GST_BDA_TS_STREAM_MPEG1_VIDEO:
+    case GST_BDA_TS_STREAM_MPEG2_VIDEO:
+      /* Sequence header, GOP header or picture_coding_type I. */
+      if (p[3] == 0xb3 || p[3] == 0xb8) {
+        return TRUE;
+      }
+      return p[3] == 0x00 && size >= 6 && ((p[5] >> 3) & 0x07) == 1;
+    case GST_BDA_TS_STREAM_H264:
+      return (p[3] & 0x1f) == 5;
+    case GST_BDA_TS_STREAM_HEVC:
+    {
+      /* BLA, IDR and CRA pictures. */
+      guint8 type = (p[3] >> 1) & 0x3f;
+      return type >= 16 && type <= 21;
+    }
+    default:
+      return FALSE;
+  }
+}
+
+gboolean
+gst_bda_ts_is_random_access (const guint8 * packet, guint8 stream_type)
+{
+  gsize offset = 4;
+  if (gst_bda_ts_has_adaptation (packet)) {
+    /* random_access_indicator */
+    if (packet[4] > 0 && (packet[5] & 0x40)) {
+      return TRUE;
+    }
+    offset += 1 + packet[4];
+  }
+
+  if (!gst_bda_ts_is_video (stream_type) || !gst_bda_ts_pusi (packet)
+      || !gst_bda_ts_has_payload (packet)
+      || offset + 9 > GST_BDA_TS_PACKET_SIZE) {
+    return FALSE;
+  }
+
+  /* PES header */
+  const guint8 *pes = packet + offset;
+  if (pes[0] != 0x00 || pes[1] != 0x00 || pes[2] != 0x01) {
+    return FALSE;
+  }
+  offset += 9 + pes[8];
+
+  for (gsize i = offset; i + 4 <= GST_BDA_TS_PACKET_SIZE; i++) {
+    const guint8 *p = packet + i;
+    if (p[0] == 0x00 && p[1] == 0x00 && p[2] == 0x01
+        && gst_bda_ts_is_random_access_code (p, GST_BDA_TS_PACKET_SIZE - i,
+            stream_type)) {
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+gchar *
+gst_bda_ts_decode_string (const guint8 * data, gsize size)
+{
+  const gchar *charset = "ISO-8859-1";
+  gchar buffer[16];
+
+  if (size > 0 && data[0] < 0x20) {
+    if (data[0] >= 0x01 && data[0] <= 0x0b) {
+      g_snprintf (buffer, sizeof (buffer), "ISO-8859-%u", data[0] + 4);
+      charset = buffer;
+      data++;
+      size--;
+    } else if (data[0] == 0x10 && size >= 3) {
+      g_snprintf (buffer, sizeof (buffer), "ISO-8859-%u",
+          (data[1] << 8) | data[2]);
+      charset = buffer;
+      data += 3;
+      size -= 3;
+    } else if (data[0] == 0x15) {
+      charset = "UTF-8";
+      data++;
+      size--;
+    } else {
+      /* Unsupported character table */
+      data++;
+      size--;
+    }
+  }
+
+  gchar *str = g_convert ((const gchar *) data, size, "UTF-8", charset, NULL,
+      NULL, NULL);
+  if (!str) {
+    str = g_convert ((const gchar *) data, size, "UTF-8", "ISO-8859-1", NULL,
+        NULL, NULL);
+  }
+
+  return str;
+}
+
+void
+gst_bda_ts_align (GstBdaTsAligner * aligner, const guint8 * data,
+    gsize size, GstBdaTsPacketsFunc func, gpointer user_data)
+{
+  while (size > 0) {
+    if (aligner->carry_size > 0) {
+      gsize n = MIN (size, GST_BDA_TS_PACKET_SIZE - aligner->carry_size);
+      memcpy (aligner->carry + aligner->carry_size, data, n);
+      aligner->carry_size += n;
+      data += n;
+      size -= n;
+      if (aligner->carry_size < GST_BDA_TS_PACKET_SIZE) {
+        break;
+      }
+      func (aligner->carry, GST_BDA_TS_PACKET_SIZE, user_data);
+      aligner->carry_size = 0;
+      continue;
+    }
+
+    if (data[0] != GST_BDA_TS_SYNC_BYTE || (size > GST_BDA_TS_PACKET_SIZE
+            && data[GST_BDA_TS_PACKET_SIZE] != GST_BDA_TS_SYNC_BYTE)) {
+      const guint8 *sync =
+          (const guint8 *) memchr (data + 1, GST_BDA_TS_SYNC_BYTE, size - 1);
+      if (!sync) {
+        break;
+      }
+      size -= sync - data;
+      data = sync;
+      continue;
+    }
+
+    if (size < GST_BDA_TS_PACKET_SIZE) {
+      memcpy (aligner->carry, data, size);
+      aligner->carry_size = size;
+      break;
+    }
+
+    /* Whole packets up to one out of sync. */
+    gsize run = GST_BDA_TS_PACKET_SIZE;
+    while (size - run >= GST_BDA_TS_PACKET_SIZE
+        && data[run] == GST_BDA_TS_SYNC_BYTE
+        && (size - run == GST_BDA_TS_PACKET_SIZE
+            || data[run + GST_BDA_TS_PACKET_SIZE] == GST_BDA_TS_SYNC_BYTE)) {
+      run += GST_BDA_TS_PACKET_SIZE;
+    }
+    func (data, run, user_data);
+    data += run;
+    size -= run;
+  }
+}
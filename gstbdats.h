@@ -0,0 +1,183 @@
+/* GStreamer
+ * Copyright (C) 2015 Raimo Järvi <raimo.jarvi@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef __GST_BDATS_H__
+#define __GST_BDATS_H__
+
+#include <glib.h>
+
+/* MPEG-2 transport stream packet helpers. */
+
+#define GST_BDA_TS_PACKET_SIZE 188
+#define GST_BDA_TS_SYNC_BYTE 0x47
+#define GST_BDA_TS_NULL_PID 0x1fff
+/* PCR runs at 27 MHz and wraps at 2^33 * 300. */
+#define GST_BDA_TS_PCR_HZ G_GUINT64_CONSTANT (27000000)
+#define GST_BDA_TS_PCR_WRAP ((G_GUINT64_CONSTANT (1) << 33) * 300)
+
+static inline guint16
+gst_bda_ts_pid (const guint8 * packet)
+{
+  return ((packet[1] & 0x1f) << 8) | packet[2];
+}
+
+static inline gboolean
+gst_bda_ts_tei (const guint8 * packet)
+{
+  return (packet[1] & 0x80) != 0;
+}
+
+static inline gboolean
+gst_bda_ts_pusi (const guint8 * packet)
+{
+  return (packet[1] & 0x40) != 0;
+}
+
+static inline guint8
+gst_bda_ts_cc (const guint8 * packet)
+{
+  return packet[3] & 0x0f;
+}
+
+static inline gboolean
+gst_bda_ts_has_adaptation (const guint8 * packet)
+{
+  return (packet[3] & 0x20) != 0;
+}
+
+static inline gboolean
+gst_bda_ts_has_payload (const guint8 * packet)
+{
+  return (packet[3] & 0x10) != 0;
+}
+
+/**
+ * Reads the PCR from the packet's adaptation field.
+ * @return TRUE if the packet carries a PCR
+ */
+static inline gboolean
+gst_bda_ts_get_pcr (const guint8 * packet, guint64 * pcr)
+{
+  if (!gst_bda_ts_has_adaptation (packet) || packet[4] < 7
+      || !(packet[5] & 0x10)) {
+    return FALSE;
+  }
+
+  const guint8 *p = packet + 6;
+  guint64 base = ((guint64) p[0] << 25) | ((guint64) p[1] << 17) |
+      ((guint64) p[2] << 9) | ((guint64) p[3] << 1) | (p[4] >> 7);
+  guint64 ext = ((p[4] & 0x01) << 8) | p[5];
+
+  *pcr = base * 300 + ext;
+  return TRUE;
+}
+
+/**
+ * Writes a PCR into an adaptation field at p (6 bytes).
+ */
+static inline void
+gst_bda_ts_write_pcr (guint8 * p, guint64 pcr)
+{
+  guint64 base = (pcr / 300) & ((G_GUINT64_CONSTANT (1) << 33) - 1);
+  guint ext = pcr % 300;
+
+  p[0] = base >> 25;
+  p[1] = base >> 17;
+  p[2] = base >> 9;
+  p[3] = base >> 1;
+  p[4] = ((base & 1) << 7) | 0x7e | (ext >> 8);
+  p[5] = ext & 0xff;
+}
+
+/**
+ * Returns the PCR difference b - a in 27 MHz ticks, taking wrap-around into
+ * account.
+ */
+static inline guint64
+gst_bda_ts_pcr_diff (guint64 a, guint64 b)
+{
+  return b >= a ? b - a : b + GST_BDA_TS_PCR_WRAP - a;
+}
+
+/**
+ * Calculates the MPEG-2 CRC-32 used by PSI/SI sections.
+ */
+guint32 gst_bda_ts_crc32 (const guint8 * data, gsize size);
+
+/* PMT stream types with random access point detection. */
+#define GST_BDA_TS_STREAM_MPEG1_VIDEO 0x01
+#define GST_BDA_TS_STREAM_MPEG2_VIDEO 0x02
+#define GST_BDA_TS_STREAM_H264 0x1b
+#define GST_BDA_TS_STREAM_HEVC 0x24
+
+/**
+ * Checks if the stream type is video that gst_bda_ts_is_random_access ()
+ * can find random access points in.
+ */
+gboolean gst_bda_ts_is_video (guint8 stream_type);
+
+/**
+ * Checks if a packet of an elementary stream of stream_type starts a
+ * random access point: the adaptation field random access indicator is set,
+ * or the payload of the packet starting a PES packet contains an MPEG-2
+ * sequence header, GOP header or I-picture, an H.264 IDR slice or an HEVC
+ * IRAP picture. Start codes beyond the first packet of the PES packet are
+ * not seen.
+ */
+gboolean gst_bda_ts_is_random_access (const guint8 * packet,
+    guint8 stream_type);
+
+/**
+ * Converts a DVB SI string (EN 300 468 annex A) to UTF-8. Unsupported
+ * character tables are read as ISO-8859-1.
+ * @return the string, or NULL if it can't be converted
+ */
+gchar *gst_bda_ts_decode_string (const guint8 * data, gsize size);
+
+typedef struct _GstBdaTsAligner GstBdaTsAligner;
+
+/* Packet alignment of a stream delivered in samples that may split packets,
+   zero initialised. */
+struct _GstBdaTsAligner {
+  guint8 carry[GST_BDA_TS_PACKET_SIZE];
+  gsize carry_size;
+};
+
+typedef void (*GstBdaTsPacketsFunc) (const guint8 * packets, gsize size,
+    gpointer user_data);
+
+/**
+ * Calls func with the whole packets of data, in runs of consecutive
+ * packets. A packet split at the end of data is completed with the start of
+ * the next call. Sync is regained on a sync byte that the next packet
+ * starts with too, as gst_bda_pes_demux_push () does.
+ */
+void gst_bda_ts_align (GstBdaTsAligner * aligner, const guint8 * data,
+    gsize size, GstBdaTsPacketsFunc func, gpointer user_data);
+
+/**
+ * Drops a split packet, e.g. after tuning.
+ */
+static inline void
+gst_bda_ts_aligner_reset (GstBdaTsAligner * aligner)
+{
+  aligner->carry_size = 0;
+}
+
+#endif
@@ -0,0 +1,840 @@
+/* GStreamer
+ * Copyright (C) 2015 Raimo Järvi <raimo.jarvi@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include "gstbdatsgen.h"
+#include "gstbdats.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define PAT_PID 0x0000
+#define NIT_PID 0x0010
+#define SDT_PID 0x0011
+#define EIT_PID 0x0012
+#define PMT_PID_BASE 0x1000
+#define ES_PID_BASE 0x0100
+#define TRANSPORT_STREAM_ID 1
+#define ORIGINAL_NETWORK_ID 0x2001
+#define NETWORK_ID 0x3001
+#define NIT_ACTUAL_TABLE_ID 0x40
+#define SDT_ACTUAL_TABLE_ID 0x42
+#define EIT_SCHEDULE_TABLE_ID 0x50
+#define NETWORK_NAME_DESCRIPTOR 0x40
+#define SERVICE_DESCRIPTOR 0x48
+#define SHORT_EVENT_DESCRIPTOR 0x4d
+/* Network and provider name. */
+#define SI_NAME "bdatsgen"
+/* EIT schedule sections used of the 8 of each segment. */
+#define EIT_SECTIONS_PER_SEGMENT 3
+#define EIT_EVENT_DURATION 1800
+/* Days from 1858-11-17 (MJD 0) to 1970-01-01. */
+#define MJD_EPOCH 40587
+/* Video frame rate and audio frame rate (MPEG audio at 48 kHz). */
+#define VIDEO_FPS 25
+#define AUDIO_FPS 42
+/* Video is this many times the bitrate of an audio stream. */
+#define VIDEO_WEIGHT 8
+/* IDR frames are this many times larger than other frames. */
+#define IDR_SIZE_FACTOR 3
+/* PTS runs this much ahead of the PCR, in 90 kHz units. */
+#define PTS_DELAY 45000
+
+typedef struct _GstBdaTsGenStream GstBdaTsGenStream;
+typedef struct _GstBdaTsGenProgram GstBdaTsGenProgram;
+
+struct _GstBdaTsGenStream {
+  guint16 pid;
+  guint8 stream_type;
+  guint8 stream_id;
+  guint8 cc;
+  gboolean video;
+  /* Payload bytes of an average frame. */
+  guint frame_bytes;
+  guint frame_count;
+
+  /* PES header and ES start codes of the current frame. */
+  guint8 head[32];
+  guint head_len;
+  guint head_pos;
+  /* Bytes left in the current PES packet, 0 to start a new one. */
+  guint remaining;
+  /* Set random_access_indicator on the next packet. */
+  gboolean random_access;
+};
+
+struct _GstBdaTsGenProgram {
+  guint16 program_number;
+  guint16 pmt_pid;
+  /* PCR is carried on the first (video) stream. */
+  GstBdaTsGenStream *pcr_stream;
+  guint64 next_pcr;
+  guint8 pmt_cc;
+  guint8 pmt[GST_BDA_TS_PACKET_SIZE];
+};
+
+struct _GstBdaTsGen {
+  GstBdaTsGenParams params;
+  GRand *rand;
+
+  /* 27 MHz clock at the current packet, advanced in exact steps. */
+  guint64 clock;
+  guint64 clock_rem;
+  guint64 clock_step;
+  guint64 clock_step_rem;
+  guint64 pcr_interval;
+  guint64 psi_interval;
+
+  guint64 next_psi;
+  /* Next PSI packet to send: 0 for PAT, 1.. for PMTs, past the end when
+     the repetition is complete. */
+  guint psi_index;
+  guint8 pat_cc;
+  guint8 pat[GST_BDA_TS_PACKET_SIZE];
+
+  /* Packets of the SDT, NIT and EIT, sent like the PSI. */
+  GByteArray *si;
+  guint64 si_interval;
+  guint64 next_si;
+  guint si_index;
+  /* Continuity counters of the NIT, SDT and EIT PIDs. */
+  guint8 si_cc[3];
+
+  GstBdaTsGenProgram *programs;
+  GstBdaTsGenStream *streams;
+  guint n_streams;
+  /* Cumulative scheduling weights of streams. */
+  guint *weights;
+  guint total_weight;
+
+  /* Output not yet returned by gst_bda_ts_gen_fill (). */
+  guint8 pending[2 * GST_BDA_TS_PACKET_SIZE];
+  gsize pending_len;
+  gsize pending_pos;
+};
+
+void
+gst_bda_ts_gen_params_init (GstBdaTsGenParams * params)
+{
+  params->seed = 1;
+  params->programs = 4;
+  params->streams = 2;
+  params->bitrate = 24000000;
+  params->pcr_interval = 40;
+  params->psi_interval = 100;
+  params->null_share = 10;
+  params->gop = 25;
+  params->cc_errors = 0;
+  params->tei_errors = 0;
+  params->sync_loss = 0;
+  params->si_interval = 0;
+  params->si_version = 0;
+  params->eit_events = 8;
+  /* 2026-01-01 00:00 UTC */
+  params->eit_start = G_GINT64_CONSTANT (1767225600);
+}
+
+gboolean
+gst_bda_ts_gen_params_parse (GstBdaTsGenParams * params, const gchar * str)
+{
+  gboolean ret = TRUE;
+  gchar **pairs = g_strsplit (str, ",", -1);
+
+  for (gchar ** pair = pairs; *pair; pair++) {
+    gchar *key = g_strstrip (*pair);
+    gchar *value = strchr (key, '=');
+    if (*key == 0) {
+      continue;
+    }
+    if (!value) {
+      ret = FALSE;
+      break;
+    }
+    *value++ = 0;
+
+    if (!strcmp (key, "seed")) {
+      params->seed = (guint32) g_ascii_strtoull (value, NULL, 0);
+    } else if (!strcmp (key, "programs")) {
+      params->programs = (guint) g_ascii_strtoull (value, NULL, 0);
+    } else if (!strcmp (key, "streams")) {
+      params->streams = (guint) g_ascii_strtoull (value, NULL, 0);
+    } else if (!strcmp (key, "bitrate")) {
+      params->bitrate = (guint) g_ascii_strtoull (value, NULL, 0);
+    } else if (!strcmp (key, "pcr-interval")) {
+      params->pcr_interval = (guint) g_ascii_strtoull (value, NULL, 0);
+    } else if (!strcmp (key, "psi-interval")) {
+      params->psi_interval = (guint) g_ascii_strtoull (value, NULL, 0);
+    } else if (!strcmp (key, "null-share")) {
+      params->null_share = (guint) g_ascii_strtoull (value, NULL, 0);
+    } else if (!strcmp (key, "gop")) {
+      params->gop = (guint) g_ascii_strtoull (value, NULL, 0);
+    } else if (!strcmp (key, "cc-errors")) {
+      params->cc_errors = g_ascii_strtod (value, NULL);
+    } else if (!strcmp (key, "tei-errors")) {
+      params->tei_errors = g_ascii_strtod (value, NULL);
+    } else if (!strcmp (key, "sync-loss")) {
+      params->sync_loss = g_ascii_strtod (value, NULL);
+    } else if (!strcmp (key, "si-interval")) {
+      params->si_interval = (guint) g_ascii_strtoull (value, NULL, 0);
+    } else if (!strcmp (key, "si-version")) {
+      params->si_version = (guint) g_ascii_strtoull (value, NULL, 0);
+    } else if (!strcmp (key, "eit-events")) {
+      params->eit_events = (guint) g_ascii_strtoull (value, NULL, 0);
+    } else if (!strcmp (key, "eit-start")) {
+      params->eit_start = g_ascii_strtoll (value, NULL, 0);
+    } else {
+      ret = FALSE;
+      break;
+    }
+  }
+
+  g_strfreev (pairs);
+
+  return ret;
+}
+
+/* Wraps a section into a PSI packet with the payload unit start set. */
+static void
+gst_bda_ts_gen_psi_packet (guint8 * packet, guint16 pid, const guint8 * section,
+    gsize section_len)
+{
+  memset (packet, 0xff, GST_BDA_TS_PACKET_SIZE);
+  packet[0] = GST_BDA_TS_SYNC_BYTE;
+  packet[1] = 0x40 | (pid >> 8);
+  packet[2] = pid & 0xff;
+  packet[3] = 0x10;
+  packet[4] = 0;
+  memcpy (packet + 5, section, section_len);
+}
+
+/* Completes section_length and CRC of a section of len bytes without CRC.
+   Returns the total section length. */
+static gsize
+gst_bda_ts_gen_finish_section (guint8 * section, gsize len)
+{
+  gsize section_length = len - 3 + 4;
+  section[1] = 0xb0 | (section_length >> 8);
+  section[2] = section_length & 0xff;
+
+  guint32 crc = gst_bda_ts_crc32 (section, len);
+  section[len] = crc >> 24;
+  section[len + 1] = crc >> 16;
+  section[len + 2] = crc >> 8;
+  section[len + 3] = crc;
+
+  return len + 4;
+}
+
+static void
+gst_bda_ts_gen_build_pat (GstBdaTsGen * gen)
+{
+  guint8 section[GST_BDA_TS_PACKET_SIZE];
+  gsize len = 0;
+
+  section[len++] = 0x00;
+  len += 2;
+  section[len++] = TRANSPORT_STREAM_ID >> 8;
+  section[len++] = TRANSPORT_STREAM_ID & 0xff;
+  section[len++] = 0xc1;
+  section[len++] = 0;
+  section[len++] = 0;
+
+  for (guint i = 0; i < gen->params.programs; i++) {
+    GstBdaTsGenProgram *program = &gen->programs[i];
+    section[len++] = program->program_number >> 8;
+    section[len++] = program->program_number & 0xff;
+    section[len++] = 0xe0 | (program->pmt_pid >> 8);
+    section[len++] = program->pmt_pid & 0xff;
+  }
+
+  len = gst_bda_ts_gen_finish_section (section, len);
+  gst_bda_ts_gen_psi_packet (gen->pat, PAT_PID, section, len);
+}
+
+static void
+gst_bda_ts_gen_build_pmt (GstBdaTsGen * gen, GstBdaTsGenProgram * program,
+    GstBdaTsGenStream * streams)
+{
+  guint8 section[GST_BDA_TS_PACKET_SIZE];
+  gsize len = 0;
+
+  section[len++] = 0x02;
+  len += 2;
+  section[len++] = program->program_number >> 8;
+  section[len++] = program->program_number & 0xff;
+  section[len++] = 0xc1;
+  section[len++] = 0;
+  section[len++] = 0;
+  section[len++] = 0xe0 | (program->pcr_stream->pid >> 8);
+  section[len++] = program->pcr_stream->pid & 0xff;
+  section[len++] = 0xf0;
+  section[len++] = 0;
+
+  for (guint i = 0; i < gen->params.streams; i++) {
+    GstBdaTsGenStream *stream = &streams[i];
+    section[len++] = stream->stream_type;
+    section[len++] = 0xe0 | (stream->pid >> 8);
+    section[len++] = stream->pid & 0xff;
+    section[len++] = 0xf0;
+    section[len++] = 0;
+  }
+
+  len = gst_bda_ts_gen_finish_section (section, len);
+  gst_bda_ts_gen_psi_packet (program->pmt, program->pmt_pid, section, len);
+}
+
+/* Writes the header of a long form section up to the last section number.
+   The section length is completed by gst_bda_ts_gen_finish_section (). */
+static gsize
+gst_bda_ts_gen_section_header (guint8 * section, guint8 table_id,
+    guint16 extension, guint version, guint number, guint last_number)
+{
+  section[0] = table_id;
+  section[3] = extension >> 8;
+  section[4] = extension & 0xff;
+  section[5] = 0xc1 | ((version & 0x1f) << 1);
+  section[6] = number;
+  section[7] = last_number;
+
+  return 8;
+}
+
+/* Appends a length prefixed string. */
+static gsize
+gst_bda_ts_gen_put_string (guint8 * p, const gchar * str)
+{
+  gsize len = strlen (str);
+  p[0] = len;
+  memcpy (p + 1, str, len);
+
+  return 1 + len;
+}
+
+/* Splits a section into packets on pid. Continuity counters are set when
+   the packets are sent. */
+static void
+gst_bda_ts_gen_add_section (GByteArray * packets, guint16 pid,
+    const guint8 * section, gsize section_len)
+{
+  for (gsize offset = 0; offset < section_len;) {
+    guint8 packet[GST_BDA_TS_PACKET_SIZE];
+    gsize header = offset == 0 ? 5 : 4;
+    memset (packet, 0xff, GST_BDA_TS_PACKET_SIZE);
+    packet[0] = GST_BDA_TS_SYNC_BYTE;
+    packet[1] = (offset == 0 ? 0x40 : 0) | (pid >> 8);
+    packet[2] = pid & 0xff;
+    packet[3] = 0x10;
+    if (offset == 0) {
+      packet[4] = 0;
+    }
+
+    gsize n = MIN (section_len - offset, GST_BDA_TS_PACKET_SIZE - header);
+    memcpy (packet + header, section + offset, n);
+    offset += n;
+    g_byte_array_append (packets, packet, GST_BDA_TS_PACKET_SIZE);
+  }
+}
+
+static void
+gst_bda_ts_gen_build_sdt (GstBdaTsGen * gen)
+{
+  guint8 section[1024];
+  gsize len = gst_bda_ts_gen_section_header (section, SDT_ACTUAL_TABLE_ID,
+      TRANSPORT_STREAM_ID, gen->params.si_version, 0, 0);
+
+  section[len++] = ORIGINAL_NETWORK_ID >> 8;
+  section[len++] = ORIGINAL_NETWORK_ID & 0xff;
+  section[len++] = 0xff;
+
+  for (guint i = 0; i < gen->params.programs; i++) {
+    guint16 service_id = gen->programs[i].program_number;
+    gchar name[32];
+    g_snprintf (name, sizeof (name), "Service %u", service_id);
+
+    section[len++] = service_id >> 8;
+    section[len++] = service_id & 0xff;
+    /* EIT schedule flag */
+    section[len++] = 0xfe;
+    gsize loop = len;
+    len += 2;
+
+    /* Digital television service */
+    section[len++] = SERVICE_DESCRIPTOR;
+    gsize desc = len++;
+    section[len++] = 0x01;
+    len += gst_bda_ts_gen_put_string (section + len, SI_NAME);
+    len += gst_bda_ts_gen_put_string (section + len, name);
+    section[desc] = len - desc - 1;
+
+    /* Running, free to air */
+    gsize loop_length = len - loop - 2;
+    section[loop] = 0x80 | (loop_length >> 8);
+    section[loop + 1] = loop_length & 0xff;
+  }
+
+  len = gst_bda_ts_gen_finish_section (section, len);
+  gst_bda_ts_gen_add_section (gen->si, SDT_PID, section, len);
+}
+
+static void
+gst_bda_ts_gen_build_nit (GstBdaTsGen * gen)
+{
+  guint8 section[GST_BDA_TS_PACKET_SIZE];
+  gsize len = gst_bda_ts_gen_section_header (section, NIT_ACTUAL_TABLE_ID,
+      NETWORK_ID, gen->params.si_version, 0, 0);
+
+  gsize loop = len;
+  len += 2;
+  section[len++] = NETWORK_NAME_DESCRIPTOR;
+  section[len++] = strlen (SI_NAME);
+  memcpy (section + len, SI_NAME, strlen (SI_NAME));
+  len += strlen (SI_NAME);
+  section[loop] = 0xf0 | ((len - loop - 2) >> 8);
+  section[loop + 1] = (len - loop - 2) & 0xff;
+
+  /* A transport stream without descriptors. */
+  section[len++] = 0xf0;
+  section[len++] = 6;
+  section[len++] = TRANSPORT_STREAM_ID >> 8;
+  section[len++] = TRANSPORT_STREAM_ID & 0xff;
+  section[len++] = ORIGINAL_NETWORK_ID >> 8;
+  section[len++] = ORIGINAL_NETWORK_ID & 0xff;
+  section[len++] = 0xf0;
+  section[len++] = 0;
+
+  len = gst_bda_ts_gen_finish_section (section, len);
+  gst_bda_ts_gen_add_section (gen->si, NIT_PID, section, len);
+}
+
+/* Converts 0 to 99 to two digit BCD. */
+static guint8
+gst_bda_ts_gen_bcd (guint value)
+{
+  return ((value / 10) << 4) | (value % 10);
+}
+
+/* Writes the EIT schedule of a service, one event per section. */
+static void
+gst_bda_ts_gen_build_eit (GstBdaTsGen * gen, guint16 service_id)
+{
+  guint events = gen->params.eit_events;
+  guint last = events - 1;
+  guint last_section = last / EIT_SECTIONS_PER_SEGMENT * 8 +
+      last % EIT_SECTIONS_PER_SEGMENT;
+
+  for (guint i = 0; i < events; i++) {
+    guint8 section[GST_BDA_TS_PACKET_SIZE];
+    guint segment = i / EIT_SECTIONS_PER_SEGMENT;
+    guint segment_events = MIN (EIT_SECTIONS_PER_SEGMENT,
+        events - segment * EIT_SECTIONS_PER_SEGMENT);
+    gsize len = gst_bda_ts_gen_section_header (section,
+        EIT_SCHEDULE_TABLE_ID, service_id, gen->params.si_version,
+        segment * 8 + i % EIT_SECTIONS_PER_SEGMENT, last_section);
+
+    section[len++] = TRANSPORT_STREAM_ID >> 8;
+    section[len++] = TRANSPORT_STREAM_ID & 0xff;
+    section[len++] = ORIGINAL_NETWORK_ID >> 8;
+    section[len++] = ORIGINAL_NETWORK_ID & 0xff;
+    section[len++] = segment * 8 + segment_events - 1;
+    section[len++] = EIT_SCHEDULE_TABLE_ID;
+
+    gint64 start = gen->params.eit_start + (gint64) i * EIT_EVENT_DURATION;
+    guint mjd = start / 86400 + MJD_EPOCH;
+    guint seconds = start % 86400;
+    section[len++] = (i + 1) >> 8;
+    section[len++] = (i + 1) & 0xff;
+    section[len++] = mjd >> 8;
+    section[len++] = mjd & 0xff;
+    section[len++] = gst_bda_ts_gen_bcd (seconds / 3600);
+    section[len++] = gst_bda_ts_gen_bcd (seconds / 60 % 60);
+    section[len++] = gst_bda_ts_gen_bcd (seconds % 60);
+    section[len++] = gst_bda_ts_gen_bcd (EIT_EVENT_DURATION / 3600);
+    section[len++] = gst_bda_ts_gen_bcd (EIT_EVENT_DURATION / 60 % 60);
+    section[len++] = gst_bda_ts_gen_bcd (EIT_EVENT_DURATION % 60);
+    gsize loop = len;
+    len += 2;
+
+    gchar title[32], text[32];
+    g_snprintf (title, sizeof (title), "Event %u", i + 1);
+    g_snprintf (text, sizeof (text), "Version %u", gen->params.si_version);
+    section[len++] = SHORT_EVENT_DESCRIPTOR;
+    gsize desc = len++;
+    memcpy (section + len, "eng", 3);
+    len += 3;
+    len += gst_bda_ts_gen_put_string (section + len, title);
+    len += gst_bda_ts_gen_put_string (section + len, text);
+    section[desc] = len - desc - 1;
+
+    /* Not running, free to air */
+    gsize loop_length = len - loop - 2;
+    section[loop] = 0x20 | (loop_length >> 8);
+    section[loop + 1] = loop_length & 0xff;
+
+    len = gst_bda_ts_gen_finish_section (section, len);
+    gst_bda_ts_gen_add_section (gen->si, EIT_PID, section, len);
+  }
+}
+
+GstBdaTsGen *
+gst_bda_ts_gen_new (const GstBdaTsGenParams * params)
+{
+  GstBdaTsGen *gen = g_new0 (GstBdaTsGen, 1);
+
+  gen->params = *params;
+  gen->params.programs =
+      CLAMP (gen->params.programs, 1, GST_BDA_TS_GEN_MAX_PROGRAMS);
+  gen->params.streams =
+      CLAMP (gen->params.streams, 1, GST_BDA_TS_GEN_MAX_STREAMS);
+  gen->params.bitrate = MAX (gen->params.bitrate, 100000);
+  gen->params.null_share = MIN (gen->params.null_share, 100);
+  gen->params.gop = MAX (gen->params.gop, 1);
+  gen->params.eit_events =
+      CLAMP (gen->params.eit_events, 1, GST_BDA_TS_GEN_MAX_EIT_EVENTS);
+  gen->params.eit_start = MAX (gen->params.eit_start, 0);
+  gen->rand = g_rand_new_with_seed (gen->params.seed);
+
+  /* Each packet advances the clock by 188 * 8 / bitrate seconds. */
+  guint64 step = GST_BDA_TS_PACKET_SIZE * 8 * GST_BDA_TS_PCR_HZ;
+  gen->clock_step = step / gen->params.bitrate;
+  gen->clock_step_rem = step % gen->params.bitrate;
+  gen->pcr_interval =
+      MAX (gen->params.pcr_interval, 1) * (GST_BDA_TS_PCR_HZ / 1000);
+  gen->psi_interval =
+      MAX (gen->params.psi_interval, 1) * (GST_BDA_TS_PCR_HZ / 1000);
+
+  guint n_programs = gen->params.programs;
+  guint n_streams = gen->params.streams;
+  gen->n_streams = n_programs * n_streams;
+  gen->programs = g_new0 (GstBdaTsGenProgram, n_programs);
+  gen->streams = g_new0 (GstBdaTsGenStream, gen->n_streams);
+  gen->weights = g_new0 (guint, gen->n_streams);
+
+  guint program_weight = VIDEO_WEIGHT + n_streams - 1;
+  guint64 payload_rate = (guint64) gen->params.bitrate / 8 *
+      (100 - gen->params.null_share) / 100 / n_programs;
+
+  for (guint i = 0; i < n_programs; i++) {
+    GstBdaTsGenProgram *program = &gen->programs[i];
+    GstBdaTsGenStream *streams = &gen->streams[i * n_streams];
+
+    program->program_number = i + 1;
+    program->pmt_pid = PMT_PID_BASE + i;
+    program->pcr_stream = &streams[0];
+    /* Spread PCRs of different programs over the interval. */
+    program->next_pcr = gen->pcr_interval * i / n_programs;
+
+    for (guint j = 0; j < n_streams; j++) {
+      GstBdaTsGenStream *stream = &streams[j];
+      guint weight = j == 0 ? VIDEO_WEIGHT : 1;
+
+      stream->pid = ES_PID_BASE + i * GST_BDA_TS_GEN_MAX_STREAMS + j;
+      stream->video = j == 0;
+      stream->stream_type = stream->video ? 0x1b : 0x03;
+      stream->stream_id = stream->video ? 0xe0 : 0xc0 + j - 1;
+      stream->frame_bytes = (guint) (payload_rate * weight / program_weight /
+          (stream->video ? VIDEO_FPS : AUDIO_FPS));
+      stream->frame_bytes = CLAMP (stream->frame_bytes, 64, 60000);
+
+      gen->total_weight += weight;
+      gen->weights[i * n_streams + j] = gen->total_weight;
+    }
+
+    gst_bda_ts_gen_build_pmt (gen, program, streams);
+  }
+
+  gst_bda_ts_gen_build_pat (gen);
+  gen->psi_index = 0;
+  gen->next_psi = gen->psi_interval;
+
+  gen->si = g_byte_array_new ();
+  if (gen->params.si_interval > 0) {
+    gen->si_interval = gen->params.si_interval * (GST_BDA_TS_PCR_HZ / 1000);
+    gen->next_si = gen->si_interval;
+    gst_bda_ts_gen_build_sdt (gen);
+    gst_bda_ts_gen_build_nit (gen);
+    for (guint i = 0; i < n_programs; i++) {
+      gst_bda_ts_gen_build_eit (gen, gen->programs[i].program_number);
+    }
+  }
+
+  return gen;
+}
+
+void
+gst_bda_ts_gen_free (GstBdaTsGen * gen)
+{
+  if (!gen) {
+    return;
+  }
+
+  g_rand_free (gen->rand);
+  g_byte_array_free (gen->si, TRUE);
+  g_free (gen->programs);
+  g_free (gen->streams);
+  g_free (gen->weights);
+  g_free (gen);
+}
+
+static inline gboolean
+gst_bda_ts_gen_chance (GstBdaTsGen * gen, gdouble probability)
+{
+  return probability > 0 && g_rand_double (gen->rand) < probability;
+}
+
+static void
+gst_bda_ts_gen_write_pts (guint8 * p, guint64 pts)
+{
+  p[0] = 0x21 | ((pts >> 29) & 0x0e);
+  p[1] = pts >> 22;
+  p[2] = 0x01 | ((pts >> 14) & 0xfe);
+  p[3] = pts >> 7;
+  p[4] = 0x01 | ((pts << 1) & 0xfe);
+}
+
+/* Starts a new PES packet carrying one frame. */
+static void
+gst_bda_ts_gen_start_frame (GstBdaTsGen * gen, GstBdaTsGenStream * stream)
+{
+  gboolean idr = stream->video && stream->frame_count % gen->params.gop == 0;
+  guint payload = stream->frame_bytes * (idr ? IDR_SIZE_FACTOR : 1);
+  guint8 *h = stream->head;
+  guint len = 0;
+
+  h[len++] = 0x00;
+  h[len++] = 0x00;
+  h[len++] = 0x01;
+  h[len++] = stream->stream_id;
+  /* PES_packet_length is filled in below. */
+  len += 2;
+  h[len++] = 0x80;
+  h[len++] = 0x80;
+  h[len++] = 5;
+  gst_bda_ts_gen_write_pts (h + len,
+      (gen->clock / 300 + PTS_DELAY) & ((G_GUINT64_CONSTANT (1) << 33) - 1));
+  len += 5;
+
+  if (stream->video) {
+    /* H.264 access unit delimiter followed by the slice NAL unit. */
+    static const guint8 aud[] = { 0, 0, 0, 1, 0x09, 0xf0 };
+    static const guint8 idr_slice[] = { 0, 0, 0, 1, 0x65, 0x88 };
+    static const guint8 slice[] = { 0, 0, 0, 1, 0x41, 0x9a };
+    memcpy (h + len, aud, sizeof (aud));
+    len += sizeof (aud);
+    memcpy (h + len, idr ? idr_slice : slice, sizeof (slice));
+    len += sizeof (slice);
+  } else {
+    /* MPEG-1 layer II frame header. */
+    static const guint8 mpa[] = { 0xff, 0xfd, 0xa4, 0x00 };
+    memcpy (h + len, mpa, sizeof (mpa));
+    len += sizeof (mpa);
+  }
+
+  guint total = len + payload;
+  guint pes_length = stream->video ? 0 : MIN (total - 6, 0xffff);
+  h[4] = pes_length >> 8;
+  h[5] = pes_length & 0xff;
+
+  stream->head_len = len;
+  stream->head_pos = 0;
+  stream->remaining = stream->video ? total : pes_length + 6;
+  stream->random_access = idr;
+  stream->frame_count++;
+}
+
+static void
+gst_bda_ts_gen_es_packet (GstBdaTsGen * gen, GstBdaTsGenStream * stream,
+    guint8 * packet, gboolean with_pcr)
+{
+  gboolean pusi = stream->remaining == 0;
+  if (pusi) {
+    gst_bda_ts_gen_start_frame (gen, stream);
+  }
+
+  guint8 flags = 0;
+  guint af_len = 0;
+  if (with_pcr) {
+    flags |= 0x10;
+  }
+  if (stream->random_access) {
+    flags |= 0x40;
+    stream->random_access = FALSE;
+  }
+  if (flags) {
+    af_len = 2 + (with_pcr ? 6 : 0);
+  }
+
+  guint capacity = GST_BDA_TS_PACKET_SIZE - 4 - af_len;
+  guint n = MIN (capacity, stream->remaining);
+  guint stuffing = capacity - n;
+  if (stuffing) {
+    /* A single byte of stuffing is an empty adaptation field. */
+    af_len = af_len ? af_len + stuffing : stuffing;
+  }
+
+  if (gst_bda_ts_gen_chance (gen, gen->params.cc_errors)) {
+    stream->cc++;
+  }
+
+  packet[0] = GST_BDA_TS_SYNC_BYTE;
+  packet[1] = (pusi ? 0x40 : 0) | (stream->pid >> 8);
+  packet[2] = stream->pid & 0xff;
+  packet[3] = (af_len ? 0x30 : 0x10) | (stream->cc & 0x0f);
+  stream->cc++;
+
+  guint8 *p = packet + 4;
+  if (af_len) {
+    p[0] = af_len - 1;
+    if (af_len > 1) {
+      p[1] = flags;
+      guint used = 2;
+      if (with_pcr) {
+        gst_bda_ts_write_pcr (p + 2, gen->clock);
+        used += 6;
+      }
+      memset (p + used, 0xff, af_len - used);
+    }
+    p += af_len;
+  }
+
+  guint head = MIN (n, stream->head_len - stream->head_pos);
+  memcpy (p, stream->head + stream->head_pos, head);
+  stream->head_pos += head;
+  memset (p + head, 0xa5, n - head);
+  stream->remaining -= n;
+}
+
+static void
+gst_bda_ts_gen_null_packet (guint8 * packet)
+{
+  packet[0] = GST_BDA_TS_SYNC_BYTE;
+  packet[1] = GST_BDA_TS_NULL_PID >> 8;
+  packet[2] = GST_BDA_TS_NULL_PID & 0xff;
+  packet[3] = 0x10;
+  memset (packet + 4, 0xff, GST_BDA_TS_PACKET_SIZE - 4);
+}
+
+static GstBdaTsGenStream *
+gst_bda_ts_gen_pick_stream (GstBdaTsGen * gen)
+{
+  guint r = g_rand_int_range (gen->rand, 0, gen->total_weight);
+  guint lo = 0, hi = gen->n_streams - 1;
+
+  while (lo < hi) {
+    guint mid = (lo + hi) / 2;
+    if (gen->weights[mid] > r) {
+      hi = mid;
+    } else {
+      lo = mid + 1;
+    }
+  }
+
+  return &gen->streams[lo];
+}
+
+/* Produces the next packet, and any garbage preceding it, into pending. */
+static void
+gst_bda_ts_gen_next_packet (GstBdaTsGen * gen)
+{
+  gen->pending_len = 0;
+  gen->pending_pos = 0;
+
+  if (gst_bda_ts_gen_chance (gen, gen->params.sync_loss)) {
+    gsize garbage = g_rand_int_range (gen->rand, 1, GST_BDA_TS_PACKET_SIZE);
+    memset (gen->pending, 0, garbage);
+    gen->pending_len = garbage;
+  }
+
+  guint8 *packet = gen->pending + gen->pending_len;
+  gen->pending_len += GST_BDA_TS_PACKET_SIZE;
+
+  if (gen->psi_index > gen->params.programs && gen->clock >= gen->next_psi) {
+    gen->psi_index = 0;
+    gen->next_psi += gen->psi_interval;
+  }
+  guint si_count = gen->si->len / GST_BDA_TS_PACKET_SIZE;
+  if (si_count > 0 && gen->si_index >= si_count
+      && gen->clock >= gen->next_si) {
+    gen->si_index = 0;
+    gen->next_si += gen->si_interval;
+  }
+
+  GstBdaTsGenProgram *pcr_program = NULL;
+  for (guint i = 0; i < gen->params.programs; i++) {
+    if (gen->clock >= gen->programs[i].next_pcr) {
+      pcr_program = &gen->programs[i];
+      break;
+    }
+  }
+
+  if (gen->psi_index <= gen->params.programs) {
+    guint8 *cc;
+    if (gen->psi_index == 0) {
+      memcpy (packet, gen->pat, GST_BDA_TS_PACKET_SIZE);
+      cc = &gen->pat_cc;
+    } else {
+      GstBdaTsGenProgram *program = &gen->programs[gen->psi_index - 1];
+      memcpy (packet, program->pmt, GST_BDA_TS_PACKET_SIZE);
+      cc = &program->pmt_cc;
+    }
+    packet[3] |= *cc & 0x0f;
+    (*cc)++;
+    gen->psi_index++;
+  } else if (pcr_program) {
+    gst_bda_ts_gen_es_packet (gen, pcr_program->pcr_stream, packet, TRUE);
+    pcr_program->next_pcr += gen->pcr_interval;
+  } else if (gen->si_index < si_count) {
+    memcpy (packet, gen->si->data + gen->si_index * GST_BDA_TS_PACKET_SIZE,
+        GST_BDA_TS_PACKET_SIZE);
+    guint8 *cc = &gen->si_cc[gst_bda_ts_pid (packet) - NIT_PID];
+    packet[3] |= *cc & 0x0f;
+    (*cc)++;
+    gen->si_index++;
+  } else if (gen->params.null_share
+      && g_rand_int_range (gen->rand, 0, 100) < (gint) gen->params.null_share) {
+    gst_bda_ts_gen_null_packet (packet);
+  } else {
+    gst_bda_ts_gen_es_packet (gen, gst_bda_ts_gen_pick_stream (gen), packet,
+        FALSE);
+  }
+
+  if (gst_bda_ts_gen_chance (gen, gen->params.tei_errors)) {
+    packet[1] |= 0x80;
+  }
+
+  gen->clock += gen->clock_step;
+  gen->clock_rem += gen->clock_step_rem;
+  if (gen->clock_rem >= gen->params.bitrate) {
+    gen->clock++;
+    gen->clock_rem -= gen->params.bitrate;
+  }
+}
+
+void
+gst_bda_ts_gen_fill (GstBdaTsGen * gen, guint8 * data, gsize size)
+{
+  while (size > 0) {
+    if (gen->pending_pos == gen->pending_len) {
+      gst_bda_ts_gen_next_packet (gen);
+    }
+
+    gsize n = MIN (size, gen->pending_len - gen->pending_pos);
+    memcpy (data, gen->pending + gen->pending_pos, n);
+    gen->pending_pos += n;
+    data += n;
+    size -= n;
+  }
+}
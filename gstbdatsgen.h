@@ -0,0 +1,92 @@
+/* GStreamer
+ * Copyright (C) 2015 Raimo Järvi <raimo.jarvi@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef __GST_BDATSGEN_H__
+#define __GST_BDATSGEN_H__
+
+#include <glib.h>
+
+/* Synthetic MPEG-2 transport stream generator for benchmarks. The output
+   is fully determined by the parameters, including the seed. */
+
+#define GST_BDA_TS_GEN_MAX_PROGRAMS 32
+#define GST_BDA_TS_GEN_MAX_STREAMS 16
+/* EIT schedule events fit in one table of 32 segments of 3 sections. */
+#define GST_BDA_TS_GEN_MAX_EIT_EVENTS 96
+
+typedef struct _GstBdaTsGen GstBdaTsGen;
+typedef struct _GstBdaTsGenParams GstBdaTsGenParams;
+
+struct _GstBdaTsGenParams {
+  guint32 seed;
+  guint programs;
+  /* Elementary streams per program, the first one is video. */
+  guint streams;
+  /* Multiplex bitrate in bits per second. */
+  guint bitrate;
+  /* PCR interval in ms. */
+  guint pcr_interval;
+  /* PAT/PMT repetition interval in ms. */
+  guint psi_interval;
+  /* Share of null packets in percent. */
+  guint null_share;
+  /* Video frames between IDR frames. */
+  guint gop;
+  /* Probabilities per packet of a continuity counter gap, a set transport
+     error indicator and lost sync (garbage bytes before the packet). */
+  gdouble cc_errors;
+  gdouble tei_errors;
+  gdouble sync_loss;
+  /* SDT, NIT and EIT schedule repetition interval in ms, 0 to send no SI.
+     Program N is service N of the SDT, named "Service N", with an EIT
+     schedule of eit_events events of 30 minutes, one per section, whose
+     titles are "Event M" and texts "Version V". */
+  guint si_interval;
+  /* Version number of the SDT, NIT and EIT. */
+  guint si_version;
+  guint eit_events;
+  /* Start of the first EIT event in seconds since the epoch. */
+  gint64 eit_start;
+};
+
+/**
+ * Sets default parameters: 4 programs of 2 streams at 24 Mbit/s, without
+ * SI.
+ */
+void gst_bda_ts_gen_params_init (GstBdaTsGenParams * params);
+
+/**
+ * Parses comma separated key=value pairs into params, e.g.
+ * "programs=8,null-share=5,cc-errors=0.001". Keys are the same as the
+ * bdatsgen command line options.
+ * @return TRUE if all keys were recognised
+ */
+gboolean gst_bda_ts_gen_params_parse (GstBdaTsGenParams * params,
+    const gchar * str);
+
+GstBdaTsGen *gst_bda_ts_gen_new (const GstBdaTsGenParams * params);
+void gst_bda_ts_gen_free (GstBdaTsGen * gen);
+
+/**
+ * Fills data with the next size bytes of the stream. The stream isn't
+ * split on packet boundaries, so any sample size can be generated.
+ */
+void gst_bda_ts_gen_fill (GstBdaTsGen * gen, guint8 * data, gsize size);
+
+#endif
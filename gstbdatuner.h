@@ -0,0 +1,102 @@
+/* GStreamer
+ * Copyright (C) 2015 Raimo Järvi <raimo.jarvi@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef __GST_BDATUNER_H__
+#define __GST_BDATUNER_H__
+
+#include "gstbdasrc.h"
+#include "gstbdaworker.h"
+
+/* Device operations of an element, for the units that run hidden tuner
+   elements on behalf of another element. Implemented in gstbdasrc.cpp. */
+
+typedef struct _GstBdaSignalQuery GstBdaSignalQuery;
+
+/* Signal lock read for gst_bdasrc_do_get_signal_locked (). */
+struct _GstBdaSignalQuery {
+  GstBdaSrc *src;
+  gboolean locked;
+};
+
+/* Worker functions of the device operations, data is the element. */
+gboolean gst_bdasrc_do_open (gpointer data);
+gboolean gst_bdasrc_do_start (gpointer data);
+gboolean gst_bdasrc_do_stop (gpointer data);
+gboolean gst_bdasrc_do_retune (gpointer data);
+gboolean gst_bdasrc_do_get_signal_locked (gpointer data);
+
+/**
+ * Runs a device operation on the worker thread of the element, waiting up
+ * to device-timeout if bounded. Returns FALSE if it failed or timed out.
+ */
+gboolean gst_bdasrc_call (GstBdaSrc * self, GstBdaWorkerFunc func,
+    const gchar * what, gboolean bounded);
+
+/**
+ * Queues a device operation without waiting for it.
+ */
+void gst_bdasrc_post (GstBdaSrc * self, GstBdaWorkerFunc func);
+
+/**
+ * Reads the signal lock status on the worker thread. A timed out read
+ * counts as not locked.
+ */
+gboolean gst_bdasrc_read_signal_locked (GstBdaSrc * self, gboolean * locked);
+
+/**
+ * Returns a key identifying everything that determines the stream at
+ * frequency.
+ */
+gchar *gst_bdasrc_tuning_key (GstBdaSrc * self, int frequency);
+
+/**
+ * Copies the device and tuning properties of the element to a hidden
+ * element.
+ */
+void gst_bdasrc_copy_properties (GstBdaSrc * self, GstBdaSrc * dest);
+
+/**
+ * Parses comma separated transponders of the form
+ * frequency[:symbol-rate[:modulation]] to "transponder" structures, taking
+ * missing values from the element.
+ */
+GPtrArray *gst_bdasrc_parse_transponders (GstBdaSrc * self,
+    const gchar * transponders);
+
+/**
+ * Sets the tuning properties of a hidden tuner from a "transponder"
+ * structure.
+ */
+void gst_bdasrc_configure_transponder (GstBdaSrc * tuner,
+    const GstStructure * transponder);
+
+/**
+ * Polls the signal lock of a hidden tuner with backoff until it locks,
+ * timeout ms pass or cancelled is set. cancelled is protected by lock, and
+ * cond is signalled when it is set.
+ */
+gboolean gst_bdasrc_wait_tuner_lock (GstBdaSrc * tuner, guint timeout,
+    GMutex * lock, GCond * cond, gboolean * cancelled);
+
+/**
+ * Queues a sample for the streaming thread, takes ownership of buffer.
+ */
+void gst_bdasrc_queue_sample (GstBdaSrc * self, GstBuffer * buffer);
+
+#endif
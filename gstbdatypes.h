@@ -20,6 +20,8 @@
 #ifndef __GST_BDATYPES_H__
 #define __GST_BDATYPES_H__
 
+#ifdef HAVE_DIRECTSHOW
+
 #ifdef __GNUC__
   // MinGW comdef.h requires this for sprintf_s
   #include <stdio.h>
@@ -42,6 +44,80 @@ extern "C" const CLSID CLSID_SampleGrabber;
 #include <qedit.h>
 #include <strmif.h>
 
+#else
+
+#include <gst/gst.h>
+
+/* Without DirectShow only the emulator backends are available. These mirror
+   the BDA tuning parameter types from bdatypes.h so that the element's
+   properties stay the same on every platform. */
+typedef enum
+{
+  BDA_MOD_NOT_SET = -1,
+  BDA_MOD_NOT_DEFINED = 0,
+  BDA_MOD_16QAM = 1,
+  BDA_MOD_32QAM = 2,
+  BDA_MOD_64QAM = 3,
+  BDA_MOD_128QAM = 7,
+  BDA_MOD_256QAM = 11,
+  BDA_MOD_QPSK = 20,
+  BDA_MOD_8VSB = 23,
+  BDA_MOD_16VSB = 24
+} ModulationType;
+
+typedef enum
+{
+  BDA_GUARD_NOT_SET = -1,
+  BDA_GUARD_NOT_DEFINED = 0,
+  BDA_GUARD_1_32 = 1,
+  BDA_GUARD_1_16 = 2,
+  BDA_GUARD_1_8 = 3,
+  BDA_GUARD_1_4 = 4
+} GuardInterval;
+
+typedef enum
+{
+  BDA_XMIT_MODE_NOT_SET = -1,
+  BDA_XMIT_MODE_NOT_DEFINED = 0,
+  BDA_XMIT_MODE_2K = 1,
+  BDA_XMIT_MODE_8K = 2
+} TransmissionMode;
+
+typedef enum
+{
+  BDA_HALPHA_NOT_SET = -1,
+  BDA_HALPHA_NOT_DEFINED = 0,
+  BDA_HALPHA_1 = 1,
+  BDA_HALPHA_2 = 2,
+  BDA_HALPHA_4 = 3
+} HierarchyAlpha;
+
+typedef enum
+{
+  BDA_POLARISATION_NOT_SET = -1,
+  BDA_POLARISATION_NOT_DEFINED = 0,
+  BDA_POLARISATION_LINEAR_H = 1,
+  BDA_POLARISATION_LINEAR_V = 2,
+  BDA_POLARISATION_CIRCULAR_L = 3,
+  BDA_POLARISATION_CIRCULAR_R = 4
+} Polarisation;
+
+typedef enum
+{
+  BDA_BCC_RATE_NOT_SET = -1,
+  BDA_BCC_RATE_NOT_DEFINED = 0,
+  BDA_BCC_RATE_1_2 = 1,
+  BDA_BCC_RATE_2_3 = 2,
+  BDA_BCC_RATE_3_4 = 3,
+  BDA_BCC_RATE_4_5 = 5,
+  BDA_BCC_RATE_5_6 = 6,
+  BDA_BCC_RATE_7_8 = 8,
+  BDA_BCC_RATE_6_7 = 12,
+  BDA_BCC_RATE_8_9 = 13
+} BinaryConvolutionCodeRate;
+
+#endif
+
 /* Supported BDA input device types. */
 typedef enum
 {
@@ -52,6 +128,31 @@ typedef enum
   GST_BDA_DVB_T
 } GstBdaInputType;
 
+/* Device control backends. */
+typedef enum
+{
+  /* BDA tuner device through a DirectShow filter graph. */
+  GST_BDA_BACKEND_DSHOW,
+  /* Transport stream file replayed through the capture path. */
+  GST_BDA_BACKEND_REPLAY,
+  /* Synthetic transport stream generated in memory. */
+  GST_BDA_BACKEND_SYNTHETIC,
+  /* Sample sizes and timing replayed from a trace, see gstbdatrace.h. */
+  GST_BDA_BACKEND_TRACE
+} GstBdaBackendType;
+
+/* Replay pacing modes. */
+typedef enum
+{
+  /* Follow the PCR of the first PCR PID found in the stream. */
+  GST_BDA_PACING_PCR,
+  /* Fixed bitrate. */
+  GST_BDA_PACING_BITRATE,
+  /* As fast as the capture path accepts samples. */
+  GST_BDA_PACING_NONE
+} GstBdaPacing;
+
+#ifdef HAVE_DIRECTSHOW
 /* Define smart pointers for BDA COM interface types.
    Unlike CComPtr, these don't require ATL. */
 _COM_SMARTPTR_TYPEDEF (IATSCLocator, __uuidof (IATSCLocator));
@@ -79,5 +180,6 @@ _COM_SMARTPTR_TYPEDEF (ITuneRequest, __uuidof (ITuneRequest));
 _COM_SMARTPTR_TYPEDEF (ITuningSpace, __uuidof (ITuningSpace));
 _COM_SMARTPTR_TYPEDEF (ITuningSpaceContainer, __uuidof (ITuningSpaceContainer));
 _COM_SMARTPTR_TYPEDEF (IUnknown, __uuidof (IUnknown));
+#endif
 
 #endif
@@ -104,11 +104,37 @@ bda_get_tuner_name (IMoniker * tuner_moniker)
   return name;
 }
 
+std::string
+bda_get_moniker_name (IMoniker * moniker)
+{
+  std::string name;
+
+  IBindCtxPtr bind_ctx;
+  if (FAILED (CreateBindCtx (0, &bind_ctx))) {
+    return name;
+  }
+
+  LPOLESTR wname;
+  if (FAILED (moniker->GetDisplayName (bind_ctx, NULL, &wname))) {
+    return name;
+  }
+
+  gchar *utf8 = g_utf16_to_utf8 ((const gunichar2 *) wname, -1, NULL, NULL,
+      NULL);
+  if (utf8) {
+    name = utf8;
+    g_free (utf8);
+  }
+  CoTaskMemFree (wname);
+
+  return name;
+}
+
 GstBdaInputType
-gst_bdasrc_get_input_type (GstBdaSrc * self)
+gst_bdasrc_get_input_type (IBaseFilter * tuner)
 {
   IBDA_TopologyPtr bda_topology;
-  HRESULT res = self->network_tuner->QueryInterface (&bda_topology);
+  HRESULT res = tuner->QueryInterface (&bda_topology);
   if (FAILED (res)) {
     return GST_BDA_UNKNOWN;
   }
@@ -174,27 +200,64 @@ gst_bdasrc_get_network_type (GstBdaInputType input_type, CLSID & network_type)
   }
 }
 
-BOOL
-gst_bdasrc_create_tuning_space (GstBdaSrc * self,
-    ITuningSpacePtr & tuning_space)
-{
+/* Process-wide tuning spaces by network type. System tuning spaces are
+   enumerated once, missing ones are created on first use. */
+typedef struct _GstBdaTuningSpaceEntry GstBdaTuningSpaceEntry;
+
+struct _GstBdaTuningSpaceEntry {
   CLSID network_type;
-  if (!gst_bdasrc_get_network_type (self->input_type, network_type)) {
-    return FALSE;
+  ITuningSpace *tuning_space;
+};
+
+G_LOCK_DEFINE_STATIC (tuning_spaces);
+static GArray *tuning_spaces;
+
+/* Called with the tuning_spaces lock held. */
+static ITuningSpace *
+gst_bdasrc_lookup_tuning_space (REFCLSID network_type)
+{
+  for (guint i = 0; i < tuning_spaces->len; i++) {
+    GstBdaTuningSpaceEntry *entry =
+        &g_array_index (tuning_spaces, GstBdaTuningSpaceEntry, i);
+    if (entry->network_type == network_type) {
+      return entry->tuning_space;
+    }
   }
-  // First we look for an existing tuning space that matches network type.
-  ITuningSpaceContainerPtr tuning_spaces;
-  HRESULT res = tuning_spaces.CreateInstance (__uuidof (SystemTuningSpaces));
+
+  return NULL;
+}
+
+/* Called with the tuning_spaces lock held. */
+static void
+gst_bdasrc_add_tuning_space (REFCLSID network_type,
+    ITuningSpace * tuning_space)
+{
+  GstBdaTuningSpaceEntry entry;
+  entry.network_type = network_type;
+  entry.tuning_space = tuning_space;
+  entry.tuning_space->AddRef ();
+
+  g_array_append_val (tuning_spaces, entry);
+}
+
+/* Called with the tuning_spaces lock held. */
+static BOOL
+gst_bdasrc_enum_tuning_spaces (void)
+{
+  ITuningSpaceContainerPtr container;
+  HRESULT res = container.CreateInstance (__uuidof (SystemTuningSpaces));
   if (FAILED (res)) {
     return FALSE;
   }
 
   IEnumTuningSpacesPtr space_enum;
-  res = tuning_spaces->get_EnumTuningSpaces (&space_enum);
+  res = container->get_EnumTuningSpaces (&space_enum);
   if (FAILED (res)) {
     return FALSE;
   }
 
+  tuning_spaces = g_array_new (FALSE, FALSE, sizeof (GstBdaTuningSpaceEntry));
+
   ITuningSpacePtr ts;
   ULONG fetched = 0;
   while (space_enum->Next (1, &ts, &fetched) == S_OK) {
@@ -204,13 +267,19 @@ gst_bdasrc_create_tuning_space (GstBdaSrc * self,
       continue;
     }
 
-    if (type == network_type) {
-      tuning_space = ts;
-      return TRUE;
+    /* The first one of each network type is used. */
+    if (!gst_bdasrc_lookup_tuning_space (type)) {
+      gst_bdasrc_add_tuning_space (type, ts);
     }
   }
 
-  // No existing tuning space found, create a new one.
+  return TRUE;
+}
+
+/* Creates a new tuning space according to input device type. */
+static BOOL
+gst_bdasrc_new_tuning_space (GstBdaSrc * self, ITuningSpacePtr & tuning_space)
+{
   if (self->input_type == GST_BDA_ATSC) {
     HRESULT res = tuning_space.CreateInstance (__uuidof (ATSCTuningSpace));
     if (FAILED (res)) {
@@ -272,6 +341,46 @@ gst_bdasrc_create_tuning_space (GstBdaSrc * self,
   return FALSE;
 }
 
+BOOL
+gst_bdasrc_create_tuning_space (GstBdaSrc * self,
+    ITuningSpacePtr & tuning_space)
+{
+  CLSID network_type;
+  if (!gst_bdasrc_get_network_type (self->input_type, network_type)) {
+    return FALSE;
+  }
+
+  G_LOCK (tuning_spaces);
+  // First we look for an existing tuning space that matches network type.
+  if (!tuning_spaces && !gst_bdasrc_enum_tuning_spaces ()) {
+    G_UNLOCK (tuning_spaces);
+    return FALSE;
+  }
+
+  ITuningSpace *cached = gst_bdasrc_lookup_tuning_space (network_type);
+  if (!cached) {
+    // No existing tuning space found, create a new one.
+    ITuningSpacePtr created;
+    if (!gst_bdasrc_new_tuning_space (self, created)) {
+      G_UNLOCK (tuning_spaces);
+      return FALSE;
+    }
+    gst_bdasrc_add_tuning_space (network_type, created);
+    cached = created;
+  }
+
+  /* Every element gets its own copy, the cached one is never modified. */
+  HRESULT res = cached->Clone (&tuning_space);
+  G_UNLOCK (tuning_spaces);
+  if (FAILED (res)) {
+    GST_ERROR_OBJECT (self, "Unable to clone tuning space: %s (0x%lx)",
+        bda_err_to_str (res).c_str (), res);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
 BOOL
 gst_bdasrc_init_tune_request (GstBdaSrc * src,
     IDVBTuneRequestPtr & tune_request)
@@ -447,7 +556,7 @@ gst_bdasrc_connect_filters (GstBdaSrc * src, IBaseFilter * filter_upstream,
 HRESULT
 gst_bdasrc_load_filter (GstBdaSrc * src, ICreateDevEnum * sys_dev_enum,
     REFCLSID clsid, IBaseFilter * upstream_filter,
-    IBaseFilter ** downstream_filter)
+    IBaseFilter ** downstream_filter, std::string * moniker_name)
 {
   IEnumMonikerPtr enum_moniker;
   HRESULT res = sys_dev_enum->CreateClassEnumerator (clsid, &enum_moniker, 0);
@@ -505,6 +614,9 @@ gst_bdasrc_load_filter (GstBdaSrc * src, ICreateDevEnum * sys_dev_enum,
     if (SUCCEEDED (res)) {
       /* It's the filter we want. */
       filter->QueryInterface (downstream_filter);
+      if (moniker_name) {
+        *moniker_name = bda_get_moniker_name (moniker);
+      }
       return S_OK;
     } else {
       /* It wasn't the the filter we want, unload and try the next one. */
@@ -518,10 +630,63 @@ gst_bdasrc_load_filter (GstBdaSrc * src, ICreateDevEnum * sys_dev_enum,
   return E_FAIL;
 }
 
+HRESULT
+gst_bdasrc_load_filter_by_name (GstBdaSrc * src, const gchar * moniker_name,
+    IBaseFilter * upstream_filter, IBaseFilter ** downstream_filter)
+{
+  gunichar2 *wname = g_utf8_to_utf16 (moniker_name, -1, NULL, NULL, NULL);
+  if (!wname) {
+    return E_INVALIDARG;
+  }
+
+  IBindCtxPtr bind_ctx;
+  HRESULT res = CreateBindCtx (0, &bind_ctx);
+  if (FAILED (res)) {
+    g_free (wname);
+    return res;
+  }
+
+  IMonikerPtr moniker;
+  ULONG eaten;
+  res = MkParseDisplayName (bind_ctx, (LPCOLESTR) wname, &eaten, &moniker);
+  g_free (wname);
+  if (FAILED (res)) {
+    return res;
+  }
+
+  IBaseFilterPtr filter;
+  res = moniker->BindToObject (NULL, NULL, IID_IBaseFilter, (void **) &filter);
+  if (FAILED (res)) {
+    return res;
+  }
+
+  std::string name = bda_get_tuner_name (moniker);
+  _bstr_t filter_name (name.c_str ());
+  res = src->filter_graph->AddFilter (filter, filter_name);
+  if (FAILED (res)) {
+    return res;
+  }
+
+  res = gst_bdasrc_connect_filters (src, upstream_filter, filter);
+  if (FAILED (res)) {
+    src->filter_graph->RemoveFilter (filter);
+    return res;
+  }
+
+  return filter->QueryInterface (downstream_filter);
+}
+
 BOOL
 gst_bdasrc_create_ts_capture (GstBdaSrc * bda_src,
-    ICreateDevEnum * sys_dev_enum, IBaseFilterPtr & ts_capture)
+    ICreateDevEnum * sys_dev_enum, IBaseFilterPtr & ts_capture,
+    GstBdaGraphHint * hint, gboolean cached)
 {
+  /* Indexed by GstBdaGraphHint::ts_subtype. */
+  static const GUID *ts_subtypes[] = {
+    &MEDIASUBTYPE_MPEG2_TRANSPORT,
+    &KSDATAFORMAT_SUBTYPE_BDA_MPEG2_TRANSPORT
+  };
+
   HRESULT res = ts_capture.CreateInstance (CLSID_SampleGrabber);
   if (FAILED (res)) {
     GST_ERROR_OBJECT (bda_src, "Unable to create TS capture");
@@ -542,38 +707,61 @@ gst_bdasrc_create_ts_capture (GstBdaSrc * bda_src,
     return FALSE;
   }
 
-  res =
-      gst_bdasrc_load_filter (bda_src, sys_dev_enum,
-      KSCATEGORY_BDA_RECEIVER_COMPONENT, bda_src->network_tuner,
-      &bda_src->receiver);
-  if (FAILED (res)) {
-    // There is no separate receiver filter, use network tuner instead.
-    bda_src->receiver = bda_src->network_tuner;
+  if (cached) {
+    if (!hint->receiver) {
+      bda_src->receiver = bda_src->network_tuner;
+    } else if (FAILED (gst_bdasrc_load_filter_by_name (bda_src,
+                hint->receiver, bda_src->network_tuner,
+                &bda_src->receiver))) {
+      GST_INFO_OBJECT (bda_src, "Cached receiver filter '%s' not available",
+          hint->receiver);
+      cached = FALSE;
+    }
+  }
+
+  if (!cached) {
+    std::string receiver_name;
+    res =
+        gst_bdasrc_load_filter (bda_src, sys_dev_enum,
+        KSCATEGORY_BDA_RECEIVER_COMPONENT, bda_src->network_tuner,
+        &bda_src->receiver, &receiver_name);
+    g_free (hint->receiver);
+    hint->receiver = NULL;
+    hint->ts_subtype = 0;
+    if (FAILED (res)) {
+      // There is no separate receiver filter, use network tuner instead.
+      bda_src->receiver = bda_src->network_tuner;
+    } else if (!receiver_name.empty ()) {
+      hint->receiver = g_strdup (receiver_name.c_str ());
+    }
   }
 
   AM_MEDIA_TYPE media_type;
   ZeroMemory (&media_type, sizeof (AM_MEDIA_TYPE));
   media_type.majortype = MEDIATYPE_Stream;
-  media_type.subtype = MEDIASUBTYPE_MPEG2_TRANSPORT;
-  if (FAILED (sample_grabber->SetMediaType (&media_type))) {
-    GST_ERROR_OBJECT (bda_src, "Unable to set TS grabber media type");
-    return FALSE;
-  }
-  res = gst_bdasrc_connect_filters (bda_src, bda_src->receiver, ts_capture);
-  if (FAILED (res)) {
-    media_type.subtype = KSDATAFORMAT_SUBTYPE_BDA_MPEG2_TRANSPORT;
+
+  /* Try the cached subtype first. */
+  guint n_subtypes = G_N_ELEMENTS (ts_subtypes);
+  guint first = hint->ts_subtype < n_subtypes ? hint->ts_subtype : 0;
+  for (guint i = 0; i < n_subtypes; i++) {
+    guint subtype = (first + i) % n_subtypes;
+    media_type.subtype = *ts_subtypes[subtype];
     if (FAILED (sample_grabber->SetMediaType (&media_type))) {
       GST_ERROR_OBJECT (bda_src, "Unable to set TS grabber media type");
       return FALSE;
     }
 
     res = gst_bdasrc_connect_filters (bda_src, bda_src->receiver, ts_capture);
-    if (FAILED (res)) {
-      GST_ERROR_OBJECT (bda_src, "Unable to connect TS capture: %s"
-          " (0x%lx)", bda_err_to_str (res).c_str (), res);
-      return FALSE;
+    if (SUCCEEDED (res)) {
+      hint->ts_subtype = subtype;
+      break;
     }
   }
+  if (FAILED (res)) {
+    GST_ERROR_OBJECT (bda_src, "Unable to connect TS capture: %s"
+        " (0x%lx)", bda_err_to_str (res).c_str (), res);
+    return FALSE;
+  }
 
   if (FAILED (res = sample_grabber->SetBufferSamples (TRUE)) ||
       FAILED (res = sample_grabber->SetOneShot (FALSE)) ||
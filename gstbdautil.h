@@ -26,6 +26,7 @@
 #include <winerror.h>
 #include <qedit.h>
 #include "gstbdasrc.h"
+#include "gstbdagraphcache.h"
 
 /**
  * Returns a description for the specified BDA / DirectShow error code.
@@ -37,12 +38,18 @@ std::string bda_err_to_str (HRESULT hr);
  */
 std::string bda_get_tuner_name (IMoniker * tuner_moniker);
 
+/**
+ * Returns the display name of the specified moniker, which identifies the
+ * device across enumerations and processes.
+ */
+std::string bda_get_moniker_name (IMoniker * moniker);
+
 /**
  * Determines input device type from tuner's capabilities. FIXME: One device
  * can probably support multiple input types (e.g. DVB-T and DVB-C), we don't
  * currently support that.
  */
-GstBdaInputType gst_bdasrc_get_input_type (GstBdaSrc * src);
+GstBdaInputType gst_bdasrc_get_input_type (IBaseFilter * tuner);
 
 const char *gst_bdasrc_get_input_type_name (GstBdaInputType input_type);
 
@@ -54,8 +61,9 @@ BOOL gst_bdasrc_get_network_type (GstBdaInputType input_type,
 
 /**
  * Returns a BDA tuning space according to input device type. If a matching
- * tuning space is found in system tuning spaces, it is returned. Otherwise
- * a new one is created.
+ * tuning space is found in system tuning spaces, it is used. Otherwise a new
+ * one is created. Tuning spaces are cached for the process, each caller gets
+ * its own clone. Thread safe.
  * @return TRUE if tuning space was found or created successfully
  */
 BOOL gst_bdasrc_create_tuning_space (GstBdaSrc * src,
@@ -80,19 +88,31 @@ HRESULT gst_bdasrc_connect_filters (GstBdaSrc * src,
 
 /**
  * Creates a filter with the specified CLSID and connects it to the specified
- * upstream filter.
+ * upstream filter. The display name of the filter's moniker is stored to
+ * moniker_name if set.
  * @return S_OK if filter was created successfully, otherwise an error
  */
 HRESULT gst_bdasrc_load_filter (GstBdaSrc * src, ICreateDevEnum * sys_dev_enum,
     REFCLSID clsid, IBaseFilter * upstream_filter,
+    IBaseFilter ** downstream_filter, std::string * moniker_name = NULL);
+
+/**
+ * Creates the filter with the specified moniker display name and connects it
+ * to the specified upstream filter.
+ * @return S_OK if filter was created successfully, otherwise an error
+ */
+HRESULT gst_bdasrc_load_filter_by_name (GstBdaSrc * src,
+    const gchar * moniker_name, IBaseFilter * upstream_filter,
     IBaseFilter ** downstream_filter);
 
 /**
  * Creates a transport stream capture filter and connects it to our
- * GstBdaGrabber.
+ * GstBdaGrabber. If cached is TRUE, the receiver filter and media subtype in
+ * hint are tried first. hint is updated with the ones that connected.
  * @return TRUE if capture filter was created successfully
  */
 BOOL gst_bdasrc_create_ts_capture (GstBdaSrc * bda_src,
-    ICreateDevEnum * sys_dev_enum, IBaseFilterPtr & ts_capture);
+    ICreateDevEnum * sys_dev_enum, IBaseFilterPtr & ts_capture,
+    GstBdaGraphHint * hint, gboolean cached);
 
 #endif
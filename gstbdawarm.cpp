@@ -0,0 +1,353 @@
+/* GStreamer
+ * Copyright (C) 2015 Raimo Järvi <raimo.jarvi@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include "gstbdawarm.h"
+#include "gstbdatuner.h"
+#include <string.h>
+
+/* Warm standby. The element's tuners are hidden elements, one delivering
+   output and the others kept running on warm-frequencies. */
+typedef struct _GstBdaWarm GstBdaWarm;
+
+struct _GstBdaWarm {
+  GstBdaSrc *element;
+  /* Hidden tuner elements, the first one is opened for the element's own
+     device. */
+  GPtrArray *tuners;
+  GMutex lock;
+  /* Tuner delivering output, protected by lock. */
+  GstBdaSrc *active;
+};
+
+/* Parses a comma separated list of frequencies in kHz. */
+static GArray *
+gst_bdasrc_parse_frequencies (GstBdaSrc * self, const gchar * frequencies)
+{
+  GArray *result = g_array_new (FALSE, FALSE, sizeof (int));
+  if (!frequencies) {
+    return result;
+  }
+
+  gchar **tokens = g_strsplit (frequencies, ",", -1);
+  for (gchar ** token = tokens; *token; token++) {
+    gchar *end;
+    guint64 frequency = g_ascii_strtoull (g_strstrip (*token), &end, 10);
+    if (end == *token || *end || frequency == 0 || frequency > G_MAXINT) {
+      GST_WARNING_OBJECT (self, "Ignoring invalid frequency '%s'", *token);
+      continue;
+    }
+    int value = (int) frequency;
+    g_array_append_val (result, value);
+  }
+  g_strfreev (tokens);
+
+  return result;
+}
+
+/* Sets the tuning properties of a tuner to the element's at frequency. */
+static void
+gst_bdasrc_warm_configure (GstBdaSrc * self, GstBdaSrc * tuner,
+    int frequency)
+{
+  int device_index = tuner->device_index;
+  GstBdaInputType device_type = tuner->device_type;
+
+  gst_bdasrc_copy_properties (self, tuner);
+  tuner->frequency = frequency;
+  tuner->device_index = device_index;
+  tuner->device_type = device_type;
+}
+
+/* Returns TRUE if the tuner is on frequency with the element's other
+   tuning properties. */
+static gboolean
+gst_bdasrc_warm_tuned (GstBdaSrc * self, GstBdaSrc * tuner, int frequency)
+{
+  gchar *wanted = gst_bdasrc_tuning_key (self, frequency);
+  gchar *current = gst_bdasrc_tuning_key (tuner, tuner->frequency);
+  gboolean tuned = strcmp (wanted, current) == 0;
+  g_free (wanted);
+  g_free (current);
+
+  return tuned;
+}
+
+static void
+gst_bdasrc_warm_received (GstBdaSrc * tuner, gpointer data, gsize size)
+{
+  GstBdaWarm *warm = tuner->warm_for;
+
+  g_mutex_lock (&warm->lock);
+  if (tuner == warm->active) {
+    warm->element->sample_received (warm->element, data, size);
+  }
+  g_mutex_unlock (&warm->lock);
+}
+
+/* Returns a copy of warm-frequencies, which can be set while the worker
+   uses it. */
+static gchar *
+gst_bdasrc_dup_warm_frequencies (GstBdaSrc * self)
+{
+  g_mutex_lock (&self->lock);
+  gchar *frequencies = g_strdup (self->warm_frequencies);
+  g_mutex_unlock (&self->lock);
+
+  return frequencies;
+}
+
+/* Moves the tuners that are neither active nor on one of warm_frequencies
+   to the warm frequencies that no tuner is on. They are retuned on their
+   own workers without waiting. */
+static void
+gst_bdasrc_warm_plan (GstBdaSrc * self, const gchar * warm_frequencies)
+{
+  GstBdaWarm *warm = self->warm;
+  GArray *frequencies = gst_bdasrc_parse_frequencies (self,
+      warm_frequencies);
+  GPtrArray *spare = g_ptr_array_new ();
+
+  for (guint i = 0; i < warm->tuners->len; i++) {
+    GstBdaSrc *tuner = GST_BDASRC (g_ptr_array_index (warm->tuners, i));
+    if (tuner != warm->active) {
+      g_ptr_array_add (spare, tuner);
+    }
+  }
+
+  /* Keep the spare tuners that are already on a warm frequency. */
+  for (guint i = 0; i < frequencies->len;) {
+    int frequency = g_array_index (frequencies, int, i);
+    gboolean covered = gst_bdasrc_warm_tuned (self, warm->active, frequency);
+    for (guint j = 0; j < spare->len && !covered; j++) {
+      GstBdaSrc *tuner = GST_BDASRC (g_ptr_array_index (spare, j));
+      if (gst_bdasrc_warm_tuned (self, tuner, frequency)) {
+        g_ptr_array_remove_index_fast (spare, j);
+        covered = TRUE;
+      }
+    }
+    if (covered) {
+      g_array_remove_index (frequencies, i);
+    } else {
+      i++;
+    }
+  }
+
+  for (guint i = 0; i < frequencies->len && i < spare->len; i++) {
+    GstBdaSrc *tuner = GST_BDASRC (g_ptr_array_index (spare, i));
+    int frequency = g_array_index (frequencies, int, i);
+    GST_DEBUG_OBJECT (self, "Moving spare tuner on device %d to %d kHz",
+        tuner->selected_device, frequency);
+    gst_bdasrc_warm_configure (self, tuner, frequency);
+    gst_bdasrc_post (tuner, gst_bdasrc_do_retune);
+  }
+
+  g_ptr_array_free (spare, TRUE);
+  g_array_free (frequencies, TRUE);
+}
+
+typedef struct _GstBdaWarmPlan GstBdaWarmPlan;
+
+/* New warm-frequencies for the worker. */
+struct _GstBdaWarmPlan {
+  GstBdaSrc *src;
+  gchar *frequencies;
+};
+
+static void
+gst_bdasrc_warm_plan_free (gpointer data)
+{
+  GstBdaWarmPlan *plan = (GstBdaWarmPlan *) data;
+
+  g_free (plan->frequencies);
+  g_free (plan);
+}
+
+static gboolean
+gst_bdasrc_do_warm_plan (gpointer data)
+{
+  GstBdaWarmPlan *plan = (GstBdaWarmPlan *) data;
+
+  if (plan->src->warm) {
+    gst_bdasrc_warm_plan (plan->src, plan->frequencies);
+  }
+
+  return TRUE;
+}
+
+/* Replans the spare tuners for frequencies on the worker, if the element
+   is running a warm standby by then. */
+void
+gst_bdasrc_post_warm_plan (GstBdaSrc * self, const gchar * frequencies)
+{
+  GstBdaWarmPlan *plan = g_new (GstBdaWarmPlan, 1);
+  plan->src = self;
+  plan->frequencies = g_strdup (frequencies);
+
+  gst_bda_worker_command_unref (gst_bda_worker_push (self->worker,
+          gst_bdasrc_do_warm_plan, plan, gst_bdasrc_warm_plan_free, -1));
+}
+
+/* Opens a tuner for the element's frequency and one for each warm
+   frequency. Missing spare tuners only cost tuning time. */
+gboolean
+gst_bdasrc_warm_open (GstBdaSrc * self)
+{
+  gchar *warm_frequencies = gst_bdasrc_dup_warm_frequencies (self);
+  GArray *frequencies = gst_bdasrc_parse_frequencies (self,
+      warm_frequencies);
+  g_free (warm_frequencies);
+
+  GstBdaWarm *warm = g_new0 (GstBdaWarm, 1);
+  warm->element = self;
+  warm->tuners = g_ptr_array_new_with_free_func (gst_object_unref);
+  g_mutex_init (&warm->lock);
+  self->warm = warm;
+
+  for (guint i = 0; i <= frequencies->len; i++) {
+    GstBdaSrc *tuner = GST_BDASRC (g_object_new (GST_TYPE_BDASRC, NULL));
+    gst_object_ref_sink (tuner);
+    if (i == 0) {
+      tuner->device_index = self->device_index;
+      tuner->device_type = self->device_type;
+      gst_bdasrc_warm_configure (self, tuner, self->frequency);
+    } else {
+      GstBdaSrc *first = GST_BDASRC (g_ptr_array_index (warm->tuners, 0));
+      tuner->device_index = -1;
+      tuner->device_type = first->input_type != GST_BDA_UNKNOWN ?
+          first->input_type : self->device_type;
+      gst_bdasrc_warm_configure (self, tuner,
+          g_array_index (frequencies, int, i - 1));
+    }
+    tuner->warm_for = warm;
+    tuner->sample_received = gst_bdasrc_warm_received;
+
+    if (!gst_bdasrc_call (tuner, gst_bdasrc_do_open, "open", TRUE)) {
+      gst_object_unref (tuner);
+      if (i == 0) {
+        g_array_free (frequencies, TRUE);
+        gst_bdasrc_warm_close (self);
+        return FALSE;
+      }
+      GST_ELEMENT_WARNING (self, RESOURCE, OPEN_READ,
+          ("Unable to open a spare tuner for %d kHz",
+              g_array_index (frequencies, int, i - 1)), (NULL));
+      continue;
+    }
+    g_ptr_array_add (warm->tuners, tuner);
+  }
+  g_array_free (frequencies, TRUE);
+
+  warm->active = GST_BDASRC (g_ptr_array_index (warm->tuners, 0));
+  self->selected_device = warm->active->selected_device;
+  self->need_tune = FALSE;
+  GST_INFO_OBJECT (self, "Opened %u spare tuners", warm->tuners->len - 1);
+
+  return TRUE;
+}
+
+void
+gst_bdasrc_warm_close (GstBdaSrc * self)
+{
+  GstBdaWarm *warm = self->warm;
+  if (!warm) {
+    return;
+  }
+
+  /* Closes the devices on finalize. */
+  g_ptr_array_free (warm->tuners, TRUE);
+  g_mutex_clear (&warm->lock);
+  g_free (warm);
+  self->warm = NULL;
+  self->selected_device = -1;
+}
+
+/* Starts every tuner, so that the spare ones stay locked. */
+gboolean
+gst_bdasrc_warm_start (GstBdaSrc * self)
+{
+  GstBdaWarm *warm = self->warm;
+
+  for (guint i = 0; i < warm->tuners->len; i++) {
+    GstBdaSrc *tuner = GST_BDASRC (g_ptr_array_index (warm->tuners, i));
+    if (gst_bdasrc_call (tuner, gst_bdasrc_do_start, "start", TRUE)) {
+      continue;
+    } else if (tuner == warm->active) {
+      return FALSE;
+    }
+    GST_WARNING_OBJECT (self, "Unable to start spare tuner on device %d",
+        tuner->selected_device);
+  }
+
+  return TRUE;
+}
+
+void
+gst_bdasrc_warm_stop (GstBdaSrc * self)
+{
+  GstBdaWarm *warm = self->warm;
+
+  for (guint i = 0; i < warm->tuners->len; i++) {
+    GstBdaSrc *tuner = GST_BDASRC (g_ptr_array_index (warm->tuners, i));
+    gst_bdasrc_call (tuner, gst_bdasrc_do_stop, "stop", TRUE);
+  }
+}
+
+/* Switches the output to a tuner that is already on the new tuning
+   properties, or tunes the active one if there is none. */
+gboolean
+gst_bdasrc_warm_retune (GstBdaSrc * self)
+{
+  GstBdaWarm *warm = self->warm;
+  GstBdaSrc *target = NULL;
+  gboolean ret = TRUE;
+
+  for (guint i = 0; i < warm->tuners->len && !target; i++) {
+    GstBdaSrc *tuner = GST_BDASRC (g_ptr_array_index (warm->tuners, i));
+    if (gst_bdasrc_warm_tuned (self, tuner, self->frequency)) {
+      target = tuner;
+    }
+  }
+
+  if (target) {
+    GST_INFO_OBJECT (self, "Switching to tuner on device %d at %d kHz",
+        target->selected_device, self->frequency);
+  } else {
+    target = warm->active;
+    gst_bdasrc_warm_configure (self, target, self->frequency);
+    ret = gst_bdasrc_call (target, gst_bdasrc_do_retune, "retune", TRUE);
+  }
+
+  g_mutex_lock (&warm->lock);
+  warm->active = target;
+  g_mutex_unlock (&warm->lock);
+  self->selected_device = target->selected_device;
+
+  gchar *warm_frequencies = gst_bdasrc_dup_warm_frequencies (self);
+  gst_bdasrc_warm_plan (self, warm_frequencies);
+  g_free (warm_frequencies);
+
+  return ret;
+}
+
+gboolean
+gst_bdasrc_warm_read_signal_locked (GstBdaSrc * self, gboolean * locked)
+{
+  /* Only changed on the worker. */
+  return gst_bdasrc_read_signal_locked (self->warm->active, locked);
+}
@@ -0,0 +1,60 @@
+/* GStreamer
+ * Copyright (C) 2015 Raimo Järvi <raimo.jarvi@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef __GST_BDAWARM_H__
+#define __GST_BDAWARM_H__
+
+#include "gstbdasrc.h"
+
+/* Warm standby of the elements with warm-frequencies set, see
+   gstbdawarm.cpp. All but gst_bdasrc_post_warm_plan () are called on the
+   worker of the element. */
+
+/**
+ * Opens a tuner for the element's frequency and one for each warm
+ * frequency. Fails only if the first one can't be opened.
+ */
+gboolean gst_bdasrc_warm_open (GstBdaSrc * self);
+void gst_bdasrc_warm_close (GstBdaSrc * self);
+
+/**
+ * Starts or stops every tuner, so that the spare ones stay locked.
+ */
+gboolean gst_bdasrc_warm_start (GstBdaSrc * self);
+void gst_bdasrc_warm_stop (GstBdaSrc * self);
+
+/**
+ * Switches the output to a tuner that is already on the new tuning
+ * properties, or tunes the active one if there is none.
+ */
+gboolean gst_bdasrc_warm_retune (GstBdaSrc * self);
+
+/**
+ * Replans the spare tuners for new warm frequencies on the worker, if the
+ * element is running a warm standby by then.
+ */
+void gst_bdasrc_post_warm_plan (GstBdaSrc * self, const gchar * frequencies);
+
+/**
+ * Reads the signal lock status of the tuner delivering output.
+ */
+gboolean gst_bdasrc_warm_read_signal_locked (GstBdaSrc * self,
+    gboolean * locked);
+
+#endif
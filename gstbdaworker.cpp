@@ -0,0 +1,184 @@
+/* GStreamer
+ * Copyright (C) 2015 Raimo Järvi <raimo.jarvi@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include "gstbdaworker.h"
+#ifdef HAVE_DIRECTSHOW
+#include <objbase.h>
+#endif
+
+struct _GstBdaWorker {
+  GThread *thread;
+  GAsyncQueue *queue;
+};
+
+struct _GstBdaWorkerCommand {
+  gint refcount;
+  /* NULL stops the worker. */
+  GstBdaWorkerFunc func;
+  gpointer data;
+  GDestroyNotify notify;
+  /* Dropped if not started by then, -1 for never. */
+  gint64 deadline;
+
+  GMutex lock;
+  GCond cond;
+  gboolean done;
+  gboolean dropped;
+  gboolean result;
+};
+
+static GstBdaWorkerCommand *
+gst_bda_worker_command_new (GstBdaWorkerFunc func, gpointer data,
+    GDestroyNotify notify, gint64 deadline)
+{
+  GstBdaWorkerCommand *command = g_new0 (GstBdaWorkerCommand, 1);
+  command->refcount = 1;
+  command->func = func;
+  command->data = data;
+  command->notify = notify;
+  command->deadline = deadline;
+  g_mutex_init (&command->lock);
+  g_cond_init (&command->cond);
+
+  return command;
+}
+
+void
+gst_bda_worker_command_unref (GstBdaWorkerCommand * command)
+{
+  if (!g_atomic_int_dec_and_test (&command->refcount)) {
+    return;
+  }
+
+  if (command->notify) {
+    command->notify (command->data);
+  }
+  g_mutex_clear (&command->lock);
+  g_cond_clear (&command->cond);
+  g_free (command);
+}
+
+gboolean
+gst_bda_worker_command_wait (GstBdaWorkerCommand * command, gint64 end_time,
+    gboolean * result)
+{
+  g_mutex_lock (&command->lock);
+  while (!command->done) {
+    if (end_time < 0) {
+      g_cond_wait (&command->cond, &command->lock);
+    } else if (!g_cond_wait_until (&command->cond, &command->lock, end_time)) {
+      break;
+    }
+  }
+  gboolean done = command->done && !command->dropped;
+  if (done && result) {
+    *result = command->result;
+  }
+  g_mutex_unlock (&command->lock);
+
+  return done;
+}
+
+gboolean
+gst_bda_worker_command_is_done (GstBdaWorkerCommand * command)
+{
+  g_mutex_lock (&command->lock);
+  gboolean done = command->done;
+  g_mutex_unlock (&command->lock);
+
+  return done;
+}
+
+static gpointer
+gst_bda_worker_thread (gpointer data)
+{
+  GstBdaWorker *worker = (GstBdaWorker *) data;
+
+#ifdef HAVE_DIRECTSHOW
+  CoInitializeEx (NULL, COINIT_MULTITHREADED);
+#endif
+
+  for (;;) {
+    GstBdaWorkerCommand *command =
+        (GstBdaWorkerCommand *) g_async_queue_pop (worker->queue);
+    if (!command->func) {
+      gst_bda_worker_command_unref (command);
+      break;
+    }
+
+    /* Whoever queued it has given up waiting. */
+    gboolean dropped = command->deadline >= 0
+        && g_get_monotonic_time () >= command->deadline;
+    gboolean result = dropped ? FALSE : command->func (command->data);
+
+    g_mutex_lock (&command->lock);
+    command->result = result;
+    command->dropped = dropped;
+    command->done = TRUE;
+    g_cond_broadcast (&command->cond);
+    g_mutex_unlock (&command->lock);
+    gst_bda_worker_command_unref (command);
+  }
+
+#ifdef HAVE_DIRECTSHOW
+  CoUninitialize ();
+#endif
+
+  return NULL;
+}
+
+GstBdaWorker *
+gst_bda_worker_new (const gchar * name)
+{
+  GstBdaWorker *worker = g_new0 (GstBdaWorker, 1);
+  worker->queue = g_async_queue_new ();
+  worker->thread = g_thread_new (name, gst_bda_worker_thread, worker);
+
+  return worker;
+}
+
+void
+gst_bda_worker_free (GstBdaWorker * worker)
+{
+  g_async_queue_push (worker->queue,
+      gst_bda_worker_command_new (NULL, NULL, NULL, -1));
+  g_thread_join (worker->thread);
+  g_async_queue_unref (worker->queue);
+  g_free (worker);
+}
+
+gboolean
+gst_bda_worker_is_current (GstBdaWorker * worker)
+{
+  return g_thread_self () == worker->thread;
+}
+
+GstBdaWorkerCommand *
+gst_bda_worker_push (GstBdaWorker * worker, GstBdaWorkerFunc func,
+    gpointer data, GDestroyNotify notify, gint64 deadline)
+{
+  GstBdaWorkerCommand *command =
+      gst_bda_worker_command_new (func, data, notify, deadline);
+
+  /* One reference for the worker thread. */
+  g_atomic_int_inc (&command->refcount);
+  g_async_queue_push (worker->queue, command);
+
+  return command;
+}
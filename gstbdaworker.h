@@ -0,0 +1,75 @@
+/* GStreamer
+ * Copyright (C) 2015 Raimo Järvi <raimo.jarvi@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef __GST_BDAWORKER_H__
+#define __GST_BDAWORKER_H__
+
+#include <glib.h>
+
+/* Thread that runs device operations queued from other threads in order.
+   With DirectShow the thread is in the multithreaded COM apartment, so all
+   COM calls of an element are made from it. */
+
+typedef struct _GstBdaWorker GstBdaWorker;
+typedef struct _GstBdaWorkerCommand GstBdaWorkerCommand;
+
+typedef gboolean (*GstBdaWorkerFunc) (gpointer data);
+
+GstBdaWorker *gst_bda_worker_new (const gchar * name);
+
+/**
+ * Runs the commands still queued and stops the thread.
+ */
+void gst_bda_worker_free (GstBdaWorker * worker);
+
+/**
+ * Queues func to be called with data on the worker thread. notify is called
+ * for data when the command is freed. A command still queued at deadline in
+ * monotonic time is dropped without running, -1 runs it whenever the worker
+ * gets to it.
+ * @return command, to be unreffed by the caller
+ */
+GstBdaWorkerCommand *gst_bda_worker_push (GstBdaWorker * worker,
+    GstBdaWorkerFunc func, gpointer data, GDestroyNotify notify,
+    gint64 deadline);
+
+/**
+ * Waits for the command to complete until end_time in monotonic time, or
+ * forever if end_time is -1. A command that already started keeps running
+ * after a timeout.
+ * @return TRUE if the command completed, its return value is stored to
+ * result. FALSE on timeout or if the command was dropped.
+ */
+gboolean gst_bda_worker_command_wait (GstBdaWorkerCommand * command,
+    gint64 end_time, gboolean * result);
+
+/**
+ * @return TRUE once the command ran or was dropped, without waiting
+ */
+gboolean gst_bda_worker_command_is_done (GstBdaWorkerCommand * command);
+
+void gst_bda_worker_command_unref (GstBdaWorkerCommand * command);
+
+/**
+ * @return TRUE if called from the worker thread, where commands must be run
+ * directly instead of waiting for them
+ */
+gboolean gst_bda_worker_is_current (GstBdaWorker * worker);
+
+#endif
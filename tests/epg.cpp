@@ -0,0 +1,272 @@
+/* GStreamer
+ * Copyright (C) 2015 Raimo Järvi <raimo.jarvi@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+/* EPG test. Feeds generated streams with an EIT schedule to the collector,
+ * and checks the events it adds to the store, the completion of segmented
+ * schedules, new versions and expiry. */
+
+#include <string.h>
+#include "test.h"
+#include "gstbdaepg.h"
+
+#define PROGRAMS 4
+/* About 0.25 s at 24 Mbit/s, the SI repeats every 100 ms. */
+#define PACKETS 4000
+/* MJD 0xC079 (1993-10-13) 12:45:00 */
+#define START G_GINT64_CONSTANT (750516300)
+#define DURATION 1800
+
+/* Returns TRUE for the packet starting EIT section number of service_id,
+   the generator starts each section in a packet of its own. */
+static gboolean
+is_eit_section (const guint8 * packet, guint16 service_id, guint number)
+{
+  const guint8 *section = packet + 5;
+
+  return gst_bda_ts_pid (packet) == TEST_EIT_PID && (packet[1] & 0x40)
+      && section[0] == 0x50 && ((section[3] << 8) | section[4]) == service_id
+      && section[6] == number;
+}
+
+/* Pushes the packets of stream one at a time until the collector
+   completes, skipping those starting EIT section skip of service 1.
+   @return the number of packets pushed, or 0 if it didn't complete */
+static guint
+push_until_complete (GstBdaEpgCollector * collector, const guint8 * stream,
+    gint skip)
+{
+  for (guint i = 0; i < PACKETS; i++) {
+    const guint8 *packet = stream + i * GST_BDA_TS_PACKET_SIZE;
+    if (skip >= 0 && is_eit_section (packet, 1, skip)) {
+      continue;
+    }
+    if (gst_bda_epg_collector_push (collector, packet,
+            GST_BDA_TS_PACKET_SIZE)) {
+      return i + 1;
+    }
+  }
+
+  return 0;
+}
+
+/* Returns the events of service_id from start on. Free with
+   g_value_unset (). */
+static void
+get_events (GstBdaEpgStore * store, guint service_id, gint64 start,
+    GValue * events)
+{
+  g_value_init (events, GST_TYPE_LIST);
+  gst_bda_epg_store_get_events (store, service_id, start, 0, events);
+}
+
+static const GstStructure *
+get_event (const GValue * events, guint i)
+{
+  return gst_value_get_structure (gst_value_list_get_value (events, i));
+}
+
+/* The start time is MJD and BCD in the section, and seconds since the
+   epoch in the store. */
+static void
+test_decode (const guint8 * stream)
+{
+  for (guint i = 0; i < PACKETS; i++) {
+    const guint8 *packet = stream + i * GST_BDA_TS_PACKET_SIZE;
+    if (is_eit_section (packet, 1, 0)) {
+      /* First event after the 14 byte header. */
+      const guint8 *event = packet + 5 + 14;
+      TEST_CHECK (event[2] == 0xc0 && event[3] == 0x79);
+      TEST_CHECK (event[4] == 0x12 && event[5] == 0x45 && event[6] == 0x00);
+      TEST_CHECK (event[7] == 0x00 && event[8] == 0x30 && event[9] == 0x00);
+      break;
+    }
+  }
+
+  GstBdaEpgStore *store = gst_bda_epg_store_new ();
+  GstBdaEpgCollector *collector = gst_bda_epg_collector_new (store);
+  TEST_CHECK (push_until_complete (collector, stream, -1) > 0);
+
+  GValue events = G_VALUE_INIT;
+  get_events (store, 1, 0, &events);
+  TEST_CHECK (gst_value_list_get_size (&events) == 8);
+  for (guint i = 0; i < gst_value_list_get_size (&events); i++) {
+    const GstStructure *event = get_event (&events, i);
+    gint64 start = 0;
+    guint value = 0;
+    TEST_CHECK (gst_structure_get_int64 (event, "start", &start)
+        && start == START + i * DURATION);
+    TEST_CHECK (gst_structure_get_uint (event, "duration", &value)
+        && value == DURATION);
+    TEST_CHECK (gst_structure_get_uint (event, "event-id", &value)
+        && value == i + 1);
+    TEST_CHECK (gst_structure_get_uint (event, "running-status", &value)
+        && value == 1);
+    TEST_CHECK (gst_structure_get_uint (event, "original-network-id",
+            &value) && value == 0x2001);
+    TEST_CHECK (!g_strcmp0 (gst_structure_get_string (event, "language"),
+            "eng"));
+    gchar *title = g_strdup_printf ("Event %u", i + 1);
+    TEST_CHECK (!g_strcmp0 (gst_structure_get_string (event, "title"),
+            title));
+    g_free (title);
+    TEST_CHECK (!g_strcmp0 (gst_structure_get_string (event, "text"),
+            "Version 0"));
+  }
+  g_value_unset (&events);
+
+  gst_bda_epg_collector_free (collector);
+  gst_bda_epg_store_free (store);
+}
+
+/* The schedule completes once every service of the SDT has all of its
+   sections, and not before. */
+static void
+test_complete (const guint8 * stream)
+{
+  GstBdaEpgStore *store = gst_bda_epg_store_new ();
+  GstBdaEpgCollector *collector = gst_bda_epg_collector_new (store);
+
+  TEST_CHECK (push_until_complete (collector, stream, -1) > 0);
+  TEST_CHECK (gst_bda_epg_collector_get_events (collector) == PROGRAMS * 8);
+  TEST_CHECK (gst_bda_epg_store_get_size (store) == PROGRAMS * 8);
+  gst_bda_epg_collector_free (collector);
+
+  /* Section 9 is the first of the fourth segment. */
+  collector = gst_bda_epg_collector_new (store);
+  TEST_CHECK (push_until_complete (collector, stream, 9) == 0);
+  /* Known events are replaced, not added. */
+  TEST_CHECK (gst_bda_epg_collector_get_events (collector) == 0);
+  TEST_CHECK (gst_bda_epg_store_get_size (store) == PROGRAMS * 8);
+  gst_bda_epg_collector_free (collector);
+
+  gst_bda_epg_store_free (store);
+}
+
+/* With 4 events, segment 0 has sections 0 to 2 and segment 1 only
+   section 8, as segment_last_section_number tells. The gaps are not
+   waited for, but the sections up to segment_last are. */
+static void
+test_segment_last (const guint8 * stream)
+{
+  GstBdaEpgStore *store = gst_bda_epg_store_new ();
+  GstBdaEpgCollector *collector = gst_bda_epg_collector_new (store);
+
+  TEST_CHECK (push_until_complete (collector, stream, -1) > 0);
+  TEST_CHECK (gst_bda_epg_store_get_size (store) == PROGRAMS * 4);
+  gst_bda_epg_collector_free (collector);
+
+  collector = gst_bda_epg_collector_new (store);
+  TEST_CHECK (push_until_complete (collector, stream, 2) == 0);
+  gst_bda_epg_collector_free (collector);
+
+  collector = gst_bda_epg_collector_new (store);
+  TEST_CHECK (push_until_complete (collector, stream, 8) == 0);
+  gst_bda_epg_collector_free (collector);
+
+  gst_bda_epg_store_free (store);
+}
+
+/* A new version of the schedule is collected again and replaces the
+   events of the old one. */
+static void
+test_version_change (const guint8 * stream, const guint8 * next)
+{
+  GstBdaEpgStore *store = gst_bda_epg_store_new ();
+  GstBdaEpgCollector *collector = gst_bda_epg_collector_new (store);
+
+  TEST_CHECK (push_until_complete (collector, stream, -1) > 0);
+  /* Repetitions of the current version add nothing. */
+  TEST_CHECK (gst_bda_epg_collector_push (collector, stream,
+          PACKETS * GST_BDA_TS_PACKET_SIZE));
+  TEST_CHECK (gst_bda_epg_collector_get_events (collector) == PROGRAMS * 8);
+  TEST_CHECK (gst_bda_epg_collector_push (collector, next,
+          PACKETS * GST_BDA_TS_PACKET_SIZE));
+  TEST_CHECK (gst_bda_epg_collector_get_events (collector) == PROGRAMS * 8);
+  TEST_CHECK (gst_bda_epg_store_get_size (store) == PROGRAMS * 8);
+
+  GValue events = G_VALUE_INIT;
+  get_events (store, 0, 0, &events);
+  TEST_CHECK (gst_value_list_get_size (&events) == PROGRAMS * 8);
+  for (guint i = 0; i < gst_value_list_get_size (&events); i++) {
+    TEST_CHECK (!g_strcmp0 (gst_structure_get_string (get_event (&events,
+                    i), "text"), "Version 1"));
+  }
+  g_value_unset (&events);
+
+  gst_bda_epg_collector_free (collector);
+  gst_bda_epg_store_free (store);
+}
+
+/* Events are dropped once they have ended, and queries return the event
+   running at their start. */
+static void
+test_expire (const guint8 * stream)
+{
+  GstBdaEpgStore *store = gst_bda_epg_store_new ();
+  GstBdaEpgCollector *collector = gst_bda_epg_collector_new (store);
+  TEST_CHECK (push_until_complete (collector, stream, -1) > 0);
+  gst_bda_epg_collector_free (collector);
+
+  GValue events = G_VALUE_INIT;
+  get_events (store, 1, START + 3 * DURATION - 1, &events);
+  TEST_CHECK (gst_value_list_get_size (&events) == 6);
+  g_value_unset (&events);
+
+  /* The third event ends at the expiry time and is kept. */
+  gst_bda_epg_store_expire (store, START + 3 * DURATION);
+  TEST_CHECK (gst_bda_epg_store_get_size (store) == PROGRAMS * 6);
+  get_events (store, 1, 0, &events);
+  gint64 start = 0;
+  TEST_CHECK (gst_value_list_get_size (&events) == 6
+      && gst_structure_get_int64 (get_event (&events, 0), "start", &start)
+      && start == START + 2 * DURATION);
+  g_value_unset (&events);
+
+  gst_bda_epg_store_expire (store, START + 9 * DURATION);
+  TEST_CHECK (gst_bda_epg_store_get_size (store) == 0);
+
+  gst_bda_epg_store_free (store);
+}
+
+int
+main (int argc, char *argv[])
+{
+  gst_init (&argc, &argv);
+
+  gsize size = PACKETS * GST_BDA_TS_PACKET_SIZE;
+  guint8 *stream = test_generate ("si-interval=100,eit-start=750516300",
+      size);
+  guint8 *next =
+      test_generate ("si-interval=100,eit-start=750516300,si-version=1",
+      size);
+  guint8 *short_stream =
+      test_generate ("si-interval=100,eit-start=750516300,eit-events=4",
+      size);
+
+  test_decode (stream);
+  test_complete (stream);
+  test_segment_last (short_stream);
+  test_version_change (stream, next);
+  test_expire (stream);
+
+  g_free (short_stream);
+  g_free (next);
+  g_free (stream);
+  return test_result ();
+}
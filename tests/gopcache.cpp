@@ -0,0 +1,200 @@
+/* GStreamer
+ * Copyright (C) 2015 Raimo Järvi <raimo.jarvi@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+/* GOP cache test. Caches a generated stream of 4 programs with an IDR frame
+ * every 10 video frames, pushed in unaligned samples, and compares the
+ * cached packets with the PSI and the packets of each program since its
+ * last IDR frame in the stream. */
+
+#include <string.h>
+#include "test.h"
+#include "gstbdagopcache.h"
+
+#define PROGRAMS 4
+/* About 1.25 s at 24 Mbit/s. */
+#define PACKETS 20000
+/* Video frames between IDR frames. */
+#define GOP 10
+/* Not a multiple of the packet size, so that packets straddle samples. */
+#define CHUNK 1000
+#define MAX_SIZE (4 * 1024 * 1024)
+
+static void
+push_stream (GstBdaGopCache * cache, const guint8 * stream, gsize size)
+{
+  for (gsize i = 0; i < size; i += CHUNK) {
+    gst_bda_gop_cache_push (cache, stream + i, MIN (CHUNK, size - i));
+  }
+}
+
+/* Appends the first packet of pid with its continuity counter cleared, as
+   the cache keeps tables. */
+static void
+append_table (GByteArray * out, const guint8 * stream, guint16 pid)
+{
+  for (guint i = 0; i < PACKETS; i++) {
+    const guint8 *packet = stream + i * GST_BDA_TS_PACKET_SIZE;
+    if (gst_bda_ts_pid (packet) == pid) {
+      guint8 table[GST_BDA_TS_PACKET_SIZE];
+      memcpy (table, packet, GST_BDA_TS_PACKET_SIZE);
+      table[3] &= 0xf0;
+      g_byte_array_append (out, table, GST_BDA_TS_PACKET_SIZE);
+      return;
+    }
+  }
+}
+
+/* Builds the expected cache content of the first packets of stream: the PAT
+   and PMTs, then the packets of each program from the start of its last
+   IDR frame. */
+static GByteArray *
+expected_packets (const guint8 * stream, guint packets)
+{
+  GByteArray *out = g_byte_array_new ();
+  guint frames[PROGRAMS] = { };
+  gint last_idr[PROGRAMS];
+
+  append_table (out, stream, TEST_PAT_PID);
+  for (guint p = 0; p < PROGRAMS; p++) {
+    append_table (out, stream, TEST_PMT_PID (p));
+    last_idr[p] = -1;
+  }
+
+  for (guint i = 0; i < packets; i++) {
+    const guint8 *packet = stream + i * GST_BDA_TS_PACKET_SIZE;
+    for (guint p = 0; p < PROGRAMS; p++) {
+      if (gst_bda_ts_pid (packet) == TEST_ES_PID (p, 0)
+          && gst_bda_ts_pusi (packet) && frames[p]++ % GOP == 0) {
+        last_idr[p] = i;
+      }
+    }
+  }
+
+  for (guint p = 0; p < PROGRAMS; p++) {
+    if (last_idr[p] < 0) {
+      continue;
+    }
+    for (guint i = last_idr[p]; i < packets; i++) {
+      const guint8 *packet = stream + i * GST_BDA_TS_PACKET_SIZE;
+      guint16 pid = gst_bda_ts_pid (packet);
+      if (pid == TEST_ES_PID (p, 0) || pid == TEST_ES_PID (p, 1)) {
+        g_byte_array_append (out, packet, GST_BDA_TS_PACKET_SIZE);
+      }
+    }
+  }
+  return out;
+}
+
+static gboolean
+bytes_equal (GBytes * bytes, GByteArray * expected)
+{
+  gsize size;
+  const guint8 *data = (const guint8 *) g_bytes_get_data (bytes, &size);
+
+  return size == expected->len && !memcmp (data, expected->data, size);
+}
+
+/* The cache holds the PSI and each program since its last IDR frame, at
+   any point of the stream. */
+static void
+test_cache (const guint8 * stream)
+{
+  GstBdaGopCache *cache = gst_bda_gop_cache_new (MAX_SIZE);
+
+  /* Only the PAT and PMTs, no random access point yet. */
+  push_stream (cache, stream, (1 + PROGRAMS) * GST_BDA_TS_PACKET_SIZE);
+  TEST_CHECK (gst_bda_gop_cache_get_packets (cache) == NULL);
+
+  guint pushed = 1 + PROGRAMS;
+  guint points[] = { PACKETS / 4, PACKETS / 2, PACKETS };
+  for (guint i = 0; i < G_N_ELEMENTS (points); i++) {
+    push_stream (cache, stream + pushed * GST_BDA_TS_PACKET_SIZE,
+        (points[i] - pushed) * GST_BDA_TS_PACKET_SIZE);
+    pushed = points[i];
+
+    GBytes *bytes = gst_bda_gop_cache_get_packets (cache);
+    GByteArray *expected = expected_packets (stream, pushed);
+    TEST_CHECK (bytes != NULL);
+    if (bytes) {
+      TEST_CHECK (bytes_equal (bytes, expected));
+      g_bytes_unref (bytes);
+    }
+    g_byte_array_free (expected, TRUE);
+  }
+
+  gst_bda_gop_cache_free (cache);
+}
+
+/* A clear drops the programs until their next random access point, but
+   keeps the PSI. */
+static void
+test_clear (const guint8 * stream)
+{
+  GstBdaGopCache *cache = gst_bda_gop_cache_new (MAX_SIZE);
+
+  push_stream (cache, stream, PACKETS / 2 * GST_BDA_TS_PACKET_SIZE);
+  gst_bda_gop_cache_clear (cache);
+  TEST_CHECK (gst_bda_gop_cache_get_packets (cache) == NULL);
+
+  push_stream (cache, stream + PACKETS / 2 * GST_BDA_TS_PACKET_SIZE,
+      (PACKETS - PACKETS / 2) * GST_BDA_TS_PACKET_SIZE);
+  GBytes *bytes = gst_bda_gop_cache_get_packets (cache);
+  TEST_CHECK (bytes != NULL);
+  if (bytes) {
+    gsize size;
+    const guint8 *data = (const guint8 *) g_bytes_get_data (bytes, &size);
+    TEST_CHECK (size > (1 + PROGRAMS) * GST_BDA_TS_PACKET_SIZE);
+    TEST_CHECK (gst_bda_ts_pid (data) == TEST_PAT_PID);
+    for (guint p = 0; p < PROGRAMS; p++) {
+      TEST_CHECK (gst_bda_ts_pid (data + (1 + p) * GST_BDA_TS_PACKET_SIZE)
+          == TEST_PMT_PID (p));
+    }
+    g_bytes_unref (bytes);
+  }
+
+  gst_bda_gop_cache_free (cache);
+}
+
+/* Programs whose packets since their last random access point don't fit
+   aren't cached. */
+static void
+test_max_size (const guint8 * stream)
+{
+  GstBdaGopCache *cache = gst_bda_gop_cache_new (16 *
+      GST_BDA_TS_PACKET_SIZE);
+
+  push_stream (cache, stream, PACKETS * GST_BDA_TS_PACKET_SIZE);
+  TEST_CHECK (gst_bda_gop_cache_get_packets (cache) == NULL);
+
+  gst_bda_gop_cache_free (cache);
+}
+
+int
+main (void)
+{
+  guint8 *stream = test_generate ("gop=10",
+      PACKETS * GST_BDA_TS_PACKET_SIZE);
+
+  test_cache (stream);
+  test_clear (stream);
+  test_max_size (stream);
+
+  g_free (stream);
+  return test_result ();
+}
@@ -0,0 +1,200 @@
+/* GStreamer
+ * Copyright (C) 2015 Raimo Järvi <raimo.jarvi@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+/* Keyframe scanner test. Scans a generated stream of 4 programs with an
+ * IDR frame every 10 video frames, and checks the random access points
+ * found against the frames the generator wrote, and that the keyframe meta
+ * follows its packet when a buffer is split. */
+
+#include "test.h"
+#include "gstbdakeyframe.h"
+
+#define PROGRAMS 4
+/* About 1.25 s at 24 Mbit/s. */
+#define PACKETS 20000
+/* Video frames between IDR frames. */
+#define GOP 10
+/* Samples of 7 packets, as from a DVB tuner. */
+#define CHUNK (7 * GST_BDA_TS_PACKET_SIZE)
+
+/* Returns the program of a video PID, or -1. */
+static gint
+video_program (guint16 pid)
+{
+  for (guint i = 0; i < PROGRAMS; i++) {
+    if (pid == TEST_ES_PID (i, 0)) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+/* Marks the packets starting an IDR frame, the first of every GOP frames
+   of each video stream. */
+static gboolean *
+find_idr_packets (const guint8 * stream, guint packets)
+{
+  gboolean *idr = g_new0 (gboolean, packets);
+  guint frames[PROGRAMS] = { };
+
+  for (guint i = 0; i < packets; i++) {
+    const guint8 *packet = stream + i * GST_BDA_TS_PACKET_SIZE;
+    gint program = video_program (gst_bda_ts_pid (packet));
+    if (program >= 0 && gst_bda_ts_pusi (packet)) {
+      idr[i] = frames[program]++ % GOP == 0;
+    }
+  }
+  return idr;
+}
+
+/* Scanned a packet at a time, exactly the IDR packets are found. */
+static void
+test_packets (const guint8 * stream, const gboolean * idr)
+{
+  GstBdaKeyframeScanner *scanner = gst_bda_keyframe_scanner_new ();
+  guint found = 0, expected = 0, wrong = 0;
+
+  for (guint i = 0; i < PACKETS; i++) {
+    const guint8 *packet = stream + i * GST_BDA_TS_PACKET_SIZE;
+    guint16 pid = GST_BDA_TS_NULL_PID;
+    gssize offset = gst_bda_keyframe_scanner_scan (scanner, packet,
+        GST_BDA_TS_PACKET_SIZE, &pid);
+    if (offset >= 0) {
+      found++;
+      if (!idr[i] || offset != 0 || pid != gst_bda_ts_pid (packet)) {
+        wrong++;
+      }
+    } else if (idr[i]) {
+      wrong++;
+    }
+    if (idr[i]) {
+      expected++;
+    }
+  }
+
+  /* More than the first IDR of each program. */
+  TEST_CHECK (expected > PROGRAMS);
+  TEST_CHECK (found == expected);
+  TEST_CHECK (wrong == 0);
+
+  gst_bda_keyframe_scanner_free (scanner);
+}
+
+/* Scanned in samples, the first IDR packet of each sample is found. */
+static void
+test_chunks (const guint8 * stream, const gboolean * idr)
+{
+  GstBdaKeyframeScanner *scanner = gst_bda_keyframe_scanner_new ();
+  gsize size = PACKETS * GST_BDA_TS_PACKET_SIZE;
+  guint wrong = 0;
+
+  for (gsize i = 0; i < size; i += CHUNK) {
+    gsize n = MIN (CHUNK, size - i);
+    guint16 pid = GST_BDA_TS_NULL_PID;
+    gssize offset = gst_bda_keyframe_scanner_scan (scanner, stream + i, n,
+        &pid);
+
+    gssize expected = -1;
+    for (gsize j = 0; j < n; j += GST_BDA_TS_PACKET_SIZE) {
+      if (idr[(i + j) / GST_BDA_TS_PACKET_SIZE]) {
+        expected = j;
+        break;
+      }
+    }
+    if (offset != expected || (offset >= 0
+            && pid != gst_bda_ts_pid (stream + i + offset))) {
+      wrong++;
+    }
+  }
+  TEST_CHECK (wrong == 0);
+
+  gst_bda_keyframe_scanner_free (scanner);
+}
+
+/* Video streams are only known once the PAT and PMTs are seen. */
+static void
+test_no_psi (const guint8 * stream, const gboolean * idr)
+{
+  GstBdaKeyframeScanner *scanner = gst_bda_keyframe_scanner_new ();
+  guint found = 0;
+
+  for (guint i = 0; i < PACKETS; i++) {
+    if (idr[i]) {
+      guint16 pid;
+      if (gst_bda_keyframe_scanner_scan (scanner,
+              stream + i * GST_BDA_TS_PACKET_SIZE, GST_BDA_TS_PACKET_SIZE,
+              &pid) >= 0) {
+        found++;
+      }
+    }
+  }
+  TEST_CHECK (found == 0);
+
+  gst_bda_keyframe_scanner_free (scanner);
+}
+
+/* A copied region keeps the meta only if it contains the random access
+   point, at an offset relative to the region. */
+static void
+test_meta (void)
+{
+  GstBuffer *buffer = gst_buffer_new_allocate (NULL,
+      4 * GST_BDA_TS_PACKET_SIZE, NULL);
+  gst_buffer_add_bda_keyframe_meta (buffer, 2 * GST_BDA_TS_PACKET_SIZE,
+      TEST_ES_PID (0, 0));
+
+  GstBdaKeyframeMeta *meta = gst_buffer_get_bda_keyframe_meta (buffer);
+  TEST_CHECK (meta && meta->offset == 2 * GST_BDA_TS_PACKET_SIZE
+      && meta->pid == TEST_ES_PID (0, 0));
+
+  GstBuffer *tail = gst_buffer_copy_region (buffer,
+      (GstBufferCopyFlags) (GST_BUFFER_COPY_MEMORY | GST_BUFFER_COPY_META),
+      GST_BDA_TS_PACKET_SIZE, 3 * GST_BDA_TS_PACKET_SIZE);
+  meta = gst_buffer_get_bda_keyframe_meta (tail);
+  TEST_CHECK (meta && meta->offset == GST_BDA_TS_PACKET_SIZE
+      && meta->pid == TEST_ES_PID (0, 0));
+
+  GstBuffer *head = gst_buffer_copy_region (buffer,
+      (GstBufferCopyFlags) (GST_BUFFER_COPY_MEMORY | GST_BUFFER_COPY_META),
+      0, 2 * GST_BDA_TS_PACKET_SIZE);
+  TEST_CHECK (gst_buffer_get_bda_keyframe_meta (head) == NULL);
+
+  gst_buffer_unref (head);
+  gst_buffer_unref (tail);
+  gst_buffer_unref (buffer);
+}
+
+int
+main (int argc, char *argv[])
+{
+  gst_init (&argc, &argv);
+
+  gsize size = PACKETS * GST_BDA_TS_PACKET_SIZE;
+  guint8 *stream = test_generate ("gop=10", size);
+  gboolean *idr = find_idr_packets (stream, PACKETS);
+
+  test_packets (stream, idr);
+  test_chunks (stream, idr);
+  test_no_psi (stream, idr);
+  test_meta ();
+
+  g_free (idr);
+  g_free (stream);
+  return test_result ();
+}
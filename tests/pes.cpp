@@ -0,0 +1,279 @@
+/* GStreamer
+ * Copyright (C) 2015 Raimo Järvi <raimo.jarvi@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+/* PES demux test. Reassembles the video and audio of the first program of
+ * a generated stream from unaligned samples, and checks the caps, the
+ * frame headers and the timestamps of the PES packets against the ones the
+ * generator wrote. */
+
+#include <string.h>
+#include "test.h"
+#include "gstbdapes.h"
+
+/* About 1.25 s at 24 Mbit/s, 31 video frames. */
+#define PACKETS 20000
+/* Not a multiple of the packet size, so that packets straddle samples. */
+#define CHUNK 1000
+/* Video frames between IDR frames. */
+#define GOP 25
+
+#define VIDEO_PID TEST_ES_PID (0, 0)
+#define AUDIO_PID TEST_ES_PID (0, 1)
+
+typedef struct _PesStream PesStream;
+
+struct _PesStream {
+  guint buffers;
+  guint discont;
+  /* Buffers not starting with the frame header of the stream. */
+  guint invalid;
+  GstClockTime first_pts;
+  GstClockTime last_pts;
+  /* PTS not after the previous one. */
+  guint backwards;
+};
+
+typedef struct _PesResult PesResult;
+
+struct _PesResult {
+  PesStream video;
+  PesStream audio;
+  guint other;
+};
+
+/* The generator starts each video frame with an access unit delimiter,
+   followed by an IDR slice every GOP frames. */
+static gboolean
+is_video_frame (const guint8 * data, gsize size, guint frame)
+{
+  static const guint8 aud[] = { 0, 0, 0, 1, 0x09 };
+  static const guint8 slice[] = { 0, 0, 0, 1 };
+
+  return size >= 11 && !memcmp (data, aud, sizeof (aud))
+      && !memcmp (data + 6, slice, sizeof (slice))
+      && data[10] == (frame % GOP == 0 ? 0x65 : 0x41);
+}
+
+/* MPEG-1 layer II frame header. */
+static gboolean
+is_audio_frame (const guint8 * data, gsize size)
+{
+  return size >= 4 && data[0] == 0xff && data[1] == 0xfd;
+}
+
+static void
+pes_received (guint16 pid, GstBuffer * buffer, gpointer user_data)
+{
+  PesResult *result = (PesResult *) user_data;
+  PesStream *stream;
+
+  if (pid == VIDEO_PID) {
+    stream = &result->video;
+  } else if (pid == AUDIO_PID) {
+    stream = &result->audio;
+  } else {
+    result->other++;
+    gst_buffer_unref (buffer);
+    return;
+  }
+
+  GstMapInfo map;
+  gst_buffer_map (buffer, &map, GST_MAP_READ);
+  gboolean valid = pid == VIDEO_PID ?
+      is_video_frame (map.data, map.size, stream->buffers) :
+      is_audio_frame (map.data, map.size);
+  gst_buffer_unmap (buffer, &map);
+  if (!valid) {
+    stream->invalid++;
+  }
+
+  GstClockTime pts = GST_BUFFER_PTS (buffer);
+  if (stream->buffers == 0) {
+    stream->first_pts = pts;
+  } else if (!GST_CLOCK_TIME_IS_VALID (pts) || pts <= stream->last_pts) {
+    stream->backwards++;
+  }
+  stream->last_pts = pts;
+  if (GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DISCONT)) {
+    stream->discont++;
+  }
+  stream->buffers++;
+
+  gst_buffer_unref (buffer);
+}
+
+/* Counts the PES packets started on pid. */
+static guint
+count_pes_starts (const guint8 * data, gsize size, guint16 pid)
+{
+  guint count = 0;
+
+  for (gsize i = 0; i + GST_BDA_TS_PACKET_SIZE <= size;
+      i += GST_BDA_TS_PACKET_SIZE) {
+    if (gst_bda_ts_pid (data + i) == pid && gst_bda_ts_pusi (data + i)) {
+      count++;
+    }
+  }
+  return count;
+}
+
+static void
+demux_stream (GstBdaPesDemux * demux, const guint8 * stream, gsize size)
+{
+  for (gsize i = 0; i < size; i += CHUNK) {
+    gsize n = MIN (CHUNK, size - i);
+    GstBuffer *buffer = gst_buffer_new_allocate (NULL, n, NULL);
+    gst_buffer_fill (buffer, 0, stream + i, n);
+    gst_bda_pes_demux_push (demux, buffer);
+    gst_buffer_unref (buffer);
+  }
+}
+
+static void
+check_caps (GstBdaPesDemux * demux)
+{
+  GstCaps *caps = gst_bda_pes_demux_get_caps (demux, VIDEO_PID);
+  TEST_CHECK (caps != NULL);
+  if (caps) {
+    GstStructure *s = gst_caps_get_structure (caps, 0);
+    TEST_CHECK (gst_structure_has_name (s, "video/x-h264"));
+    gst_caps_unref (caps);
+  }
+
+  caps = gst_bda_pes_demux_get_caps (demux, AUDIO_PID);
+  TEST_CHECK (caps != NULL);
+  if (caps) {
+    GstStructure *s = gst_caps_get_structure (caps, 0);
+    gint version = 0;
+    TEST_CHECK (gst_structure_has_name (s, "audio/mpeg"));
+    TEST_CHECK (gst_structure_get_int (s, "mpegversion", &version)
+        && version == 1);
+    gst_caps_unref (caps);
+  }
+
+  TEST_CHECK (gst_bda_pes_demux_get_program (demux, VIDEO_PID) ==
+      TEST_PMT_PID (0));
+  TEST_CHECK (gst_bda_pes_demux_get_program (demux, AUDIO_PID) ==
+      TEST_PMT_PID (0));
+}
+
+/* Every PES packet is passed on intact with increasing timestamps. */
+static void
+test_demux (const guint8 * stream, gsize size)
+{
+  PesResult result = { };
+  GstBdaPesDemux *demux = gst_bda_pes_demux_new (pes_received, &result);
+
+  gst_bda_pes_demux_add_pid (demux, VIDEO_PID);
+  gst_bda_pes_demux_add_pid (demux, AUDIO_PID);
+  /* Not listed by any PMT. */
+  gst_bda_pes_demux_add_pid (demux, TEST_ES_PID (0, 2));
+  demux_stream (demux, stream, size);
+  check_caps (demux);
+  TEST_CHECK (gst_bda_pes_demux_get_caps (demux, TEST_ES_PID (0, 2)) ==
+      NULL);
+
+  /* Video PES packets are unbounded and end at the start of the next
+     one, audio ones end with their length. */
+  guint video = count_pes_starts (stream, size, VIDEO_PID);
+  guint audio = count_pes_starts (stream, size, AUDIO_PID);
+  TEST_CHECK (video > GOP);
+  TEST_CHECK (result.video.buffers == video - 1);
+  TEST_CHECK (result.audio.buffers + 1 >= audio
+      && result.audio.buffers <= audio);
+  TEST_CHECK (result.other == 0);
+
+  TEST_CHECK (result.video.invalid == 0);
+  TEST_CHECK (result.audio.invalid == 0);
+  TEST_CHECK (result.video.backwards == 0);
+  TEST_CHECK (result.audio.backwards == 0);
+  /* Only the first buffer of each PID is a discontinuity. */
+  TEST_CHECK (result.video.discont == 1);
+  TEST_CHECK (result.audio.discont == 1);
+  /* PTS runs 0.5 s ahead of the PCR, which starts at 0. */
+  TEST_CHECK (result.video.first_pts >= GST_SECOND / 2
+      && result.video.first_pts < GST_SECOND / 2 + 100 * GST_MSECOND);
+  TEST_CHECK (result.video.last_pts - result.video.first_pts >
+      GST_SECOND / 2);
+
+  gst_bda_pes_demux_free (demux);
+}
+
+/* PES packets that lost packets are dropped, and the next one of the PID
+   is marked as a discontinuity. */
+static void
+test_continuity_errors (void)
+{
+  gsize size = PACKETS * GST_BDA_TS_PACKET_SIZE;
+  guint8 *stream = test_generate ("cc-errors=0.002", size);
+  PesResult result = { };
+  GstBdaPesDemux *demux = gst_bda_pes_demux_new (pes_received, &result);
+
+  gst_bda_pes_demux_add_pid (demux, VIDEO_PID);
+  demux_stream (demux, stream, size);
+
+  TEST_CHECK (result.video.buffers > 0);
+  TEST_CHECK (result.video.buffers < count_pes_starts (stream, size,
+          VIDEO_PID) - 1);
+  TEST_CHECK (result.video.discont > 1);
+  TEST_CHECK (result.video.backwards == 0);
+  TEST_CHECK (result.audio.buffers == 0);
+
+  gst_bda_pes_demux_free (demux);
+  g_free (stream);
+}
+
+/* A reset forgets the PMTs, so PES packets are passed on again only after
+   the next repetition of the PSI. */
+static void
+test_reset (const guint8 * stream, gsize size)
+{
+  PesResult result = { };
+  GstBdaPesDemux *demux = gst_bda_pes_demux_new (pes_received, &result);
+
+  gst_bda_pes_demux_add_pid (demux, VIDEO_PID);
+  gst_bda_pes_demux_add_pid (demux, AUDIO_PID);
+  demux_stream (demux, stream, size / 2);
+  gst_bda_pes_demux_reset (demux);
+  TEST_CHECK (gst_bda_pes_demux_get_caps (demux, VIDEO_PID) == NULL);
+  TEST_CHECK (gst_bda_pes_demux_get_program (demux, VIDEO_PID) == 0);
+
+  guint before = result.video.buffers;
+  demux_stream (demux, stream + size / 2, size - size / 2);
+  TEST_CHECK (result.video.buffers > before);
+  check_caps (demux);
+
+  gst_bda_pes_demux_free (demux);
+}
+
+int
+main (int argc, char *argv[])
+{
+  gst_init (&argc, &argv);
+
+  gsize size = PACKETS * GST_BDA_TS_PACKET_SIZE;
+  guint8 *stream = test_generate ("gop=25", size);
+
+  test_demux (stream, size);
+  test_continuity_errors ();
+  test_reset (stream, size);
+
+  g_free (stream);
+  return test_result ();
+}
@@ -0,0 +1,291 @@
+/* GStreamer
+ * Copyright (C) 2015 Raimo Järvi <raimo.jarvi@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+/* PSI cache test. Collects the PAT and PMTs of generated streams, and
+ * round trips them through the process cache and a key file. */
+
+#include <string.h>
+#include <unistd.h>
+#include <glib/gstdio.h>
+#include "test.h"
+#include "gstbdapsicache.h"
+
+#define PROGRAMS 4
+/* About 0.25 s at 24 Mbit/s, three repetitions of the PSI. */
+#define PACKETS 4000
+
+/* Returns the first PSI repetition of stream with the continuity counters
+   cleared, as the collector keeps it. */
+static GBytes *
+first_psi (const guint8 * stream, guint programs)
+{
+  gsize size = (1 + programs) * GST_BDA_TS_PACKET_SIZE;
+  guint8 *packets = (guint8 *) g_malloc (size);
+
+  memcpy (packets, stream, size);
+  for (guint i = 0; i < 1 + programs; i++) {
+    packets[i * GST_BDA_TS_PACKET_SIZE + 3] &= 0xf0;
+  }
+  return g_bytes_new_take (packets, size);
+}
+
+static void
+test_get_section (const guint8 * stream)
+{
+  guint8 packet[GST_BDA_TS_PACKET_SIZE];
+  gsize size = 0;
+
+  /* The generator starts with the PAT. */
+  const guint8 *section = gst_bda_psi_get_section (stream, &size);
+  TEST_CHECK (section != NULL);
+  TEST_CHECK (section && section[0] == 0x00 && size == 8 + PROGRAMS * 4 + 4);
+
+  section = gst_bda_psi_get_section (stream + GST_BDA_TS_PACKET_SIZE, &size);
+  TEST_CHECK (section && section[0] == 0x02);
+
+  /* A corrupt section fails its CRC check. */
+  memcpy (packet, stream, GST_BDA_TS_PACKET_SIZE);
+  packet[12] ^= 0x01;
+  TEST_CHECK (gst_bda_psi_get_section (packet, &size) == NULL);
+
+  /* So does a packet with the transport error indicator set. */
+  memcpy (packet, stream, GST_BDA_TS_PACKET_SIZE);
+  packet[1] |= 0x80;
+  TEST_CHECK (gst_bda_psi_get_section (packet, &size) == NULL);
+
+  /* A PES packet doesn't start a section. */
+  guint elementary = 0;
+  for (guint i = 0; i < PACKETS; i++) {
+    const guint8 *p = stream + i * GST_BDA_TS_PACKET_SIZE;
+    guint16 pid = gst_bda_ts_pid (p);
+    if (pid >= TEST_ES_PID (0, 0) && pid < TEST_PMT_PID (0)
+        && gst_bda_ts_pusi (p)) {
+      TEST_CHECK (gst_bda_psi_get_section (p, &size) == NULL);
+      elementary++;
+    }
+  }
+  TEST_CHECK (elementary > 0);
+}
+
+/* The collector completes with the last PMT of the first repetition. */
+static void
+test_collect (const guint8 * stream)
+{
+  GstBdaPsiCollector *collector = gst_bda_psi_collector_new ();
+  gint complete = -1;
+
+  for (guint i = 0; i < PACKETS && complete < 0; i++) {
+    if (gst_bda_psi_collector_push (collector,
+            stream + i * GST_BDA_TS_PACKET_SIZE, GST_BDA_TS_PACKET_SIZE)) {
+      complete = i;
+    }
+  }
+  TEST_CHECK (complete == PROGRAMS);
+
+  GBytes *packets = gst_bda_psi_collector_get_packets (collector);
+  GBytes *expected = first_psi (stream, PROGRAMS);
+  TEST_CHECK (g_bytes_equal (packets, expected));
+  g_bytes_unref (expected);
+  g_bytes_unref (packets);
+
+  gst_bda_psi_collector_free (collector);
+}
+
+/* Starting after the PAT, PMTs are only collected once a PAT lists them. */
+static void
+test_collect_late (const guint8 * stream)
+{
+  GstBdaPsiCollector *collector = gst_bda_psi_collector_new ();
+
+  /* The next repetition, the PAT followed by the PMTs. */
+  guint pat = 1;
+  while (pat < PACKETS
+      && gst_bda_ts_pid (stream + pat * GST_BDA_TS_PACKET_SIZE) !=
+      TEST_PAT_PID) {
+    pat++;
+  }
+  TEST_CHECK (pat + PROGRAMS < PACKETS);
+
+  /* The PMTs of the first repetition are ignored, and the collector
+     completes only with the last PMT of the next one. */
+  TEST_CHECK (!gst_bda_psi_collector_push (collector,
+          stream + GST_BDA_TS_PACKET_SIZE,
+          (pat + PROGRAMS - 1) * GST_BDA_TS_PACKET_SIZE));
+  TEST_CHECK (gst_bda_psi_collector_push (collector,
+          stream + (pat + PROGRAMS) * GST_BDA_TS_PACKET_SIZE,
+          GST_BDA_TS_PACKET_SIZE));
+
+  gst_bda_psi_collector_free (collector);
+}
+
+/* A new PAT replaces the programs, e.g. after tuning. */
+static void
+test_collect_new_pat (const guint8 * stream)
+{
+  guint8 *other = test_generate ("programs=2", PACKETS *
+      GST_BDA_TS_PACKET_SIZE);
+  GstBdaPsiCollector *collector = gst_bda_psi_collector_new ();
+
+  TEST_CHECK (gst_bda_psi_collector_push (collector, stream,
+          PACKETS * GST_BDA_TS_PACKET_SIZE));
+  TEST_CHECK (gst_bda_psi_collector_push (collector, other,
+          PACKETS * GST_BDA_TS_PACKET_SIZE));
+
+  GBytes *packets = gst_bda_psi_collector_get_packets (collector);
+  GBytes *expected = first_psi (other, 2);
+  TEST_CHECK (g_bytes_equal (packets, expected));
+  g_bytes_unref (expected);
+  g_bytes_unref (packets);
+
+  gst_bda_psi_collector_free (collector);
+  g_free (other);
+}
+
+static gchar *
+temp_location (void)
+{
+  gchar *location;
+  gint fd = g_file_open_tmp ("bdapsi-XXXXXX.ini", &location, NULL);
+  if (fd < 0) {
+    g_error ("Unable to create a temporary file");
+  }
+  close (fd);
+  return location;
+}
+
+/* Packets are stored for the process, and persisted to and loaded from a
+   key file. */
+static void
+test_cache (const guint8 * stream)
+{
+  GBytes *packets = first_psi (stream, PROGRAMS);
+
+  TEST_CHECK (gst_bda_psi_cache_lookup (NULL, "dvb-t:1") == NULL);
+  TEST_CHECK (gst_bda_psi_cache_store ("dvb-t:1", packets));
+  /* Storing the same packets again needs no saving. */
+  TEST_CHECK (!gst_bda_psi_cache_store ("dvb-t:1", packets));
+  GBytes *cached = gst_bda_psi_cache_lookup (NULL, "dvb-t:1");
+  TEST_CHECK (cached && g_bytes_equal (cached, packets));
+  if (cached) {
+    g_bytes_unref (cached);
+  }
+
+  /* Persisted as base64 in a group per transponder. */
+  gchar *location = temp_location ();
+  TEST_CHECK (gst_bda_psi_cache_store ("dvb-t:2", packets));
+  TEST_CHECK (gst_bda_psi_cache_save (location, "dvb-t:2"));
+  GKeyFile *key_file = g_key_file_new ();
+  TEST_CHECK (g_key_file_load_from_file (key_file, location,
+          G_KEY_FILE_NONE, NULL));
+  gchar *encoded = g_key_file_get_string (key_file, "dvb-t:2", "packets",
+      NULL);
+  TEST_CHECK (encoded != NULL);
+  if (encoded) {
+    gsize size;
+    guchar *data = g_base64_decode (encoded, &size);
+    GBytes *saved = g_bytes_new_take (data, size);
+    TEST_CHECK (g_bytes_equal (saved, packets));
+    g_bytes_unref (saved);
+    g_free (encoded);
+  }
+  g_key_file_free (key_file);
+  g_unlink (location);
+  g_free (location);
+
+  /* Loaded from a key file written by another process. Packets of the
+     wrong size are ignored. */
+  location = temp_location ();
+  key_file = g_key_file_new ();
+  gsize size;
+  const guchar *data = (const guchar *) g_bytes_get_data (packets, &size);
+  encoded = g_base64_encode (data, size);
+  g_key_file_set_string (key_file, "dvb-t:3", "packets", encoded);
+  g_free (encoded);
+  encoded = g_base64_encode (data, size - 1);
+  g_key_file_set_string (key_file, "dvb-t:4", "packets", encoded);
+  g_free (encoded);
+  TEST_CHECK (g_key_file_save_to_file (key_file, location, NULL));
+  g_key_file_free (key_file);
+
+  cached = gst_bda_psi_cache_lookup (location, "dvb-t:3");
+  TEST_CHECK (cached && g_bytes_equal (cached, packets));
+  if (cached) {
+    g_bytes_unref (cached);
+  }
+  TEST_CHECK (gst_bda_psi_cache_lookup (location, "dvb-t:4") == NULL);
+  g_unlink (location);
+  g_free (location);
+
+  g_bytes_unref (packets);
+}
+
+static void
+count_packets (const guint8 * packets, gsize size, gpointer user_data)
+{
+  GByteArray *aligned = (GByteArray *) user_data;
+
+  TEST_CHECK (size % GST_BDA_TS_PACKET_SIZE == 0);
+  g_byte_array_append (aligned, packets, size);
+}
+
+/* Samples of odd sizes are joined back into whole packets. */
+static void
+test_align (const guint8 * stream)
+{
+  GstBdaTsAligner aligner = { };
+  GByteArray *aligned = g_byte_array_new ();
+  gsize size = 64 * GST_BDA_TS_PACKET_SIZE;
+  gsize offset = 0;
+
+  for (gsize chunk = 1; offset < size; chunk = chunk * 7 % 1000 + 1) {
+    chunk = MIN (chunk, size - offset);
+    gst_bda_ts_align (&aligner, stream + offset, chunk, count_packets,
+        aligned);
+    offset += chunk;
+  }
+  TEST_CHECK (aligned->len == size);
+  TEST_CHECK (memcmp (aligned->data, stream, size) == 0);
+
+  /* A sample that doesn't start with a sync byte is resynced. */
+  g_byte_array_set_size (aligned, 0);
+  gst_bda_ts_aligner_reset (&aligner);
+  gst_bda_ts_align (&aligner, stream + 5, 4 * GST_BDA_TS_PACKET_SIZE - 5,
+      count_packets, aligned);
+  TEST_CHECK (aligned->len == 3 * GST_BDA_TS_PACKET_SIZE);
+  TEST_CHECK (memcmp (aligned->data, stream + GST_BDA_TS_PACKET_SIZE,
+          aligned->len) == 0);
+
+  g_byte_array_unref (aligned);
+}
+
+int
+main (void)
+{
+  guint8 *stream = test_generate (NULL, PACKETS * GST_BDA_TS_PACKET_SIZE);
+
+  test_get_section (stream);
+  test_collect (stream);
+  test_collect_late (stream);
+  test_collect_new_pat (stream);
+  test_cache (stream);
+  test_align (stream);
+
+  g_free (stream);
+  return test_result ();
+}
@@ -0,0 +1,278 @@
+/* GStreamer
+ * Copyright (C) 2015 Raimo Järvi <raimo.jarvi@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+/* Replay backend test. Replays generated streams with bdasrc ! fakesink
+ * and checks the samples the backend delivers to
+ * GstBdaSrc::sample_received: their sizes and data, looping, and the time
+ * each pacing mode takes. */
+
+#include <string.h>
+#include <unistd.h>
+#include <glib/gstdio.h>
+#include "test.h"
+#include "gstbdasrc.h"
+
+#define BITRATE 8000000
+/* About 0.5 s at BITRATE. */
+#define PACKETS 2660
+#define SIZE (PACKETS * GST_BDA_TS_PACKET_SIZE)
+#define CHUNK_SIZE (348 * GST_BDA_TS_PACKET_SIZE)
+/* Time a paced replay takes after its first sample, in us. */
+#define PACED_TIME ((gint64) (SIZE - CHUNK_SIZE) * 8 * G_USEC_PER_SEC / BITRATE)
+#define TIMEOUT (10 * GST_SECOND)
+
+typedef struct _Recorder Recorder;
+
+/* Samples delivered by the backend. */
+struct _Recorder {
+  void (*sample_received) (GstBdaSrc * src, gpointer data, gsize size);
+  GMutex lock;
+  GByteArray *data;
+  GArray *sizes;
+  gint64 first;
+  gint64 last;
+};
+
+static GQuark
+recorder_quark (void)
+{
+  static GQuark quark = 0;
+
+  if (!quark) {
+    quark = g_quark_from_static_string ("test-recorder");
+  }
+  return quark;
+}
+
+static void
+record_sample (GstBdaSrc * src, gpointer data, gsize size)
+{
+  Recorder *recorder =
+      (Recorder *) g_object_get_qdata (G_OBJECT (src), recorder_quark ());
+  gint64 now = g_get_monotonic_time ();
+
+  g_mutex_lock (&recorder->lock);
+  if (recorder->sizes->len == 0) {
+    recorder->first = now;
+  }
+  recorder->last = now;
+  g_byte_array_append (recorder->data, (const guint8 *) data, size);
+  g_array_append_val (recorder->sizes, size);
+  g_mutex_unlock (&recorder->lock);
+
+  recorder->sample_received (src, data, size);
+}
+
+static void
+recorder_free (Recorder * recorder)
+{
+  g_byte_array_free (recorder->data, TRUE);
+  g_array_free (recorder->sizes, TRUE);
+  g_mutex_clear (&recorder->lock);
+  g_free (recorder);
+}
+
+static gchar *
+write_stream (const guint8 * data, gsize size)
+{
+  gchar *location;
+  gint fd = g_file_open_tmp ("bdareplay-XXXXXX.ts", &location, NULL);
+  if (fd < 0) {
+    g_error ("Unable to create a temporary file");
+  }
+  close (fd);
+  if (!g_file_set_contents (location, (const gchar *) data, size, NULL)) {
+    g_error ("Unable to write '%s'", location);
+  }
+
+  return location;
+}
+
+/* Replays location until the end of the stream, or with loop until
+   loop_size bytes are delivered. */
+static Recorder *
+replay (const gchar * location, GstBdaPacing pacing, guint bitrate,
+    gsize loop_size)
+{
+  GstElement *pipeline = gst_pipeline_new (NULL);
+  GstElement *src = gst_element_factory_make ("bdasrc", NULL);
+  GstElement *sink = gst_element_factory_make ("fakesink", NULL);
+  if (!src || !sink) {
+    g_error ("Unable to create elements");
+  }
+
+  Recorder *recorder = g_new0 (Recorder, 1);
+  g_mutex_init (&recorder->lock);
+  recorder->data = g_byte_array_new ();
+  recorder->sizes = g_array_new (FALSE, FALSE, sizeof (gsize));
+  g_object_set_qdata (G_OBJECT (src), recorder_quark (), recorder);
+  recorder->sample_received = GST_BDASRC (src)->sample_received;
+  GST_BDASRC (src)->sample_received = record_sample;
+
+  g_object_set (src, "backend", GST_BDA_BACKEND_REPLAY,
+      "replay-location", location, "pacing", pacing, "bitrate", bitrate,
+      "chunk-size", CHUNK_SIZE, "jitter", 0, "loop", loop_size > 0,
+      "buffer-size", 1024, NULL);
+  g_object_set (sink, "sync", FALSE, NULL);
+  gst_bin_add_many (GST_BIN (pipeline), src, sink, NULL);
+  gst_element_link (src, sink);
+
+  TEST_CHECK (gst_element_set_state (pipeline, GST_STATE_PLAYING) !=
+      GST_STATE_CHANGE_FAILURE);
+
+  if (loop_size) {
+    gint64 deadline = g_get_monotonic_time () + TIMEOUT / GST_USECOND;
+    for (;;) {
+      g_mutex_lock (&recorder->lock);
+      gsize len = recorder->data->len;
+      g_mutex_unlock (&recorder->lock);
+      if (len >= loop_size || g_get_monotonic_time () > deadline) {
+        break;
+      }
+      g_usleep (10000);
+    }
+  } else {
+    GstBus *bus = gst_element_get_bus (pipeline);
+    GstMessage *msg = gst_bus_timed_pop_filtered (bus, TIMEOUT,
+        (GstMessageType) (GST_MESSAGE_EOS | GST_MESSAGE_ERROR));
+    TEST_CHECK (msg && GST_MESSAGE_TYPE (msg) == GST_MESSAGE_EOS);
+    if (msg) {
+      gst_message_unref (msg);
+    }
+    gst_object_unref (bus);
+  }
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (pipeline);
+
+  return recorder;
+}
+
+/* The stream is delivered once, unchanged, in samples of chunk-size but
+   the last. */
+static void
+check_chunks (Recorder * recorder, const guint8 * stream)
+{
+  TEST_CHECK (recorder->data->len == SIZE
+      && !memcmp (recorder->data->data, stream, SIZE));
+  for (guint i = 0; i < recorder->sizes->len; i++) {
+    gsize size = g_array_index (recorder->sizes, gsize, i);
+    if (i + 1 < recorder->sizes->len) {
+      TEST_CHECK (size == CHUNK_SIZE);
+    } else {
+      TEST_CHECK (size == SIZE % CHUNK_SIZE);
+    }
+  }
+}
+
+/* Without pacing the stream is delivered much faster than its bitrate. */
+static void
+test_none (const gchar * location, const guint8 * stream)
+{
+  Recorder *recorder = replay (location, GST_BDA_PACING_NONE, BITRATE, 0);
+
+  check_chunks (recorder, stream);
+  TEST_CHECK (recorder->last - recorder->first < PACED_TIME / 2);
+  recorder_free (recorder);
+}
+
+/* At the bitrate property the stream takes its duration. */
+static void
+test_bitrate (const gchar * location, const guint8 * stream)
+{
+  Recorder *recorder = replay (location, GST_BDA_PACING_BITRATE, BITRATE, 0);
+
+  check_chunks (recorder, stream);
+  TEST_CHECK (recorder->last - recorder->first >= PACED_TIME * 9 / 10);
+  recorder_free (recorder);
+}
+
+/* The PCR paces the stream at its own rate, whatever the bitrate
+   property. */
+static void
+test_pcr (const gchar * location, const guint8 * stream)
+{
+  Recorder *recorder = replay (location, GST_BDA_PACING_PCR, BITRATE * 10, 0);
+
+  check_chunks (recorder, stream);
+  TEST_CHECK (recorder->last - recorder->first >= PACED_TIME * 8 / 10);
+  recorder_free (recorder);
+}
+
+/* A stream of null packets, without PCR, falls back to the bitrate. */
+static void
+test_pcr_fallback (void)
+{
+  guint8 *nulls = (guint8 *) g_malloc (SIZE);
+  for (gsize i = 0; i < SIZE; i += GST_BDA_TS_PACKET_SIZE) {
+    memset (nulls + i, 0xff, GST_BDA_TS_PACKET_SIZE);
+    nulls[i] = GST_BDA_TS_SYNC_BYTE;
+    nulls[i + 1] = 0x1f;
+    nulls[i + 3] = 0x10;
+  }
+  gchar *location = write_stream (nulls, SIZE);
+
+  Recorder *recorder = replay (location, GST_BDA_PACING_PCR, BITRATE, 0);
+  check_chunks (recorder, nulls);
+  TEST_CHECK (recorder->last - recorder->first >= PACED_TIME * 9 / 10);
+  recorder_free (recorder);
+
+  g_unlink (location);
+  g_free (location);
+  g_free (nulls);
+}
+
+/* With loop the stream starts over right after its last byte. */
+static void
+test_loop (const gchar * location, const guint8 * stream)
+{
+  Recorder *recorder = replay (location, GST_BDA_PACING_NONE, BITRATE,
+      3 * SIZE);
+
+  TEST_CHECK (recorder->data->len >= 3 * SIZE);
+  for (gsize i = 0; i + SIZE <= recorder->data->len; i += SIZE) {
+    TEST_CHECK (!memcmp (recorder->data->data + i, stream, SIZE));
+  }
+  recorder_free (recorder);
+}
+
+int
+main (int argc, char *argv[])
+{
+  gst_init (&argc, &argv);
+  gst_plugin_register_static (GST_VERSION_MAJOR, GST_VERSION_MINOR,
+      "bdasrc", "BDA Source", gst_bdasrc_plugin_init, VERSION, GST_LICENSE,
+      PACKAGE, GST_PACKAGE_NAME, GST_PACKAGE_ORIGIN);
+
+  gchar *params = g_strdup_printf ("bitrate=%u", BITRATE);
+  guint8 *stream = test_generate (params, SIZE);
+  gchar *location = write_stream (stream, SIZE);
+
+  test_none (location, stream);
+  test_bitrate (location, stream);
+  test_pcr (location, stream);
+  test_pcr_fallback ();
+  test_loop (location, stream);
+
+  g_unlink (location);
+  g_free (location);
+  g_free (stream);
+  g_free (params);
+  return test_result ();
+}
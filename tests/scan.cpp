@@ -0,0 +1,163 @@
+/* GStreamer
+ * Copyright (C) 2015 Raimo Järvi <raimo.jarvi@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+/* Scan collector test. Feeds generated streams with SI to the collector
+ * and checks the channel list it makes of the PAT, PMTs, SDT and NIT. */
+
+#include <string.h>
+#include "test.h"
+#include "gstbdascan.h"
+
+#define PROGRAMS 4
+/* About 0.25 s at 24 Mbit/s, the SI repeats every 100 ms. */
+#define PACKETS 4000
+
+/* Pushes the packets of stream one at a time until the collector
+   completes, skipping those of skip_pid.
+   @return the number of packets pushed, or 0 if it didn't complete */
+static guint
+push_until_complete (GstBdaScanCollector * collector, const guint8 * stream,
+    guint packets, gint skip_pid)
+{
+  for (guint i = 0; i < packets; i++) {
+    const guint8 *packet = stream + i * GST_BDA_TS_PACKET_SIZE;
+    if (gst_bda_ts_pid (packet) == skip_pid) {
+      continue;
+    }
+    if (gst_bda_scan_collector_push (collector, packet,
+            GST_BDA_TS_PACKET_SIZE)) {
+      return i + 1;
+    }
+  }
+
+  return 0;
+}
+
+static const GstStructure *
+get_channel (const GValue * channels, guint i)
+{
+  return gst_value_get_structure (gst_value_list_get_value (channels, i));
+}
+
+/* The first repetition of the PSI and SI completes the transponder. */
+static void
+test_complete (const guint8 * stream)
+{
+  GstBdaScanCollector *collector = gst_bda_scan_collector_new ();
+  GstStructure *transponder = gst_structure_new ("transponder",
+      "frequency", G_TYPE_INT, 506000, NULL);
+  GValue channels = G_VALUE_INIT;
+  g_value_init (&channels, GST_TYPE_LIST);
+
+  guint pushed = push_until_complete (collector, stream, PACKETS, -1);
+  TEST_CHECK (pushed > 0 && pushed < PACKETS / 2);
+  TEST_CHECK (gst_bda_scan_collector_get_channels (collector, transponder,
+          &channels) == PROGRAMS);
+  TEST_CHECK (gst_value_list_get_size (&channels) == PROGRAMS);
+
+  for (guint i = 0; i < gst_value_list_get_size (&channels); i++) {
+    const GstStructure *channel = get_channel (&channels, i);
+    gint value = 0;
+    guint uvalue = 0;
+    TEST_CHECK (gst_structure_get_int (channel, "frequency", &value)
+        && value == 506000);
+    TEST_CHECK (gst_structure_get_uint (channel, "service-id", &uvalue)
+        && uvalue == i + 1);
+    TEST_CHECK (gst_structure_get_uint (channel, "pmt-pid", &uvalue)
+        && uvalue == TEST_PMT_PID (i));
+    TEST_CHECK (gst_structure_get_uint (channel, "transport-stream-id",
+            &uvalue) && uvalue == 1);
+    TEST_CHECK (gst_structure_get_uint (channel, "original-network-id",
+            &uvalue) && uvalue == 0x2001);
+    TEST_CHECK (gst_structure_get_uint (channel, "network-id", &uvalue)
+        && uvalue == 0x3001);
+    TEST_CHECK (!g_strcmp0 (gst_structure_get_string (channel,
+                "network-name"), "bdatsgen"));
+    TEST_CHECK (!g_strcmp0 (gst_structure_get_string (channel,
+                "provider-name"), "bdatsgen"));
+    gchar *name = g_strdup_printf ("Service %u", i + 1);
+    TEST_CHECK (!g_strcmp0 (gst_structure_get_string (channel,
+                "service-name"), name));
+    g_free (name);
+    const GValue *streams = gst_structure_get_value (channel, "streams");
+    TEST_CHECK (streams && gst_value_list_get_size (streams) == 2);
+  }
+
+  g_value_unset (&channels);
+  gst_structure_free (transponder);
+  gst_bda_scan_collector_free (collector);
+}
+
+/* Without an SDT the transponder is incomplete, but the channels of the
+   PAT and PMTs are listed without names. */
+static void
+test_incomplete (const guint8 * stream)
+{
+  GstBdaScanCollector *collector = gst_bda_scan_collector_new ();
+  GstStructure *transponder = gst_structure_new_empty ("transponder");
+  GValue channels = G_VALUE_INIT;
+  g_value_init (&channels, GST_TYPE_LIST);
+
+  TEST_CHECK (push_until_complete (collector, stream, PACKETS,
+          TEST_SDT_PID) == 0);
+  TEST_CHECK (gst_bda_scan_collector_get_channels (collector, transponder,
+          &channels) == PROGRAMS);
+  for (guint i = 0; i < gst_value_list_get_size (&channels); i++) {
+    const GstStructure *channel = get_channel (&channels, i);
+    TEST_CHECK (!gst_structure_has_field (channel, "service-name"));
+    TEST_CHECK (gst_structure_has_field (channel, "network-name"));
+  }
+
+  g_value_unset (&channels);
+  gst_structure_free (transponder);
+  gst_bda_scan_collector_free (collector);
+}
+
+/* A new SDT version restarts the table, and the collector completes on
+   the sections of the new version. */
+static void
+test_version_change (const guint8 * stream, const guint8 * next)
+{
+  GstBdaScanCollector *collector = gst_bda_scan_collector_new ();
+
+  TEST_CHECK (push_until_complete (collector, stream, PACKETS,
+          TEST_SDT_PID) == 0);
+  TEST_CHECK (push_until_complete (collector, next, PACKETS, -1) > 0);
+
+  gst_bda_scan_collector_free (collector);
+}
+
+int
+main (int argc, char *argv[])
+{
+  gst_init (&argc, &argv);
+
+  guint8 *stream = test_generate ("si-interval=100",
+      PACKETS * GST_BDA_TS_PACKET_SIZE);
+  guint8 *next = test_generate ("si-interval=100,si-version=1",
+      PACKETS * GST_BDA_TS_PACKET_SIZE);
+
+  test_complete (stream);
+  test_incomplete (stream);
+  test_version_change (stream, next);
+
+  g_free (next);
+  g_free (stream);
+  return test_result ();
+}
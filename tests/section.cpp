@@ -0,0 +1,201 @@
+/* GStreamer
+ * Copyright (C) 2015 Raimo Järvi <raimo.jarvi@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+/* Section assembler test. Assembles the PAT and PMTs of a generated stream
+ * of 4 programs, with and without deduplication, and checks their content
+ * and counts against the packets of the stream. */
+
+#include "test.h"
+#include "gstbdasection.h"
+
+#define PROGRAMS 4
+/* About 1.25 s at 24 Mbit/s, 13 repetitions of the PSI. */
+#define PACKETS 20000
+
+typedef struct _SectionCounts SectionCounts;
+
+struct _SectionCounts {
+  guint pat;
+  guint pmt[PROGRAMS];
+  guint other;
+};
+
+static void
+check_pat (const guint8 * section, gsize size)
+{
+  TEST_CHECK (size == 8 + PROGRAMS * 4 + 4);
+  if (size != 8 + PROGRAMS * 4 + 4) {
+    return;
+  }
+  for (guint i = 0; i < PROGRAMS; i++) {
+    const guint8 *p = section + 8 + i * 4;
+    TEST_CHECK (((p[0] << 8) | p[1]) == (gint) i + 1);
+    TEST_CHECK ((((p[2] & 0x1f) << 8) | p[3]) == TEST_PMT_PID (i));
+  }
+}
+
+static void
+check_pmt (guint program, const guint8 * section, gsize size)
+{
+  TEST_CHECK (((section[3] << 8) | section[4]) == (gint) program + 1);
+  TEST_CHECK (size == 12 + 2 * 5 + 4);
+  if (size != 12 + 2 * 5 + 4) {
+    return;
+  }
+  /* PCR PID, then the video and audio streams. */
+  TEST_CHECK ((((section[8] & 0x1f) << 8) | section[9]) ==
+      TEST_ES_PID (program, 0));
+  const guint8 *p = section + 12;
+  TEST_CHECK (p[0] == GST_BDA_TS_STREAM_H264);
+  TEST_CHECK ((((p[1] & 0x1f) << 8) | p[2]) == TEST_ES_PID (program, 0));
+  TEST_CHECK (p[5] == 0x03);
+  TEST_CHECK ((((p[6] & 0x1f) << 8) | p[7]) == TEST_ES_PID (program, 1));
+}
+
+static void
+section_received (guint16 pid, const guint8 * section, gsize size,
+    gpointer user_data)
+{
+  SectionCounts *counts = (SectionCounts *) user_data;
+
+  /* The CRC of a section including its CRC is 0. */
+  TEST_CHECK (gst_bda_ts_crc32 (section, size) == 0);
+  if (pid == TEST_PAT_PID && section[0] == 0x00) {
+    counts->pat++;
+    check_pat (section, size);
+  } else if (pid >= TEST_PMT_PID (0) && pid < TEST_PMT_PID (PROGRAMS)
+      && section[0] == 0x02) {
+    counts->pmt[pid - TEST_PMT_PID (0)]++;
+    check_pmt (pid - TEST_PMT_PID (0), section, size);
+  } else {
+    counts->other++;
+  }
+}
+
+static GstBdaSectionAssembler *
+assembler_new (SectionCounts * counts, gboolean deduplicate)
+{
+  GstBdaSectionAssembler *assembler =
+      gst_bda_section_assembler_new (section_received, counts);
+  gst_bda_section_assembler_set_deduplicate (assembler, deduplicate);
+  gst_bda_section_assembler_add_pid (assembler, TEST_PAT_PID);
+  for (guint i = 0; i < PROGRAMS; i++) {
+    gst_bda_section_assembler_add_pid (assembler, TEST_PMT_PID (i));
+  }
+
+  return assembler;
+}
+
+/* Every repetition is passed on without deduplication. */
+static void
+test_all_sections (const guint8 * stream, gsize size)
+{
+  SectionCounts counts = { };
+  GstBdaSectionAssembler *assembler = assembler_new (&counts, FALSE);
+
+  gst_bda_section_assembler_push (assembler, stream, size);
+
+  TEST_CHECK (counts.pat > 10);
+  TEST_CHECK (counts.pat == test_count_packets (stream, size, TEST_PAT_PID));
+  for (guint i = 0; i < PROGRAMS; i++) {
+    TEST_CHECK (counts.pmt[i] ==
+        test_count_packets (stream, size, TEST_PMT_PID (i)));
+  }
+  TEST_CHECK (counts.other == 0);
+  TEST_CHECK (gst_bda_section_assembler_get_repeated (assembler) == 0);
+
+  gst_bda_section_assembler_free (assembler);
+}
+
+/* Only the first of each table is passed on with deduplication, also when
+   pushed a packet at a time, and again after a reset. */
+static void
+test_deduplicate (const guint8 * stream, gsize size)
+{
+  SectionCounts counts = { };
+  GstBdaSectionAssembler *assembler = assembler_new (&counts, TRUE);
+
+  for (gsize i = 0; i < size / 2; i += GST_BDA_TS_PACKET_SIZE) {
+    gst_bda_section_assembler_push (assembler, stream + i,
+        GST_BDA_TS_PACKET_SIZE);
+  }
+  TEST_CHECK (counts.pat == 1);
+  for (guint i = 0; i < PROGRAMS; i++) {
+    TEST_CHECK (counts.pmt[i] == 1);
+  }
+
+  guint psi = test_count_packets (stream, size / 2, TEST_PAT_PID);
+  for (guint i = 0; i < PROGRAMS; i++) {
+    psi += test_count_packets (stream, size / 2, TEST_PMT_PID (i));
+  }
+  TEST_CHECK (gst_bda_section_assembler_get_repeated (assembler) ==
+      psi - 1 - PROGRAMS);
+
+  gst_bda_section_assembler_reset (assembler);
+  gst_bda_section_assembler_push (assembler, stream + size / 2,
+      size - size / 2);
+  TEST_CHECK (counts.pat == 2);
+  for (guint i = 0; i < PROGRAMS; i++) {
+    TEST_CHECK (counts.pmt[i] == 2);
+  }
+  TEST_CHECK (counts.other == 0);
+
+  gst_bda_section_assembler_free (assembler);
+}
+
+/* Packets with the transport error indicator set are skipped, and the
+   sections of the others still pass their CRC check. */
+static void
+test_transport_errors (void)
+{
+  gsize size = PACKETS * GST_BDA_TS_PACKET_SIZE;
+  guint8 *stream = test_generate ("tei-errors=0.2", size);
+  SectionCounts counts = { };
+  GstBdaSectionAssembler *assembler = assembler_new (&counts, FALSE);
+
+  guint errors = 0;
+  for (gsize i = 0; i < size; i += GST_BDA_TS_PACKET_SIZE) {
+    if (gst_bda_ts_pid (stream + i) == TEST_PAT_PID
+        && gst_bda_ts_tei (stream + i)) {
+      errors++;
+    }
+  }
+
+  gst_bda_section_assembler_push (assembler, stream, size);
+  TEST_CHECK (errors > 0);
+  TEST_CHECK (counts.pat ==
+      test_count_packets (stream, size, TEST_PAT_PID) - errors);
+
+  gst_bda_section_assembler_free (assembler);
+  g_free (stream);
+}
+
+int
+main (void)
+{
+  gsize size = PACKETS * GST_BDA_TS_PACKET_SIZE;
+  guint8 *stream = test_generate (NULL, size);
+
+  test_all_sections (stream, size);
+  test_deduplicate (stream, size);
+  test_transport_errors ();
+
+  g_free (stream);
+  return test_result ();
+}
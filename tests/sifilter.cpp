@@ -0,0 +1,323 @@
+/* GStreamer
+ * Copyright (C) 2015 Raimo Järvi <raimo.jarvi@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+/* SI filter test. Filters a generated stream of 4 programs, whose PAT,
+ * PMTs, NIT, SDT and EIT repeat every 100 ms, and checks that the other
+ * packets pass unchanged while the PSI/SI is reduced to its first
+ * occurrence and the configured refreshes. */
+
+#include <string.h>
+#include "test.h"
+#include "gstbdasifilter.h"
+#include "gstbdasection.h"
+
+#define PROGRAMS 4
+/* About 1.25 s at 24 Mbit/s. */
+#define PACKETS 20000
+#define BITRATE 24000000
+/* Samples of 7 packets, as from a DVB tuner. */
+#define CHUNK (7 * GST_BDA_TS_PACKET_SIZE)
+/* EIT schedule sections of each service. */
+#define EIT_EVENTS 8
+
+static gboolean
+is_psi (guint16 pid)
+{
+  return pid == TEST_PAT_PID || pid == TEST_NIT_PID || pid == TEST_SDT_PID
+      || pid == TEST_EIT_PID || (pid >= TEST_PMT_PID (0)
+      && pid < TEST_PMT_PID (PROGRAMS));
+}
+
+static void
+count_section (guint16 pid, const guint8 * section, gsize size,
+    gpointer user_data)
+{
+  (void) pid;
+  (void) section;
+  (void) size;
+  (*(guint *) user_data)++;
+}
+
+/* Pushes data and appends the output the runs describe to out. */
+static void
+push (GstBdaSiFilter * filter, const guint8 * data, gsize size, gint64 now,
+    GByteArray * out)
+{
+  GArray *runs = g_array_new (FALSE, FALSE, sizeof (GstBdaSiFilterRun));
+  GByteArray *written = g_byte_array_new ();
+
+  gst_bda_si_filter_push (filter, data, size, now, runs, written);
+  for (guint i = 0; i < runs->len; i++) {
+    GstBdaSiFilterRun *run = &g_array_index (runs, GstBdaSiFilterRun, i);
+    g_byte_array_append (out, (run->written ? written->data : data) +
+        run->offset, run->size);
+  }
+
+  g_byte_array_free (written, TRUE);
+  g_array_free (runs, TRUE);
+}
+
+/* Filters the stream in chunks timed by the bitrate. */
+static GByteArray *
+filter_stream (GstBdaSiFilter * filter, const guint8 * stream, gsize size)
+{
+  GByteArray *out = g_byte_array_new ();
+
+  for (gsize i = 0; i < size; i += CHUNK) {
+    gsize n = MIN (CHUNK, size - i);
+    gint64 now = (gint64) (i + n) * 8 * G_USEC_PER_SEC / BITRATE;
+    push (filter, stream + i, n, now, out);
+  }
+  return out;
+}
+
+/* Counts the sections on pid in out. */
+static guint
+count_sections (const guint8 * data, gsize size, guint16 pid)
+{
+  guint sections = 0;
+  GstBdaSectionAssembler *assembler =
+      gst_bda_section_assembler_new (count_section, &sections);
+  gst_bda_section_assembler_add_pid (assembler, pid);
+  gst_bda_section_assembler_push (assembler, data, size);
+  gst_bda_section_assembler_free (assembler);
+
+  return sections;
+}
+
+/* Compares the packets of data other than the PSI with those of
+   expected. */
+static gboolean
+same_payload_packets (const guint8 * data, gsize size,
+    const guint8 * expected, gsize expected_size)
+{
+  gsize i = 0, j = 0;
+
+  for (;;) {
+    while (i < size && is_psi (gst_bda_ts_pid (data + i))) {
+      i += GST_BDA_TS_PACKET_SIZE;
+    }
+    while (j < expected_size && is_psi (gst_bda_ts_pid (expected + j))) {
+      j += GST_BDA_TS_PACKET_SIZE;
+    }
+    if (i >= size || j >= expected_size) {
+      return i >= size && j >= expected_size;
+    }
+    if (memcmp (data + i, expected + j, GST_BDA_TS_PACKET_SIZE)) {
+      return FALSE;
+    }
+    i += GST_BDA_TS_PACKET_SIZE;
+    j += GST_BDA_TS_PACKET_SIZE;
+  }
+}
+
+/* The continuity counters of the packets of pid increase by one, and stay
+   the same in packets without payload. */
+static gboolean
+is_continuous (const guint8 * data, gsize size, guint16 pid)
+{
+  gint cc = -1;
+
+  for (gsize i = 0; i < size; i += GST_BDA_TS_PACKET_SIZE) {
+    if (gst_bda_ts_pid (data + i) != pid) {
+      continue;
+    }
+    if (!gst_bda_ts_has_payload (data + i)) {
+      if (cc >= 0 && gst_bda_ts_cc (data + i) != cc) {
+        return FALSE;
+      }
+      continue;
+    }
+    if (cc >= 0 && gst_bda_ts_cc (data + i) != ((cc + 1) & 0x0f)) {
+      return FALSE;
+    }
+    cc = gst_bda_ts_cc (data + i);
+  }
+  return TRUE;
+}
+
+/* Without refresh only the first PAT, PMTs, NIT, SDT and EIT are passed
+   on, as valid sections. */
+static void
+test_no_refresh (const guint8 * stream, gsize size)
+{
+  GstBdaSiFilter *filter = gst_bda_si_filter_new (0, 0);
+  GByteArray *out = filter_stream (filter, stream, size);
+
+  TEST_CHECK (same_payload_packets (out->data, out->len, stream, size));
+  TEST_CHECK (test_count_packets (out->data, out->len, TEST_PAT_PID) == 1);
+  for (guint i = 0; i < PROGRAMS; i++) {
+    TEST_CHECK (test_count_packets (out->data, out->len,
+            TEST_PMT_PID (i)) == 1);
+  }
+
+  guint sections = 0;
+  GstBdaSectionAssembler *assembler =
+      gst_bda_section_assembler_new (count_section, &sections);
+  gst_bda_section_assembler_add_pid (assembler, TEST_PAT_PID);
+  for (guint i = 0; i < PROGRAMS; i++) {
+    gst_bda_section_assembler_add_pid (assembler, TEST_PMT_PID (i));
+  }
+  gst_bda_section_assembler_push (assembler, out->data, out->len);
+  TEST_CHECK (sections == 1 + PROGRAMS);
+  gst_bda_section_assembler_free (assembler);
+  TEST_CHECK (count_sections (out->data, out->len, TEST_NIT_PID) == 1);
+  TEST_CHECK (count_sections (out->data, out->len, TEST_SDT_PID) == 1);
+  TEST_CHECK (count_sections (out->data, out->len, TEST_EIT_PID) ==
+      PROGRAMS * EIT_EVENTS);
+
+  g_byte_array_free (out, TRUE);
+  gst_bda_si_filter_free (filter);
+}
+
+/* PSI tables are repeated every 500 ms, at 0.5 and 1 s of the 1.25 s
+   stream, with continuous continuity counters, and SI tables not at all. */
+static void
+test_refresh (const guint8 * stream, gsize size)
+{
+  GstBdaSiFilter *filter = gst_bda_si_filter_new (500, 0);
+  GByteArray *out = filter_stream (filter, stream, size);
+
+  TEST_CHECK (same_payload_packets (out->data, out->len, stream, size));
+  TEST_CHECK (test_count_packets (out->data, out->len, TEST_PAT_PID) == 3);
+  TEST_CHECK (is_continuous (out->data, out->len, TEST_PAT_PID));
+  for (guint i = 0; i < PROGRAMS; i++) {
+    TEST_CHECK (test_count_packets (out->data, out->len,
+            TEST_PMT_PID (i)) == 3);
+    TEST_CHECK (is_continuous (out->data, out->len, TEST_PMT_PID (i)));
+  }
+  TEST_CHECK (count_sections (out->data, out->len, TEST_SDT_PID) == 1);
+
+  g_byte_array_free (out, TRUE);
+  gst_bda_si_filter_free (filter);
+}
+
+/* SI tables are repeated every 500 ms, the SDT and NIT as the PSI and each
+   section of the EIT schedule separately. */
+static void
+test_si_refresh (const guint8 * stream, gsize size)
+{
+  GstBdaSiFilter *filter = gst_bda_si_filter_new (0, 500);
+  GByteArray *out = filter_stream (filter, stream, size);
+
+  TEST_CHECK (same_payload_packets (out->data, out->len, stream, size));
+  TEST_CHECK (count_sections (out->data, out->len, TEST_PAT_PID) == 1);
+  TEST_CHECK (count_sections (out->data, out->len, TEST_NIT_PID) == 3);
+  TEST_CHECK (count_sections (out->data, out->len, TEST_SDT_PID) == 3);
+  TEST_CHECK (count_sections (out->data, out->len, TEST_EIT_PID) ==
+      3 * PROGRAMS * EIT_EVENTS);
+  TEST_CHECK (is_continuous (out->data, out->len, TEST_SDT_PID));
+  TEST_CHECK (is_continuous (out->data, out->len, TEST_EIT_PID));
+
+  g_byte_array_free (out, TRUE);
+  gst_bda_si_filter_free (filter);
+}
+
+/* A PMT PID that is also the PCR PID of its program keeps its PCRs in
+   adaptation field only packets, while the PMT is passed on once. */
+static void
+test_pcr (const guint8 * stream, gsize size)
+{
+  const guint8 *pat = NULL, *pmt = NULL;
+  for (gsize i = 0; i < size; i += GST_BDA_TS_PACKET_SIZE) {
+    if (!pat && gst_bda_ts_pid (stream + i) == TEST_PAT_PID) {
+      pat = stream + i;
+    } else if (!pmt && gst_bda_ts_pid (stream + i) == TEST_PMT_PID (0)) {
+      pmt = stream + i;
+    }
+  }
+  TEST_CHECK (pat != NULL && pmt != NULL);
+  if (!pat || !pmt) {
+    return;
+  }
+
+  /* The PAT, for the PMT PIDs, and the PMT after a 7 byte adaptation field
+     with the PCR. */
+  GByteArray *in = g_byte_array_new ();
+  g_byte_array_append (in, pat, GST_BDA_TS_PACKET_SIZE);
+  for (guint i = 0; i < 5; i++) {
+    guint8 packet[GST_BDA_TS_PACKET_SIZE];
+    memcpy (packet, pmt, 4);
+    packet[3] = 0x30 | i;
+    packet[4] = 7;
+    packet[5] = 0x10;
+    gst_bda_ts_write_pcr (packet + 6, 27000000 + i * 1080000);
+    memcpy (packet + 12, pmt + 4, GST_BDA_TS_PACKET_SIZE - 12);
+    g_byte_array_append (in, packet, GST_BDA_TS_PACKET_SIZE);
+  }
+
+  GstBdaSiFilter *filter = gst_bda_si_filter_new (0, 0);
+  GByteArray *out = g_byte_array_new ();
+  push (filter, in->data, in->len, 0, out);
+
+  guint pcrs = 0;
+  for (gsize i = 0; i < out->len; i += GST_BDA_TS_PACKET_SIZE) {
+    guint64 pcr;
+    if (gst_bda_ts_get_pcr (out->data + i, &pcr)) {
+      TEST_CHECK (pcr == 27000000 + pcrs * 1080000);
+      TEST_CHECK (!gst_bda_ts_has_payload (out->data + i));
+      pcrs++;
+    }
+  }
+  TEST_CHECK (pcrs == 5);
+  TEST_CHECK (count_sections (out->data, out->len, TEST_PMT_PID (0)) == 1);
+  TEST_CHECK (is_continuous (out->data, out->len, TEST_PMT_PID (0)));
+
+  g_byte_array_free (out, TRUE);
+  g_byte_array_free (in, TRUE);
+  gst_bda_si_filter_free (filter);
+}
+
+/* After a reset the tables are passed on again. */
+static void
+test_reset (const guint8 * stream, gsize size)
+{
+  GstBdaSiFilter *filter = gst_bda_si_filter_new (0, 0);
+  GByteArray *out = filter_stream (filter, stream, size / 2);
+
+  gst_bda_si_filter_reset (filter);
+  GByteArray *rest = filter_stream (filter, stream + size / 2,
+      size - size / 2);
+  TEST_CHECK (test_count_packets (out->data, out->len, TEST_PAT_PID) == 1);
+  TEST_CHECK (test_count_packets (rest->data, rest->len, TEST_PAT_PID) == 1);
+  for (guint i = 0; i < PROGRAMS; i++) {
+    TEST_CHECK (test_count_packets (rest->data, rest->len,
+            TEST_PMT_PID (i)) == 1);
+  }
+
+  g_byte_array_free (rest, TRUE);
+  g_byte_array_free (out, TRUE);
+  gst_bda_si_filter_free (filter);
+}
+
+int
+main (void)
+{
+  gsize size = PACKETS * GST_BDA_TS_PACKET_SIZE;
+  guint8 *stream = test_generate ("si-interval=100", size);
+
+  test_no_refresh (stream, size);
+  test_refresh (stream, size);
+  test_si_refresh (stream, size);
+  test_pcr (stream, size);
+  test_reset (stream, size);
+
+  g_free (stream);
+  return test_result ();
+}
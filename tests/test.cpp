@@ -0,0 +1,72 @@
+/* GStreamer
+ * Copyright (C) 2015 Raimo Järvi <raimo.jarvi@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#include "test.h"
+
+static guint failures;
+
+void
+test_check (gboolean ok, const gchar * expr, const gchar * file, gint line)
+{
+  if (!ok) {
+    g_printerr ("%s:%d: check failed: %s\n", file, line, expr);
+    failures++;
+  }
+}
+
+int
+test_result (void)
+{
+  if (failures) {
+    g_printerr ("%u checks failed\n", failures);
+    return 1;
+  }
+  return 0;
+}
+
+guint8 *
+test_generate (const gchar * params, gsize size)
+{
+  GstBdaTsGenParams p;
+  gst_bda_ts_gen_params_init (&p);
+  if (params && !gst_bda_ts_gen_params_parse (&p, params)) {
+    g_error ("Invalid generator parameters '%s'", params);
+  }
+
+  guint8 *data = (guint8 *) g_malloc (size);
+  GstBdaTsGen *gen = gst_bda_ts_gen_new (&p);
+  gst_bda_ts_gen_fill (gen, data, size);
+  gst_bda_ts_gen_free (gen);
+
+  return data;
+}
+
+guint
+test_count_packets (const guint8 * data, gsize size, guint16 pid)
+{
+  guint count = 0;
+
+  for (gsize i = 0; i + GST_BDA_TS_PACKET_SIZE <= size;
+      i += GST_BDA_TS_PACKET_SIZE) {
+    if (gst_bda_ts_pid (data + i) == pid) {
+      count++;
+    }
+  }
+  return count;
+}
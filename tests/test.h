@@ -0,0 +1,68 @@
+/* GStreamer
+ * Copyright (C) 2015 Raimo Järvi <raimo.jarvi@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+#ifndef __TEST_H__
+#define __TEST_H__
+
+#include <glib.h>
+#include "gstbdats.h"
+#include "gstbdatsgen.h"
+
+/* Helpers shared by the parser tests. */
+
+/* PIDs of the generated stream: program i (from 0) has its PMT on
+   TEST_PMT_PID (i) and stream j on TEST_ES_PID (i, j), stream 0 being
+   H.264 video and the others MPEG audio. With si-interval set it carries
+   an SDT, NIT and EIT schedule, see GstBdaTsGenParams. */
+#define TEST_PAT_PID 0x0000
+#define TEST_NIT_PID 0x0010
+#define TEST_SDT_PID 0x0011
+#define TEST_EIT_PID 0x0012
+#define TEST_PMT_PID(i) (0x1000 + (i))
+#define TEST_ES_PID(i, j) (0x0100 + (i) * GST_BDA_TS_GEN_MAX_STREAMS + (j))
+
+/**
+ * Counts a failure and prints cond with its location if it doesn't hold.
+ * The test goes on either way.
+ */
+#define TEST_CHECK(cond) \
+  test_check ((cond) ? TRUE : FALSE, #cond, __FILE__, __LINE__)
+
+void test_check (gboolean ok, const gchar * expr, const gchar * file,
+    gint line);
+
+/**
+ * @return the exit status of the test, 0 if all checks passed
+ */
+int test_result (void);
+
+/**
+ * Generates size bytes of stream with the default generator parameters
+ * overridden by params, see gst_bda_ts_gen_params_parse (). Free with
+ * g_free ().
+ */
+guint8 *test_generate (const gchar * params, gsize size);
+
+/**
+ * Counts the packets of pid in packet aligned data, including ones with
+ * the transport error indicator set.
+ */
+guint test_count_packets (const guint8 * data, gsize size, guint16 pid);
+
+#endif
@@ -0,0 +1,204 @@
+/* GStreamer
+ * Copyright (C) 2015 Raimo Järvi <raimo.jarvi@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+/* Sample trace test. Writes traces of generated samples, with and without
+ * payload, and checks that reading them back gives the same sizes, timing
+ * and data, and that truncated and foreign files are detected. */
+
+#include <string.h>
+#include <unistd.h>
+#include <glib/gstdio.h>
+#include "test.h"
+#include "gstbdatrace.h"
+
+#define SAMPLES 200
+/* A tuner delivers samples of 7 packets up to 348 packets. */
+#define MAX_SAMPLE (348 * GST_BDA_TS_PACKET_SIZE)
+
+typedef struct _Sample Sample;
+
+struct _Sample {
+  gint64 arrival;
+  gint64 sample_time;
+  gsize size;
+};
+
+/* Sample sizes, bursty arrival times and sample times that sometimes go
+   backwards, starting from arbitrary absolute values. */
+static void
+make_samples (Sample * samples)
+{
+  GRand *rand = g_rand_new_with_seed (1);
+  gint64 arrival = G_GINT64_CONSTANT (123456789012);
+  gint64 sample_time = 5000000;
+
+  for (guint i = 0; i < SAMPLES; i++) {
+    if (g_rand_int_range (rand, 0, 2)) {
+      arrival += g_rand_int_range (rand, 1, 200000);
+    }
+    sample_time += g_rand_int_range (rand, -10000, 1000000);
+    samples[i].arrival = arrival;
+    samples[i].sample_time = sample_time;
+    samples[i].size = g_rand_int_range (rand, 1, 349) *
+        GST_BDA_TS_PACKET_SIZE;
+  }
+  g_rand_free (rand);
+}
+
+static gchar *
+temp_location (void)
+{
+  gchar *location;
+  gint fd = g_file_open_tmp ("bdatrace-XXXXXX", &location, NULL);
+  if (fd < 0) {
+    g_error ("Unable to create a temporary file");
+  }
+  close (fd);
+
+  return location;
+}
+
+static void
+write_trace (const gchar * location, const Sample * samples,
+    const guint8 * stream, gboolean payload)
+{
+  GstBdaTraceWriter *writer = gst_bda_trace_writer_new (location, payload,
+      NULL);
+  TEST_CHECK (writer != NULL);
+  if (!writer) {
+    return;
+  }
+
+  for (guint i = 0; i < SAMPLES; i++) {
+    TEST_CHECK (gst_bda_trace_writer_add (writer, samples[i].arrival,
+            samples[i].sample_time, stream, samples[i].size));
+  }
+  gst_bda_trace_writer_free (writer);
+}
+
+/* Reads the trace twice, the second time after a rewind. */
+static void
+test_round_trip (const Sample * samples, const guint8 * stream,
+    gboolean payload)
+{
+  gchar *location = temp_location ();
+  write_trace (location, samples, stream, payload);
+
+  GstBdaTraceReader *reader = gst_bda_trace_reader_new (location, NULL);
+  TEST_CHECK (reader != NULL);
+  if (!reader) {
+    g_unlink (location);
+    g_free (location);
+    return;
+  }
+  TEST_CHECK (gst_bda_trace_reader_has_payload (reader) == payload);
+
+  for (guint pass = 0; pass < 2; pass++) {
+    GstBdaTraceRecord record;
+    guint i;
+    for (i = 0; gst_bda_trace_reader_next (reader, &record); i++) {
+      if (i >= SAMPLES) {
+        continue;
+      }
+      TEST_CHECK (record.arrival == samples[i].arrival - samples[0].arrival);
+      TEST_CHECK (record.sample_time ==
+          samples[i].sample_time - samples[0].sample_time);
+      TEST_CHECK (record.size == samples[i].size);
+      if (payload) {
+        TEST_CHECK (record.payload != NULL
+            && !memcmp (record.payload, stream, record.size));
+      } else {
+        TEST_CHECK (record.payload == NULL);
+      }
+    }
+    TEST_CHECK (i == SAMPLES);
+    gst_bda_trace_reader_rewind (reader);
+  }
+
+  gst_bda_trace_reader_free (reader);
+  g_unlink (location);
+  g_free (location);
+}
+
+/* A trace cut in the middle of the last payload ends before the last
+   record. */
+static void
+test_truncated (const Sample * samples, const guint8 * stream)
+{
+  gchar *location = temp_location ();
+  write_trace (location, samples, stream, TRUE);
+
+  gchar *contents;
+  gsize length;
+  TEST_CHECK (g_file_get_contents (location, &contents, &length, NULL));
+  TEST_CHECK (g_file_set_contents (location, contents, length - 1, NULL));
+  g_free (contents);
+
+  GstBdaTraceReader *reader = gst_bda_trace_reader_new (location, NULL);
+  TEST_CHECK (reader != NULL);
+  if (reader) {
+    GstBdaTraceRecord record;
+    guint i = 0;
+    while (gst_bda_trace_reader_next (reader, &record)) {
+      i++;
+    }
+    TEST_CHECK (i == SAMPLES - 1);
+    gst_bda_trace_reader_free (reader);
+  }
+
+  g_unlink (location);
+  g_free (location);
+}
+
+/* A transport stream is not a trace. */
+static void
+test_not_trace (const guint8 * stream)
+{
+  gchar *location = temp_location ();
+  TEST_CHECK (g_file_set_contents (location, (const gchar *) stream,
+          MAX_SAMPLE, NULL));
+
+  GError *err = NULL;
+  GstBdaTraceReader *reader = gst_bda_trace_reader_new (location, &err);
+  TEST_CHECK (reader == NULL);
+  TEST_CHECK (err != NULL);
+  if (reader) {
+    gst_bda_trace_reader_free (reader);
+  }
+  g_clear_error (&err);
+
+  g_unlink (location);
+  g_free (location);
+}
+
+int
+main (void)
+{
+  Sample samples[SAMPLES];
+  guint8 *stream = test_generate (NULL, MAX_SAMPLE);
+
+  make_samples (samples);
+  test_round_trip (samples, stream, TRUE);
+  test_round_trip (samples, stream, FALSE);
+  test_truncated (samples, stream);
+  test_not_trace (stream);
+
+  g_free (stream);
+  return test_result ();
+}
@@ -0,0 +1,215 @@
+/* GStreamer
+ * Copyright (C) 2015 Raimo Järvi <raimo.jarvi@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+/* Generator test. Checks that the generated stream is determined by its
+ * parameters alone, however it is read, that it is a valid stream whose
+ * PCRs follow the bitrate, and that the error injection rates hold. */
+
+#include <string.h>
+#include "test.h"
+
+/* About 1 s at 24 Mbit/s. */
+#define PACKETS 16000
+#define SIZE (PACKETS * GST_BDA_TS_PACKET_SIZE)
+#define NULL_PID 0x1fff
+
+/* Reads the stream in chunks of the given sizes, in turn. */
+static guint8 *
+generate_chunked (const gsize * chunks, guint n_chunks)
+{
+  GstBdaTsGenParams params;
+  gst_bda_ts_gen_params_init (&params);
+  GstBdaTsGen *gen = gst_bda_ts_gen_new (&params);
+  guint8 *data = (guint8 *) g_malloc (SIZE);
+
+  for (gsize pos = 0, i = 0; pos < SIZE; i++) {
+    gsize n = MIN (chunks[i % n_chunks], SIZE - pos);
+    gst_bda_ts_gen_fill (gen, data + pos, n);
+    pos += n;
+  }
+  gst_bda_ts_gen_free (gen);
+
+  return data;
+}
+
+static void
+test_deterministic (const guint8 * stream)
+{
+  guint8 *again = test_generate (NULL, SIZE);
+  guint8 *seeded = test_generate ("seed=2", SIZE);
+  const gsize chunks[] = { 1, 187, 7 * GST_BDA_TS_PACKET_SIZE, 1000, 65424 };
+  guint8 *chunked = generate_chunked (chunks, G_N_ELEMENTS (chunks));
+
+  TEST_CHECK (!memcmp (stream, again, SIZE));
+  TEST_CHECK (!memcmp (stream, chunked, SIZE));
+  TEST_CHECK (memcmp (stream, seeded, SIZE) != 0);
+
+  g_free (chunked);
+  g_free (seeded);
+  g_free (again);
+}
+
+/* Counts continuity counter gaps of the packets other than null
+   packets. */
+static guint
+count_cc_gaps (const guint8 * data, gsize size)
+{
+  gint *cc = g_new (gint, 0x2000);
+  guint gaps = 0;
+
+  for (guint i = 0; i < 0x2000; i++) {
+    cc[i] = -1;
+  }
+  for (gsize i = 0; i + GST_BDA_TS_PACKET_SIZE <= size;
+      i += GST_BDA_TS_PACKET_SIZE) {
+    const guint8 *packet = data + i;
+    guint16 pid = gst_bda_ts_pid (packet);
+    if (pid == NULL_PID || !gst_bda_ts_has_payload (packet)) {
+      continue;
+    }
+    if (cc[pid] >= 0 && gst_bda_ts_cc (packet) != ((cc[pid] + 1) & 0x0f)) {
+      gaps++;
+    }
+    cc[pid] = gst_bda_ts_cc (packet);
+  }
+  g_free (cc);
+
+  return gaps;
+}
+
+static guint
+count_tei (const guint8 * data, gsize size)
+{
+  guint count = 0;
+
+  for (gsize i = 0; i + GST_BDA_TS_PACKET_SIZE <= size;
+      i += GST_BDA_TS_PACKET_SIZE) {
+    if (gst_bda_ts_tei (data + i)) {
+      count++;
+    }
+  }
+  return count;
+}
+
+/* The default stream is packet aligned, without errors, with the PAT, the
+   PMTs and about 10% null packets. */
+static void
+test_valid (const guint8 * stream)
+{
+  guint sync = 0;
+  for (gsize i = 0; i < SIZE; i += GST_BDA_TS_PACKET_SIZE) {
+    if (stream[i] == GST_BDA_TS_SYNC_BYTE) {
+      sync++;
+    }
+  }
+  TEST_CHECK (sync == PACKETS);
+  TEST_CHECK (count_cc_gaps (stream, SIZE) == 0);
+  TEST_CHECK (count_tei (stream, SIZE) == 0);
+  TEST_CHECK (test_count_packets (stream, SIZE, TEST_PAT_PID) > 0);
+  for (guint i = 0; i < 4; i++) {
+    TEST_CHECK (test_count_packets (stream, SIZE, TEST_PMT_PID (i)) > 0);
+    TEST_CHECK (test_count_packets (stream, SIZE, TEST_ES_PID (i, 0)) > 0);
+    TEST_CHECK (test_count_packets (stream, SIZE, TEST_ES_PID (i, 1)) > 0);
+  }
+
+  guint nulls = test_count_packets (stream, SIZE, NULL_PID);
+  TEST_CHECK (nulls > PACKETS / 20 && nulls < PACKETS / 5);
+}
+
+/* PCRs of the first program are about 40 ms apart, and advance with the
+   byte position at 24 Mbit/s. */
+static void
+test_pcr (const guint8 * stream)
+{
+  guint64 first = 0, last = 0;
+  gsize first_pos = 0, last_pos = 0;
+  guint pcrs = 0;
+
+  for (gsize i = 0; i < SIZE; i += GST_BDA_TS_PACKET_SIZE) {
+    guint64 pcr;
+    if (gst_bda_ts_pid (stream + i) != TEST_ES_PID (0, 0)
+        || !gst_bda_ts_get_pcr (stream + i, &pcr)) {
+      continue;
+    }
+    if (pcrs == 0) {
+      first = pcr;
+      first_pos = i;
+    } else {
+      guint64 diff = gst_bda_ts_pcr_diff (last, pcr);
+      TEST_CHECK (diff > GST_BDA_TS_PCR_HZ / 50
+          && diff < GST_BDA_TS_PCR_HZ / 20);
+    }
+    last = pcr;
+    last_pos = i;
+    pcrs++;
+  }
+
+  TEST_CHECK (pcrs > 20);
+  gdouble bytes = last_pos - first_pos;
+  gdouble seconds = (gdouble) (last - first) / GST_BDA_TS_PCR_HZ;
+  TEST_CHECK (seconds > 0 && ABS (bytes * 8 / seconds - 24e6) < 24e4);
+}
+
+/* Each error rate of 1% gives about 1% errors. */
+static void
+test_errors (void)
+{
+  guint8 *stream = test_generate ("cc-errors=0.01", SIZE);
+  guint gaps = count_cc_gaps (stream, SIZE);
+  TEST_CHECK (gaps > PACKETS / 200 && gaps < PACKETS / 50);
+  g_free (stream);
+
+  stream = test_generate ("tei-errors=0.01", SIZE);
+  guint tei = count_tei (stream, SIZE);
+  TEST_CHECK (tei > PACKETS / 200 && tei < PACKETS / 50);
+  TEST_CHECK (count_cc_gaps (stream, SIZE) == 0);
+  g_free (stream);
+
+  /* Lost sync inserts garbage, count the resynchronizations. */
+  stream = test_generate ("sync-loss=0.01", SIZE);
+  guint losses = 0;
+  for (gsize i = 0; i + 2 * GST_BDA_TS_PACKET_SIZE <= SIZE;) {
+    if (stream[i] == GST_BDA_TS_SYNC_BYTE) {
+      i += GST_BDA_TS_PACKET_SIZE;
+      continue;
+    }
+    losses++;
+    while (i + 2 * GST_BDA_TS_PACKET_SIZE <= SIZE
+        && (stream[i] != GST_BDA_TS_SYNC_BYTE
+            || stream[i + GST_BDA_TS_PACKET_SIZE] != GST_BDA_TS_SYNC_BYTE)) {
+      i++;
+    }
+  }
+  TEST_CHECK (losses > PACKETS / 200 && losses < PACKETS / 50);
+  g_free (stream);
+}
+
+int
+main (void)
+{
+  guint8 *stream = test_generate (NULL, SIZE);
+
+  test_deterministic (stream);
+  test_valid (stream);
+  test_pcr (stream);
+  test_errors ();
+
+  g_free (stream);
+  return test_result ();
+}
@@ -0,0 +1,140 @@
+/* GStreamer
+ * Copyright (C) 2015 Raimo Järvi <raimo.jarvi@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ */
+
+/* Writes a synthetic transport stream, e.g. for the replay backend:
+ *
+ *   bdatsgen --programs=8 --duration=60 --cc-errors=0.0001 -o mux.ts
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "gstbdatsgen.h"
+
+int
+main (int argc, char *argv[])
+{
+  GstBdaTsGenParams params;
+  gst_bda_ts_gen_params_init (&params);
+
+  gint seed = params.seed;
+  gint programs = params.programs;
+  gint streams = params.streams;
+  gint bitrate = params.bitrate;
+  gint pcr_interval = params.pcr_interval;
+  gint psi_interval = params.psi_interval;
+  gint null_share = params.null_share;
+  gint gop = params.gop;
+  gint si_interval = params.si_interval;
+  gint si_version = params.si_version;
+  gint eit_events = params.eit_events;
+  gdouble duration = 10;
+  gchar *output = NULL;
+
+  GOptionEntry entries[] = {
+    {"seed", 0, 0, G_OPTION_ARG_INT, &seed, "Random seed", "N"},
+    {"programs", 0, 0, G_OPTION_ARG_INT, &programs, "Number of programs", "N"},
+    {"streams", 0, 0, G_OPTION_ARG_INT, &streams,
+        "Elementary streams per program", "N"},
+    {"bitrate", 0, 0, G_OPTION_ARG_INT, &bitrate, "Bitrate in bits/s", "BPS"},
+    {"pcr-interval", 0, 0, G_OPTION_ARG_INT, &pcr_interval,
+        "PCR interval in ms", "MS"},
+    {"psi-interval", 0, 0, G_OPTION_ARG_INT, &psi_interval,
+        "PAT/PMT repetition interval in ms", "MS"},
+    {"null-share", 0, 0, G_OPTION_ARG_INT, &null_share,
+        "Share of null packets in percent", "PERCENT"},
+    {"gop", 0, 0, G_OPTION_ARG_INT, &gop, "Video frames between IDR frames",
+        "N"},
+    {"cc-errors", 0, 0, G_OPTION_ARG_DOUBLE, &params.cc_errors,
+        "Probability of a continuity counter gap per packet", "P"},
+    {"tei-errors", 0, 0, G_OPTION_ARG_DOUBLE, &params.tei_errors,
+        "Probability of transport error indicator per packet", "P"},
+    {"sync-loss", 0, 0, G_OPTION_ARG_DOUBLE, &params.sync_loss,
+        "Probability of lost sync before a packet", "P"},
+    {"si-interval", 0, 0, G_OPTION_ARG_INT, &si_interval,
+        "SDT, NIT and EIT repetition interval in ms, 0 for none", "MS"},
+    {"si-version", 0, 0, G_OPTION_ARG_INT, &si_version,
+        "Version number of the SDT, NIT and EIT", "N"},
+    {"eit-events", 0, 0, G_OPTION_ARG_INT, &eit_events,
+        "EIT schedule events per service", "N"},
+    {"eit-start", 0, 0, G_OPTION_ARG_INT64, &params.eit_start,
+        "Start of the first event in seconds since the epoch", "S"},
+    {"duration", 'd', 0, G_OPTION_ARG_DOUBLE, &duration,
+        "Stream duration in seconds", "S"},
+    {"output", 'o', 0, G_OPTION_ARG_FILENAME, &output,
+        "Output file, default stdout", "FILE"},
+    {NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL}
+  };
+
+  GError *err = NULL;
+  GOptionContext *context =
+      g_option_context_new ("- generate a synthetic MPEG-2 transport stream");
+  g_option_context_add_main_entries (context, entries, NULL);
+  if (!g_option_context_parse (context, &argc, &argv, &err)) {
+    g_printerr ("%s\n", err->message);
+    g_error_free (err);
+    g_option_context_free (context);
+    return 1;
+  }
+  g_option_context_free (context);
+
+  params.seed = seed;
+  params.programs = programs;
+  params.streams = streams;
+  params.bitrate = bitrate;
+  params.pcr_interval = pcr_interval;
+  params.psi_interval = psi_interval;
+  params.null_share = null_share;
+  params.gop = gop;
+  params.si_interval = si_interval;
+  params.si_version = si_version;
+  params.eit_events = eit_events;
+
+  FILE *out = stdout;
+  if (output && strcmp (output, "-") != 0) {
+    out = fopen (output, "wb");
+    if (!out) {
+      g_printerr ("Unable to open '%s'\n", output);
+      return 1;
+    }
+  }
+
+  GstBdaTsGen *gen = gst_bda_ts_gen_new (&params);
+  guint8 chunk[348 * 188];
+  guint64 total = (guint64) (duration * bitrate / 8) / 188 * 188;
+  int ret = 0;
+
+  while (total > 0) {
+    gsize n = (gsize) MIN (total, sizeof (chunk));
+    gst_bda_ts_gen_fill (gen, chunk, n);
+    if (fwrite (chunk, 1, n, out) != n) {
+      g_printerr ("Write error\n");
+      ret = 1;
+      break;
+    }
+    total -= n;
+  }
+
+  gst_bda_ts_gen_free (gen);
+  if (out != stdout) {
+    fclose (out);
+  }
+  g_free (output);
+
+  return ret;
+}